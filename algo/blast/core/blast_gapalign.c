@@ -45,6 +45,11 @@ static char const rcsid[] =
 #include "blast_hits_priv.h"
 #include "blast_itree.h"
 
+#if defined(__SSE2__) && defined(__GNUC__)
+#define BLAST_VECTOR_DP
+#include <emmintrin.h>
+#endif
+
 static Int2 s_BlastDynProgNtGappedAlignment(BLAST_SequenceBlk* query_blk, 
    BLAST_SequenceBlk* subject_blk, BlastGapAlignStruct* gap_align, 
    const BlastScoringParameters* score_params, BlastInitHSP* init_hsp);
@@ -285,6 +290,7 @@ BLAST_GapAlignStructFree(BlastGapAlignStruct* gap_align)
       s_BlastGreedyAlignsFree(gap_align->greedy_align_mem);
    GapStateFree(gap_align->state_struct);
    sfree(gap_align->dp_mem);
+   sfree(gap_align->vec_dp);
 
    sfree(gap_align);
    return NULL;
@@ -318,6 +324,8 @@ BLAST_GapAlignStructNew(const BlastScoringParameters* score_params,
                                                sizeof(BlastGapDP));
       if (!gap_align->dp_mem)
          gap_align = BLAST_GapAlignStructFree(gap_align);
+      else
+         gap_align->vector_dp = ext_params->options->vector_dp;
    }
    else {
       /* allocate structures for greedy dynamic programming */
@@ -2349,6 +2357,356 @@ s_BlastDynProgNtGappedAlignment(BLAST_SequenceBlk* query_blk,
    return 0;
 }
 
+#ifdef BLAST_VECTOR_DP
+
+/** Bound on the scores and the gap costs for the vectorized dynamic
+ * programming. It keeps the cells in Int2, relative to the best score
+ * when their row was computed; the cells that can pass the X-dropoff
+ * test always fit. */
+#define VEC_DP_MAX_SCORE 1024
+/** Bound on the X-dropoff for the vectorized dynamic programming */
+#define VEC_DP_MAX_X 16384
+/** Columns kept before and after each array of the vectorized dynamic
+ * programming */
+#define VEC_DP_PAD 16
+/** Arrays of the vectorized dynamic programming: best, best_gap and the
+ * scores of the letters of B against each base */
+#define VEC_DP_ARRAYS 6
+
+/** Lane 7 of a vector in all lanes */
+#define VEC_DP_LAST(a) \
+    _mm_unpackhi_epi64(_mm_shufflehi_epi16(a, 0xFF), \
+                       _mm_shufflehi_epi16(a, 0xFF))
+
+/** Prefix maximum of the lanes of a vector
+ * @param a The vector [in]
+ * @param min_score INT2_MIN in all lanes [in]
+ * @return Lane i is the maximum of the lanes 0 to i of a
+ */
+static __m128i
+s_VecDPPrefixMax(__m128i a, __m128i min_score)
+{
+    a = _mm_max_epi16(a, _mm_or_si128(_mm_slli_si128(a, 2),
+                                      _mm_srli_si128(min_score, 14)));
+    a = _mm_max_epi16(a, _mm_or_si128(_mm_slli_si128(a, 4),
+                                      _mm_srli_si128(min_score, 12)));
+    return _mm_max_epi16(a, _mm_or_si128(_mm_slli_si128(a, 8),
+                                         _mm_srli_si128(min_score, 8)));
+}
+
+/** Makes room for the columns [-VEC_DP_PAD, size + VEC_DP_PAD) of each
+ * array of the vectorized dynamic programming
+ * @param gap_align The structure holding the arrays [in] [out]
+ * @param size Number of columns needed [in]
+ * @param used The columns [-VEC_DP_PAD, used) are kept [in]
+ * @return FALSE if out of memory
+ */
+static Boolean
+s_VecDPReserve(BlastGapAlignStruct* gap_align, Int4 size, Int4 used)
+{
+    Int2* mem;
+    Int4 k, old_stride, stride;
+
+    if (size <= gap_align->vec_dp_alloc)
+        return TRUE;
+    stride = size + 2 * VEC_DP_PAD;
+    mem = (Int2 *)malloc(VEC_DP_ARRAYS * stride * sizeof(Int2));
+    if (mem == NULL)
+        return FALSE;
+    if (gap_align->vec_dp != NULL) {
+        old_stride = gap_align->vec_dp_alloc + 2 * VEC_DP_PAD;
+        for (k = 0; k < VEC_DP_ARRAYS; k++)
+            memcpy(mem + k * stride, gap_align->vec_dp + k * old_stride,
+                   (used + VEC_DP_PAD) * sizeof(Int2));
+        sfree(gap_align->vec_dp);
+    }
+    gap_align->vec_dp = mem;
+    gap_align->vec_dp_alloc = size;
+    return TRUE;
+}
+
+/** Do the scores, the gap costs and the X-dropoff fit the vectorized
+ * dynamic programming?
+ * @param gap_align The auxiliary structure for gapped alignment [in]
+ * @param score_params Parameters related to scoring [in]
+ */
+static Boolean
+s_VecDPApplies(const BlastGapAlignStruct* gap_align,
+               const BlastScoringParameters* score_params)
+{
+    Int4 a_base, b_letter, score;
+
+    if (score_params->gap_open < 0 || score_params->gap_extend < 0 ||
+        score_params->gap_open + score_params->gap_extend > VEC_DP_MAX_SCORE ||
+        gap_align->gap_x_dropoff > VEC_DP_MAX_X)
+        return FALSE;
+    for (a_base = 0; a_base < 4; a_base++) {
+        for (b_letter = 0; b_letter < BLASTNA_SIZE; b_letter++) {
+            score = gap_align->sbp->matrix->data[a_base][b_letter];
+            if (score > INT2_MIN && (score > VEC_DP_MAX_SCORE ||
+                                     score < -VEC_DP_MAX_SCORE))
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/** s_BlastAlignPackedNucl with eight cells of a row of the dynamic
+ * programming at a time. The diagonal and column gap scores of the cells
+ * come first; the row gap scores and the best score before each cell
+ * are then prefix maxima over the row. A cell that fails the X-dropoff
+ * test is set to INT2_MIN; the values derived from it stay below the
+ * test, so the cells that pass it, the loop bounds and the best score
+ * and its offsets are the same as in s_BlastAlignPackedNucl.
+ * @param B The query sequence [in]
+ * @param A The subject sequence [in]
+ * @param N Maximal extension length in query [in]
+ * @param M Maximal extension length in subject [in]
+ * @param b_offset Resulting starting offset in query [out]
+ * @param a_offset Resulting starting offset in subject [out]
+ * @param gap_align The auxiliary structure for gapped alignment [in]
+ * @param score_params Parameters related to scoring [in]
+ * @param reverse_sequence Reverse the sequence.
+ * @return The best alignment score found, -1 if out of memory.
+ */
+static Int4
+s_BlastAlignPackedNuclVec(Uint1* B, Uint1* A, Int4 N, Int4 M,
+        Int4* b_offset, Int4* a_offset,
+        BlastGapAlignStruct* gap_align,
+        const BlastScoringParameters* score_params,
+        Boolean reverse_sequence)
+{
+    Int4 i, k, a_index, a_base_pair, b_index, b_size, first_b_index;
+    Int4 last_b_index, first_alive, filled, stride, bits;
+    Int4 gap_open_extend, gap_extend, x_dropoff;
+    Int4 score, score_gap_row, best_score, bias, row_best, row_offset;
+    Int4** matrix;
+    Int2* best;
+    Int2* best_gap;
+    Int2* row_scores;
+    Int2* base_scores[4];
+    Int2 best_carry, gap_carry, gap_lanes[8];
+    __m128i v_score, v_best, v_gap_col, v_diag, v_diag_gap, v_gap_row;
+    __m128i v_cell, v_row_best, v_alive, v_valid, v_shift, v_lane;
+    __m128i v_min, v_open_extend, v_extend, v_extend2, v_extend4, v_xdrop;
+
+    matrix = gap_align->sbp->matrix->data;
+    *a_offset = 0;
+    *b_offset = 0;
+    gap_extend = score_params->gap_extend;
+    gap_open_extend = score_params->gap_open + gap_extend;
+    x_dropoff = gap_align->gap_x_dropoff;
+
+    if (x_dropoff < gap_open_extend)
+        x_dropoff = gap_open_extend;
+
+    if(N <= 0 || M <= 0)
+        return 0;
+
+    v_lane = _mm_set_epi16(7, 6, 5, 4, 3, 2, 1, 0);
+    v_min = _mm_set1_epi16(INT2_MIN);
+    v_open_extend = _mm_set1_epi16((Int2)gap_open_extend);
+    v_extend = _mm_set1_epi16((Int2)gap_extend);
+    v_extend2 = _mm_set1_epi16((Int2)(2 * gap_extend));
+    v_extend4 = _mm_set1_epi16((Int2)(4 * gap_extend));
+    v_xdrop = _mm_set1_epi16((Int2)(x_dropoff + 1));
+
+    /* the loop bounds are rarely much wider than x_dropoff / gap_extend */
+    if (gap_extend > 0 && x_dropoff / gap_extend + 64 < N + 9)
+        i = x_dropoff / gap_extend + 64;
+    else
+        i = N + 9;
+    if (!s_VecDPReserve(gap_align, i, 0))
+        return -1;
+
+#define VEC_DP_SET_ARRAYS() \
+    stride = gap_align->vec_dp_alloc + 2 * VEC_DP_PAD; \
+    best = gap_align->vec_dp + VEC_DP_PAD; \
+    best_gap = best + stride; \
+    for (k = 0; k < 4; k++) \
+        base_scores[k] = best + (k + 2) * stride;
+#define VEC_DP_RESERVE(size) \
+    if ((size) > gap_align->vec_dp_alloc) { \
+        if (!s_VecDPReserve(gap_align, \
+                 MIN(N + 9, MAX(size, 2 * gap_align->vec_dp_alloc)), \
+                 MAX(b_size, filled) + 1)) \
+            return -1; \
+        VEC_DP_SET_ARRAYS() \
+    }
+
+    VEC_DP_SET_ARRAYS()
+
+    score = -gap_open_extend;
+    best[0] = 0;
+    best_gap[0] = (Int2)(-gap_open_extend);
+
+    for (i = 1; i <= N; i++) {
+        if (score < -x_dropoff)
+            break;
+
+        best[i] = (Int2)score;
+        best_gap[i] = (Int2)(score - gap_open_extend);
+        score -= gap_extend;
+    }
+
+    /* The scores of the letters of B against each base are filled in as
+       the loop bounds move right; those past N and those below INT2_MIN
+       are INT2_MIN */
+    for (k = 0; k < 4; k++)
+        base_scores[k][0] = 0;
+    filled = 0;
+
+    b_size = i;
+    best_score = 0;
+    bias = 0;
+    first_b_index = 0;
+
+    for (a_index = 1; a_index <= M; a_index++) {
+
+        if(reverse_sequence) {
+            a_base_pair = NCBI2NA_UNPACK_BASE(A[(M-a_index)/4],
+                                               ((a_index-1)%4));
+        }
+        else {
+            a_base_pair = NCBI2NA_UNPACK_BASE(A[1+((a_index-1)/4)],
+                                               (3-((a_index-1)%4)));
+        }
+
+        VEC_DP_RESERVE(b_size + 8)
+        for (; filled < b_size + 8; filled++) {
+            i = filled + 1;
+            for (k = 0; k < 4; k++) {
+                score = (i > N) ? MININT :
+                    matrix[k][reverse_sequence ? B[N - i] : B[i]];
+                base_scores[k][i] = (Int2)MAX(score, INT2_MIN);
+            }
+        }
+        row_scores = base_scores[a_base_pair];
+
+        /* the cells of the last row were kept relative to its best score */
+        v_shift = _mm_set1_epi16((Int2)MIN(best_score - bias, INT2_MAX));
+        bias = best_score;
+        best_carry = gap_carry = INT2_MIN;
+        v_row_best = _mm_setzero_si128();
+        row_best = 0;
+        row_offset = 0;
+        first_alive = last_b_index = -1;
+
+        for (b_index = first_b_index; b_index < b_size; b_index += 8) {
+            v_score = _mm_loadu_si128((__m128i *)(row_scores + b_index));
+            v_best = _mm_subs_epi16(
+                    _mm_loadu_si128((__m128i *)(best + b_index)), v_shift);
+            v_gap_col = _mm_subs_epi16(
+                    _mm_loadu_si128((__m128i *)(best_gap + b_index)), v_shift);
+            v_valid = _mm_cmplt_epi16(v_lane, _mm_set1_epi16((Int2)
+                                      MIN(b_size - b_index, 8)));
+
+            v_diag = _mm_adds_epi16(_mm_insert_epi16(
+                        _mm_slli_si128(v_best, 2), best_carry, 0), v_score);
+            best_carry = (Int2)_mm_extract_epi16(v_best, 7);
+            v_diag = _mm_max_epi16(v_diag, v_gap_col);
+
+            /* the row gap score of a cell is the larger of the score of
+               the cell before it less gap_open_extend and the row gap
+               score there less gap_extend */
+            v_diag_gap = _mm_subs_epi16(v_diag, v_open_extend);
+            v_gap_row = _mm_insert_epi16(_mm_slli_si128(v_diag_gap, 2),
+                                         gap_carry, 0);
+            v_gap_row = _mm_max_epi16(v_gap_row, _mm_subs_epi16(
+                    _mm_or_si128(_mm_slli_si128(v_gap_row, 2),
+                                 _mm_srli_si128(v_min, 14)), v_extend));
+            v_gap_row = _mm_max_epi16(v_gap_row, _mm_subs_epi16(
+                    _mm_or_si128(_mm_slli_si128(v_gap_row, 4),
+                                 _mm_srli_si128(v_min, 12)), v_extend2));
+            v_gap_row = _mm_max_epi16(v_gap_row, _mm_subs_epi16(
+                    _mm_or_si128(_mm_slli_si128(v_gap_row, 8),
+                                 _mm_srli_si128(v_min, 8)), v_extend4));
+            v_cell = _mm_max_epi16(v_diag, v_gap_row);
+            v_cell = _mm_or_si128(_mm_and_si128(v_valid, v_cell),
+                                  _mm_andnot_si128(v_valid, v_min));
+
+            /* the row gap score of the cell after each one */
+            v_gap_row = _mm_max_epi16(v_diag_gap,
+                                      _mm_subs_epi16(v_gap_row, v_extend));
+            if (b_index + 8 < b_size) {
+                gap_carry = (Int2)_mm_extract_epi16(v_gap_row, 7);
+            }
+            else {
+                _mm_storeu_si128((__m128i *)gap_lanes, v_gap_row);
+                gap_carry = gap_lanes[b_size - 1 - b_index];
+            }
+
+            /* the best score before each cell */
+            v_gap_row = _mm_max_epi16(_mm_or_si128(_mm_slli_si128(
+                        s_VecDPPrefixMax(v_cell, v_min), 2),
+                                      _mm_srli_si128(v_min, 14)), v_row_best);
+            v_row_best = VEC_DP_LAST(_mm_max_epi16(v_gap_row, v_cell));
+            v_alive = _mm_cmpgt_epi16(v_cell,
+                                      _mm_subs_epi16(v_gap_row, v_xdrop));
+
+            _mm_storeu_si128((__m128i *)(best + b_index),
+                             _mm_or_si128(_mm_and_si128(v_alive, v_cell),
+                                          _mm_andnot_si128(v_alive, v_min)));
+            _mm_storeu_si128((__m128i *)(best_gap + b_index),
+                   _mm_or_si128(_mm_and_si128(v_alive,
+                         _mm_max_epi16(_mm_subs_epi16(v_cell, v_open_extend),
+                                       _mm_subs_epi16(v_gap_col, v_extend))),
+                                _mm_andnot_si128(v_alive, v_gap_col)));
+
+            bits = _mm_movemask_epi8(v_alive) & 0x5555;
+            if (bits) {
+                if (first_alive < 0)
+                    first_alive = b_index + __builtin_ctz(bits) / 2;
+                last_b_index = b_index + (31 - __builtin_clz(bits)) / 2;
+            }
+            score = (Int2)_mm_cvtsi128_si32(v_row_best);
+            if (score > row_best) {
+                row_best = score;
+                row_offset = b_index + __builtin_ctz(_mm_movemask_epi8(
+                            _mm_cmpeq_epi16(v_cell, v_row_best))) / 2;
+            }
+        }
+        if (row_best > 0) {
+            best_score = bias + row_best;
+            *a_offset = a_index;
+            *b_offset = row_offset;
+        }
+        if (last_b_index < 0)
+            last_b_index = first_b_index;
+        score_gap_row = gap_carry;
+        first_b_index = (first_alive >= 0) ? first_alive : b_size;
+
+        if (first_b_index == b_size)
+            break;
+
+        if (last_b_index < b_size - 1) {
+            b_size = last_b_index + 1;
+        }
+        else {
+            while (score_gap_row >= best_score - bias - x_dropoff &&
+                   b_size <= N) {
+                VEC_DP_RESERVE(b_size + 8)
+                best[b_size] = (Int2)score_gap_row;
+                best_gap[b_size] = (Int2)(score_gap_row - gap_open_extend);
+                score_gap_row -= gap_extend;
+                b_size++;
+            }
+        }
+
+        if (b_size <= N) {
+            best[b_size] = INT2_MIN;
+            best_gap[b_size] = INT2_MIN;
+            b_size++;
+        }
+    }
+
+#undef VEC_DP_RESERVE
+#undef VEC_DP_SET_ARRAYS
+
+    return best_score;
+}
+#endif /* BLAST_VECTOR_DP */
+
 /** Aligns two nucleotide sequences, one (A) should be packed in the
  * same way as the BLAST databases, the other (B) should contain one
  * basepair/byte. Traceback is not done in this function.
@@ -2413,6 +2771,20 @@ s_BlastAlignPackedNucl(Uint1* B, Uint1* A, Int4 N, Int4 M,
     if(N <= 0 || M <= 0) 
         return 0;
   
+#ifdef BLAST_VECTOR_DP
+    /* if the scratch arrays cannot be allocated, fall through to
+       the scalar code */
+    if (gap_align->vector_dp && s_VecDPApplies(gap_align, score_params)) {
+        best_score = s_BlastAlignPackedNuclVec(B, A, N, M, b_offset, a_offset,
+                                               gap_align, score_params,
+                                               reverse_sequence);
+        if (best_score >= 0)
+            return best_score;
+        *a_offset = 0;
+        *b_offset = 0;
+    }
+#endif
+
     /* Allocate and fill in the auxiliary bookeeping structures.
        Since A and B could be very large, maintain a window
        of auxiliary structures only large enough to contain the current
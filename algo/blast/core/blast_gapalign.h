@@ -70,6 +70,11 @@ typedef struct BlastGapAlignStruct {
                                          gapped extension */
    BlastGapDP* dp_mem; /**< scratch structures for dynamic programming */
    Int4 dp_mem_alloc;  /**< current number of structures allocated */
+   Boolean vector_dp;  /**< use the vectorized dynamic programming for
+                            nucleotide extensions when it applies */
+   Int2* vec_dp;       /**< scratch arrays of the vectorized dynamic
+                            programming */
+   Int4 vec_dp_alloc;  /**< current number of columns in vec_dp */
    BlastScoreBlk* sbp; /**< Pointer to the scoring information block */
    Int4 gap_x_dropoff; /**< X-dropoff parameter to use */
    Int4 query_start; /**< query start offset of current alignment */
@@ -280,6 +280,9 @@ typedef struct BlastExtensionOptions {
    EBlastPrelimGapExt ePrelimGapExt; /**< type of preliminary gapped extension (normally) for calculating
                               score. */
    EBlastTbackExt eTbackExt; /**< type of traceback extension. */
+   Boolean vector_dp; /**< score the dynamic programming extension of
+                           nucleotide sequences with the vectorized kernel
+                           (eDynProgExt only; same scores) */
    Int4 compositionBasedStats; /**< mode of compositional adjustment to use;
                                    if zero then compositional adjustment is
                                    not used */
@@ -2568,6 +2568,226 @@ NLM_EXTERN Int2 LIBCALL SeqPortRead (SeqPortPtr spp, Uint1Ptr buf, Int2 len)
     return ctr;
 }
 
+/*****************************************************************************
+*
+*   SeqPortBulkRead(bsp, start, stop, strand, code, buf)
+*   SeqPortBulkReadLoc(slp, code, buf)
+*       raw or const nucleotide Bioseqs stored in ncbi2na or ncbi4na are
+*         expanded a byte at a time through a 16 entry table built from the
+*         same conversion and complement tables SeqPort uses; the minus
+*         strand is written back to front, so no separate reverse pass
+*       anything else goes through a SeqPort with do_virtual set
+*
+*****************************************************************************/
+#define BULK_BYTES 1024
+#define BULK_RANDOM 0x80
+
+static Boolean SeqPortBulkTable (Uint1 oldcode, Uint1 newcode, Boolean revcomp,
+                                 Uint1Ptr conv)
+
+{
+  Uint1            na4toiupac [16] = {'N', 'A', 'C', 'M', 'G', 'R', 'S', 'V',
+                                      'T', 'W', 'Y', 'H', 'K', 'D', 'B', 'N'};
+  Uint1            na2tona4 [4] = {1, 2, 4, 8};
+  Int2             i, num;
+  SeqCodeTablePtr  sctp = NULL;
+  SeqMapTablePtr   smtp = NULL;
+
+  num = (oldcode == Seq_code_ncbi2na ? 4 : 16);
+
+  /* 2na or 4na to 4na or iupacna are the SeqPortQuickGetResidue tables */
+
+  for (i = 0; i < num; i++) {
+    switch (newcode) {
+      case Seq_code_ncbi4na :
+        conv [i] = (oldcode == Seq_code_ncbi2na ? na2tona4 [i] : (i == 0 ? 15 : i));
+        break;
+      case Seq_code_iupacna :
+        conv [i] = (oldcode == Seq_code_ncbi2na ? na4toiupac [na2tona4 [i]] : na4toiupac [i]);
+        break;
+      default :
+        if (oldcode == newcode) {
+          conv [i] = (Uint1) i;
+        } else if (newcode == Seq_code_ncbi2na && i != 1 && i != 2 && i != 4 && i != 8) {
+          /* ambiguity, SeqMapTableConvert picks a random base */
+          conv [i] = (Uint1) (BULK_RANDOM | i);
+          continue;
+        } else {
+          if (smtp == NULL && (smtp = SeqMapTableFind (newcode, oldcode)) == NULL) {
+            return FALSE;
+          }
+          conv [i] = SeqMapTableConvert (smtp, (Uint1) i);
+        }
+        break;
+    }
+  }
+
+  if (revcomp) {
+    if ((sctp = SeqCodeTableFind (newcode)) == NULL) return FALSE;
+    for (i = 0; i < num; i++) {
+      if ((conv [i] & BULK_RANDOM) == 0) {
+        conv [i] = SeqCodeTableComp (sctp, conv [i]);
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+static Int4 SeqPortBulkRaw (BioseqPtr bsp, Int4 start, Int4 stop,
+                            Boolean revcomp, Uint1 code, Uint1Ptr buf)
+
+{
+  Uint1            bytes [BULK_BYTES];
+  Uint1            byte, conv [16];
+  Int4             compress, first, from, last, pos, step, total, k;
+  Int2             bits, j, mask;
+  Uint1Ptr         ptr;
+  SeqCodeTablePtr  sctp;
+  SeqMapTablePtr   smtp;
+
+  if (bsp->seq_data_type == Seq_code_ncbi2na) {
+    compress = 4;
+    bits = 2;
+    mask = 3;
+  } else {
+    compress = 2;
+    bits = 4;
+    mask = 15;
+  }
+
+  if (! SeqPortBulkTable (bsp->seq_data_type, code, revcomp, conv)) return -1;
+
+  /* the minus strand is decoded forward and stored back to front */
+
+  if (revcomp) {
+    ptr = buf + (stop - start);
+    step = -1;
+  } else {
+    ptr = buf;
+    step = 1;
+  }
+
+  first = start / compress;
+  last = stop / compress;
+  pos = first * compress;
+
+  for (from = first; from <= last; from += total) {
+    total = MIN (last - from + 1, BULK_BYTES);
+    BSSeek (bsp->seq_data, from, SEEK_SET);
+    if (BSRead (bsp->seq_data, (VoidPtr) bytes, total) != total) return -1;
+
+    for (k = 0; k < total; k++) {
+      byte = bytes [k];
+      if (pos >= start && pos + compress - 1 <= stop) {
+        /* whole byte inside the range */
+        if (compress == 4) {
+          ptr [0] = conv [(byte >> 6) & 3];
+          ptr [step] = conv [(byte >> 4) & 3];
+          ptr [2 * step] = conv [(byte >> 2) & 3];
+          ptr [3 * step] = conv [byte & 3];
+        } else {
+          ptr [0] = conv [(byte >> 4) & 15];
+          ptr [step] = conv [byte & 15];
+        }
+        ptr += compress * step;
+        pos += compress;
+      } else {
+        for (j = compress - 1; j >= 0; j--, pos++) {
+          if (pos >= start && pos <= stop) {
+            *ptr = conv [(byte >> (j * bits)) & mask];
+            ptr += step;
+          }
+        }
+      }
+    }
+  }
+
+  /* resolve ambiguities to ncbi2na in the order SeqPort reads them, so the
+     random draws come out the same */
+
+  if (code == Seq_code_ncbi2na && bsp->seq_data_type == Seq_code_ncbi4na) {
+    smtp = SeqMapTableFind (Seq_code_ncbi2na, Seq_code_ncbi4na);
+    sctp = SeqCodeTableFind (Seq_code_ncbi2na);
+    if (smtp == NULL || sctp == NULL) return -1;
+    total = stop - start + 1;
+    for (k = 0; k < total; k++) {
+      if (buf [k] & BULK_RANDOM) {
+        buf [k] = SeqMapTableConvert (smtp, (Uint1) (buf [k] & 15));
+        if (revcomp) {
+          buf [k] = SeqCodeTableComp (sctp, buf [k]);
+        }
+      }
+    }
+  }
+
+  return stop - start + 1;
+}
+
+static Int4 SeqPortBulkPort (SeqPortPtr spp, Uint1Ptr buf)
+
+{
+  Int4   count = 0;
+  Uint1  residue;
+
+  if (spp == NULL) return -1;
+
+  SeqPortSet_do_virtual (spp, TRUE);
+  while ((residue = SeqPortGetResidue (spp)) != SEQPORT_EOF) {
+    if (IS_residue (residue)) {
+      buf [count] = residue;
+      count++;
+    }
+  }
+  SeqPortFree (spp);
+
+  return count;
+}
+
+NLM_EXTERN Int4 LIBCALL SeqPortBulkRead (BioseqPtr bsp, Int4 start, Int4 stop,
+                                         Uint1 strand, Uint1 code, Uint1Ptr buf)
+
+{
+  if (bsp == NULL || buf == NULL) return -1;
+
+  if (start < 0) start = 0;
+  if (stop < 0 || stop >= bsp->length) stop = bsp->length - 1;
+  if (start > stop) return 0;
+
+  if ((bsp->repr == Seq_repr_raw || bsp->repr == Seq_repr_const) &&
+      bsp->seq_data != NULL && ISA_na (bsp->mol) &&
+      (bsp->seq_data_type == Seq_code_ncbi2na ||
+       bsp->seq_data_type == Seq_code_ncbi4na) &&
+      (code == Seq_code_ncbi2na || code == Seq_code_ncbi4na ||
+       code == Seq_code_iupacna)) {
+    return SeqPortBulkRaw (bsp, start, stop,
+                           (Boolean) (strand == Seq_strand_minus), code, buf);
+  }
+
+  return SeqPortBulkPort (SeqPortNew (bsp, start, stop, strand, code), buf);
+}
+
+NLM_EXTERN Int4 LIBCALL SeqPortBulkReadLoc (SeqLocPtr slp, Uint1 code, Uint1Ptr buf)
+
+{
+  BioseqPtr  bsp;
+  Int4       count;
+
+  if (slp == NULL || buf == NULL) return -1;
+
+  if (slp->choice == SEQLOC_INT || slp->choice == SEQLOC_WHOLE) {
+    bsp = BioseqLockById (SeqLocId (slp));
+    if (bsp != NULL) {
+      count = SeqPortBulkRead (bsp, SeqLocStart (slp), SeqLocStop (slp),
+                               SeqLocStrand (slp), code, buf);
+      BioseqUnlock (bsp);
+      return count;
+    }
+  }
+
+  return SeqPortBulkPort (SeqPortNewByLoc (slp, code), buf);
+}
+
 /*******************************************************************************
 *	
 *   SeqPortStream (bsp, flags, userdata, proc)
@@ -377,6 +377,21 @@ NLM_EXTERN Uint1 GetGapCode PROTO((Uint1 seqcode));
 NLM_EXTERN Boolean LIBCALL SeqPortSetUpFields PROTO((SeqPortPtr spp, Int4 start, Int4 stop, Uint1 strand, Uint1 newcode));
 NLM_EXTERN Boolean LIBCALL SeqPortSetUpAlphabet PROTO((SeqPortPtr spp, Uint1 curr_code, Uint1 newcode));
 
+/*****************************************************************************
+*
+*   SeqPortBulkRead(bsp, start, stop, strand, code, buf)
+*   SeqPortBulkReadLoc(slp, code, buf)
+*       decode a whole range into buf, one residue per byte, with the
+*         residues SeqPortGetResidue would return (do_virtual set, no EOS)
+*       packed nucleotide Bioseqs are expanded through lookup tables
+*       buf must hold stop - start + 1 (SeqLocLen) bytes
+*       stop of -1 means the end of the Bioseq
+*       returns the number of residues written, -1 on failure
+*
+*****************************************************************************/
+NLM_EXTERN Int4 LIBCALL SeqPortBulkRead PROTO((BioseqPtr bsp, Int4 start, Int4 stop, Uint1 strand, Uint1 code, Uint1Ptr buf));
+NLM_EXTERN Int4 LIBCALL SeqPortBulkReadLoc PROTO((SeqLocPtr slp, Uint1 code, Uint1Ptr buf));
+
 /*******************************************************************************
 *	
 *   SeqPortStream (bsp, flags, userdata, proc)
@@ -0,0 +1,115 @@
+#!/bin/env bash
+# mgblast benchmark driver: generates a reproducible EST data set with
+# mgbsim, formats it and clusters it with mgblast in a set of standard
+# configurations, then runs the mgbbench microbenchmarks.
+#
+# usage: bench_mgblast.sh [bindir [workdir]]
+#   bindir  - where formatdb, mgblast, mgbsim and mgbbench are (./build)
+#   workdir - scratch directory for the data and the results (./bench)
+# The data set can be changed through the environment:
+#   BENCH_READS (20000), BENCH_SEED (1), BENCH_SIM_ARGS (extra mgbsim args)
+#   BENCH_THREADS (4, for the multithreaded configuration)
+#   BENCH_FILTER (T: dust; the unmasked poly-A tails make -F F runs
+#                 many times slower)
+#
+# Results: workdir/results.json has one line per configuration with the
+# wall time, throughput (reads/s), hit count and the mgblast -u run record
+# (per stage times, counters and peak_rss_kb); a summary table is printed.
+bindir=${1:-./build}
+workdir=${2:-./bench}
+reads=${BENCH_READS:-20000}
+seed=${BENCH_SEED:-1}
+threads=${BENCH_THREADS:-4}
+filter=${BENCH_FILTER:-T}
+
+for prog in formatdb mgblast mgbsim mgbbench; do
+  if [ ! -x "$bindir/$prog" ]; then
+    echo "Error: $bindir/$prog not found; build it first" >&2
+    exit 1
+  fi
+done
+bindir=$(cd "$bindir" && pwd)
+mkdir -p "$workdir" || exit 1
+cd "$workdir" || exit 1
+
+now() {
+  date +%s.%N
+}
+
+# elapsed seconds between two now() values
+elapsed() {
+  awk -v s="$1" -v e="$2" 'BEGIN { printf "%.3f", e - s }'
+}
+
+# value of a numeric field in a JSON line (first occurrence)
+jfield() {
+  sed -n "s/.*\"$2\":\([0-9.eE+-]*\).*/\1/p" <<< "$1" | head -1
+}
+
+echo "Generating $reads reads (seed $seed)"
+"$bindir/mgbsim" -n "$reads" -s "$seed" $BENCH_SIM_ARGS -o ests.fa \
+   -t transcripts.fa || exit 1
+"$bindir/formatdb" -i ests.fa -p F -o F -l formatdb.log || exit 1
+
+# name and mgblast arguments of each configuration; all of them cluster
+# the reads against themselves
+common="-d ests.fa -i ests.fa -F $filter"
+flt="-D 4 -p 90 -C 40 -H 30"
+configs=(
+  "d4_slice|$flt -K T -k 0"
+  "d4|$flt"
+  "d5_gaps|-D 5 -p 90 -C 40 -H 30"
+  "d4_W16|$flt -W 16"
+  "d4_W40|$flt -W 40"
+  "d4_V500|$flt -V 500"
+  "d4_p98|-D 4 -p 98 -C 40 -H 10"
+  "d4_p98_verify|-D 4 -p 98 -C 40 -H 10 -w T"
+  "d4_a$threads|$flt -a $threads"
+  "d4_slice_a$threads|$flt -K T -k 0 -a $threads"
+)
+
+rm -f results.json
+printf "%-16s %9s %10s %9s %10s %8s %8s %8s %8s %8s %8s\n" config wall \
+   reads/s hits rss_kb lookup scan extend traceb filter output
+for config in "${configs[@]}"; do
+  name=${config%%|*}
+  args=${config#*|}
+  rm -f "stats.$name.json"
+  start=$(now)
+  "$bindir/mgblast" $common $args -o "hits.$name" -u "stats.$name.json" \
+     2> "log.$name"
+  status=$?
+  end=$(now)
+  if [ $status -ne 0 ]; then
+    echo "$name: mgblast failed with status $status, see $workdir/log.$name" >&2
+    continue
+  fi
+  wall=$(elapsed "$start" "$end")
+  hits=$(wc -l < "hits.$name")
+  run=$(grep '"type":"run"' "stats.$name.json")
+  rate=$(awk -v n="$reads" -v t="$wall" 'BEGIN { printf "%.1f", (t > 0 ? n/t : 0) }')
+  echo "{\"config\":\"$name\",\"args\":\"$args\",\"wall\":$wall,\"reads_per_sec\":$rate,\"hits\":$hits,\"run\":$run}" >> results.json
+  printf "%-16s %9s %10s %9s %10s %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n" \
+     "$name" "$wall" "$rate" "$hits" "$(jfield "$run" peak_rss_kb)" \
+     "$(jfield "$run" lookup)" "$(jfield "$run" scan)" \
+     "$(jfield "$run" extend)" "$(jfield "$run" traceback)" \
+     "$(jfield "$run" filter)" "$(jfield "$run" output)"
+done
+
+# microbenchmarks: the greedy aligners and the database scan
+"$bindir/mgbbench" -m align -s "$seed" > micro.json || exit 1
+"$bindir/mgbbench" -m scan -i ests.fa -d ests.fa -V 1000 -F "$filter" \
+   >> micro.json || exit 1
+"$bindir/mgbbench" -m verify -s "$seed" >> micro.json || exit 1
+"$bindir/mgbbench" -m decode -i ests.fa -V "$reads" >> micro.json || exit 1
+# accession lookups of all the reads in random order, with a string id
+# index and the hashed index of formatdb -H
+"$bindir/formatdb" -i ests.fa -p F -o T -H T -n estids -l formatdb.log || exit 1
+sed -n 's/^>\([^ ]*\).*/\1/p' ests.fa | \
+   awk -v s="$seed" 'BEGIN { srand(s) } { print rand() "\t" $0 }' | \
+   sort -n | cut -f 2 > ids.txt
+"$bindir/mgbbench" -m lookup -d estids -i ids.txt >> micro.json || exit 1
+echo
+cat micro.json
+echo
+echo "Results are in $(pwd)/results.json and $(pwd)/micro.json"
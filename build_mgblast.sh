@@ -57,6 +57,18 @@ eval $(sed -e 's/^ *#.*//g' -e '/^$/d' -e 's/ *= */=/g' -e 's/^\([^=]*\)=\(.*\)$
 
 export NCBI_OPTFLAG="-DNDEBUG $NCBI_OPTFLAG"
 
+# zlib is needed for the compressed output of mgblast (-Y option)
+if [ -n "$ZLIB_DIR" ]; then
+   export NCBI_CFLAGS1="$NCBI_CFLAGS1 -DHAVE_ZLIB -I$ZLIB_DIR"
+   export NCBI_OTHERLIBS="$NCBI_OTHERLIBS $ZLIB_DIR/libz.a"
+elif $(pkg-config zlib --exists > /dev/null 2>&1) ; then
+   export NCBI_CFLAGS1="$NCBI_CFLAGS1 `pkg-config zlib --cflags` -DHAVE_ZLIB"
+   export NCBI_OTHERLIBS="$NCBI_OTHERLIBS `pkg-config zlib --libs`"
+elif echo '#include <zlib.h>' | $NCBI_CC -E - > /dev/null 2>&1 ; then
+   export NCBI_CFLAGS1="$NCBI_CFLAGS1 -DHAVE_ZLIB"
+   export NCBI_OTHERLIBS="$NCBI_OTHERLIBS -lz"
+fi
+
 cd ./build
 ln -s ../make/*.unx .
 ln -s ../make/ln-if-absent .
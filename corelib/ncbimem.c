@@ -987,3 +987,142 @@ NLM_EXTERN Nlm_Boolean Nlm_MemMapAdvisePtr(Nlm_MemMapPtr ptr, EMemMapAdvise advi
   return TRUE;
 #endif
 }
+
+
+/*********************************************************************
+ *  Arenas
+ */
+
+#define ARENA_DEFAULT_BLOCK_SIZE 65536
+/* Alignment of the objects, enough for any type */
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(x) (((x) + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1))
+
+typedef struct SArenaBlock {
+  struct SArenaBlock PNTR next;
+  size_t                  size;  /* bytes of data */
+  size_t                  used;
+} SArenaBlock;
+
+/* The data of a block starts after the header */
+#define ARENA_BLOCK_DATA(block) \
+  ((Nlm_CharPtr) (block) + ARENA_ROUND(sizeof(SArenaBlock)))
+
+struct Nlm_ArenaTag {
+  size_t          block_size;
+  SArenaBlock PNTR first;
+  SArenaBlock PNTR current;  /* blocks after it are free */
+};
+
+
+static SArenaBlock PNTR s_ArenaBlockNew(size_t size)
+{
+  SArenaBlock PNTR block = (SArenaBlock PNTR)
+    Nlm_Malloc(ARENA_ROUND(sizeof(SArenaBlock)) + size);
+
+  if (block == NULL) {
+    ErrPostEx(SEV_FATAL, E_NoMemory, 0,
+              "Failed to allocate an arena block of %ld bytes", (long) size);
+    return NULL;
+  }
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+
+NLM_EXTERN Nlm_ArenaPtr Nlm_ArenaNew(size_t block_size)
+{
+  Nlm_ArenaPtr arena;
+
+  if (block_size == 0)
+    block_size = ARENA_DEFAULT_BLOCK_SIZE;
+  block_size = ARENA_ROUND(block_size);
+
+  arena = (Nlm_ArenaPtr) Nlm_MemNew(sizeof(struct Nlm_ArenaTag));
+  if (arena == NULL)
+    return NULL;
+  arena->block_size = block_size;
+  if ((arena->first = s_ArenaBlockNew(block_size)) == NULL)
+    return (Nlm_ArenaPtr) Nlm_MemFree(arena);
+  arena->current = arena->first;
+  return arena;
+}
+
+
+NLM_EXTERN void* Nlm_ArenaAlloc(Nlm_ArenaPtr arena, size_t size)
+{
+  SArenaBlock PNTR block;
+  void*            ptr;
+
+  if (arena == NULL)
+    return NULL;
+
+  size = ARENA_ROUND(size ? size : 1);
+  block = arena->current;
+  while (block->size - block->used < size) {
+    /* Move on to the next free block if it is large enough, otherwise
+       put a new one in front of it */
+    if (block->next == NULL || block->next->size < size) {
+      SArenaBlock PNTR new_block =
+        s_ArenaBlockNew(MAX(size, arena->block_size));
+      if (new_block == NULL)
+        return NULL;
+      new_block->next = block->next;
+      block->next = new_block;
+    }
+    block = arena->current = block->next;
+    block->used = 0;
+  }
+
+  ptr = ARENA_BLOCK_DATA(block) + block->used;
+  block->used += size;
+  Nlm_MemSet(ptr, 0, size);
+  return ptr;
+}
+
+
+NLM_EXTERN Nlm_ArenaMark Nlm_ArenaGetMark(Nlm_ArenaPtr arena)
+{
+  Nlm_ArenaMark mark;
+
+  mark.block = arena ? (Nlm_VoidPtr) arena->current : NULL;
+  mark.used = arena ? arena->current->used : 0;
+  return mark;
+}
+
+
+NLM_EXTERN void Nlm_ArenaRelease(Nlm_ArenaPtr arena, Nlm_ArenaMark mark)
+{
+  if (arena == NULL || mark.block == NULL)
+    return;
+
+  arena->current = (SArenaBlock PNTR) mark.block;
+  arena->current->used = mark.used;
+}
+
+
+NLM_EXTERN void Nlm_ArenaReset(Nlm_ArenaPtr arena)
+{
+  if (arena == NULL)
+    return;
+
+  arena->current = arena->first;
+  arena->current->used = 0;
+}
+
+
+NLM_EXTERN Nlm_ArenaPtr Nlm_ArenaFree(Nlm_ArenaPtr arena)
+{
+  SArenaBlock PNTR block;
+
+  if (arena == NULL)
+    return NULL;
+
+  while ((block = arena->first) != NULL) {
+    arena->first = block->next;
+    Nlm_Free(block);
+  }
+  return (Nlm_ArenaPtr) Nlm_MemFree(arena);
+}
@@ -329,6 +329,62 @@ Nlm_Boolean Nlm_MemMapAdvise(void* addr, size_t len, EMemMapAdvise advise);
 Nlm_Boolean Nlm_MemMapAdvisePtr(Nlm_MemMapPtr ptr, EMemMapAdvise advise);
 
 
+
+/****************************************************************************
+ * Arenas
+ *
+ * An arena hands out zero-filled memory from a chain of large blocks and
+ * takes it all back at once, for objects that live and die together (e.g.
+ * everything found for one database sequence).  There is no per-object free.
+ * An arena is not locked: each thread uses its own instance.
+ */
+
+struct Nlm_ArenaTag;
+typedef struct Nlm_ArenaTag PNTR Nlm_ArenaPtr;
+
+/* Position in an arena, to give back what was allocated after it */
+typedef struct Nlm_ArenaMark {
+  Nlm_VoidPtr block;
+  size_t      used;
+} Nlm_ArenaMark;
+
+/* Create an arena allocating blocks of "block_size" bytes (0 for the default
+ * 64K); larger objects get a block of their own
+ */
+NLM_EXTERN Nlm_ArenaPtr Nlm_ArenaNew(size_t block_size);
+
+/* Zero-filled memory aligned for any type, valid until the arena is reset,
+ * released to an earlier mark or freed; NULL (and a posted error) if the
+ * system is out of memory
+ */
+NLM_EXTERN void* Nlm_ArenaAlloc(Nlm_ArenaPtr arena, size_t size);
+
+/* Current position of the arena, see Nlm_ArenaRelease
+ */
+NLM_EXTERN Nlm_ArenaMark Nlm_ArenaGetMark(Nlm_ArenaPtr arena);
+
+/* Take back everything allocated since "mark" was got
+ */
+NLM_EXTERN void Nlm_ArenaRelease(Nlm_ArenaPtr arena, Nlm_ArenaMark mark);
+
+/* Take back everything; the blocks are kept for reuse
+ */
+NLM_EXTERN void Nlm_ArenaReset(Nlm_ArenaPtr arena);
+
+/* Free the arena and its blocks; returns NULL
+ */
+NLM_EXTERN Nlm_ArenaPtr Nlm_ArenaFree(Nlm_ArenaPtr arena);
+
+#define ArenaPtr     Nlm_ArenaPtr
+#define ArenaMark    Nlm_ArenaMark
+#define ArenaNew     Nlm_ArenaNew
+#define ArenaAlloc   Nlm_ArenaAlloc
+#define ArenaGetMark Nlm_ArenaGetMark
+#define ArenaRelease Nlm_ArenaRelease
+#define ArenaReset   Nlm_ArenaReset
+#define ArenaFree    Nlm_ArenaFree
+
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -286,6 +286,10 @@
 ****************************************************************************/
 
 
+#if defined(__linux__)  &&  !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  /* CPU affinity of the thread pool workers */
+#endif
+
 #include <ncbistd.h>
 #include <ncbimem.h>
 #include <ncbierr.h>
@@ -899,9 +903,16 @@ NLM_EXTERN Int4 NlmThreadJoin(TNlmThread wait_for, VoidPtr *status)
 }
 
 
+#ifdef NCBI_THREADS_AVAIL
+static void s_ThreadPoolSharedFree(void);
+#endif
+
 NLM_EXTERN Int4 NlmThreadJoinAll(void)
 {
 #ifdef NCBI_THREADS_AVAIL
+  /* the workers of the shared pool wait for tasks until stopped */
+  s_ThreadPoolSharedFree();
+
   /* wait for all threads to exit */
   while (s_ThreadCounter > 0)
     NlmSemaWait(s_ThreadCounter_sema);
@@ -2600,6 +2611,213 @@ NLM_EXTERN Int4 NlmCPUNumber(void)
 }
 
 
+/********************************************************************
+ * === Thread pool  =================================================
+ ********************************************************************/
+
+typedef struct {
+  TNlmThreadPool pool;
+  Int4           index;
+  TNlmThread     thread;
+  TNlmSemaphore  start;  /* posted when the worker has a task */
+} SThreadPoolWorker;
+
+struct TNlmThreadPoolTag {
+  Boolean             pin_cpus;
+  Int4                num_workers;
+  SThreadPoolWorker **workers;
+  TNlmSemaphore       done;       /* posted by a worker after its task */
+  TNlmMutex           run_mutex;  /* one run at a time */
+  TNlmThreadStart     func;       /* the tasks of the current run */
+  VoidPtr            *args;
+  VoidPtr            *results;
+  Boolean             quit;
+};
+
+static TNlmThreadPool s_SharedPool = NULL;
+static TNlmMutex      s_SharedPool_mutex = NULL;
+
+
+/* Pin the calling thread to the index-th CPU the process may run on */
+static void s_ThreadPoolPin(Int4 index)
+{
+#if defined(POSIX_THREADS_AVAIL)  &&  defined(CPU_SET)
+  cpu_set_t allowed, cpus;
+  Int4 num_cpus, cpu;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return;
+  num_cpus = CPU_COUNT(&allowed);
+  if (num_cpus <= 1)
+    return;
+  index %= num_cpus;
+  for (cpu = 0;  cpu < CPU_SETSIZE;  cpu++) {
+    if (CPU_ISSET(cpu, &allowed)  &&  index-- == 0) {
+      CPU_ZERO(&cpus);
+      CPU_SET(cpu, &cpus);
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+      break;
+    }
+  }
+#endif
+}
+
+
+static VoidPtr s_ThreadPoolWorker(VoidPtr arg)
+{
+  SThreadPoolWorker *worker = (SThreadPoolWorker *) arg;
+  TNlmThreadPool pool = worker->pool;
+  VoidPtr result;
+
+  if ( pool->pin_cpus )
+    s_ThreadPoolPin(worker->index);
+
+  for (;;) {
+    NlmSemaWait(worker->start);
+    if ( pool->quit )
+      break;
+    result = (*pool->func)(pool->args[worker->index]);
+    if ( pool->results )
+      pool->results[worker->index] = result;
+    NlmSemaPost(pool->done);
+  }
+  return NULL;
+}
+
+
+/* Start workers up to "num_threads";  return the number of workers */
+static Int4 s_ThreadPoolGrow(TNlmThreadPool pool, Int4 num_threads)
+{
+  SThreadPoolWorker *worker;
+
+  if (num_threads <= pool->num_workers)
+    return pool->num_workers;
+
+  pool->workers = (SThreadPoolWorker **)
+    Realloc(pool->workers, num_threads * sizeof(SThreadPoolWorker *));
+  while (pool->num_workers < num_threads) {
+    worker = (SThreadPoolWorker *) MemNew(sizeof(SThreadPoolWorker));
+    worker->pool  = pool;
+    worker->index = pool->num_workers;
+    worker->start = NlmSemaInit(0);
+    worker->thread = NlmThreadCreateEx(s_ThreadPoolWorker, (VoidPtr) worker,
+                                       THREAD_RUN|THREAD_BOUND, eTP_Default,
+                                       NULL, NULL);
+    if ( NlmThreadCompare(worker->thread, NULL_thread) ) {
+      NlmSemaDestroy(worker->start);
+      MemFree(worker);
+      break;
+    }
+    pool->workers[pool->num_workers++] = worker;
+  }
+  return pool->num_workers;
+}
+
+
+NLM_EXTERN TNlmThreadPool NlmThreadPoolNew(Int4 num_threads, Boolean pin_cpus)
+{
+  TNlmThreadPool pool;
+
+  if ( !NlmThreadsAvailable() )
+    return NULL;
+
+  pool = (TNlmThreadPool) MemNew(sizeof(struct TNlmThreadPoolTag));
+  pool->pin_cpus = pin_cpus;
+  pool->done = NlmSemaInit(0);
+  NlmMutexInit(&pool->run_mutex);
+  s_ThreadPoolGrow(pool, num_threads);
+  return pool;
+}
+
+
+NLM_EXTERN Int4 NlmThreadPoolRun(TNlmThreadPool pool, TNlmThreadStart func,
+                                 VoidPtr PNTR args, VoidPtr PNTR results,
+                                 Int4 num_tasks)
+{
+  Int4 index;
+
+  if (pool == NULL  ||  func == NULL  ||  num_tasks <= 0)
+    return -1;
+  if (NlmMutexTryLock(pool->run_mutex) != 0)
+    return -1;
+
+  if (s_ThreadPoolGrow(pool, num_tasks) < num_tasks) {
+    NlmMutexUnlock(pool->run_mutex);
+    return -1;
+  }
+
+  pool->func    = func;
+  pool->args    = args;
+  pool->results = results;
+  for (index = 0;  index < num_tasks;  index++)
+    NlmSemaPost(pool->workers[index]->start);
+  for (index = 0;  index < num_tasks;  index++)
+    NlmSemaWait(pool->done);
+  pool->func    = NULL;
+  pool->args    = NULL;
+  pool->results = NULL;
+
+  NlmMutexUnlock(pool->run_mutex);
+  return 0;
+}
+
+
+NLM_EXTERN TNlmThreadPool NlmThreadPoolFree(TNlmThreadPool pool)
+{
+  VoidPtr status;
+  Int4 index;
+
+  if (pool == NULL)
+    return NULL;
+
+  NlmMutexLock(pool->run_mutex);
+  pool->quit = TRUE;
+  for (index = 0;  index < pool->num_workers;  index++)
+    NlmSemaPost(pool->workers[index]->start);
+  for (index = 0;  index < pool->num_workers;  index++) {
+    NlmThreadJoin(pool->workers[index]->thread, &status);
+    NlmSemaDestroy(pool->workers[index]->start);
+    MemFree(pool->workers[index]);
+  }
+  MemFree(pool->workers);
+  NlmSemaDestroy(pool->done);
+  NlmMutexUnlock(pool->run_mutex);
+  NlmMutexDestroy(pool->run_mutex);
+  MemFree(pool);
+  return NULL;
+}
+
+
+NLM_EXTERN TNlmThreadPool NlmThreadPoolShared(Boolean pin_cpus)
+{
+  TNlmThreadPool pool;
+
+  if ( !NlmThreadsAvailable() )
+    return NULL;
+
+  NlmMutexLockEx(&s_SharedPool_mutex);
+  if (s_SharedPool == NULL)
+    s_SharedPool = NlmThreadPoolNew(0, pin_cpus);
+  pool = s_SharedPool;
+  NlmMutexUnlock(s_SharedPool_mutex);
+  return pool;
+}
+
+
+#ifdef NCBI_THREADS_AVAIL
+/* Stop the shared pool, so that its workers can be joined */
+static void s_ThreadPoolSharedFree(void)
+{
+  if (s_SharedPool_mutex == NULL)
+    return;
+
+  NlmMutexLock(s_SharedPool_mutex);
+  s_SharedPool = NlmThreadPoolFree(s_SharedPool);
+  NlmMutexUnlock(s_SharedPool_mutex);
+}
+#endif
+
+
 /********************************************************************
  * === Internals
  ********************************************************************/
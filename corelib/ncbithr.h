@@ -120,6 +120,9 @@ struct TNlmTlsTag;                      /* hidden internal TLS structure */
 typedef struct TNlmTlsTag PNTR TNlmTls; /* handle(id) of the mutex       */
 typedef TNlmTls PNTR TNlmTlsPtr;        /* pointer to mutex handle       */
 
+struct TNlmThreadPoolTag;                             /* internal pool data */
+typedef struct TNlmThreadPoolTag PNTR TNlmThreadPool; /* handle of the pool */
+
 /* pointer to the thread function */
 typedef Nlm_VoidPtr (*TNlmThreadStart)(Nlm_VoidPtr arg);
 
@@ -596,6 +599,63 @@ NLM_EXTERN Nlm_Boolean NlmThreadsAvailable(void);
 NLM_EXTERN Nlm_Int4 NlmCPUNumber(void);
 
 
+/********************************************************************
+ * === Thread pool  =================================================
+ ********************************************************************/
+
+/* ---------------------  NlmThreadPoolNew  -------------------------
+   Purpose:     Start a pool of worker threads
+   Parameters:  "num_threads" -- number of workers to start now (the
+                                 pool grows as needed, see below);
+                "pin_cpus"    -- pin the i-th worker to the i-th CPU
+                                 the process may run on (modulo their
+                                 number), where supported
+   Returns:     handle of the pool;  NULL if threads are not available
+   Description: The workers wait for tasks until NlmThreadPoolFree();
+                this saves the cost of starting and joining a thread
+                for each task when many short runs are made
+  -----------------------------------------------------------------*/
+NLM_EXTERN TNlmThreadPool NlmThreadPoolNew(Nlm_Int4 num_threads,
+                                           Nlm_Boolean pin_cpus);
+
+
+/* ---------------------  NlmThreadPoolRun  -------------------------
+   Purpose:     Run a set of tasks on the pool and wait for them
+   Parameters:  "func"      -- the task function;
+                "args"      -- its argument for each task;
+                "results"   -- if not NULL, gets the value returned by
+                               each task;
+                "num_tasks" -- number of tasks, task i runs on worker i
+                               (the pool is grown to "num_tasks" workers)
+   Returns:     zero value on success;  non-zero value if the pool is
+                busy with a run of another thread or a worker could not
+                be started (nothing is run then)
+  -----------------------------------------------------------------*/
+NLM_EXTERN Nlm_Int4 NlmThreadPoolRun(TNlmThreadPool pool,
+                                     TNlmThreadStart func,
+                                     Nlm_VoidPtr PNTR args,
+                                     Nlm_VoidPtr PNTR results,
+                                     Nlm_Int4 num_tasks);
+
+
+/* ---------------------  NlmThreadPoolFree  ------------------------
+   Purpose:     Stop the workers (after the current run) and free the pool
+   Returns:     NULL
+  -----------------------------------------------------------------*/
+NLM_EXTERN TNlmThreadPool NlmThreadPoolFree(TNlmThreadPool pool);
+
+
+/* ---------------------  NlmThreadPoolShared  ----------------------
+   Purpose:     Get the pool shared by the whole process
+   Parameters:  "pin_cpus" -- see NlmThreadPoolNew, applies if this call
+                              creates the pool
+   Returns:     handle of the pool;  NULL if threads are not available
+   NOTE:        The pool is created on the first call and stopped by
+                NlmThreadJoinAll()
+  -----------------------------------------------------------------*/
+NLM_EXTERN TNlmThreadPool NlmThreadPoolShared(Nlm_Boolean pin_cpus);
+
+
 /********************************************************************
  * === CoreLib internals
  ********************************************************************/
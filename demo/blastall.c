@@ -887,7 +887,8 @@ ARG_FORCE_OLD,
 #endif
 #endif
 ARG_COMP_BASED_STATS,
-ARG_SMITH_WATERMAN
+ARG_SMITH_WATERMAN,
+ARG_VECTOR_DP
 } BlastArguments;
 
 #define NUMARG (sizeof(myargs)/sizeof(myargs[0]))
@@ -1026,6 +1027,10 @@ static Args myargs[] = {
         "(This option is only\n"
       "      available for gapped tblastn.)",                          /* ARG_SMITH_WATERMAN */
       "F", NULL, NULL, FALSE, 's', ARG_BOOLEAN, 0.0, 0, NULL},
+    { "Score the gapped extensions of blastn with the vectorized "
+      "dynamic programming\n"
+      "      (same alignments; not used with megablast)",              /* ARG_VECTOR_DP */
+      "F", NULL, NULL, FALSE, 'x', ARG_BOOLEAN, 0.0, 0, NULL},
 };
 
 #ifdef BLAST_CS_API
@@ -1126,6 +1131,7 @@ s_FillOptions(SBlastOptions* options)
 
    BLAST_FillExtensionOptions(ext_options, program_number, greedy, 
       myargs[ARG_XDROP].intvalue, myargs[ARG_XDROP_FINAL].intvalue);
+   ext_options->vector_dp = (Boolean) myargs[ARG_VECTOR_DP].intvalue;
 
    /* if both gap_open and gap_extend are zero then they are set to suggested values */
    SBlastOptionsSetMatrixAndGapCosts(options, myargs[ARG_MATRIX].strvalue,
@@ -1721,6 +1727,8 @@ Int2 Main_old (void)
     if(myargs[ARG_XDROP_FINAL].intvalue != 0) 
         options->gap_x_dropoff_final = myargs[ARG_XDROP_FINAL].intvalue;
 
+    options->vector_dp = (Boolean) myargs[ARG_VECTOR_DP].intvalue;
+
     if (StringICmp(myargs[ARG_FILTER].strvalue, "T") == 0) {
         if (StringICmp("blastn", blast_program) == 0)
             options->filter_string = StringSave("D");
@@ -456,6 +456,15 @@ Args dump_args[] = {
      NULL, NULL,NULL,TRUE,'B',ARG_FILE_OUT, 0.0,0,NULL},
     {"Taxid file to set the taxonomy ids in ASN.1 deflines",
      NULL, NULL,NULL,TRUE,'T',ARG_FILE_IN, 0.0,0,NULL},
+    {"Build a megablast word index of a nucleotide database (.mwx file)\n"
+     "         indexing the words ending on every N-th base, N a multiple\n"
+     "         of 4: 4 indexes all the words megablast scans, a larger N\n"
+     "         makes a smaller index that finds the hits of the searches\n"
+     "         with a word size of at least N + 11 [0 = no index]",
+     "0", "0", NULL, TRUE, 'W', ARG_INT, 0.0, 0, NULL},
+    {"Build a hashed index of the string ids for fast batch lookups\n"
+     "         by accession (.nsh/.psh file, needs -o T)",
+     "F", NULL, NULL, TRUE, 'H', ARG_BOOLEAN, 0.0, 0, NULL},
 #if 0
      /* disabled for this release of the NCBI C toolkit */
     {"Clean up options for new blast database generation\n"
@@ -484,6 +493,8 @@ enum {
     gifile_arg,
     bin_gifile_arg,
     seqid_taxid_file_arg,
+    wordindex_arg,
+    acchash_arg,
     cleanup_arg
 };
 
@@ -599,6 +610,21 @@ Int2 Main(void)
     }
     MemFree(file_inputs);
 
+    if (dump_args[wordindex_arg].intvalue != 0 &&
+        (dump_args[wordindex_arg].intvalue % READDB_COMPRESSION_RATIO != 0 ||
+         dump_args[is_prot_arg].intvalue)) {
+       ErrPostEx(SEV_FATAL, 1, 0, "A word index needs a nucleotide database "
+                 "and a stride that is a multiple of %d\n", 
+                 READDB_COMPRESSION_RATIO);
+       return 1;
+    }
+
+    if (dump_args[acchash_arg].intvalue && !dump_args[parse_arg].intvalue) {
+       ErrPostEx(SEV_FATAL, 1, 0, "A hashed string id index needs the "
+                 "string ids parsed with -o T\n");
+       return 1;
+    }
+
     options = FDBOptionsNew(dump_args[input_arg].strvalue,
                             dump_args[is_prot_arg].intvalue,
                             dump_args[title_arg].strvalue,
@@ -615,6 +641,7 @@ Int2 Main(void)
     if (options == NULL)
         return 1;
 
+    options->acc_hash = dump_args[acchash_arg].intvalue;
     options->gi_file = StringSave(dump_args[gifile_arg].strvalue);
     options->gi_file_bin = StringSave(dump_args[bin_gifile_arg].strvalue);
     orig_ptr = options->db_file;
@@ -1034,6 +1061,17 @@ Int2 Main(void)
 
     taxid_tbl = FDBTaxidDeflineTableFree(taxid_tbl);
 
+    if (dump_args[wordindex_arg].intvalue > 0) {
+        if (!MBWordIndexBuild(options->base_name, 
+                              dump_args[wordindex_arg].intvalue)) {
+            ErrPostEx(SEV_FATAL, 1, 0, "Unable to build the word index of %s",
+                      options->base_name);
+            return 1;
+        }
+        ErrLogPrintf("SUCCESS: built word index %s%s\n", options->base_name,
+                     MBWX_SUFFIX);
+    }
+
     if (options->version >= FORMATDB_VER) {
         options->linkbit_listp = FDBDestroyLinksTable(options->linkbit_listp);
         options->memb_tblp = FDBDestroyMembershipsTable(options->memb_tblp);
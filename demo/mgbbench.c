@@ -0,0 +1,731 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mgbbench.c
+
+Contents: microbenchmarks of the Mega BLAST inner loops, writing one line
+          JSON records like the mgblast -u statistics:
+            -m align: MegaBlastGreedyAlign and MegaBlastAffineGreedyAlign
+                      on read pairs made by the mbsim generator, extended
+                      from both ends as the word extension does;
+            -m scan:  the database scan (MegaBlastWordFinder) and the
+                      ungapped/greedy extension of the queries in -i
+                      against -d, with a results callback that does
+                      nothing, so lookup, scan and extension are all that
+                      is timed;
+            -m verify: the bit-parallel seed verification of mgblast -w
+                      (MBVerifyEditBound) on the -m align read pairs and on
+                      as many unrelated pairs, with the edit budget and 
+                      band mgblast uses for an identity of -p, counting 
+                      the related pairs verified and the unrelated ones
+                      rejected;
+            -m decode: SeqPortGetResidue against SeqPortBulkRead on both
+                      strands of the sequences in -i, and BioseqDust;
+            -m lookup: the OIDs of the ids listed in -i (one per line) in
+                      database -d with readdb_acc2fasta through the string
+                      ISAM index and through the hashed index of 
+                      formatdb -H, one by one and with 
+                      readdb_acc2fasta_batch.
+          The formatting and output callbacks of mgblast itself are timed
+          by mgblast -u (the "output" stage), see bench_mgblast.sh.
+
+******************************************************************************/
+
+#include <ncbi.h>
+#include <objseq.h>
+#include <objsset.h>
+#include <sequtil.h>
+#include <blast.h>
+#include <mblast.h>
+#include <mbalign.h>
+#include <mbverify.h>
+#include <mbstats.h>
+#include <mbsim.h>
+#include <blfmtutl.h>
+#include <seqport.h>
+#include <dust.h>
+#include <sqnutils.h>
+#include <tofasta.h>
+#include <readdb.h>
+
+static Args myargs [] = {
+  { "Benchmark: align, scan, verify, decode or lookup",
+	"align", NULL, NULL, FALSE, 'm', ARG_STRING, 0.0, 0, NULL},
+  { "Repetitions (the best one is reported)",
+	"3", NULL, NULL, FALSE, 'r', ARG_INT, 0.0, 0, NULL},
+  { "Random seed (align)",
+	"1", NULL, NULL, FALSE, 's', ARG_INT, 0.0, 0, NULL},
+  { "Number of sequence pairs (align)",
+	"5000", NULL, NULL, FALSE, 'n', ARG_INT, 0.0, 0, NULL},
+  { "Sequence length (align)",
+	"600", NULL, NULL, FALSE, 'l', ARG_INT, 0.0, 0, NULL},
+  { "Error rate between the two sequences of a pair (align)",
+	"0.03", NULL, NULL, FALSE, 'e', ARG_FLOAT, 0.0, 0, NULL},
+  { "X dropoff, raw score (align)",
+	"10", NULL, NULL, FALSE, 'X', ARG_INT, 0.0, 0, NULL},
+  { "Gap open cost of the affine aligner (align)",
+	"5", NULL, NULL, FALSE, 'G', ARG_INT, 0.0, 0, NULL},
+  { "Gap extension cost of the affine aligner (align)",
+	"2", NULL, NULL, FALSE, 'E', ARG_INT, 0.0, 0, NULL},
+  { "Query file (scan, decode), id list (lookup)",
+	"stdin", NULL, NULL, FALSE, 'i', ARG_FILE_IN, 0.0, 0, NULL},
+  { "Database (scan, lookup)",
+	NULL, NULL, NULL, TRUE, 'd', ARG_STRING, 0.0, 0, NULL},
+  { "Word size (scan)",
+	"28", NULL, NULL, FALSE, 'W', ARG_INT, 0.0, 0, NULL},
+  { "Number of threads (scan)",
+	"1", NULL, NULL, FALSE, 'a', ARG_INT, 0.0, 0, NULL},
+  { "Maximal number of queries (scan, decode)",
+	"1000", NULL, NULL, FALSE, 'V', ARG_INT, 0.0, 0, NULL},
+  { "Filter query sequence (scan)",
+	"T", NULL, NULL, FALSE, 'F', ARG_STRING, 0.0, 0, NULL},
+  { "Identity percentage the pairs are verified for (verify)",
+	"96", NULL, NULL, FALSE, 'p', ARG_FLOAT, 0.0, 0, NULL}
+};
+
+#define ARG_MODE    0
+#define ARG_REPEAT  1
+#define ARG_SEED    2
+#define ARG_PAIRS   3
+#define ARG_LENGTH  4
+#define ARG_ERRORS  5
+#define ARG_XDROP   6
+#define ARG_GAPOPEN 7
+#define ARG_GAPEXT  8
+#define ARG_QUERY   9
+#define ARG_DB      10
+#define ARG_WORD    11
+#define ARG_THREADS 12
+#define ARG_NUMSEQ  13
+#define ARG_FILTER  14
+#define ARG_IDENT   15
+
+#define BENCH_REWARD  1
+#define BENCH_PENALTY 3
+
+/* ncbi2na codes of a generated sequence, for the unpacked (rem = 4) 
+   aligner interface */
+static Uint1Ptr BenchEncode(CharPtr seq, Int4 length)
+{
+   Uint1Ptr codes;
+   Int4 index;
+
+   codes = (Uint1Ptr) MemNew(length + 1);
+   for (index = 0; index < length; index++) {
+      switch (seq[index]) {
+      case 'C': codes[index] = 1; break;
+      case 'G': codes[index] = 2; break;
+      case 'T': codes[index] = 3; break;
+      default: codes[index] = 0; break;
+      }
+   }
+   return codes;
+}
+
+static Int2 BenchAlign(void)
+{
+   MBSimParams params;
+   MBSimPtr sim;
+   Uint1Ptr PNTR query, PNTR subject;
+   Int4Ptr subject_length;
+   GreedyAlignMemPtr abmp;
+   edit_script_t *script;
+   CharPtr seq, copy;
+   Int4 num_pairs, length, pass, rep, index, gap_open, gap_extend;
+   Int4 e1, e2;
+   Int8 score_sum, bases;
+   FloatHi start, best;
+
+   num_pairs = MAX(myargs[ARG_PAIRS].intvalue, 1);
+   length = MAX(myargs[ARG_LENGTH].intvalue, 1);
+   MBSimParamsDefault(&params);
+   params.seed = (Uint4) myargs[ARG_SEED].intvalue;
+   /* Only the random number generator is needed */
+   params.num_transcripts = 1;
+   params.transcript_min = params.transcript_max = 1;
+   params.num_repeats = 0;
+   sim = MBSimNew(&params);
+
+   query = (Uint1Ptr PNTR) MemNew(num_pairs*sizeof(Uint1Ptr));
+   subject = (Uint1Ptr PNTR) MemNew(num_pairs*sizeof(Uint1Ptr));
+   subject_length = (Int4Ptr) MemNew(num_pairs*sizeof(Int4));
+   copy = (CharPtr) MemNew(2*length + 1);
+   bases = 0;
+   for (index = 0; index < num_pairs; index++) {
+      seq = MBSimRandomSequence(sim, length);
+      subject_length[index] = 
+         MBSimMutate(sim, seq, length, myargs[ARG_ERRORS].floatvalue, 
+                     params.indel_fraction, copy);
+      query[index] = BenchEncode(seq, length);
+      subject[index] = BenchEncode(copy, subject_length[index]);
+      bases += length + subject_length[index];
+      MemFree(seq);
+   }
+   MemFree(copy);
+
+   /* pass 0: basic greedy aligner (no gap costs), pass 1: affine */
+   for (pass = 0; pass < 2; pass++) {
+      gap_open = pass ? myargs[ARG_GAPOPEN].intvalue : 0;
+      gap_extend = pass ? myargs[ARG_GAPEXT].intvalue : 0;
+      abmp = GreedyAlignMemNew(2*length, BENCH_REWARD, BENCH_PENALTY,
+                               myargs[ARG_XDROP].intvalue, gap_open, 
+                               gap_extend, TRUE);
+      if (abmp == NULL) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Unable to allocate aligner memory");
+         break;
+      }
+      best = -1.0;
+      score_sum = 0;
+      for (rep = 0; rep < MAX(myargs[ARG_REPEAT].intvalue, 1); rep++) {
+         score_sum = 0;
+         start = MBStatsClock();
+         for (index = 0; index < num_pairs; index++) {
+            /* From the start forward and from the end backward, as the
+               right and left extensions of a word hit */
+            script = edit_script_new();
+            score_sum += 
+               MegaBlastAffineGreedyAlign(subject[index], 
+                                          subject_length[index], 
+                                          query[index], length, FALSE, 
+                                          myargs[ARG_XDROP].intvalue, 
+                                          BENCH_REWARD, BENCH_PENALTY,
+                                          gap_open, gap_extend, &e1, &e2, 
+                                          abmp, script, 4);
+            score_sum += e1 + e2;
+            edit_script_free(script);
+            script = edit_script_new();
+            score_sum += 
+               MegaBlastAffineGreedyAlign(subject[index], 
+                                          subject_length[index], 
+                                          query[index], length, TRUE, 
+                                          myargs[ARG_XDROP].intvalue, 
+                                          BENCH_REWARD, BENCH_PENALTY,
+                                          gap_open, gap_extend, &e1, &e2, 
+                                          abmp, script, 4);
+            score_sum += e1 + e2;
+            edit_script_free(script);
+         }
+         start = MBStatsClock() - start;
+         if (best < 0 || start < best)
+            best = start;
+      }
+      GreedyAlignMemFree(abmp);
+      /* checksum is the sum of the scores and extension lengths; it only
+         changes when the alignments do */
+      printf("{\"bench\":\"%s\",\"pairs\":%ld,\"length\":%ld,"
+             "\"error_rate\":%g,\"time\":%.6f,\"mbases_per_sec\":%.3f,"
+             "\"checksum\":%ld}\n", 
+             pass ? "affine_greedy_align" : "greedy_align",
+             (long) num_pairs, (long) length, myargs[ARG_ERRORS].floatvalue,
+             best, best > 0 ? bases / best / 1e6 : 0.0, (long) score_sum);
+   }
+
+   for (index = 0; index < num_pairs; index++) {
+      MemFree(query[index]);
+      MemFree(subject[index]);
+   }
+   MemFree(query);
+   MemFree(subject);
+   MemFree(subject_length);
+   MBSimFree(sim);
+   return 0;
+}
+
+static Int2 BenchVerify(void)
+{
+   MBSimParams params;
+   MBSimPtr sim;
+   Uint1Ptr PNTR query, PNTR subject;
+   Int4Ptr subject_length;
+   CharPtr seq, copy;
+   Int4 num_pairs, length, rep, index, max_edits, edits;
+   Int4 verified, rejected;
+   Int8 bases, edit_sum;
+   FloatHi start, best, diff_fraction;
+
+   num_pairs = MAX(myargs[ARG_PAIRS].intvalue, 1);
+   length = MAX(myargs[ARG_LENGTH].intvalue, 1);
+   diff_fraction = (100.0 - myargs[ARG_IDENT].floatvalue) / 100.0;
+   if (diff_fraction < 0 || diff_fraction >= 0.25) {
+      ErrPostEx(SEV_ERROR, 0, 0, "The verification needs an identity "
+                "above 75%%");
+      return 1;
+   }
+   /* as MegaBlastVerifySeed for an overlap of the whole read */
+   max_edits = (Int4) (diff_fraction * length / (1 - 3*diff_fraction)) + 1;
+
+   MBSimParamsDefault(&params);
+   params.seed = (Uint4) myargs[ARG_SEED].intvalue;
+   params.num_transcripts = 1;
+   params.transcript_min = params.transcript_max = 1;
+   params.num_repeats = 0;
+   sim = MBSimNew(&params);
+
+   /* the first half of the pairs are related, the second half not */
+   query = (Uint1Ptr PNTR) MemNew(2*num_pairs*sizeof(Uint1Ptr));
+   subject = (Uint1Ptr PNTR) MemNew(2*num_pairs*sizeof(Uint1Ptr));
+   subject_length = (Int4Ptr) MemNew(2*num_pairs*sizeof(Int4));
+   copy = (CharPtr) MemNew(2*length + 1);
+   bases = 0;
+   for (index = 0; index < 2*num_pairs; index++) {
+      seq = MBSimRandomSequence(sim, length);
+      query[index] = BenchEncode(seq, length);
+      if (index < num_pairs) {
+         subject_length[index] = 
+            MBSimMutate(sim, seq, length, myargs[ARG_ERRORS].floatvalue, 
+                        params.indel_fraction, copy);
+         subject[index] = BenchEncode(copy, subject_length[index]);
+      } else {
+         MemFree(seq);
+         seq = MBSimRandomSequence(sim, length);
+         subject_length[index] = length;
+         subject[index] = BenchEncode(seq, length);
+      }
+      bases += length;
+      MemFree(seq);
+   }
+   MemFree(copy);
+
+   best = -1.0;
+   verified = rejected = 0;
+   edit_sum = 0;
+   for (rep = 0; rep < MAX(myargs[ARG_REPEAT].intvalue, 1); rep++) {
+      verified = rejected = 0;
+      edit_sum = 0;
+      start = MBStatsClock();
+      for (index = 0; index < 2*num_pairs; index++) {
+         edits = MBVerifyEditBound(query[index], 0, length, subject[index],
+                                   subject_length[index], FALSE, 0, 
+                                   max_edits, max_edits);
+         edit_sum += edits;
+         if (edits <= max_edits) {
+            if (index < num_pairs)
+               verified++;
+         } else if (index >= num_pairs)
+            rejected++;
+      }
+      start = MBStatsClock() - start;
+      if (best < 0 || start < best)
+         best = start;
+   }
+   printf("{\"bench\":\"verify\",\"pairs\":%ld,\"length\":%ld,"
+          "\"error_rate\":%g,\"identity\":%g,\"max_edits\":%ld,"
+          "\"time\":%.6f,\"mbases_per_sec\":%.3f,\"related_verified\":%ld,"
+          "\"unrelated_rejected\":%ld,\"checksum\":%ld}\n",
+          (long) num_pairs, (long) length, myargs[ARG_ERRORS].floatvalue,
+          myargs[ARG_IDENT].floatvalue, (long) max_edits, best, 
+          best > 0 ? bases / best / 1e6 : 0.0, (long) verified, 
+          (long) rejected, (long) edit_sum);
+
+   for (index = 0; index < 2*num_pairs; index++) {
+      MemFree(query[index]);
+      MemFree(subject[index]);
+   }
+   MemFree(query);
+   MemFree(subject);
+   MemFree(subject_length);
+   MBSimFree(sim);
+   return 0;
+}
+
+static int LIBCALLBACK BenchNoProgress(Int4 done, Int4 positives)
+{
+   return 0;
+}
+
+/* Drop the results; only the scan and extension are timed */
+static int LIBCALLBACK BenchNoResults(VoidPtr ptr)
+{
+   return 0;
+}
+
+static void BenchFreeReturns(ValNodePtr other_returns, 
+                             ValNodePtr error_returns)
+{
+   ValNodePtr vnp;
+
+   if (error_returns) {
+      BlastErrorPrint(error_returns);
+      for (vnp = error_returns; vnp; vnp = vnp->next)
+         BlastDestroyErrorMessage((BlastErrorMsgPtr) vnp->data.ptrvalue);
+      ValNodeFree(error_returns);
+   }
+   for (vnp = other_returns; vnp; vnp = vnp->next) {
+      switch (vnp->choice) {
+      case TXDBINFO:
+         TxDfDbInfoDestruct(vnp->data.ptrvalue);
+         break;
+      case TXKABLK_NOGAP:
+      case TXKABLK_GAP:
+      case TXPARAMETERS:
+         MemFree(vnp->data.ptrvalue);
+         break;
+      case TXMATRIX:
+         BLAST_MatrixDestruct(vnp->data.ptrvalue);
+         break;
+      default:
+         break;
+      }
+   }
+   ValNodeFree(other_returns);
+}
+
+/* Reads up to -V nucleotide queries from -i; returns how many were read */
+static Int4 BenchReadQueries(SeqEntryPtr PNTR PNTR sepp_out, 
+                             BioseqPtr PNTR PNTR bsp_out, Int8Ptr bases)
+{
+   SeqEntryPtr PNTR sepp;
+   BioseqPtr PNTR bsp_array;
+   BioseqPtr bsp;
+   FILE *infp;
+   Int4 max_queries, num_queries;
+   Int2 ctr = 1;
+
+   *bases = 0;
+   if ((infp = FileOpen(myargs[ARG_QUERY].strvalue, "r")) == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open file %s", 
+                myargs[ARG_QUERY].strvalue);
+      return 0;
+   }
+   max_queries = MAX(myargs[ARG_NUMSEQ].intvalue, 1);
+   sepp = (SeqEntryPtr PNTR) MemNew((max_queries+1)*sizeof(SeqEntryPtr));
+   bsp_array = (BioseqPtr PNTR) MemNew((max_queries+1)*sizeof(BioseqPtr));
+   num_queries = 0;
+   while (num_queries < max_queries &&
+          (sepp[num_queries] = FastaToSeqEntryForDb(infp, TRUE, NULL, FALSE,
+                                                    NULL, &ctr, NULL)) 
+          != NULL) {
+      bsp = NULL;
+      SeqEntryExplore(sepp[num_queries], &bsp, FindNuc);
+      if (bsp == NULL) {
+         sepp[num_queries] = SeqEntryFree(sepp[num_queries]);
+         continue;
+      }
+      *bases += bsp->length;
+      bsp_array[num_queries++] = bsp;
+   }
+   FileClose(infp);
+   if (num_queries == 0) {
+      ErrPostEx(SEV_ERROR, 0, 0, "No queries read from %s", 
+                myargs[ARG_QUERY].strvalue);
+      MemFree(sepp);
+      MemFree(bsp_array);
+      return 0;
+   }
+   *sepp_out = sepp;
+   *bsp_out = bsp_array;
+   return num_queries;
+}
+
+static Int2 BenchScan(void)
+{
+   BLAST_OptionsBlkPtr options;
+   MBSearchStats stats, best;
+   SeqEntryPtr PNTR sepp;
+   BioseqPtr PNTR bsp_array;
+   SeqAlignPtr PNTR seqalign_array;
+   ValNodePtr other_returns, error_returns;
+   Int4 num_queries, index, rep;
+   Int8 query_bases;
+   FloatHi start, elapsed, best_time = -1.0, scan;
+
+   if (myargs[ARG_DB].strvalue == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "The scan benchmark needs a database (-d)");
+      return 1;
+   }
+   if ((num_queries = BenchReadQueries(&sepp, &bsp_array, &query_bases)) 
+       == 0)
+      return 1;
+
+   options = BLASTOptionNewEx("blastn", TRUE, TRUE);
+   options->do_sum_stats = FALSE;
+   if (StringICmp(myargs[ARG_FILTER].strvalue, "T") == 0)
+      options->filter_string = StringSave("D");
+   else
+      options->filter_string = StringSave(myargs[ARG_FILTER].strvalue);
+   options->wordsize = myargs[ARG_WORD].intvalue;
+   options->cutoff_s2 = options->wordsize*options->reward;
+   options->number_of_cpus = MAX(myargs[ARG_THREADS].intvalue, 1);
+   options->hitlist_size = 500;
+
+   MemSet(&best, 0, sizeof(best));
+   for (rep = 0; rep < MAX(myargs[ARG_REPEAT].intvalue, 1); rep++) {
+      MemSet(&stats, 0, sizeof(stats));
+      options->search_stats = &stats;
+      options->mb_stage_timing = TRUE;
+      other_returns = error_returns = NULL;
+      start = MBStatsClock();
+      seqalign_array = 
+         BioseqMegaBlastEngine(bsp_array, "blastn", myargs[ARG_DB].strvalue,
+                               options, &other_returns, &error_returns,
+                               BenchNoProgress, NULL, NULL, 0, 
+                               BenchNoResults);
+      elapsed = MBStatsClock() - start;
+      if (seqalign_array) {
+         for (index = 0; index < num_queries; index++)
+            SeqAlignSetFree(seqalign_array[index]);
+         MemFree(seqalign_array);
+      }
+      BenchFreeReturns(other_returns, error_returns);
+      if (best_time < 0 || elapsed < best_time) {
+         best_time = elapsed;
+         MBSearchStatsClear(&best);
+         MemCpy(&best, &stats, sizeof(stats));
+      } else
+         MBSearchStatsClear(&stats);
+   }
+   options->search_stats = NULL;
+
+   /* Stage times are summed over the threads */
+   scan = best.total.time[MB_STAGE_SCAN];
+   printf("{\"bench\":\"scan\",\"queries\":%ld,\"query_bases\":%ld,"
+          "\"word_size\":%ld,\"threads\":%ld,\"time\":%.6f,"
+          "\"lookup\":%.6f,\"scan\":%.6f,\"extend\":%.6f,"
+          "\"subjects\":%ld,\"db_bytes\":%ld,\"word_hits\":%ld,"
+          "\"extensions\":%ld,\"scan_mbytes_per_sec\":%.3f}\n",
+          (long) num_queries, (long) query_bases, 
+          (long) options->wordsize, (long) options->number_of_cpus, 
+          best_time, best.total.time[MB_STAGE_LOOKUP], scan,
+          best.total.time[MB_STAGE_EXTEND], (long) best.total.subjects,
+          (long) best.total.db_bytes, (long) best.total.word_hits,
+          (long) best.total.extensions,
+          scan > 0 ? best.total.db_bytes / scan / 1e6 : 0.0);
+   MBSearchStatsClear(&best);
+
+   BlastFreeSpareGreedyMem();
+   options = BLASTOptionDelete(options);
+   for (index = 0; index < num_queries; index++)
+      SeqEntryFree(sepp[index]);
+   MemFree(sepp);
+   MemFree(bsp_array);
+   return 0;
+}
+
+/* Per residue SeqPort decoding against SeqPortBulkRead of both strands of
+   the -i sequences in ncbi4na, as the query setup does, and the DUST pass */
+static Int2 BenchDecode(void)
+{
+   SeqEntryPtr PNTR sepp;
+   BioseqPtr PNTR bsp_array;
+   SeqPortPtr spp;
+   SeqLocPtr slp;
+   Uint1Ptr buf;
+   Uint1 residue, strand;
+   Int4 num_queries, max_length, index, pass, rep, count;
+   Int8 query_bases, sum[2];
+   FloatHi start, elapsed, best[3];
+
+   if ((num_queries = BenchReadQueries(&sepp, &bsp_array, &query_bases)) 
+       == 0)
+      return 1;
+   max_length = 0;
+   for (index = 0; index < num_queries; index++)
+      max_length = MAX(max_length, bsp_array[index]->length);
+   buf = (Uint1Ptr) MemNew(max_length+1);
+
+   best[0] = best[1] = best[2] = -1.0;
+   for (rep = 0; rep < MAX(myargs[ARG_REPEAT].intvalue, 1); rep++) {
+      for (pass = 0; pass < 2; pass++) {
+         sum[pass] = 0;
+         start = MBStatsClock();
+         for (index = 0; index < num_queries; index++) {
+            for (strand = Seq_strand_plus; strand <= Seq_strand_minus; 
+                 strand++) {
+               if (pass == 0) {
+                  spp = SeqPortNew(bsp_array[index], 0, -1, strand, 
+                                   Seq_code_ncbi4na);
+                  SeqPortSet_do_virtual(spp, TRUE);
+                  count = 0;
+                  while ((residue=SeqPortGetResidue(spp)) != SEQPORT_EOF) {
+                     if (IS_residue(residue))
+                        buf[count++] = residue;
+                  }
+                  SeqPortFree(spp);
+               } else
+                  count = SeqPortBulkRead(bsp_array[index], 0, -1, strand,
+                                          Seq_code_ncbi4na, buf);
+               while (count > 0)
+                  sum[pass] += buf[--count];
+            }
+         }
+         elapsed = MBStatsClock() - start;
+         if (best[pass] < 0 || elapsed < best[pass])
+            best[pass] = elapsed;
+      }
+      if (sum[0] != sum[1]) {
+         ErrPostEx(SEV_ERROR, 0, 0, "SeqPortBulkRead differs from "
+                   "SeqPortGetResidue");
+         break;
+      }
+
+      start = MBStatsClock();
+      for (index = 0; index < num_queries; index++) {
+         slp = BioseqDust(bsp_array[index], 0, -1, -1, -1, -1, -1);
+         SeqLocSetFree(slp);
+      }
+      elapsed = MBStatsClock() - start;
+      if (best[2] < 0 || elapsed < best[2])
+         best[2] = elapsed;
+   }
+
+   printf("{\"bench\":\"decode\",\"sequences\":%ld,\"bases\":%ld,"
+          "\"residue_time\":%.6f,\"bulk_time\":%.6f,"
+          "\"bulk_mbases_per_sec\":%.3f,\"dust_time\":%.6f,"
+          "\"checksum\":%ld}\n",
+          (long) num_queries, (long) query_bases, best[0], best[1],
+          best[1] > 0 ? 2.0 * query_bases / best[1] / 1e6 : 0.0, best[2],
+          (long) sum[1]);
+
+   MemFree(buf);
+   for (index = 0; index < num_queries; index++)
+      SeqEntryFree(sepp[index]);
+   MemFree(sepp);
+   MemFree(bsp_array);
+   return (sum[0] == sum[1]) ? 0 : 1;
+}
+
+/* readdb_acc2fasta through the string ISAM index, the same through the
+   hashed string id index, and readdb_acc2fasta_batch */
+static Int2 BenchLookup(void)
+{
+   ReadDBFILEPtr rdfp, rdfp_tmp;
+   RDBAccHashPtr PNTR hashes;
+   CharPtr PNTR ids = NULL;
+   CharPtr line;
+   Char buf[256];
+   Int4Ptr oids[3];
+   Int4 num_ids = 0, max_ids = 0, num_vols, index, pass, rep, found = 0;
+   Boolean hashed = TRUE, same = TRUE;
+   FloatHi start, elapsed, best[3];
+   FILE *infp;
+
+   if (myargs[ARG_DB].strvalue == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "The lookup benchmark needs a database "
+                "(-d)");
+      return 1;
+   }
+   if ((infp = FileOpen(myargs[ARG_QUERY].strvalue, "r")) == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open %s",
+                myargs[ARG_QUERY].strvalue);
+      return 1;
+   }
+   while (FileGets(buf, sizeof(buf), infp) != NULL) {
+      for (line = buf; *line && !IS_WHITESP(*line); line++)
+         continue;
+      *line = NULLB;
+      if (*buf == NULLB)
+         continue;
+      if (num_ids == max_ids) {
+         max_ids = MAX(2*max_ids, 1024);
+         ids = (CharPtr PNTR) Realloc(ids, max_ids*sizeof(CharPtr));
+      }
+      ids[num_ids++] = StringSave(buf);
+   }
+   FileClose(infp);
+   if (num_ids == 0) {
+      ErrPostEx(SEV_ERROR, 0, 0, "No ids in %s", myargs[ARG_QUERY].strvalue);
+      return 1;
+   }
+   if ((rdfp = readdb_new(myargs[ARG_DB].strvalue, FALSE)) == NULL)
+      return 1;
+   for (num_vols = 0, rdfp_tmp = rdfp; rdfp_tmp; rdfp_tmp = rdfp_tmp->next)
+      num_vols++;
+   hashes = (RDBAccHashPtr PNTR) MemNew(num_vols*sizeof(RDBAccHashPtr));
+   for (index = 0, rdfp_tmp = rdfp; rdfp_tmp; rdfp_tmp = rdfp_tmp->next) {
+      hashes[index++] = rdfp_tmp->acc_hash;
+      hashed = hashed && (rdfp_tmp->acc_hash != NULL);
+   }
+   for (pass = 0; pass < 3; pass++)
+      oids[pass] = (Int4Ptr) MemNew(num_ids*sizeof(Int4));
+
+   best[0] = best[1] = best[2] = -1.0;
+   for (rep = 0; rep < MAX(myargs[ARG_REPEAT].intvalue, 1); rep++) {
+      for (pass = 0; pass < 3; pass++) {
+         /* the first pass without the hashed indexes */
+         for (index = 0, rdfp_tmp = rdfp; rdfp_tmp; 
+              rdfp_tmp = rdfp_tmp->next)
+            rdfp_tmp->acc_hash = pass ? hashes[index++] : NULL;
+         start = MBStatsClock();
+         if (pass < 2) {
+            for (index = 0; index < num_ids; index++)
+               oids[pass][index] = readdb_acc2fasta(rdfp, ids[index]);
+         } else
+            found = readdb_acc2fasta_batch(rdfp, ids, num_ids, oids[pass]);
+         elapsed = MBStatsClock() - start;
+         if (best[pass] < 0 || elapsed < best[pass])
+            best[pass] = elapsed;
+      }
+   }
+   for (index = 0; index < num_ids; index++) {
+      if (oids[1][index] != oids[0][index] || 
+          oids[2][index] != oids[0][index])
+         same = FALSE;
+   }
+   if (!same)
+      ErrPostEx(SEV_ERROR, 0, 0, "The hashed index lookups differ from "
+                "the ISAM ones");
+
+   printf("{\"bench\":\"lookup\",\"ids\":%ld,\"found\":%ld,"
+          "\"hashed\":%s,\"isam_time\":%.6f,\"hash_time\":%.6f,"
+          "\"batch_time\":%.6f,\"batch_ids_per_sec\":%.0f,"
+          "\"same\":%s}\n",
+          (long) num_ids, (long) found, hashed ? "true" : "false", 
+          best[0], best[1], best[2], 
+          best[2] > 0 ? num_ids / best[2] : 0.0, same ? "true" : "false");
+
+   for (index = 0; index < num_ids; index++)
+      MemFree(ids[index]);
+   MemFree(ids);
+   for (pass = 0; pass < 3; pass++)
+      MemFree(oids[pass]);
+   MemFree(hashes);
+   readdb_destruct(rdfp);
+   return same ? 0 : 1;
+}
+
+Int2 Main (void)
+{
+   if (! GetArgs ("mgbbench", DIM(myargs), myargs))
+      return (1);
+
+   UseLocalAsnloadDataAndErrMsg ();
+   if (! SeqEntryLoad())
+      return 1;
+   ErrSetMessageLevel(SEV_WARNING);
+
+   if (StringICmp(myargs[ARG_MODE].strvalue, "align") == 0)
+      return BenchAlign();
+   if (StringICmp(myargs[ARG_MODE].strvalue, "scan") == 0)
+      return BenchScan();
+   if (StringICmp(myargs[ARG_MODE].strvalue, "verify") == 0)
+      return BenchVerify();
+   if (StringICmp(myargs[ARG_MODE].strvalue, "decode") == 0)
+      return BenchDecode();
+   if (StringICmp(myargs[ARG_MODE].strvalue, "lookup") == 0)
+      return BenchLookup();
+   ErrPostEx(SEV_ERROR, 0, 0, "Unknown benchmark %s (align, scan, verify, "
+             "decode or lookup)", myargs[ARG_MODE].strvalue);
+   return 1;
+}
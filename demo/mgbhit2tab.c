@@ -0,0 +1,101 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mgbhit2tab.c
+
+Contents: converts binary mgblast hits (-D 6 or -D 7) to the tabulated
+          -D 4 (or -D 5, when gap info is present) text format.
+
+******************************************************************************/
+
+#include <ncbi.h>
+#include <txalign.h>
+#include <mbhitio.h>
+
+static Args myargs [] = {
+  { "Binary hit file written by mgblast -D 6 or -D 7",
+	NULL, NULL, NULL, FALSE, 'i', ARG_FILE_IN, 0.0, 0, NULL},
+  { "Output file",
+	"stdout", NULL, NULL, FALSE, 'o', ARG_FILE_OUT, 0.0, 0, NULL},
+  { "First hit to convert (0-based)",
+	"0", NULL, NULL, FALSE, 'f', ARG_INT, 0.0, 0, NULL},
+  { "Number of hits to convert (0 = all)",
+	"0", NULL, NULL, FALSE, 'n', ARG_INT, 0.0, 0, NULL}
+};
+
+Int2 Main (void)
+{
+   MBHitReaderPtr reader;
+   MBHitRecord rec;
+   FILE *outfp;
+   CharPtr query_name, subject_name, gap_info, eval_buff;
+   Char bit_score_buff[10];
+   Int4 query_len, subject_len;
+   Int8 index, last;
+
+   if (! GetArgs ("mgbhit2tab", DIM(myargs), myargs))
+      return (1);
+
+   if ((reader = MBHitReaderOpen(myargs[0].strvalue)) == NULL)
+      return 1;
+   if ((outfp = FileOpen(myargs[1].strvalue, "w")) == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open file %s", myargs[1].strvalue);
+      MBHitReaderFree(reader);
+      return 1;
+   }
+
+   last = reader->num_hits;
+   if (myargs[3].intvalue > 0)
+      last = MIN(last, (Int8) myargs[2].intvalue + myargs[3].intvalue);
+   eval_buff = Malloc(10);
+   for (index = myargs[2].intvalue; index < last; index++) {
+      if (!MBHitReaderGet(reader, index, &rec)) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Unable to read hit %ld", (long) index);
+         break;
+      }
+      query_name = MBHitReaderQueryName(reader, rec.query_ord, &query_len);
+      subject_name = MBHitReaderSubjectName(reader, rec.subject_oid,
+                                            &subject_len);
+      if (query_name == NULL || subject_name == NULL) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Missing name for hit %ld", (long) index);
+         break;
+      }
+      ScoreAndEvalueToBuffers(rec.bit_score, rec.evalue,
+                              bit_score_buff, &eval_buff, 0);
+      fprintf(outfp, "%s\t%d\t%d\t%d\t%s\t%d\t%d\t%d\t%.2f\t%s\t%s\t%c",
+              query_name, query_len, rec.q_start, rec.q_end,
+              subject_name, subject_len, rec.s_start, rec.s_end,
+              MBHitRecordPercIdent(&rec), bit_score_buff, eval_buff, rec.strand);
+      if ((gap_info = MBHitReaderGapInfo(reader, &rec)) != NULL) {
+         fprintf(outfp, "\t%s", gap_info);
+         MemFree(gap_info);
+      }
+      fprintf(outfp, "\n");
+   }
+   MemFree(eval_buff);
+   FileClose(outfp);
+   MBHitReaderFree(reader);
+   return 0;
+}
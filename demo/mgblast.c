@@ -13,6 +13,14 @@
 #include <xmlblast.h>
 #include <sqnutils.h>
 #include <blfmtutl.h>
+#include <mbclust.h>
+#include <mbhitio.h>
+#include <mbasnout.h>
+#include <mbzout.h>
+#include <mbstats.h>
+#include <mbserver.h>
+#include <mbwindex.h>
+#include <connect/ncbi_socket.h>
 #if MB_ALLOW_NEW
 #include <algo/blast/api/blast_input.h>
 #include <algo/blast/api/blast_format.h>
@@ -32,12 +40,6 @@ FILE *global_fp=NULL;
 	Callback to print out ticks, in UNIX only due to file systems
 	portability issues.
 */
-static int LIBCALLBACK
-dummy_callback(Int4 sequence_number, Int4 number_of_positive_hits)
-{
-   return 0;
-}
-
 static int LIBCALLBACK
 tick_callback(Int4 sequence_number, Int4 number_of_positive_hits)
 
@@ -58,7 +60,9 @@ enum {
    MBLAST_ALIGN_INFO,
    #ifdef MGBLAST_OPTS
     MBLAST_FLTHITS, /* tab output */
-    MBLAST_HITGAPS  /* tab output, including gap positions and lengths! */
+    MBLAST_HITGAPS, /* tab output, including gap positions and lengths! */
+    MBLAST_BINHITS, /* binary records of the -D 4 hits, see mbhitio.h */
+    MBLAST_BINGAPS  /* binary records with gap info blobs (-D 5 data) */
    #else
     MBLAST_DELAYED_TRACEBACK
    #endif 
@@ -106,6 +110,8 @@ static int min_overlap=0;
 static int slice_clustering=FALSE;
 static int gap_Info=FALSE;
 static int db_skipto=0;
+static Int4 db_range_start=0; /* -x: OID range of the database searched, */
+static Int4 db_range_end=0;   /* end excluded, 0 = to the end */
 static int appendName=0; /* for -D4, appends query or subject defline */
 static CharPtr dbgaps_buf=NULL;
 static CharPtr qgaps_buf=NULL;
@@ -115,8 +121,24 @@ static Int4 qgaps_buf_used;
 static Int4 qgaps_bufsize=1024;
 /*-- how many query slicing iterations? */
 static int qread_base = 0;
+/*-- read ordinal of each query in the current block; queries shorter
+     than -C are dropped at load, so these may have gaps */
+static Int4Ptr query_ords = NULL;
 
 static int max_num_queries = 4000;
+/*-- in-process clustering of the hits passing the filter (-c option) */
+static MBClusterSetPtr hit_clusters = NULL;
+/*-- binary hit output (-D 6 and -D 7) */
+static MBHitWriterPtr hit_writer = NULL;
+/*-- streaming Seq-align output (-m 10 and -m 11) */
+static MBAsnWriterPtr asn_writer = NULL;
+/*-- in-process compression of the tabulated hits (-Y option) */
+static MBZWriterPtr zout = NULL;
+/*-- resident server mode (-N option): queries and hits of the current
+     request go through the connection, and the database stays open */
+static FILE *server_infp = NULL;
+static FILE *server_outfp = NULL;
+static ReadDBFILEPtr server_rdfp = NULL;
 
 /* Geo's new callback output functions:
 
@@ -536,6 +558,85 @@ int LIBCALLBACK MegaBlastPrintTabulated(VoidPtr ptr)
    return 0;
 }
 
+/* With -h min_shared,R every pair is searched: count the kept hits whose
+   pair the sketch prefilter would have searched */
+static void MGBCountSketchHit(BlastSearchBlkPtr search, Int4 query_no)
+{
+   if (search->pbp->mb_params == NULL || 
+       !search->pbp->mb_params->sketch_recall || search->thr_info == NULL)
+      return;
+   if (MBSketchPairsHas(search->thr_info->sketch_pairs, search->subject_id,
+                        query_no))
+      search->stage_stats.sketch_hsps_kept++;
+}
+
+/* The traceback of an HSP saved without one (dynamic programming 
+   extension, whose traceback is otherwise left to the end of the search),
+   on the subject in blastna; also sets the e-value. FALSE if it cannot be
+   done here */
+static Boolean MGBTracebackHsp(BlastSearchBlkPtr search, BLAST_HSPPtr hsp,
+                               Int4 context, Uint1Ptr subject_seq)
+{
+   /* This must have already been allocated */
+   GapAlignBlkPtr gap_align = search->gap_align; 
+   FloatHi searchsp_eff;
+   Int4 max_offset, max_start = MAX_DBSEQ_LEN / 2, start_shift;
+
+   if (gap_align == NULL || subject_seq == NULL)
+      return FALSE;
+   /* Set the X-dropoff to the final X dropoff parameter. */
+   gap_align->x_parameter = search->pbp->gap_x_dropoff_final;
+   gap_align->query = search->context[context].query->sequence;
+   gap_align->query_length = search->query_context_offsets[context+1] -
+      search->query_context_offsets[context] - 1;
+   gap_align->subject = subject_seq;
+   gap_align->subject_length = search->subject->length;
+   if ((hsp->query.gapped_start == 0 && hsp->subject.gapped_start == 0) ||
+       CheckStartForGappedAlignment(search, hsp, gap_align->query, gap_align->subject, search->sbp->matrix) == FALSE) {
+      max_offset = GetStartForGappedAlignment(search, hsp, gap_align->query, gap_align->subject, search->sbp->matrix);
+      gap_align->q_start = max_offset;
+      gap_align->s_start = (hsp->subject.offset - hsp->query.offset) + max_offset;
+      hsp->query.gapped_start = gap_align->q_start;
+      hsp->subject.gapped_start = gap_align->s_start;
+   } else {
+      gap_align->q_start = hsp->query.gapped_start;
+      gap_align->s_start = hsp->subject.gapped_start;
+   }
+      
+   if (gap_align->s_start > max_start) {
+      start_shift = (gap_align->s_start / max_start) * max_start;
+      gap_align->subject = gap_align->subject + start_shift;
+      
+      gap_align->s_start %= max_start;
+   } else
+      start_shift = 0;
+   
+   gap_align->subject_length =
+      MIN(gap_align->subject_length - start_shift, 
+          gap_align->s_start + hsp->subject.length + max_start);
+   PerformGappedAlignmentWithTraceback(gap_align);
+   hsp->query.offset = gap_align->query_start;
+   hsp->subject.offset = gap_align->subject_start + start_shift;
+   /* The end is one further for BLAST than for the gapped align. */
+   hsp->query.end = gap_align->query_stop + 1;
+   hsp->subject.end = gap_align->subject_stop + 1 + start_shift;
+   if (gap_align->edit_block && start_shift > 0) {
+      gap_align->edit_block->start2 += start_shift;
+      gap_align->edit_block->length2 += start_shift;
+   }
+   hsp->query.length = hsp->query.end - hsp->query.offset;
+   hsp->subject.length = hsp->subject.end - hsp->subject.offset;
+   hsp->score = gap_align->score;
+   hsp->gap_info = gap_align->edit_block;
+   searchsp_eff = (FloatHi) search->dblen_eff *
+      (FloatHi) search->context[context].query->effective_length;
+   
+   hsp->evalue = 
+      BlastKarlinStoE_simple(hsp->score, search->sbp->kbp[context], 
+                             searchsp_eff);
+   return (Boolean) (hsp->gap_info != NULL);
+}
+
 /* -- the following is inspired from MegaBlastPrintAlignInfo in blastool.c */
 
 int LIBCALLBACK MegaBlastPrintFltHits(VoidPtr ptr) {
@@ -564,7 +665,11 @@ int LIBCALLBACK MegaBlastPrintFltHits(VoidPtr ptr) {
    CharPtr query_seq_buffer, subject_seq_buffer;
    Boolean print_sequences;
    /* vv - geo add-on: */
+   Int4 total_ident;
+   CharPtr line=NULL; /* formatted hit line, for the compressed output */
+   Int4 line_size=0, line_len;
    static Char tmp_buf[1024]; /* text buffer for preparing gap info */
+   Char subject_gi_buff[16];
    Int4 query_no;
    Int4 score, qseg_start, qseg_end;
    Char context_sign;
@@ -572,6 +677,8 @@ int LIBCALLBACK MegaBlastPrintFltHits(VoidPtr ptr) {
           q_beg_over, q_end_over, h_beg_over, h_end_over, beg_ovh, end_ovh, q_gaplens, h_gaplens;
    Int4 dbgaplen, qgaplen;
    Int4 qseg_prev_end, dbseg_prev_end;
+   FloatHi start_time, stage_time, output_time=0, traceback_time=0;
+   Boolean timing;
 
 
    /* ^^ - geo add-on: */
@@ -581,6 +688,8 @@ int LIBCALLBACK MegaBlastPrintFltHits(VoidPtr ptr) {
       return 0;
    }
 
+   timing = search->pbp->mb_params->stage_timing;
+   start_time = timing ? MBStatsClock() : 0.0;
    print_sequences = (getenv("PRINT_SEQUENCES") != NULL);
 
    subject_seq = search->subject->sequence_start + 1;
@@ -639,17 +748,21 @@ int LIBCALLBACK MegaBlastPrintFltHits(VoidPtr ptr) {
    /* -= looping through HSPs =- */
    for (hsp_index=0; hsp_index<search->current_hitlist->hspcnt; hsp_index++) {
       hsp = search->current_hitlist->hsp_array[hsp_index];
-      if (hsp==NULL || (search->pbp->cutoff_e > 0 && 
-                        hsp->evalue > search->pbp->cutoff_e)) {
+      if (hsp==NULL)
+          continue;
+      if (search->pbp->cutoff_e > 0 && hsp->evalue > search->pbp->cutoff_e) {
+          search->stage_stats.hsps_dropped[MB_DROP_EVALUE]++;
 	  continue;
       }
       context = hsp->context;
       /* vv - geo add-on: */
       query_no = (context >> 1);
       /* ^^ - geo add-on: */
-      if (slice_clustering && (qread_base+query_no+db_skipto>search->subject_id)) 
+      if (slice_clustering && (query_ords[query_no]+db_skipto>search->subject_id)) {
            /* skip this hit, don't display it */
+           search->stage_stats.hsps_dropped[MB_DROP_SELF]++;
            continue;
+           }
 
       query_id = search->qid_array[query_no];
 
@@ -667,60 +780,14 @@ int LIBCALLBACK MegaBlastPrintFltHits(VoidPtr ptr) {
       kbp = search->sbp->kbp[context];
       /* If traceback hasn't been done yet, do it now */
       if (!hsp->gap_info) {
-         /* This must have already been allocated */
-         GapAlignBlkPtr gap_align = search->gap_align; 
-         FloatHi searchsp_eff;
-         Int4 max_offset, max_start = MAX_DBSEQ_LEN / 2, start_shift;
-
-         /* Set the X-dropoff to the final X dropoff parameter. */
-         gap_align->x_parameter = search->pbp->gap_x_dropoff_final;
-         gap_align->query = query_seq;
-         gap_align->query_length = query_length;
-         gap_align->subject = subject_seq;
-         gap_align->subject_length = search->subject->length;
-         if ((hsp->query.gapped_start == 0 && hsp->subject.gapped_start == 0) ||
-             CheckStartForGappedAlignment(search, hsp, gap_align->query, gap_align->subject, search->sbp->matrix) == FALSE) {
-            max_offset = GetStartForGappedAlignment(search, hsp, gap_align->query, gap_align->subject, search->sbp->matrix);
-            gap_align->q_start = max_offset;
-            gap_align->s_start = (hsp->subject.offset - hsp->query.offset) + max_offset;
-            hsp->query.gapped_start = gap_align->q_start;
-            hsp->subject.gapped_start = gap_align->s_start;
-         } else {
-            gap_align->q_start = hsp->query.gapped_start;
-            gap_align->s_start = hsp->subject.gapped_start;
-         }
-            
-         if (gap_align->s_start > max_start) {
-            start_shift = (gap_align->s_start / max_start) * max_start;
-            gap_align->subject = gap_align->subject + start_shift;
-            
-            gap_align->s_start %= max_start;
-         } else
-            start_shift = 0;
-         
-         gap_align->subject_length =
-            MIN(gap_align->subject_length - start_shift, 
-                gap_align->s_start + hsp->subject.length + max_start);
-         PerformGappedAlignmentWithTraceback(gap_align);
-         hsp->query.offset = gap_align->query_start;
-         hsp->subject.offset = gap_align->subject_start + start_shift;
-         /* The end is one further for BLAST than for the gapped align. */
-         hsp->query.end = gap_align->query_stop + 1;
-         hsp->subject.end = gap_align->subject_stop + 1 + start_shift;
-         if (gap_align->edit_block && start_shift > 0) {
-            gap_align->edit_block->start2 += start_shift;
-            gap_align->edit_block->length2 += start_shift;
-         }
-         hsp->query.length = hsp->query.end - hsp->query.offset;
-         hsp->subject.length = hsp->subject.end - hsp->subject.offset;
-         hsp->score = gap_align->score;
-         hsp->gap_info = gap_align->edit_block;
-         searchsp_eff = (FloatHi) search->dblen_eff *
-            (FloatHi) search->context[hsp->context].query->effective_length;
-         
-         hsp->evalue = 
-            BlastKarlinStoE_simple(hsp->score, kbp, searchsp_eff);
+         stage_time = timing ? MBStatsClock() : 0.0;
+         MGBTracebackHsp(search, hsp, context, subject_seq);
+         if (timing)
+            traceback_time += MBStatsClock() - stage_time;
+         if (hsp->gap_info == NULL)
+            continue;
          if (hsp->evalue > search->pbp->cutoff_e) {
+            search->stage_stats.hsps_dropped[MB_DROP_EVALUE]++;
             continue;
          }
       }
@@ -874,12 +941,14 @@ int LIBCALLBACK MegaBlastPrintFltHits(VoidPtr ptr) {
                }
        } /* for each segment */
     } /* no gap info needed */
+  total_ident = (Int4) perc_ident;
   perc_ident = perc_ident / align_length * 100;
   /* Avoid printing 100.00 when the hit is not an exact match */
   if (perc_ident >= 99.995 && perc_ident < 100.00)
      perc_ident = 99.99;
 
   if (perc_ident < search->pbp->mb_params->perc_identity) {
+      search->stage_stats.hsps_dropped[MB_DROP_IDENT]++;
       MemFree(start);
       MemFree(length);
       MemFree(strands);
@@ -1016,28 +1085,93 @@ int LIBCALLBACK MegaBlastPrintFltHits(VoidPtr ptr) {
           score = (int)bit_score + (qovl+hovl)-end_ovh-beg_ovh-num_gap_opens-h_gaplens-q_gaplens;
           if (score<=0) score=1; // should never happen.. 
           */
-          if (numeric_sip_type)
-            fprintf(fp, "%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%.2f\t%s\t%s\t%c\n",
+          search->stage_stats.hsps_kept++;
+          MGBCountSketchHit(search, query_no);
+          stage_time = timing ? MBStatsClock() : 0.0;
+          if (hit_clusters!=NULL && MBClusterHitPasses(hit_clusters, 
+                        MIN(qovl, hovl), perc_ident, bit_score)) {
+            CharPtr hit_name=subject_buffer;
+            if (numeric_sip_type) {
+               sprintf(subject_gi_buff, "%ld", (long) subject_gi);
+               hit_name=subject_gi_buff;
+               }
+            if (slice_clustering) /* query ordinals are db OIDs */
+               MBClusterSetLink(hit_clusters, query_ords[query_no]+db_skipto, 
+                     query_buffer, qlen, search->subject_id, hit_name, hlen);
+             else
+               MBClusterSetLink(hit_clusters, 
+                     MBClusterSetIntern(hit_clusters, query_buffer), query_buffer, qlen,
+                     MBClusterSetIntern(hit_clusters, hit_name), hit_name, hlen);
+            }
+          if (hit_writer!=NULL) {
+            MBHitRecord hit_rec;
+            CharPtr gap_blob=NULL;
+            MemSet(&hit_rec, 0, sizeof(hit_rec));
+            hit_rec.query_ord=query_ords[query_no]+(slice_clustering ? db_skipto : 0);
+            hit_rec.subject_oid=search->subject_id;
+            hit_rec.q_start=q_start;
+            hit_rec.q_end=q_end;
+            hit_rec.s_start=s_start;
+            hit_rec.s_end=s_end;
+            hit_rec.score=hsp->score;
+            hit_rec.align_length=align_length;
+            hit_rec.num_ident=total_ident;
+            hit_rec.bit_score=bit_score;
+            hit_rec.evalue=hsp->evalue;
+            hit_rec.strand=(Uint1) context_sign;
+            if (numeric_sip_type) 
+               sprintf(subject_gi_buff, "%ld", (long) subject_gi);
+            if (gap_Info) {
+               gap_blob=(CharPtr) MemNew(qgaps_buf_used+dbgaps_buf_used+2);
+               sprintf(gap_blob, "%s\t%s", qgaps_buf, dbgaps_buf);
+               }
+            MBHitWriterAdd(hit_writer, &hit_rec, query_buffer, qlen,
+               numeric_sip_type ? subject_gi_buff : subject_buffer, hlen, gap_blob);
+            MemFree(gap_blob);
+            }
+          else if (fp==NULL) /* hit table not wanted (-o none) */
+            ;
+          else {
+            line_len = StringLen(query_buffer) + StringLen(subject_buffer) + 160;
+            if (gap_Info)
+               line_len += qgaps_buf_used + dbgaps_buf_used;
+            if (line_len > line_size) {
+               line_size = line_len;
+               line = (CharPtr) Realloc(line, line_size);
+               }
+            if (numeric_sip_type)
+             sprintf(line, "%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%.2f\t%s\t%s\t%c\n",
                query_buffer, qlen, q_start, q_end, subject_gi, hlen, s_start, s_end, 
                      perc_ident, bit_score_buff, eval_buff, context_sign);
-           else {
-            if (gap_Info)
-             fprintf(fp, "%s\t%d\t%d\t%d\t%s\t%d\t%d\t%d\t%.2f\t%s\t%s\t%c\t%s\t%s\n",
+            else if (gap_Info)
+             sprintf(line, "%s\t%d\t%d\t%d\t%s\t%d\t%d\t%d\t%.2f\t%s\t%s\t%c\t%s\t%s\n",
                query_buffer, qlen, q_start, q_end, 
                subject_buffer, hlen, s_start, s_end, 
                      perc_ident, bit_score_buff, eval_buff, context_sign, qgaps_buf, dbgaps_buf);
             else             
-             fprintf(fp, "%s\t%d\t%d\t%d\t%s\t%d\t%d\t%d\t%.2f\t%s\t%s\t%c\n",
+             sprintf(line, "%s\t%d\t%d\t%d\t%s\t%d\t%d\t%d\t%.2f\t%s\t%s\t%c\n",
                query_buffer, qlen, q_start, q_end, 
                subject_buffer, hlen, s_start, s_end, 
                      perc_ident, bit_score_buff, eval_buff, context_sign);
+            if (zout!=NULL)
+               MBZWriterWrite(zout, line, StringLen(line));
+             else
+               fputs(line, fp);
             }         
             /*   query_no+db_skipto>search->subject_id
             fprintf(fp, "%s[%d]\t%d\t%d\t%d\t%s[%d]\t%d\t%d\t%d\t%d\t%d\t%d\t%c\n",
                query_buffer, query_no+db_skipto, qlen, q_start, q_end, 
                subject_buffer, search->subject_id, hlen, s_start, s_end, 
                      (int)perc_ident, (int)bit_score, (int)score, context_sign); */
+          if (timing)
+             output_time += MBStatsClock() - stage_time;
       } /* passed the filter */
+      else if (strcmp(query_buffer, subject_buffer)==0)
+          search->stage_stats.hsps_dropped[MB_DROP_SELF]++;
+      else if (hovl<min_overlap || qovl<min_overlap)
+          search->stage_stats.hsps_dropped[MB_DROP_OVERLAP]++;
+      else
+          search->stage_stats.hsps_dropped[MB_DROP_OVERHANG]++;
 /* ^^ - geo add-on */
 
 
@@ -1051,9 +1185,19 @@ int LIBCALLBACK MegaBlastPrintFltHits(VoidPtr ptr) {
    MemFree(subject_descr);
    MemFree(buffer);
    MemFree(eval_buff);
+   MemFree(line);
 
    sip = SeqIdSetFree(sip);
-   fflush(fp);
+   if (fp!=NULL && hit_writer==NULL && zout==NULL)
+      fflush(fp);
+   if (timing) {
+      search->stage_stats.time[MB_STAGE_TRACEBACK] += traceback_time;
+      search->stage_stats.time[MB_STAGE_OUTPUT] += output_time;
+      search->stage_stats.time[MB_STAGE_FILTER] += 
+         MBStatsClock() - start_time - traceback_time - output_time;
+      MBStageStatsNotePeak(&search->stage_stats, MB_STAGE_TRACEBACK, 
+                           MB_STAGE_OUTPUT);
+   }
    return 0;
 }
 
@@ -1451,6 +1595,143 @@ MegaBlastPrintSegments(VoidPtr ptr)
    return 1;
 }
 
+/* Local Seq-id named after the first word of a defline */
+static SeqIdPtr MGBLocalSeqId(CharPtr title)
+{
+   ObjectIdPtr oip;
+   CharPtr end;
+
+   if (title == NULL)
+      return NULL;
+   for (end = title; *end != NULLB && !IS_WHITESP(*end); end++)
+      continue;
+   oip = ObjectIdNew();
+   oip->str = (CharPtr) MemNew(end - title + 1);
+   StringNCpy(oip->str, title, end - title);
+   return ValNodeAddPointer(NULL, SEQID_LOCAL, oip);
+}
+
+/* -m 10 and -m 11: the Seq-aligns of each database sequence go straight
+   to the ASN.1 output. As for the tabulated output, queries and subjects
+   without a usable id are named after their defline. */
+static int LIBCALLBACK
+MegaBlastWriteSeqAligns(VoidPtr ptr)
+{
+   BlastSearchBlkPtr search = (BlastSearchBlkPtr) ptr;
+   BLAST_HSPPtr hsp; 
+   BLAST_KarlinBlkPtr kbp;
+   BioseqPtr query_bsp;
+   SeqIdPtr sip, subject_id, query_id;
+   SeqAlignPtr seqalign = NULL, last = NULL, sap;
+   ScorePtr score_set;
+   CharPtr subject_descr = NULL;
+   Int4 hsp_index, query_no, query_length, buf_len = 0;
+   FloatHi start_time, bit_score;
+   Boolean timing;
+
+   if (search->current_hitlist == NULL || search->current_hitlist->hspcnt <= 0) {
+      search->subject_info = BLASTSubjectInfoDestruct(search->subject_info);
+      return 0;
+   }
+
+   timing = search->pbp->mb_params->stage_timing;
+   start_time = timing ? MBStatsClock() : 0.0;
+   sip = NULL;
+   if (search->rdfp)
+      readdb_get_descriptor(search->rdfp, search->subject_id, &sip,
+                            &subject_descr);
+   else 
+      sip = SeqIdSetDup(search->subject_info->sip);
+   if (sip == NULL) {
+      ErrPostEx(SEV_WARNING, 0, 0, "No id for database sequence %ld, "
+                "its alignments are not written", (long) search->subject_id);
+      MemFree(subject_descr);
+      return 0;
+   }
+   if (sip->choice == SEQID_GENERAL &&
+       !StringCmp(((DbtagPtr)sip->data.ptrvalue)->db, "BL_ORD_ID") &&
+       subject_descr != NULL)
+      subject_id = MGBLocalSeqId(subject_descr);
+   else
+      subject_id = SeqIdDup(SeqIdFindBestAccession(sip));
+
+   for (hsp_index=0; hsp_index<search->current_hitlist->hspcnt; hsp_index++) {
+      hsp = search->current_hitlist->hsp_array[hsp_index];
+      if (hsp==NULL)
+          continue;
+      if (hsp->gap_info==NULL) {
+          /* the subject is freed by the caller after this callback */
+          if (search->subject->sequence_start == NULL && search->rdfp) {
+             readdb_get_sequence_ex(search->rdfp, search->subject_id, 
+                                    &search->subject->sequence_start, 
+                                    &buf_len, TRUE);
+             search->stage_stats.subject_unpacks++;
+          }
+          if (search->subject->sequence_start == NULL ||
+              !MGBTracebackHsp(search, hsp, hsp->context, 
+                               search->subject->sequence_start + 1))
+             continue;
+      }
+      if (search->pbp->cutoff_e > 0 && hsp->evalue > search->pbp->cutoff_e) {
+          search->stage_stats.hsps_dropped[MB_DROP_EVALUE]++;
+          continue;
+      }
+      query_no = hsp->context >> 1;
+      if (slice_clustering && (query_ords[query_no]+db_skipto>search->subject_id)) {
+           search->stage_stats.hsps_dropped[MB_DROP_SELF]++;
+           continue;
+           }
+      if (search->qid_array[query_no] == NULL)
+         continue;
+
+      /* as MegaBlastSaveCurrentHitlist leaves the edit block */
+      query_length = search->query_context_offsets[hsp->context+1] -
+         search->query_context_offsets[hsp->context] - 1;
+      hsp->gap_info->start1 = hsp->query.offset;
+      hsp->gap_info->start2 = hsp->subject.offset;
+      hsp->gap_info->frame1 = (hsp->context & 1) ? -1 : 1;
+      hsp->gap_info->length1 = query_length;
+
+      query_bsp = BioseqLockById(search->qid_array[query_no]);
+      query_id = MGBLocalSeqId(BioseqGetTitle(query_bsp));
+      BioseqUnlock(query_bsp);
+      if (query_id == NULL)
+         query_id = SeqIdDup(search->qid_array[query_no]);
+
+      sap = GapXEditBlockToSeqAlign(hsp->gap_info, subject_id, query_id);
+      SeqIdFree(query_id);
+      kbp = search->sbp->kbp[hsp->context];
+      bit_score = (hsp->score*kbp->Lambda - kbp->logK) / NCBIMATH_LN2;
+      score_set = NULL;
+      MakeBlastScore(&score_set, "score", 0.0, hsp->score);
+      MakeBlastScore(&score_set, "e_value", 
+                     (hsp->evalue < 1.0e-180) ? 0.0 : hsp->evalue, 0);
+      MakeBlastScore(&score_set, "bit_score", bit_score, 0);
+      if (hsp->num_ident > 0)
+         MakeBlastScore(&score_set, "num_ident", 0.0, hsp->num_ident);
+      sap->score = score_set;
+      if (last == NULL)
+         seqalign = sap;
+      else
+         last->next = sap;
+      for (last = sap; last->next; last = last->next)
+         continue;
+      search->stage_stats.hsps_kept++;
+      MGBCountSketchHit(search, query_no);
+   }
+
+   MBAsnWriterWrite(asn_writer, seqalign);
+   SeqIdFree(subject_id);
+   SeqIdSetFree(sip);
+   MemFree(subject_descr);
+   if (timing) {
+      search->stage_stats.time[MB_STAGE_OUTPUT] += MBStatsClock() - start_time;
+      MBStageStatsNotePeak(&search->stage_stats, MB_STAGE_TRACEBACK, 
+                           MB_STAGE_OUTPUT);
+   }
+   return 0;
+}
+
 /* Breaks up a location like "2000 3000" into two integers 
    that are returned.
 
@@ -1526,7 +1807,18 @@ ARG_MINOVL,
 ARG_DBSKIP,
 ARG_DBSLICE,
 ARG_TABDESCR,
-ARG_BLOCKSIZE
+ARG_BLOCKSIZE,
+ARG_CLUSTERS,
+ARG_CLTHRESH,
+ARG_ZBLOCK,
+ARG_STATSFILE,
+ARG_SERVER,
+ARG_DBRANGE,
+ARG_MEMBUDGET,
+ARG_WORDINDEX,
+ARG_SKETCH,
+ARG_VERIFY,
+ARG_DPEXT
 #else
  ARG_FORCE_OLD
 #endif
@@ -1562,7 +1854,8 @@ static Args myargs [] = {
         "250", NULL, NULL, FALSE, 'b', ARG_INT, 0.0, 0, NULL},     /* ARG_ALIGNMENTS */
   { "Type of output:\n0 - alignment endpoints and score,\n1 - all ungapped segments endpoints,"
      "\n2 - traditional BLAST output,\n3 - tab-delimited one line format,"
-     "\n4 - filtered tabulated hits (default)\n5 - tabulated hits with gap info",
+     "\n4 - filtered tabulated hits (default)\n5 - tabulated hits with gap info"
+     "\n6 - binary hit records (-o file required)\n7 - binary hit records with gap info",
         "4", NULL, NULL, FALSE, 'D', ARG_INT, 0.0, 0, NULL},       /* ARG_OUTTYPE */
   { "Number of processors to use",
         "1", NULL, NULL, FALSE, 'a', ARG_INT, 0.0, 0, NULL},       /* ARG_THREADS */
@@ -1627,7 +1920,8 @@ static Args myargs [] = {
 #ifdef MGBLAST_OPTS
   { "Maximum mismatched overhang allowed on either side [only with -D 4 ]",  /* ARG_MAXOVH */
         "0", NULL, NULL, FALSE, 'H', ARG_INT, 0.0, 0, NULL},
-  { "Minimum overlap length [only with -D 4 option]",              /* ARG_MINOVL */
+  { "Minimum overlap length [only with -D 4 option];\n"
+    "      shorter queries and database sequences are not searched",  /* ARG_MINOVL */
         "0", NULL, NULL, FALSE, 'C', ARG_INT, 0.0, 0, NULL},
   { "Number of db sequences to skip",                                    /* ARG_DBSKIP */
         "0", NULL, NULL, FALSE, 'k', ARG_INT, 0.0, 0, NULL},
@@ -1636,7 +1930,46 @@ static Args myargs [] = {
   { "Append query or subject description as the last field of -D4 output: 0=none, 1=qry. descr., 2=subj descr.",
         "0", NULL, NULL, FALSE, 'n', ARG_INT, 0.0, 0, NULL},           /* ARG_TABDESCR */
   { "Number of query sequences to load&process at once",
-	"4000", NULL, NULL, FALSE, 'V', ARG_INT, 0.0, 0, NULL}        /* ARG_BLOCKSIZE */
+	"4000", NULL, NULL, FALSE, 'V', ARG_INT, 0.0, 0, NULL},       /* ARG_BLOCKSIZE */
+  { "Cluster the filtered hits in memory and write the clusters (blastclust format)\n"
+    "to this file [only with -D 4 to -D 7]; use -o none to skip the hit table",
+	NULL, NULL, NULL, TRUE, 'c', ARG_FILE_OUT, 0.0, 0, NULL},      /* ARG_CLUSTERS */
+  { "Minimum overlap,percent identity,bit score for a hit to join two clusters [with -c]",
+	"0,0,0", NULL, NULL, FALSE, 'j', ARG_STRING, 0.0, 0, NULL},    /* ARG_CLTHRESH */
+  { "Compress the output (gzip format) in blocks of this many KB, using -a threads\n"
+    "[only with -D 4 or -D 5; 0 = no compression]",
+	"0", NULL, NULL, FALSE, 'Y', ARG_INT, 0.0, 0, NULL},           /* ARG_ZBLOCK */
+  { "Write per stage timing and counters, per thread, as JSON lines to this file\n"
+    "(one record for each query block and one for the whole run)",
+	NULL, NULL, NULL, TRUE, 'u', ARG_FILE_OUT, 0.0, 0, NULL},      /* ARG_STATSFILE */
+  { "Stay resident and serve searches of this database on this local TCP port;\n"
+    "requests are sent with mgblastc and may change the other options\n"
+    "[0 = single run]",
+	"0", "0", "65535", FALSE, 'N', ARG_INT, 0.0, 0, NULL},         /* ARG_SERVER */
+  { "Search only the database sequences with ordinal ids in start:end (0-based,\n"
+    "end excluded; no end = to the end of the database), see mgshard",
+	NULL, NULL, NULL, TRUE, 'x', ARG_STRING, 0.0, 0, NULL},        /* ARG_DBRANGE */
+  { "Memory budget in megabytes: query blocks are cut short so that their\n"
+    "estimated footprint stays within it, and the HSPs kept per database\n"
+    "sequence are capped (the lowest scoring ones are dropped) [0 = none]",
+	"0", "0", NULL, FALSE, 'B', ARG_INT, 0.0, 0, NULL},            /* ARG_MEMBUDGET */
+  { "Take the seeds from the database word index built by formatdb -W instead\n"
+    "of scanning the whole database [word size 11 or more, single database;\n"
+    "same results with an index of stride 4]",
+	"F", NULL, NULL, FALSE, 't', ARG_BOOLEAN, 0.0, 0, NULL},       /* ARG_WORDINDEX */
+  { "Minimizer sketch prefilter for all-vs-all runs: only search the query-\n"
+    "database sequence pairs sharing at least this many sketch minimizers on\n"
+    "one diagonal band [0 = search all pairs]; N,R searches all pairs anyway\n"
+    "and reports the fraction of the hits the prefilter keeps (recall)",
+	"0", NULL, NULL, FALSE, 'h', ARG_STRING, 0.0, 0, NULL},        /* ARG_SKETCH */
+  { "Verify each seed with a bit-parallel edit distance bound before the gapped\n"
+    "extension and drop those that cannot give a hit passing -p, -H and -C\n"
+    "[-D 4 and up with -H; same hits]",
+	"F", NULL, NULL, FALSE, 'w', ARG_BOOLEAN, 0.0, 0, NULL},       /* ARG_VERIFY */
+  { "Gapped extension: 0 = greedy, 1 = dynamic programming, 2 = dynamic\n"
+    "programming scored with the vectorized kernel [1 and 2 need affine gap\n"
+    "costs (-G, -E); 2 gives the same hits as 1]",
+	"0", "0", "2", FALSE, 'g', ARG_INT, 0.0, 0, NULL}              /* ARG_DPEXT */
 #else
 /* -- end of mgblast clustering features -- */
 #ifdef MB_ALLOW_NEW
@@ -1647,14 +1980,313 @@ static Args myargs [] = {
 };
 
 #define MAX_NUM_QUERIES 16383 /* == 1/2 INT2_MAX */
+#define MB_MIN_HSP_BUFFER 1000 /* lowest per subject HSP cap under -B */
+
+#ifdef MGBLAST_OPTS
+/* Length of the longest sequence of the database(s), for the -B memory
+   estimate */
+static Int4 MGBMaxDbLength(CharPtr database, Boolean db_is_na)
+{
+   ReadDBFILEPtr rdfp, rdfp_var;
+   Int4 max_length = 0;
+
+   rdfp = (server_rdfp != NULL) ? server_rdfp : readdb_new(database, !db_is_na);
+   for (rdfp_var = rdfp; rdfp_var; rdfp_var = rdfp_var->next)
+      max_length = MAX(max_length, readdb_get_maxlen(rdfp_var));
+   if (rdfp != server_rdfp)
+      readdb_destruct(rdfp);
+   return max_length;
+}
+#endif
+
+/* Query blocks. MGBQueryBlockLoad reads a block of queries, masks them and
+   sets up its search, lookup table included. When threads are available
+   a loader thread does that for the next block while the current one is
+   searched; the two block buffers are used in turn, so no more than two
+   blocks are ever in memory. */
+typedef struct mgb_query_block {
+   SeqEntryPtr PNTR sepp;
+   BioseqPtr PNTR query_bsp_array; /* NULL terminated */
+   Int4Ptr query_ords;        /* read ordinals, see query_ords */
+   Int4Ptr query_oids;        /* database OIDs of the queries for the slice
+                                 outputs, NULL if not needed */
+   Int4 num_bsps;
+   Int4 num_read;             /* queries read, with the skipped ones */
+   Int4 num_skipped;          /* queries shorter than -C */
+   Boolean done;              /* the input ends with this block */
+   Boolean failed;
+   BLAST_OptionsBlk options;  /* copy of the options with the lower case
+                                 mask and the query OIDs of this block */
+   MBPreparedSearchPtr prep;  /* the search, set up */
+} MGBQueryBlock, PNTR MGBQueryBlockPtr;
+
+typedef struct mgb_query_loader {
+   FILE *infp;
+   BLAST_OptionsBlkPtr options;
+   CharPtr program, database;
+   Boolean query_is_na, believe_query, lcase_masking;
+   Int2 ctr;
+   Int4 max_total_length;     /* -M */
+   Int8 memory_budget;        /* -B share of one block */
+   Int4 max_db_length;
+   Boolean budget_warned;
+   SeqEntryPtr pending_sep;   /* the query cutting the last block short */
+   SeqLocPtr pending_mask;
+   MGBQueryBlock blocks[2];
+   Int4 num_taken;            /* blocks handed to the search so far */
+   TNlmThread thread;         /* NULL when the blocks are loaded in turn */
+   TNlmSemaphore free_blocks, loaded_blocks;
+} MGBQueryLoader, PNTR MGBQueryLoaderPtr;
+
+static void MGBQueryBlockLoad(MGBQueryLoaderPtr loader, MGBQueryBlockPtr block)
+{
+   BLAST_OptionsBlkPtr options = loader->options;
+   BioseqPtr query_bsp;
+   BioSourcePtr source;
+   SeqLocPtr mask_slp, last_mask;
+   Int4 index, num_bsps, total_length;
+   Char prefix[2];
+
+   num_bsps = 0;
+   total_length = 0;
+   block->num_read = block->num_skipped = 0;
+   block->done = TRUE;
+   block->failed = FALSE;
+   block->prep = NULL;
+   MemCopy(&block->options, options, sizeof(BLAST_OptionsBlk));
+   block->options.query_lcase_mask = NULL;
+   block->options.mb_query_oids = NULL;
+   StrCpy(prefix, "");
+   SeqMgrHoldIndexing(TRUE);
+   mask_slp = last_mask = NULL;
+
+   while ((block->sepp[num_bsps] = (loader->pending_sep != NULL) ? 
+           loader->pending_sep :
+           FastaToSeqEntryForDb(loader->infp, loader->query_is_na, NULL,
+                                loader->believe_query, prefix, &loader->ctr, 
+                                &mask_slp)) != NULL) {
+      if (loader->pending_sep != NULL) {
+         /* the query left over from the previous block */
+         mask_slp = loader->pending_mask;
+         loader->pending_sep = NULL;
+         loader->pending_mask = NULL;
+      }
+      if (!loader->lcase_masking) /* Lower case ignored */
+         mask_slp = SeqLocFree(mask_slp);
+      query_bsp = NULL;
+      SeqEntryExplore(block->sepp[num_bsps], &query_bsp, FindNuc);
+
+      if (query_bsp == NULL) {
+         ErrPostEx(SEV_FATAL, 1, 0, "Unable to obtain bioseq\n");
+         block->failed = TRUE;
+         break;
+      }
+      block->num_read++;
+      /* a query shorter than -C cannot have a reportable hit */
+      if (query_bsp->length < options->mb_min_subject_length) {
+         mask_slp = SeqLocFree(mask_slp);
+         block->sepp[num_bsps] = SeqEntryFree(block->sepp[num_bsps]);
+         block->num_skipped++;
+         continue;
+      }
+      if (loader->memory_budget > 0 &&
+          MegaBlastMemoryEstimate(options, total_length + query_bsp->length, 
+             num_bsps + 1, loader->max_db_length) > loader->memory_budget) {
+         if (num_bsps > 0) {
+            /* cut the block short, this query starts the next one */
+            loader->pending_sep = block->sepp[num_bsps];
+            loader->pending_mask = mask_slp;
+            block->sepp[num_bsps] = NULL;
+            mask_slp = NULL;
+            block->num_read--;
+            block->done = FALSE;
+            break;
+         }
+         if (!loader->budget_warned)
+            ErrPostEx(SEV_WARNING, 0, 0, "Query %ld (%ld bases) "
+                      "alone needs more than the %ld MB memory "
+                      "budget of a block, searching one query at a time",
+                      (long) (qread_base + block->num_read), 
+                      (long) query_bsp->length,
+                      (long) (loader->memory_budget >> 20));
+         loader->budget_warned = TRUE;
+      }
+      if (mask_slp) {
+         if (!last_mask)
+            block->options.query_lcase_mask = last_mask = mask_slp;
+         else {
+            last_mask->next = mask_slp;
+            last_mask = last_mask->next;
+         }
+         mask_slp = NULL;
+      }
+
+      source = BioSourceNew();
+      source->org = OrgRefNew();
+      source->org->orgname = OrgNameNew();
+      source->org->orgname->gcode = options->genetic_code;
+      ValNodeAddPointer(&(query_bsp->descr), Seq_descr_source, source);
+
+      block->query_ords[num_bsps] = qread_base + block->num_read - 1;
+      block->query_bsp_array[num_bsps++] = query_bsp;
+
+      total_length += query_bsp->length;
+      if (total_length > loader->max_total_length || 
+          num_bsps >= max_num_queries) {
+         block->done = FALSE;
+         break;
+      }
+   }
+   block->query_bsp_array[num_bsps] = NULL;
+   block->num_bsps = num_bsps;
+   qread_base += block->num_read;
+   SeqMgrHoldIndexing(FALSE);
+
+   if (num_bsps == 0 || block->failed)
+      return;
+   if (block->query_oids != NULL) {
+      for (index = 0; index < num_bsps; index++)
+         block->query_oids[index] = block->query_ords[index] + db_skipto;
+      block->options.mb_query_oids = block->query_oids;
+   }
+   block->prep = BioseqMegaBlastEnginePrepare(block->query_bsp_array, 
+                    loader->program, loader->database, &block->options, 
+                    NULL, NULL, 0);
+}
+
+/* TRUE if no block follows this one */
+static Boolean MGBQueryBlockIsLast(MGBQueryBlockPtr block)
+{
+   return (block->done || block->failed || block->num_bsps == 0);
+}
+
+static VoidPtr LIBCALLBACK MGBQueryLoaderThread(VoidPtr data)
+{
+   MGBQueryLoaderPtr loader = (MGBQueryLoaderPtr) data;
+   MGBQueryBlockPtr block;
+   Int4 num_loaded = 0;
+
+   do {
+      NlmSemaWait(loader->free_blocks);
+      block = &loader->blocks[num_loaded++ % 2];
+      MGBQueryBlockLoad(loader, block);
+      NlmSemaPost(loader->loaded_blocks);
+   } while (!MGBQueryBlockIsLast(block));
+
+   return NULL;
+}
+
+/* Sets up the loading of the query blocks; with_oids asks for the query
+   OIDs (slice outputs), pipelined for a loader thread */
+static void MGBQueryLoaderInit(MGBQueryLoaderPtr loader, FILE *infp,
+               BLAST_OptionsBlkPtr options, CharPtr program, CharPtr database,
+               Boolean query_is_na, Boolean believe_query, 
+               Boolean lcase_masking, Int8 memory_budget, Int4 max_db_length,
+               Boolean with_oids, Boolean pipelined)
+{
+   Int4 index;
+
+   MemSet(loader, 0, sizeof(MGBQueryLoader));
+   loader->infp = infp;
+   loader->options = options;
+   loader->program = program;
+   loader->database = database;
+   loader->query_is_na = query_is_na;
+   loader->believe_query = believe_query;
+   loader->lcase_masking = lcase_masking;
+   loader->ctr = 1;
+   loader->max_total_length = myargs[ARG_MAXQUERY].intvalue;
+   loader->memory_budget = memory_budget;
+   loader->max_db_length = max_db_length;
+   pipelined = (pipelined && NlmThreadsAvailable());
+   /* two blocks are in memory at a time then */
+   if (pipelined)
+      loader->memory_budget /= 2;
+   for (index = 0; index < 2; index++) {
+      loader->blocks[index].sepp = (SeqEntryPtr PNTR) 
+         MemNew(max_num_queries*sizeof(SeqEntryPtr));
+      loader->blocks[index].query_bsp_array = (BioseqPtr PNTR) 
+         MemNew((max_num_queries+1)*sizeof(BioseqPtr));
+      loader->blocks[index].query_ords = (Int4Ptr) 
+         MemNew(max_num_queries*sizeof(Int4));
+      if (with_oids)
+         loader->blocks[index].query_oids = (Int4Ptr) 
+            MemNew(max_num_queries*sizeof(Int4));
+   }
+   if (pipelined) {
+      loader->free_blocks = NlmSemaInit(2);
+      loader->loaded_blocks = NlmSemaInit(0);
+      loader->thread = NlmThreadCreate(MGBQueryLoaderThread, loader);
+      if (loader->thread == NULL_thread) {
+         ErrPostEx(SEV_WARNING, 0, 0, "Unable to start the query loader "
+                   "thread, loading the query blocks in turn");
+         NlmSemaDestroy(loader->free_blocks);
+         NlmSemaDestroy(loader->loaded_blocks);
+         loader->thread = NULL_thread;
+         loader->memory_budget = memory_budget;
+      }
+   }
+}
+
+/* The next block of queries, loaded and set up */
+static MGBQueryBlockPtr MGBQueryLoaderNext(MGBQueryLoaderPtr loader)
+{
+   MGBQueryBlockPtr block = &loader->blocks[loader->num_taken++ % 2];
+
+   if (loader->thread != NULL_thread)
+      NlmSemaWait(loader->loaded_blocks);
+   else
+      MGBQueryBlockLoad(loader, block);
+   return block;
+}
+
+/* Done with the block: its queries are freed if free_queries is set and
+   its buffer is handed back to the loader */
+static void MGBQueryBlockRelease(MGBQueryLoaderPtr loader, 
+                                 MGBQueryBlockPtr block, Boolean free_queries)
+{
+   Int4 index;
+
+   block->options.query_lcase_mask = 
+      SeqLocSetFree(block->options.query_lcase_mask);
+   for (index = 0; index < block->num_bsps; index++) {
+      if (free_queries)
+         block->sepp[index] = SeqEntryFree(block->sepp[index]);
+      block->query_bsp_array[index] = NULL;
+   }
+   block->num_bsps = 0;
+   if (loader->thread != NULL_thread)
+      NlmSemaPost(loader->free_blocks);
+}
+
+static void MGBQueryLoaderFree(MGBQueryLoaderPtr loader)
+{
+   VoidPtr status;
+   Int4 index;
+
+   if (loader->thread != NULL_thread) {
+      /* the loader thread stops after the last block */
+      NlmThreadJoin(loader->thread, &status);
+      NlmSemaDestroy(loader->free_blocks);
+      NlmSemaDestroy(loader->loaded_blocks);
+      loader->thread = NULL_thread;
+   }
+   loader->pending_sep = SeqEntryFree(loader->pending_sep);
+   loader->pending_mask = SeqLocSetFree(loader->pending_mask);
+   for (index = 0; index < 2; index++) {
+      MemFree(loader->blocks[index].sepp);
+      MemFree(loader->blocks[index].query_bsp_array);
+      MemFree(loader->blocks[index].query_ords);
+      MemFree(loader->blocks[index].query_oids);
+   }
+}
 
 
 static Int2 Main_old (void)
  
 {
    AsnIoPtr aip, xml_aip = NULL;
-   BioseqPtr query_bsp, PNTR query_bsp_array;
-   BioSourcePtr source;
+   BioseqPtr PNTR query_bsp_array;
    BLAST_MatrixPtr matrix;
    BLAST_OptionsBlkPtr options;
    BLAST_KarlinBlkPtr ka_params=NULL, ka_params_gap=NULL;
@@ -1665,19 +2297,26 @@ static Int2 Main_old (void)
    Int4 number_of_descriptions, number_of_alignments;
    SeqAlignPtr  seqalign, PNTR seqalign_array;
    SeqAnnotPtr seqannot;
-   SeqEntryPtr PNTR sepp;
    TxDfDbInfoPtr dbinfo=NULL, dbinfo_head;
    Uint1 align_type, align_view;
    Uint4 align_options, print_options;
    ValNodePtr mask_loc, mask_loc_start, next_mask_loc;
    ValNodePtr vnp, other_returns, error_returns;
+   MBSearchStats block_stats, run_stats;
+   FILE *statsfp=NULL;
+   Int4 block_no=0;
+   Int8 memory_budget=0;
+   Int4 max_db_length=0;
+   MBWordIndexPtr word_index=NULL;
+   MBSketchIndexPtr sketch_index=NULL;
+   Uint4Ptr length_mask=NULL;
+   MGBQueryLoader loader;
+   MGBQueryBlockPtr block;
    
    CharPtr blast_program, blast_database, blast_inputfile, blast_outputfile;
    FILE *infp, *outfp, *mqfp=NULL;
-   Int4 index, num_bsps, total_length, total_processed = 0;
-   Int2 ctr = 1;
-   Char prefix[2];
-   SeqLocPtr last_mask, mask_slp;
+   Int4 index, num_bsps, total_processed = 0;
+   SeqLocPtr mask_slp;
    Boolean done, hits_found;
    Boolean lcase_masking;
    MBXmlPtr mbxp = NULL;
@@ -1691,13 +2330,21 @@ static Int2 Main_old (void)
 	if (myargs[ARG_HTML].intvalue)
 		html = TRUE;
 
-	if ((infp = FileOpen(blast_inputfile, "r")) == NULL) {
+	if (server_infp != NULL)
+	   infp = server_infp;
+	else if ((infp = FileOpen(blast_inputfile, "r")) == NULL) {
 	   ErrPostEx(SEV_FATAL, 1, 0, "blast: Unable to open input file %s\n", blast_inputfile);
 	   return (1);
 	}
 
 	align_view = (Int1) myargs[ARG_FORMAT].intvalue;
 	outfp = NULL;
+    #ifdef MGBLAST_OPTS
+    /* with in-process clustering the hit table itself is optional */
+    if (hit_clusters!=NULL && blast_outputfile!=NULL && 
+             StringICmp(blast_outputfile, "none")==0)
+        blast_outputfile=NULL;
+    #endif
 
     traditional_formatting = 
         (myargs[ARG_OUTTYPE].intvalue == MBLAST_ALIGNMENTS 
@@ -1706,10 +2353,22 @@ static Int2 Main_old (void)
          #endif
          );
 
-	if ((!traditional_formatting ||
+    #ifdef MGBLAST_OPTS
+    if ((myargs[ARG_OUTTYPE].intvalue == MBLAST_BINHITS || 
+          myargs[ARG_OUTTYPE].intvalue == MBLAST_BINGAPS) && blast_outputfile != NULL &&
+          StringCmp(blast_outputfile, "stdout") == 0) {
+        ErrPostEx(SEV_FATAL, 1, 0, "binary hit output (-D %ld) needs an output file (-o)", 
+                  (long) myargs[ARG_OUTTYPE].intvalue);
+        return 1;
+        }
+    #endif
+	if (server_outfp != NULL)
+	   outfp = server_outfp;
+	else if ((!traditional_formatting ||
             (align_view != 7 && align_view != 10 && align_view != 11)) && 
             blast_outputfile != NULL) {
-	   if ((outfp = FileOpen(blast_outputfile, "w")) == NULL) {
+	   if ((outfp = FileOpen(blast_outputfile, 
+                 myargs[ARG_OUTTYPE].intvalue >= MBLAST_BINHITS ? "wb" : "w")) == NULL) {
 	      ErrPostEx(SEV_FATAL, 1, 0, "blast: Unable to open output file %s\n", blast_outputfile);
 	      return (1);
 	   }
@@ -1726,9 +2385,9 @@ static Int2 Main_old (void)
     /* Geo add-on -- we NEVER care about NCBI's defline parsing! */
     believe_query = FALSE;
     /* If ASN.1 output is requested and believe_query is not set to TRUE,
-       exit with an error. */
-    if (!believe_query && (myargs[ARG_ASNOUT].strvalue ||
-                           align_view == 10 || align_view == 11)) {
+       exit with an error; the streamed -m 10/11 output names the queries
+       after their deflines instead (see MegaBlastWriteSeqAligns) */
+    if (!believe_query && myargs[ARG_ASNOUT].strvalue) {
         ErrPostEx(SEV_FATAL, 1, 0, 
                   "-J option must be TRUE to produce ASN.1 output; before "
                   "changing -J to TRUE please also ensure that all query "
@@ -1747,6 +2406,9 @@ static Int2 Main_old (void)
 	options->hitlist_size = MAX(number_of_descriptions, number_of_alignments);
         #ifdef MGBLAST_OPTS
           if (db_skipto>0) options->first_db_seq=db_skipto;
+          if (db_range_start>options->first_db_seq) 
+             options->first_db_seq=db_range_start;
+          if (db_range_end>0) options->final_db_seq=db_range_end;
         #endif
 	if (myargs[ARG_XDROP].intvalue != 0)
            options->gap_x_dropoff = myargs[ARG_XDROP].intvalue;
@@ -1800,6 +2462,95 @@ static Int2 Main_old (void)
         options->mb_template_length = 0;
         options->mb_one_base_step = (Boolean)0;
         options->mb_disc_type = 0;
+#endif
+#ifdef MGBLAST_OPTS
+        options->shared_rdfp = server_rdfp;
+        /* -C applies to both sequences of a hit, so shorter subjects and
+           queries need not be searched at all */
+        if (myargs[ARG_OUTTYPE].intvalue >= MBLAST_FLTHITS)
+           options->mb_min_subject_length = min_overlap;
+        /* read the subject lengths once rather than for each query block */
+        if (options->mb_min_subject_length > 0) {
+           ReadDBFILEPtr rdfp = (server_rdfp != NULL) ? server_rdfp :
+              readdb_new(blast_database, !db_is_na);
+
+           length_mask = 
+              MegaBlastSubjectLengthMask(rdfp, options->mb_min_subject_length);
+           if (rdfp != server_rdfp)
+              readdb_destruct(rdfp);
+           options->mb_length_mask = length_mask;
+        }
+        if (myargs[ARG_MEMBUDGET].intvalue > 0) {
+           memory_budget = ((Int8) myargs[ARG_MEMBUDGET].intvalue) << 20;
+           max_db_length = MGBMaxDbLength(blast_database, db_is_na);
+           /* an eighth of the budget for the HSPs saved by the threads,
+              counting a few hundred bytes per HSP with its traceback */
+           options->mb_hsp_buffer_max = (Int4) 
+              MIN(memory_budget / 8 / MAX(options->number_of_cpus, 1) / 256,
+                  INT4_MAX);
+           options->mb_hsp_buffer_max = 
+              MAX(options->mb_hsp_buffer_max, MB_MIN_HSP_BUFFER);
+        }
+        if (myargs[ARG_WORDINDEX].intvalue) {
+           if (options->wordsize < 11 || StringChr(blast_database, ' '))
+              ErrPostEx(SEV_WARNING, 0, 0, "The word index needs a single "
+                        "database and a word size of 11 or more, scanning "
+                        "the database instead");
+           else {
+              ReadDBFILEPtr rdfp = (server_rdfp != NULL) ? server_rdfp :
+                 readdb_new(blast_database, !db_is_na);
+
+              if (rdfp != NULL)
+                 word_index = MBWordIndexOpen(blast_database, rdfp);
+              if (rdfp != server_rdfp)
+                 readdb_destruct(rdfp);
+              if (word_index == NULL)
+                 ErrPostEx(SEV_WARNING, 0, 0, "No usable word index for %s,"
+                           " scanning the database instead", blast_database);
+              options->mb_word_index = word_index;
+           }
+        }
+        /* the seeds are verified against the -D 4 filter */
+        if (myargs[ARG_VERIFY].intvalue && 
+            myargs[ARG_OUTTYPE].intvalue >= MBLAST_FLTHITS && 
+            max_overhang > 0)
+           options->mb_verify_overhang = max_overhang;
+        if (myargs[ARG_SKETCH].strvalue != NULL && 
+            atoi(myargs[ARG_SKETCH].strvalue) > 0) {
+           CharPtr recall = StringChr(myargs[ARG_SKETCH].strvalue, ',');
+
+           if (!db_is_na || StringChr(blast_database, ' '))
+              ErrPostEx(SEV_WARNING, 0, 0, "The sketch prefilter needs a "
+                        "single nucleotide database, searching all pairs");
+           else {
+              ReadDBFILEPtr rdfp = (server_rdfp != NULL) ? server_rdfp :
+                 readdb_new(blast_database, !db_is_na);
+              FloatHi sketch_time = MBStatsClock();
+
+              if (rdfp != NULL)
+                 sketch_index = MBSketchIndexNew(rdfp, options->first_db_seq,
+                    options->final_db_seq, options->wordsize, 
+                    atoi(myargs[ARG_SKETCH].strvalue), 
+                    options->mb_min_subject_length);
+              if (rdfp != server_rdfp)
+                 readdb_destruct(rdfp);
+              if (sketch_index == NULL)
+                 ErrPostEx(SEV_WARNING, 0, 0, "Unable to sketch %s, "
+                           "searching all pairs", blast_database);
+              else if (myargs[ARG_LOGINFO].intvalue)
+                 fprintf(stderr, "Sketched %ld database sequences in %.2fs: "
+                         "%ld minimizers (k=%ld, w=%ld), %ld too frequent "
+                         "ones dropped\n", (long) sketch_index->num_oids,
+                         MBStatsClock() - sketch_time, 
+                         (long) sketch_index->num_entries,
+                         (long) sketch_index->kmer, 
+                         (long) sketch_index->window, 
+                         (long) sketch_index->num_dropped);
+              options->mb_sketch_index = sketch_index;
+              options->mb_sketch_recall = (Boolean) 
+                 (recall != NULL && TO_UPPER(recall[1]) == 'R');
+           }
+        }
 #endif
         lcase_masking = (Boolean) myargs[ARG_LCASE].intvalue;
         /* Allow dynamic programming gapped extension only with affine 
@@ -1808,6 +2559,19 @@ static Int2 Main_old (void)
         if (options->gap_open != 0 || options->gap_extend != 0)
            options->mb_use_dyn_prog = (Boolean) myargs[ARG_DYNAMIC].intvalue;
         #endif
+#ifdef MGBLAST_OPTS
+        if (myargs[ARG_DPEXT].intvalue > 0) {
+           if (options->gap_open != 0 || options->gap_extend != 0) {
+              options->mb_use_dyn_prog = TRUE;
+              options->vector_dp =
+                 (Boolean) (myargs[ARG_DPEXT].intvalue == 2);
+           } else {
+              ErrPostEx(SEV_WARNING, 0, 0, "-g %ld needs affine gap costs "
+                        "(-G, -E); using the greedy extension",
+                        (long) myargs[ARG_DPEXT].intvalue);
+           }
+        }
+#endif
         print_options = 0;
         align_options = 0;
         align_options += TXALIGN_COMPRESS;
@@ -1860,13 +2624,43 @@ static Int2 Main_old (void)
         /*if (options->megablast_full_deflines)
           believe_query = FALSE;*/
 
-	query_bsp_array = (BioseqPtr PNTR) MemNew((max_num_queries+1)*sizeof(BioseqPtr));
-	sepp = (SeqEntryPtr PNTR) MemNew(max_num_queries*sizeof(SeqEntryPtr));
-
-	StrCpy(prefix, "");
 
 	global_fp = outfp;
         options->output = outfp;
+        MemSet(&block_stats, 0, sizeof(block_stats));
+        MemSet(&run_stats, 0, sizeof(run_stats));
+        options->search_stats = &block_stats;
+        #ifdef MGBLAST_OPTS
+        if (myargs[ARG_STATSFILE].strvalue != NULL &&
+            (statsfp = FileOpen(myargs[ARG_STATSFILE].strvalue, "w")) == NULL) {
+           ErrPostEx(SEV_FATAL, 1, 0, "blast: Unable to open output file %s\n", 
+                     myargs[ARG_STATSFILE].strvalue);
+           return 1;
+           }
+        /* the stage times are only reported in the statistics file */
+        options->mb_stage_timing = (statsfp != NULL);
+        #endif
+        #ifdef MGBLAST_OPTS
+        if (outfp != NULL && (myargs[ARG_OUTTYPE].intvalue == MBLAST_BINHITS || 
+                              myargs[ARG_OUTTYPE].intvalue == MBLAST_BINGAPS)) {
+           hit_writer = MBHitWriterNew(outfp, blast_outputfile, 
+              (myargs[ARG_OUTTYPE].intvalue == MBLAST_BINGAPS ? MBHIT_FLAG_GAPINFO : 0) |
+              (slice_clustering ? MBHIT_FLAG_SLICE : 0));
+           if (hit_writer == NULL)
+              return 1;
+        }
+        if (outfp != NULL && myargs[ARG_ZBLOCK].intvalue > 0) {
+           if (myargs[ARG_OUTTYPE].intvalue != MBLAST_FLTHITS && 
+                    myargs[ARG_OUTTYPE].intvalue != MBLAST_HITGAPS) {
+              ErrPostEx(SEV_FATAL, 1, 0, "-Y option can only be used with -D 4 or -D 5");
+              return 1;
+           }
+           zout = MBZWriterNew(outfp, myargs[ARG_ZBLOCK].intvalue*1024, 
+                               MAX(myargs[ARG_THREADS].intvalue, 1), MBZ_DEFAULT_LEVEL);
+           if (zout == NULL)
+              return 1;
+        }
+        #endif
 
 	if (traditional_formatting) {
         
@@ -1914,6 +2708,12 @@ static Int2 Main_old (void)
         if (align_view == 7) {
            xml_aip = AsnIoOpen(blast_outputfile, "wx");
         }
+        #ifdef MGBLAST_OPTS
+        /* the ASN.1 output is written as the search goes */
+        if (aip != NULL && (align_view == 10 || align_view == 11) &&
+            myargs[ARG_ASNOUT].strvalue == NULL)
+           asn_writer = MBAsnWriterNew(aip, align_type);
+        #endif
 
         if (myargs[ARG_QUERYLOC].strvalue) {       
             Int4 start, end;
@@ -1922,92 +2722,67 @@ static Int2 Main_old (void)
             options->required_end = end -1;
         }
 
+        /* the next query block is loaded and its lookup table built while
+           the current one is searched, except for the traditional output,
+           formatted between the searches, and in server mode, where the
+           next request is not read before the hits of the current one
+           are sent; the slice outputs drop the hits of a query with itself
+           and with the database sequences before it, so the engine is 
+           told not to look for them */
+        MGBQueryLoaderInit(&loader, infp, options, blast_program, 
+           blast_database, query_is_na, believe_query, lcase_masking,
+           memory_budget, max_db_length,
+           (Boolean) (slice_clustering && 
+                      (myargs[ARG_OUTTYPE].intvalue >= MBLAST_FLTHITS || 
+                       asn_writer != NULL)),
+           (Boolean) (!traditional_formatting && server_infp == NULL));
+
 	done = FALSE;
 	while (!done) {
-	   num_bsps = 0;
-	   total_length = 0;
-	   done = TRUE;
-	   SeqMgrHoldIndexing(TRUE);
-	   mask_slp = last_mask = NULL;
-   
-	   while ((sepp[num_bsps]=FastaToSeqEntryForDb(infp, query_is_na, NULL,
-						       believe_query, prefix, &ctr, 
-						       &mask_slp)) != NULL) {
-              if (!lcase_masking) /* Lower case ignored */
-                 mask_slp = SeqLocFree(mask_slp);
-	      if (mask_slp) {
-		 if (!last_mask)
-		    options->query_lcase_mask = last_mask = mask_slp;
-		 else {
-		    last_mask->next = mask_slp;
-		    last_mask = last_mask->next;
-		 }
-		 mask_slp = NULL;
-	      }
-	      query_bsp = NULL;
-              SeqEntryExplore(sepp[num_bsps], &query_bsp, FindNuc);
-
-	      if (query_bsp == NULL) {
-		 ErrPostEx(SEV_FATAL, 1, 0, "Unable to obtain bioseq\n");
-		 return 2;
-	      }
-	      
-	      source = BioSourceNew();
-	      source->org = OrgRefNew();
-	      source->org->orgname = OrgNameNew();
-	      source->org->orgname->gcode = options->genetic_code;
-	      ValNodeAddPointer(&(query_bsp->descr), Seq_descr_source, source);
-	      
-	      query_bsp_array[num_bsps++] = query_bsp;
-	      
-	      total_length += query_bsp->length;
-	      if (total_length > myargs[ARG_MAXQUERY].intvalue || 
-		  num_bsps >= max_num_queries) {
-		 done = FALSE;
-		 break;
-	      }
+	   block = MGBQueryLoaderNext(&loader);
+	   if (block->failed) {
+	      MGBQueryLoaderFree(&loader);
+	      return 2;
 	   }
-
+	   done = block->done;
+	   num_bsps = block->num_bsps;
            if (num_bsps == 0)
                break;
+	   query_bsp_array = block->query_bsp_array;
+	   query_ords = block->query_ords;
 
-	   SeqMgrHoldIndexing(FALSE);
 	   other_returns = NULL;
 	   error_returns = NULL;
 	   
-           
-           if (myargs[ARG_OUTTYPE].intvalue==MBLAST_FLTHITS) {
-	      seqalign_array = BioseqMegaBlastEngine(query_bsp_array, blast_program,
-						     blast_database, options,
+           /* no progress callback for the hit outputs: its ticker thread 
+              sleeps in one second steps and each search would wait for it
+              to end */
+           if (myargs[ARG_OUTTYPE].intvalue==MBLAST_FLTHITS ||
+               myargs[ARG_OUTTYPE].intvalue==MBLAST_BINHITS) {
+	      seqalign_array = BioseqMegaBlastEngineRun(block->prep, &block->options,
 						     &other_returns, &error_returns,
-						     dummy_callback, NULL, NULL, 0,
-						     MegaBlastPrintFltHits);
+						     NULL, MegaBlastPrintFltHits);
             
              }
-	   else if (myargs[ARG_OUTTYPE].intvalue==MBLAST_HITGAPS) {
+	   else if (myargs[ARG_OUTTYPE].intvalue==MBLAST_HITGAPS ||
+                    myargs[ARG_OUTTYPE].intvalue==MBLAST_BINGAPS) {
               gap_Info=TRUE;
               if (dbgaps_buf==NULL)
                   dbgaps_buf=(CharPtr) Malloc(dbgaps_bufsize + 1);
               if (qgaps_buf==NULL) 
                  qgaps_buf=(CharPtr) Malloc(qgaps_bufsize + 1);
-	      seqalign_array = BioseqMegaBlastEngine(query_bsp_array, blast_program,
-						     blast_database, options,
+	      seqalign_array = BioseqMegaBlastEngineRun(block->prep, &block->options,
 						     &other_returns, &error_returns,
-						     dummy_callback, NULL, NULL, 0,
-						     MegaBlastPrintFltHits);
+						     NULL, MegaBlastPrintFltHits);
               }
            else if (myargs[ARG_OUTTYPE].intvalue==MBLAST_ENDPOINTS) 
-	      seqalign_array = BioseqMegaBlastEngine(query_bsp_array, blast_program,
-						     blast_database, options,
+	      seqalign_array = BioseqMegaBlastEngineRun(block->prep, &block->options,
 						     &other_returns, &error_returns,
-						     dummy_callback, NULL, NULL, 0, 
-						     MegaBlastPrintEndpoints);
+						     NULL, MegaBlastPrintEndpoints);
 	   else if (myargs[ARG_OUTTYPE].intvalue==MBLAST_SEGMENTS) 
-	      seqalign_array = BioseqMegaBlastEngine(query_bsp_array, blast_program,
-						     blast_database, options,
+	      seqalign_array = BioseqMegaBlastEngineRun(block->prep, &block->options,
 						     &other_returns, &error_returns,
-						     dummy_callback, NULL, NULL, 0,
-						     MegaBlastPrintSegments);
+						     NULL, MegaBlastPrintSegments);
 	   else if (myargs[ARG_OUTTYPE].intvalue==MBLAST_ALIGN_INFO) {
            
               /* why there is no option to disable these headers?!
@@ -2015,19 +2790,20 @@ static Int2 Main_old (void)
                                        (num_bsps==1) ? query_bsp_array[0] : NULL,
                                        NULL, "megablast", 0, believe_query,
                                        global_fp); */
-	      seqalign_array = BioseqMegaBlastEngine(query_bsp_array, blast_program,
-						     blast_database, options,
+	      seqalign_array = BioseqMegaBlastEngineRun(block->prep, &block->options,
 						     &other_returns, &error_returns,
-						     dummy_callback, NULL, NULL, 0,
-						     MegaBlastPrintTabulated); 
+						     NULL, MegaBlastPrintTabulated); 
 						     /* MegaBlastPrintAlignInfo); */
 	   } else if (myargs[ARG_OUTTYPE].intvalue==MBLAST_ALIGNMENTS) {
-	      seqalign_array = BioseqMegaBlastEngine(query_bsp_array, blast_program,
-				  blast_database, options, &other_returns, 
-                                  &error_returns, align_view < 7 ? tick_callback : NULL,
-                                  NULL, NULL, 0, NULL);
+	      seqalign_array = BioseqMegaBlastEngineRun(block->prep, &block->options,
+						     &other_returns, &error_returns,
+                                  align_view < 7 ? tick_callback : NULL,
+                                  asn_writer != NULL ? MegaBlastWriteSeqAligns : NULL);
                  }
-	qread_base+=num_bsps;   
+           block_stats.total.queries_skipped = block->num_skipped;
+           MBSearchStatsAdd(&run_stats, &block_stats);
+           MBSearchStatsWriteJSON(statsfp, "block", ++block_no, num_bsps, 
+                                  &block_stats);
 #ifdef OS_UNIX
 	   fflush(global_fp);
 #endif
@@ -2275,20 +3051,17 @@ static Int2 Main_old (void)
 	   }
 	   other_returns = ValNodeFree(other_returns);
 	   MemFree(seqalign_array);
-           options->query_lcase_mask = 
-              SeqLocSetFree(options->query_lcase_mask);
 
 	   /* Freeing SeqEntries can be very expensive, do this only if 
 	      this is not the last iteration of search */
-	   if (!done) { 
-	      for (index=0; index<num_bsps; index++) {
-		 sepp[index] = SeqEntryFree(sepp[index]);
-		 query_bsp_array[index] = NULL;
-	      }	   
-           }
+	   MGBQueryBlockRelease(&loader, block, 
+	                        (Boolean) (!done || server_infp != NULL));
            total_processed += num_bsps;
 	} /* End of loop on complete searches */
+	MGBQueryLoaderFree(&loader);
+	query_ords = NULL;
         
+        asn_writer = MBAsnWriterFree(asn_writer);
         aip = AsnIoClose(aip);
 
         /*if (align_view == 7)
@@ -2299,11 +3072,67 @@ static Int2 Main_old (void)
         if (align_view < 7 && myargs[ARG_LOGINFO].intvalue)
            fprintf(outfp, "Mega BLAST run finished, processed %d queries\n",
                    total_processed);
-	MemFree(query_bsp_array);
-	MemFree(sepp);
+        if (myargs[ARG_LOGINFO].intvalue)
+           fprintf(stderr, "Subjects unpacked with ambiguities: %ld, "
+                   "rescored from packed data: %ld (HSPs over ambiguities: %ld)\n",
+                   (long) run_stats.total.subject_unpacks,
+                   (long) run_stats.total.subject_unpacks_avoided,
+                   (long) run_stats.total.ambig_hsps);
+        #ifdef MGBLAST_OPTS
+        if (options->mb_verify_overhang > 0 && myargs[ARG_LOGINFO].intvalue)
+           fprintf(stderr, "Seeds verified before extension: %ld, "
+                   "rejected: %ld\n", (long) run_stats.total.verify_tests,
+                   (long) run_stats.total.verify_rejected);
+        if (sketch_index != NULL && (options->mb_sketch_recall ||
+                                     myargs[ARG_LOGINFO].intvalue)) {
+           fprintf(stderr, "Sketch prefilter: %ld of %ld query-subject pairs "
+                   "are candidates (%.2f%%)\n", 
+                   (long) run_stats.total.sketch_candidates,
+                   (long) run_stats.total.sketch_pairs,
+                   run_stats.total.sketch_pairs > 0 ? 100.0 * 
+                   run_stats.total.sketch_candidates / 
+                   run_stats.total.sketch_pairs : 0.0);
+           if (options->mb_sketch_recall)
+              fprintf(stderr, "Sketch prefilter recall: %ld of %ld hits "
+                      "kept on candidate pairs (%.2f%%)\n",
+                      (long) run_stats.total.sketch_hsps_kept,
+                      (long) run_stats.total.hsps_kept,
+                      run_stats.total.hsps_kept > 0 ? 100.0 *
+                      run_stats.total.sketch_hsps_kept / 
+                      run_stats.total.hsps_kept : 100.0);
+        }
+        #endif
+        MBSearchStatsWriteJSON(statsfp, "run", 0, total_processed, &run_stats);
+        FileClose(statsfp);
+        MBSearchStatsClear(&block_stats);
+        MBSearchStatsClear(&run_stats);
 	options = BLASTOptionDelete(options);
-	FileClose(infp);
-        FileClose(outfp);
+        #ifdef MGBLAST_OPTS
+        word_index = MBWordIndexFree(word_index);
+        sketch_index = MBSketchIndexFree(sketch_index);
+        length_mask = MemFree(length_mask);
+        #endif
+	if (infp != server_infp)
+	   FileClose(infp);
+        #ifdef MGBLAST_OPTS
+        hit_writer = MBHitWriterFree(hit_writer);
+        zout = MBZWriterFree(zout);
+        #endif
+        if (outfp != server_outfp)
+           FileClose(outfp);
+        #ifdef MGBLAST_OPTS
+        if (hit_clusters!=NULL) {
+           FILE *clfp;
+           if ((clfp = FileOpen(myargs[ARG_CLUSTERS].strvalue, "w")) == NULL) {
+              ErrPostEx(SEV_FATAL, 1, 0, "blast: Unable to open output file %s\n", 
+                        myargs[ARG_CLUSTERS].strvalue);
+              return 1;
+              }
+           MBClusterSetWrite(hit_clusters, clfp);
+           FileClose(clfp);
+           hit_clusters=MBClusterSetFree(hit_clusters);
+           }
+        #endif
 	/* --
         getc(stdin); --*/
 	return 0;
@@ -2752,37 +3581,90 @@ readdb_use_new_blast(char* dbname)
       return retval;
 }
 
-
-Int2 Nlm_Main(void)
+#ifdef MGBLAST_OPTS
+/* Parse the -x "start:end" database range; end may be left out */
+static Boolean ParseDbRange(CharPtr str, Int4Ptr start, Int4Ptr end)
 {
-    Boolean use_new_engine;
-    char buf[256] = { '\0' };
-
-    StringCpy(buf, "mgblast ");
-    StringNCat(buf, BlastGetVersionNumber(), sizeof(buf)-StringLen(buf)-1);
-    if (! GetArgs (buf, NUMARG, myargs))
-	   return (1);
+   CharPtr ptr;
+   long value;
+
+   value = strtol(str, &ptr, 10);
+   if (ptr == str || value < 0)
+      return FALSE;
+   *start = (Int4) value;
+   *end = 0;
+   if (*ptr == NULLB)
+      return TRUE;
+   if (*ptr++ != ':')
+      return FALSE;
+   if (*ptr == NULLB)
+      return TRUE;
+   str = ptr;
+   value = strtol(str, &ptr, 10);
+   if (ptr == str || *ptr != NULLB || value <= *start)
+      return FALSE;
+   *end = (Int4) value;
+   return TRUE;
+}
 
-    UseLocalAsnloadDataAndErrMsg ();
+/* Free what a search leaves in the file statics when it stops early, so
+   that the next search of a resident server starts clean; the outputs
+   are still open then, the writers only flush into them */
+static void MGBFreeRunState(void)
+{
+   hit_clusters = MBClusterSetFree(hit_clusters);
+   hit_writer = MBHitWriterFree(hit_writer);
+   zout = MBZWriterFree(zout);
+   asn_writer = MBAsnWriterFree(asn_writer);
+   query_ords = NULL;
+}
+#endif
 
-    if (! SeqEntryLoad())
-		return 1;
+/* Set up the search from the parsed arguments and run it */
+static Int2 MGBRunSearch(void)
+{
+    Boolean use_new_engine;
+    #ifdef MGBLAST_OPTS
+    Int2 status;
+    #endif
 
-    ErrSetMessageLevel(SEV_WARNING);
-    
-    
-    
     #ifdef MGBLAST_OPTS
      use_new_engine=FALSE;
+     /* back to the defaults, a resident server runs many searches */
+     MGBFreeRunState();
+     db_skipto=0;
+     slice_clustering=FALSE;
+     gap_Info=FALSE;
+     qread_base=0;
      max_num_queries = (int) myargs[ARG_BLOCKSIZE].intvalue; 
      if (myargs[ARG_DBSKIP].intvalue > 0)
              db_skipto=myargs[ARG_DBSKIP].intvalue;
+     db_range_start=db_range_end=0;
+     if (myargs[ARG_DBRANGE].strvalue != NULL &&
+         !ParseDbRange(myargs[ARG_DBRANGE].strvalue, &db_range_start, 
+                       &db_range_end)) {
+        ErrPostEx(SEV_FATAL, 1, 0, "Invalid -x value: %s", 
+                  myargs[ARG_DBRANGE].strvalue);
+        return 1;
+     }
      max_overhang=myargs[ARG_MAXOVH].intvalue;
      min_overlap=myargs[ARG_MINOVL].intvalue;
     
      if (myargs[ARG_DBSLICE].strvalue[0] == 'T' || myargs[ARG_DBSLICE].strvalue[0] == 't' ||
               myargs[ARG_DBSLICE].strvalue[0] == '1')
               slice_clustering = TRUE;
+     if (myargs[ARG_CLUSTERS].strvalue != NULL) {
+        if (myargs[ARG_OUTTYPE].intvalue<MBLAST_FLTHITS) {
+            ErrPostEx(SEV_FATAL, 1, 0, "-c option can only be used with -D 4 to -D 7");
+            return 1;
+            }
+        hit_clusters=MBClusterSetNew(0);
+        if (!MBClusterThreshParse(myargs[ARG_CLTHRESH].strvalue, &hit_clusters->thresh)) {
+            ErrPostEx(SEV_FATAL, 1, 0, "Invalid -j value: %s", myargs[ARG_CLTHRESH].strvalue);
+            hit_clusters=MBClusterSetFree(hit_clusters);
+            return 1;
+            }
+        }
 
     #else
      if (myargs[ARG_FORCE_OLD].intvalue == 0 &&
@@ -2802,6 +3684,201 @@ Int2 Nlm_Main(void)
     if (use_new_engine) {
     	return Main_new();
         }
+   #ifdef MGBLAST_OPTS
+    /* Main_old only frees the per-run statics when it gets to the end */
+    if ((status = Main_old()) != 0)
+        MGBFreeRunState();
+    return status;
+   #else
     else
     	return Main_old();
+   #endif
+}
+
+#if defined(MGBLAST_OPTS) && defined(OS_UNIX)
+#include <unistd.h>
+#include <fcntl.h>
+
+/* declared in ncbiwin.h, which does not go along with ncbi.h */
+extern void Nlm_SetupArguments(int argc, char *argv[]);
+
+/* Options naming files for the search to write; a request cannot change
+   them, or a client could have the server write over any of its files */
+static Int4 MGBServerFileArgs[] = { ARG_OUT, ARG_CLUSTERS, ARG_STATSFILE };
+#define MGB_NUM_SERVER_FILE_ARGS \
+   ((Int4) (sizeof(MGBServerFileArgs) / sizeof(MGBServerFileArgs[0])))
+
+/* Whether the request changed any of the file options from the values
+   the server was started with */
+static Boolean MGBServerFileArgChanged(CharPtr PNTR server_files)
+{
+    Int4 index;
+
+    for (index = 0; index < MGB_NUM_SERVER_FILE_ARGS; index++)
+       if (StringCmp(server_files[index], 
+                     myargs[MGBServerFileArgs[index]].strvalue) != 0)
+          return TRUE;
+    return FALSE;
+}
+
+/* Run one server request: its arguments go after the ones the server was
+   started with, queries are read from rfp and hits written to wfp */
+static Int2 MGBServeRequest(CharPtr progname, Int4 req_argc, 
+                            CharPtr PNTR req_argv, FILE *rfp, FILE *wfp)
+{
+    Int4 srv_argc = GetArgc(), argc, index;
+    CharPtr PNTR srv_argv = GetArgv();
+    CharPtr PNTR argv;
+    CharPtr server_db;
+    CharPtr server_files[MGB_NUM_SERVER_FILE_ARGS];
+    Int2 status = 1;
+
+    server_db = StringSave(myargs[ARG_DB].strvalue);
+    for (index = 0; index < MGB_NUM_SERVER_FILE_ARGS; index++)
+       server_files[index] = 
+          StringSave(myargs[MGBServerFileArgs[index]].strvalue);
+    argv = (CharPtr PNTR) MemNew((srv_argc + req_argc + 1)*sizeof(CharPtr));
+    for (argc = 0; argc < srv_argc; argc++)
+       argv[argc] = srv_argv[argc];
+    for (index = 0; index < req_argc; index++)
+       argv[argc++] = req_argv[index];
+
+    Nlm_SetupArguments(argc, argv);
+    FreeArgs(NUMARG, myargs);
+    if (!GetArgs(progname, NUMARG, myargs))
+       ErrPostEx(SEV_ERROR, 0, 0, "mgblast server: invalid request arguments");
+    else if (MGBServerFileArgChanged(server_files))
+       ErrPostEx(SEV_ERROR, 0, 0, "mgblast server: the output files "
+                 "(-o, -c, -u) cannot be set by a request");
+    else if (myargs[ARG_OUTTYPE].intvalue != MBLAST_FLTHITS &&
+             myargs[ARG_OUTTYPE].intvalue != MBLAST_HITGAPS)
+       ErrPostEx(SEV_ERROR, 0, 0, "mgblast server: only -D 4 and -D 5 "
+                 "output can be served");
+    else if (myargs[ARG_ZBLOCK].intvalue > 0)
+       ErrPostEx(SEV_ERROR, 0, 0, "mgblast server: compressed output (-Y) "
+                 "cannot be served");
+    else {
+       ReadDBFILEPtr rdfp = server_rdfp;
+
+       /* the open database is only shared when the request keeps it */
+       if (StringCmp(server_db, myargs[ARG_DB].strvalue) != 0)
+          server_rdfp = NULL;
+       server_infp = rfp;
+       server_outfp = wfp;
+       status = MGBRunSearch();
+       server_infp = server_outfp = NULL;
+       server_rdfp = rdfp;
+    }
+    /* put the server arguments back for the next request */
+    Nlm_SetupArguments(srv_argc, srv_argv);
+    FreeArgs(NUMARG, myargs);
+    GetArgs(progname, NUMARG, myargs);
+    MemFree(server_db);
+    for (index = 0; index < MGB_NUM_SERVER_FILE_ARGS; index++)
+       MemFree(server_files[index]);
+    MemFree(argv);
+    return status;
+}
+
+/* Resident server mode (-N): keep the database open and serve the
+   requests of mgblastc one at a time, see mbserver.h for the protocol */
+static Int2 MGBServe(CharPtr progname)
+{
+    LSOCK lsock;
+    SOCK sock;
+    int fd;
+    FILE *rfp, *wfp;
+    CharPtr PNTR req_argv;
+    Int4 req_argc;
+    Boolean quit = FALSE;
+    Char drain[4096];
+    Uint2 port = (Uint2) myargs[ARG_SERVER].intvalue;
+    Int2 status;
+
+    if ((server_rdfp = readdb_new(myargs[ARG_DB].strvalue, 
+                                  READDB_DB_IS_NUC)) == NULL) {
+       ErrPostEx(SEV_FATAL, 1, 0, "Database %s was not found or does not "
+                 "exist", myargs[ARG_DB].strvalue);
+       return 1;
+    }
+    if (LSOCK_CreateEx(port, 16, &lsock, fLSCE_BindLocal) != eIO_Success) {
+       ErrPostEx(SEV_FATAL, 1, 0, "mgblast server: cannot listen on port %d",
+                 (int) port);
+       server_rdfp = readdb_destruct(server_rdfp);
+       return 1;
+    }
+    /* a failed request must not take the server down */
+    ErrSetFatalLevel(SEV_MAX);
+    fprintf(stderr, "mgblast server: serving %s on port %d\n", 
+            myargs[ARG_DB].strvalue, (int) port);
+
+    while (!quit && LSOCK_Accept(lsock, NULL, &sock) == eIO_Success) {
+       /* the request is served with plain blocking stdio on the socket
+          descriptor; SOCK keeps it non-blocking */
+       if (SOCK_GetOSHandle(sock, &fd, sizeof(fd)) != eIO_Success ||
+           fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK) != 0 ||
+           (rfp = fdopen(dup(fd), "r")) == NULL) {
+          SOCK_Close(sock);
+          continue;
+       }
+       if ((wfp = fdopen(dup(fd), "w")) == NULL) {
+          fclose(rfp);
+          SOCK_Close(sock);
+          continue;
+       }
+       if (!MBServerReadRequest(rfp, &req_argv, &req_argc, &quit))
+          status = 1;
+       else if (quit)
+          status = 0;
+       else
+          status = MGBServeRequest(progname, req_argc, req_argv, rfp, wfp);
+       req_argv = MBServerArgsFree(req_argv);
+       /* a rejected request leaves queries unread; take them in, or 
+          closing the connection would reset it before the client reads
+          the status */
+       while (fread(drain, 1, sizeof(drain), rfp) > 0)
+          ;
+       fprintf(wfp, "%s %d\n", MBSRV_END, (int) status);
+       fclose(wfp);
+       fclose(rfp);
+       SOCK_Close(sock);
+    }
+
+    LSOCK_Close(lsock);
+    server_rdfp = readdb_destruct(server_rdfp);
+    return 0;
+}
+#endif
+
+Int2 Nlm_Main(void)
+{
+    char buf[256] = { '\0' };
+    Int2 status;
+
+    StringCpy(buf, "mgblast ");
+    StringNCat(buf, BlastGetVersionNumber(), sizeof(buf)-StringLen(buf)-1);
+    if (! GetArgs (buf, NUMARG, myargs))
+	   return (1);
+
+    UseLocalAsnloadDataAndErrMsg ();
+
+    if (! SeqEntryLoad())
+		return 1;
+
+    ErrSetMessageLevel(SEV_WARNING);
+
+#ifdef MGBLAST_OPTS
+    if (myargs[ARG_SERVER].intvalue > 0) {
+#ifdef OS_UNIX
+       status = MGBServe(buf);
+#else
+       ErrPostEx(SEV_FATAL, 1, 0, "The server mode (-N) is only available "
+                 "on UNIX");
+       status = 1;
+#endif
+    } else
+#endif
+    status = MGBRunSearch();
+    BlastFreeSpareGreedyMem();
+    return status;
 }
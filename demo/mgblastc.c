@@ -0,0 +1,125 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mgblastc.c
+
+Contents: client of the resident mgblast search server (mgblast -N port).
+          Stands in for an mgblast command line:
+
+            mgblastc -N port [-i queries] [-o hits] [mgblast options]
+
+          -i (default stdin) is sent to the server and the -D 4/-D 5 hits
+          it sends back go to -o (default stdout); all other arguments are
+          passed on and applied over the options the server was started
+          with. "mgblastc -N port stop" shuts the server down. The exit
+          status is the one of the remote search.
+
+******************************************************************************/
+
+#include <ncbi.h>
+#include <mbserver.h>
+
+static void Usage(void)
+{
+   fprintf(stderr, "Usage: mgblastc -N port [-i queries] [-o hits] "
+           "[mgblast options]\n"
+           "       mgblastc -N port stop\n");
+}
+
+/* Value of the option at argv[*index]: either attached ("-ifile") or the
+   next argument */
+static CharPtr OptionValue(Int4 argc, CharPtr PNTR argv, Int4Ptr index)
+{
+   if (argv[*index][2] != NULLB)
+      return argv[*index] + 2;
+   if (*index + 1 < argc) 
+      return argv[++(*index)];
+   return NULL;
+}
+
+Int2 Main (void)
+{
+   Int4 argc = GetArgc(), index, num_args = 0, port = 0, status;
+   CharPtr PNTR argv = GetArgv();
+   CharPtr PNTR args;
+   CharPtr value, infile = "stdin", outfile = "stdout";
+   Char opt;
+   Boolean stop = FALSE;
+   FILE *infp = NULL, *outfp;
+
+   args = (CharPtr PNTR) MemNew((argc + 1)*sizeof(CharPtr));
+   for (index = 1; index < argc; index++) {
+      if (StringCmp(argv[index], "stop") == 0) {
+         stop = TRUE;
+         continue;
+      }
+      if (argv[index][0] != '-' || argv[index][1] == NULLB ||
+          StringChr("Nio", argv[index][1]) == NULL) {
+         args[num_args++] = argv[index];
+         continue;
+      }
+      opt = argv[index][1];
+      if ((value = OptionValue(argc, argv, &index)) == NULL) {
+         Usage();
+         MemFree(args);
+         return 1;
+      }
+      switch (opt) {
+      case 'N':
+         port = atoi(value);
+         break;
+      case 'i':
+         infile = value;
+         break;
+      case 'o':
+         outfile = value;
+         break;
+      }
+   }
+   if (port <= 0 || port > 65535 || (stop && num_args > 0)) {
+      Usage();
+      MemFree(args);
+      return 1;
+   }
+
+   if (!stop && (infp = FileOpen(infile, "r")) == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open input file %s", infile);
+      MemFree(args);
+      return 1;
+   }
+   if ((outfp = FileOpen(outfile, "w")) == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open output file %s", outfile);
+      FileClose(infp);
+      MemFree(args);
+      return 1;
+   }
+
+   status = MBServerClientRun("127.0.0.1", (Uint2) port, num_args, args, 
+                              infp, outfp);
+   FileClose(infp);
+   FileClose(outfp);
+   MemFree(args);
+   return (Int2) (status < 0 ? 2 : status);
+}
@@ -0,0 +1,197 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mgbsim.c
+
+Contents: writes a reproducible synthetic EST data set (and optionally the
+          transcripts it was sampled from) for mgblast benchmarks; see
+          mbsim.h for the model. The read deflines record the origin of
+          each read: transcript, range, strand and poly-A tail length.
+
+******************************************************************************/
+
+#include <ncbi.h>
+#include <mbsim.h>
+
+static Args myargs [] = {
+  { "Output file for the reads",
+	"stdout", NULL, NULL, FALSE, 'o', ARG_FILE_OUT, 0.0, 0, NULL},
+  { "Output file for the transcripts",
+	NULL, NULL, NULL, TRUE, 't', ARG_FILE_OUT, 0.0, 0, NULL},
+  { "Random seed",
+	"1", NULL, NULL, FALSE, 's', ARG_INT, 0.0, 0, NULL},
+  { "Number of reads",
+	"20000", NULL, NULL, FALSE, 'n', ARG_INT, 0.0, 0, NULL},
+  { "Number of transcripts",
+	"2000", NULL, NULL, FALSE, 'T', ARG_INT, 0.0, 0, NULL},
+  { "Transcript length range (min:max)",
+	"500:4000", NULL, NULL, FALSE, 'L', ARG_STRING, 0.0, 0, NULL},
+  { "Read length mean:standard deviation:minimum",
+	"550:150:100", NULL, NULL, FALSE, 'l', ARG_STRING, 0.0, 0, NULL},
+  { "Expression skew (1 = uniform coverage of the transcripts, larger "
+    "values give fewer and deeper clusters)",
+	"2.0", NULL, NULL, FALSE, 'k', ARG_FLOAT, 0.0, 0, NULL},
+  { "Sequencing error rate per base",
+	"0.01", NULL, NULL, FALSE, 'e', ARG_FLOAT, 0.0, 0, NULL},
+  { "Fraction of the errors that are insertions or deletions",
+	"0.3", NULL, NULL, FALSE, 'I', ARG_FLOAT, 0.0, 0, NULL},
+  { "Rate of N calls per base",
+	"0.001", NULL, NULL, FALSE, 'N', ARG_FLOAT, 0.0, 0, NULL},
+  { "Repeat families",
+	"10", NULL, NULL, FALSE, 'r', ARG_INT, 0.0, 0, NULL},
+  { "Repeat length",
+	"300", NULL, NULL, FALSE, 'R', ARG_INT, 0.0, 0, NULL},
+  { "Repeat copies per kb of transcript",
+	"0.1", NULL, NULL, FALSE, 'c', ARG_FLOAT, 0.0, 0, NULL},
+  { "Divergence of the repeat copies",
+	"0.15", NULL, NULL, FALSE, 'd', ARG_FLOAT, 0.0, 0, NULL},
+  { "Fraction of 3' reads (ending at the poly-A site)",
+	"0.5", NULL, NULL, FALSE, 'E', ARG_FLOAT, 0.0, 0, NULL},
+  { "Poly-A tail length range (min:max)",
+	"10:40", NULL, NULL, FALSE, 'A', ARG_STRING, 0.0, 0, NULL},
+  { "Fraction of reads from the minus strand",
+	"0.5", NULL, NULL, FALSE, 'S', ARG_FLOAT, 0.0, 0, NULL}
+};
+
+/* Parse up to max_values colon separated integers; FALSE on a syntax 
+   error */
+static Boolean ParseIntList(CharPtr str, Int4Ptr values, Int4 max_values)
+{
+   CharPtr ptr = str, end;
+   Int4 index;
+   long value;
+
+   for (index = 0; index < max_values; index++) {
+      value = strtol(ptr, &end, 10);
+      if (end == ptr)
+         return FALSE;
+      values[index] = (Int4) value;
+      if (*end == NULLB)
+         return TRUE;
+      if (*end != ':')
+         return FALSE;
+      ptr = end + 1;
+   }
+   return FALSE;
+}
+
+Int2 Main (void)
+{
+   MBSimParams params;
+   MBSimPtr sim;
+   MBSimRead read;
+   FILE *outfp, *trfp;
+   Char defline[128];
+   Int4 values[3], index;
+   Int8 read_bases = 0;
+
+   if (! GetArgs ("mgbsim", DIM(myargs), myargs))
+      return (1);
+
+   MBSimParamsDefault(&params);
+   params.seed = (Uint4) myargs[2].intvalue;
+   params.num_reads = myargs[3].intvalue;
+   params.num_transcripts = myargs[4].intvalue;
+   values[0] = params.transcript_min;
+   values[1] = params.transcript_max;
+   if (!ParseIntList(myargs[5].strvalue, values, 2)) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Bad transcript length range %s",
+                myargs[5].strvalue);
+      return 1;
+   }
+   params.transcript_min = values[0];
+   params.transcript_max = values[1];
+   values[0] = params.read_mean;
+   values[1] = params.read_sd;
+   values[2] = params.read_min;
+   if (!ParseIntList(myargs[6].strvalue, values, 3)) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Bad read length distribution %s",
+                myargs[6].strvalue);
+      return 1;
+   }
+   params.read_mean = values[0];
+   params.read_sd = values[1];
+   params.read_min = values[2];
+   params.expression_skew = myargs[7].floatvalue;
+   params.error_rate = myargs[8].floatvalue;
+   params.indel_fraction = myargs[9].floatvalue;
+   params.n_rate = myargs[10].floatvalue;
+   params.num_repeats = myargs[11].intvalue;
+   params.repeat_length = myargs[12].intvalue;
+   params.repeat_rate = myargs[13].floatvalue;
+   params.repeat_divergence = myargs[14].floatvalue;
+   params.end3_fraction = myargs[15].floatvalue;
+   values[0] = params.polya_min;
+   values[1] = params.polya_max;
+   if (!ParseIntList(myargs[16].strvalue, values, 2)) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Bad poly-A length range %s",
+                myargs[16].strvalue);
+      return 1;
+   }
+   params.polya_min = values[0];
+   params.polya_max = values[1];
+   params.minus_fraction = myargs[17].floatvalue;
+
+   if ((outfp = FileOpen(myargs[0].strvalue, "w")) == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open file %s", myargs[0].strvalue);
+      return 1;
+   }
+
+   sim = MBSimNew(&params);
+   if (myargs[1].strvalue) {
+      if ((trfp = FileOpen(myargs[1].strvalue, "w")) == NULL) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Unable to open file %s", 
+                   myargs[1].strvalue);
+         MBSimFree(sim);
+         FileClose(outfp);
+         return 1;
+      }
+      for (index = 0; index < params.num_transcripts; index++) {
+         sprintf(defline, "TR%06ld len=%ld", (long) index, 
+                 (long) sim->transcript_lengths[index]);
+         MBSimWriteFasta(trfp, defline, sim->transcripts[index], 
+                         sim->transcript_lengths[index]);
+      }
+      FileClose(trfp);
+   }
+
+   while (MBSimNextRead(sim, &read)) {
+      sprintf(defline, "EST%07ld tr=%ld range=%ld-%ld strand=%c polya=%ld",
+              (long) read.ordinal, (long) read.transcript, 
+              (long) read.start + 1, (long) read.end, read.strand, 
+              (long) read.polya);
+      MBSimWriteFasta(outfp, defline, read.sequence, read.length);
+      read_bases += read.length;
+   }
+   FileClose(outfp);
+
+   fprintf(stderr, "%ld reads, %ld bases from %ld transcripts of %ld bases "
+           "(%.2fx coverage)\n", (long) params.num_reads, (long) read_bases,
+           (long) params.num_transcripts, (long) sim->transcript_bases,
+           sim->transcript_bases > 0 ? 
+           (FloatHi) read_bases / sim->transcript_bases : 0.0);
+   MBSimFree(sim);
+   return 0;
+}
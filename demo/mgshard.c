@@ -0,0 +1,414 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mgshard.c
+
+Contents: splits an mgblast search over database ranges (mgblast -x) and
+          merges the shard outputs:
+
+            mgshard -d db --shards n [--procs n] [--mgblast path] 
+                    [--prefix p] [--list | --merge] [-o hits]
+                    [mgblast options]
+
+          The shards are planned from the database index so that each one
+          holds about the same number of residues. By default the shards
+          are run as local mgblast processes, at most --procs (default:
+          the number of CPUs) at a time, and their outputs (prefix.0, 
+          prefix.1, ...) are appended to -o in shard order once all of them
+          succeeded, so the result does not depend on which shard finished
+          first. For a cluster, --list only prints the command line of each
+          shard, to be run anywhere the database and the prefix directory
+          are shared, and --merge merges the finished shard outputs 
+          afterwards. The long options avoid the mgblast option letters.
+          The other arguments are passed to every mgblast; options that
+          cannot be split this way (-o, -x, -c, -u, -N, -D 6/7) are not
+          accepted.
+
+******************************************************************************/
+
+#include <ncbi.h>
+#include <readdb.h>
+#ifdef OS_UNIX
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#define MGSHARD_COPY_SIZE 65536
+
+static void Usage(void)
+{
+   fprintf(stderr, "Usage: mgshard -d db --shards n [--procs n] "
+           "[--mgblast path] [--prefix p]\n"
+           "               [--list | --merge] [-o hits] "
+           "[mgblast options]\n");
+}
+
+/* Value of the option at argv[*index]: either attached ("-dfile") or the
+   next argument; always the next one for a long option */
+static CharPtr OptionValue(Int4 argc, CharPtr PNTR argv, Int4Ptr index)
+{
+   if (argv[*index][1] != '-' && argv[*index][2] != NULLB)
+      return argv[*index] + 2;
+   if (*index + 1 < argc) 
+      return argv[++(*index)];
+   return NULL;
+}
+
+/* Shard boundaries: bounds[i] .. bounds[i+1] holding about 1/num_shards
+   of the residues each; the number of shards is reduced to the number of
+   database sequences if needed. Returns the number of shards, 0 on 
+   error */
+static Int4 PlanShards(CharPtr database, Int4 num_shards, Int4Ptr PNTR bounds)
+{
+   ReadDBFILEPtr rdfp;
+   Int4 num_seqs, oid, shard;
+   Int8 total = 0, sum = 0;
+   Int4Ptr lengths;
+
+   if ((rdfp = readdb_new(database, FALSE)) == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open nucleotide database %s",
+                database);
+      return 0;
+   }
+   num_seqs = readdb_get_num_entries_total(rdfp);
+   if (num_seqs <= 0) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Database %s is empty", database);
+      readdb_destruct(rdfp);
+      return 0;
+   }
+   num_shards = MIN(num_shards, num_seqs);
+   /* Only the index is read: the lengths are rounded to whole bytes, 
+      which is close enough for balancing */
+   lengths = (Int4Ptr) MemNew(num_seqs*sizeof(Int4));
+   for (oid = 0; oid < num_seqs; oid++) {
+      lengths[oid] = readdb_get_sequence_length_approx(rdfp, oid);
+      total += lengths[oid];
+   }
+   readdb_destruct(rdfp);
+
+   *bounds = (Int4Ptr) MemNew((num_shards + 1)*sizeof(Int4));
+   for (oid = 0, shard = 1; shard < num_shards; shard++) {
+      /* at least one sequence per shard, and one left for each of the 
+         following shards */
+      while (oid < num_seqs - (num_shards - shard) &&
+             (sum < total*shard/num_shards || oid <= (*bounds)[shard-1])) {
+         sum += lengths[oid];
+         oid++;
+      }
+      (*bounds)[shard] = oid;
+   }
+   (*bounds)[num_shards] = num_seqs;
+   MemFree(lengths);
+   return num_shards;
+}
+
+/* Arguments of the mgblast run of one shard, NULL terminated; the strings
+   in the array the function makes itself are freed by FreeShardArgs */
+static CharPtr PNTR ShardArgs(CharPtr mgblast, CharPtr database, 
+                              CharPtr prefix, Int4 shard, Int4 start, 
+                              Int4 end, CharPtr PNTR args, Int4 num_args)
+{
+   CharPtr PNTR argv;
+   Char buf[64];
+   Int4 index, argc = 0;
+
+   argv = (CharPtr PNTR) MemNew((num_args + 8)*sizeof(CharPtr));
+   argv[argc++] = mgblast;
+   for (index = 0; index < num_args; index++)
+      argv[argc++] = args[index];
+   argv[argc++] = "-d";
+   argv[argc++] = database;
+   argv[argc++] = "-x";
+   sprintf(buf, "%ld:%ld", (long) start, (long) end);
+   argv[argc++] = StringSave(buf);
+   argv[argc++] = "-o";
+   argv[argc] = (CharPtr) MemNew(StringLen(prefix) + 16);
+   sprintf(argv[argc++], "%s.%ld", prefix, (long) shard);
+   return argv;
+}
+
+static CharPtr PNTR FreeShardArgs(CharPtr PNTR argv, Int4 num_args)
+{
+   /* the -x value and the output name */
+   MemFree(argv[num_args + 4]);
+   MemFree(argv[num_args + 6]);
+   return (CharPtr PNTR) MemFree(argv);
+}
+
+/* Print a shell command line, quoting the arguments */
+static void PrintCommand(FILE *fp, CharPtr PNTR argv)
+{
+   CharPtr ptr;
+
+   for (; *argv != NULL; argv++) {
+      fprintf(fp, "'");
+      for (ptr = *argv; *ptr != NULLB; ptr++) {
+         if (*ptr == '\'')
+            fprintf(fp, "'\\''");
+         else
+            fputc(*ptr, fp);
+      }
+      fprintf(fp, argv[1] != NULL ? "' " : "'\n");
+   }
+}
+
+#ifdef OS_UNIX
+/* Run the shards, at most max_procs at a time; FALSE if any failed */
+static Boolean RunShards(CharPtr PNTR PNTR shard_argv, Int4 num_shards,
+                         Int4 max_procs)
+{
+   pid_t PNTR pids;
+   pid_t pid;
+   Int4 next = 0, running = 0, index, status;
+   Boolean ok = TRUE;
+
+   pids = (pid_t PNTR) MemNew(num_shards*sizeof(pid_t));
+   while (next < num_shards || running > 0) {
+      if (ok && next < num_shards && running < max_procs) {
+         fflush(NULL);
+         if ((pid = fork()) < 0) {
+            ErrPostEx(SEV_ERROR, 0, 0, "Unable to start shard %ld", 
+                      (long) next);
+            ok = FALSE;
+            continue;
+         }
+         if (pid == 0) {
+            execvp(shard_argv[next][0], shard_argv[next]);
+            fprintf(stderr, "mgshard: unable to run %s\n", 
+                    shard_argv[next][0]);
+            _exit(127);
+         }
+         pids[next++] = pid;
+         running++;
+         continue;
+      }
+      if (running == 0)
+         break;
+      if ((pid = waitpid(-1, &status, 0)) < 0)
+         break;
+      for (index = 0; index < next && pids[index] != pid; index++)
+         ;
+      if (index == next)
+         continue;
+      running--;
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Shard %ld failed with status %d",
+                   (long) index, 
+                   WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+         ok = FALSE;
+      }
+   }
+   MemFree(pids);
+   return ok;
+}
+#endif
+
+/* Append the shard outputs to outfp in shard order, then remove them */
+static Boolean MergeShards(CharPtr prefix, Int4 num_shards, FILE *outfp)
+{
+   CharPtr name, buf;
+   FILE *fp;
+   size_t len;
+   Int4 shard;
+   Boolean ok = TRUE;
+
+   name = (CharPtr) MemNew(StringLen(prefix) + 16);
+   buf = (CharPtr) MemNew(MGSHARD_COPY_SIZE);
+   for (shard = 0; shard < num_shards && ok; shard++) {
+      sprintf(name, "%s.%ld", prefix, (long) shard);
+      if ((fp = FileOpen(name, "rb")) == NULL) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Unable to open shard output %s", name);
+         ok = FALSE;
+         break;
+      }
+      while ((len = FileRead(buf, 1, MGSHARD_COPY_SIZE, fp)) > 0) {
+         if (FileWrite(buf, 1, len, outfp) != len) {
+            ErrPostEx(SEV_ERROR, 0, 0, "Error writing the merged output");
+            ok = FALSE;
+            break;
+         }
+      }
+      FileClose(fp);
+   }
+   if (ok) {
+      for (shard = 0; shard < num_shards; shard++) {
+         sprintf(name, "%s.%ld", prefix, (long) shard);
+         FileRemove(name);
+      }
+   }
+   MemFree(buf);
+   MemFree(name);
+   return ok;
+}
+
+Int2 Main (void)
+{
+   Int4 argc = GetArgc(), index, num_args = 0, num_shards = 0;
+   Int4 max_procs = 0, shard;
+   CharPtr PNTR argv = GetArgv();
+   CharPtr PNTR args;
+   CharPtr PNTR PNTR shard_argv = NULL;
+   CharPtr value, option, database = NULL, mgblast = "mgblast";
+   CharPtr outfile = "stdout";
+   CharPtr prefix = NULL;
+   Int4Ptr bounds = NULL;
+   Char opt;
+   Boolean list_only = FALSE, merge_only = FALSE, ok = TRUE;
+   FILE *outfp = NULL;
+
+   args = (CharPtr PNTR) MemNew((argc + 1)*sizeof(CharPtr));
+   for (index = 1; index < argc; index++) {
+      if (StringCmp(argv[index], "--list") == 0) {
+         list_only = TRUE;
+         continue;
+      }
+      if (StringCmp(argv[index], "--merge") == 0) {
+         merge_only = TRUE;
+         continue;
+      }
+      if (argv[index][0] != '-' || argv[index][1] == NULLB ||
+          (argv[index][1] != '-' && 
+           StringChr("doxcuND", argv[index][1]) == NULL)) {
+         args[num_args++] = argv[index];
+         continue;
+      }
+      opt = argv[index][1];
+      option = argv[index];
+      if ((value = OptionValue(argc, argv, &index)) == NULL) {
+         Usage();
+         MemFree(args);
+         return 1;
+      }
+      if (opt == '-') {
+         if (StringCmp(option, "--shards") == 0)
+            num_shards = atoi(value);
+         else if (StringCmp(option, "--procs") == 0)
+            max_procs = atoi(value);
+         else if (StringCmp(option, "--mgblast") == 0)
+            mgblast = value;
+         else if (StringCmp(option, "--prefix") == 0)
+            prefix = value;
+         else {
+            Usage();
+            MemFree(args);
+            return 1;
+         }
+         continue;
+      }
+      switch (opt) {
+      case 'd':
+         database = value;
+         break;
+      case 'o':
+         outfile = value;
+         break;
+      case 'D':
+         if (atoi(value) == 6 || atoi(value) == 7) {
+            ErrPostEx(SEV_ERROR, 0, 0, "Binary hit files (-D %s) cannot be "
+                      "merged", value);
+            MemFree(args);
+            return 1;
+         }
+         args[num_args++] = "-D";
+         args[num_args++] = value;
+         break;
+      default:
+         ErrPostEx(SEV_ERROR, 0, 0, "mgblast option -%c cannot be used "
+                   "with mgshard", opt);
+         MemFree(args);
+         return 1;
+      }
+   }
+   if (database == NULL || num_shards <= 0 || (list_only && merge_only)) {
+      Usage();
+      MemFree(args);
+      return 1;
+   }
+   if (prefix == NULL)
+      prefix = StringCmp(outfile, "stdout") ? outfile : "mgshard";
+   if (prefix == outfile) {
+      prefix = (CharPtr) MemNew(StringLen(outfile) + 8);
+      sprintf(prefix, "%s.shard", outfile);
+   } else
+      prefix = StringSave(prefix);
+
+   /* --merge too: the shards run are fewer when the database has fewer
+      sequences than --shards */
+   if ((num_shards = PlanShards(database, num_shards, &bounds)) == 0) {
+      MemFree(prefix);
+      MemFree(args);
+      return 1;
+   }
+   if (!merge_only) {
+      shard_argv = (CharPtr PNTR PNTR) 
+         MemNew(num_shards*sizeof(CharPtr PNTR));
+      for (shard = 0; shard < num_shards; shard++)
+         shard_argv[shard] = ShardArgs(mgblast, database, prefix, shard,
+                                       bounds[shard], bounds[shard+1],
+                                       args, num_args);
+   }
+
+   if (list_only) {
+      for (shard = 0; shard < num_shards; shard++)
+         PrintCommand(stdout, shard_argv[shard]);
+   } else {
+#ifdef OS_UNIX
+      if (!merge_only) {
+         if (max_procs <= 0)
+            max_procs = (Int4) sysconf(_SC_NPROCESSORS_ONLN);
+         max_procs = MAX(max_procs, 1);
+         ok = RunShards(shard_argv, num_shards, max_procs);
+      }
+#else
+      if (!merge_only) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Local shard processes are not available "
+                   "on this platform; use --list and --merge");
+         ok = FALSE;
+      }
+#endif
+      if (ok && (outfp = FileOpen(outfile, "wb")) == NULL) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Unable to open output file %s", 
+                   outfile);
+         ok = FALSE;
+      }
+      if (ok)
+         ok = MergeShards(prefix, num_shards, outfp);
+      FileClose(outfp);
+      if (!ok && !merge_only)
+         ErrPostEx(SEV_ERROR, 0, 0, "Shard outputs were kept in %s.*", 
+                   prefix);
+   }
+
+   if (shard_argv) {
+      for (shard = 0; shard < num_shards; shard++)
+         FreeShardArgs(shard_argv[shard], num_args);
+      MemFree(shard_argv);
+   }
+   MemFree(bounds);
+   MemFree(prefix);
+   MemFree(args);
+   return ok ? 0 : 1;
+}
@@ -77,6 +77,7 @@
 
 
 #include <ncbi.h>
+#include <ncbithr.h>
 #include <spidey.h>
 #include <accid1.h>
 #include <lsqfetch.h>
@@ -111,8 +112,12 @@
 #define MYARGDSPLICE   25
 #define MYARGASPLICE   26
 #define MYARGREPDB     27
+#define MYARGTHREADS   28
 
-#define NUMARGS        28
+#define NUMARGS        29
+
+/* mRNAs aligned together by one batch mode thread */
+#define SPI_BATCH_BLOCK 8
 
 Args myargs[NUMARGS] = {
    {"Input file -- genomic sequence(s)", NULL, NULL, NULL, FALSE, 'i', ARG_FILE_IN, 0.0, 0, NULL},
@@ -146,13 +151,40 @@ Args myargs[NUMARGS] = {
    {"File with acceptor splice matrix", NULL, NULL, NULL, TRUE, 'N', ARG_FILE_IN, 0.0, 0, NULL},
       /* KSK added */
    {"File (including path) to repeat blast database for filtering", NULL, NULL, NULL, TRUE, 'R', ARG_STRING, 0.0, 0, NULL},
+   {"Batch mode: number of threads aligning the mRNAs (results stay in input order,\nthroughput is reported on stderr); 0 = off", "0", NULL, NULL, TRUE, 'P', ARG_INT, 0.0, 0, NULL},
 };
 
+typedef struct spi_batchblock {
+   Int4           index;
+   Int4           count;
+   SPI_bsinfoPtr  spim[SPI_BATCH_BLOCK];
+   FILE           *ofp;  /* the block's output, copied out in input order */
+   FILE           *ofp2;
+   SeqAlignPtr    sap;
+   struct spi_batchblock PNTR next;
+} SPI_BatchBlock, PNTR SPI_BatchBlockPtr;
+
+/* state shared by the batch mode threads */
+typedef struct spi_batch {
+   SPI_bsinfoPtr      spig;
+   SPI_bsinfoPtr      spim_next; /* next mRNA to hand out */
+   SPI_OptionsPtr     spot;      /* copied by each thread */
+   FILE               *ofp;
+   FILE               *ofp2;
+   TNlmMutex          in_mutex;
+   TNlmMutex          out_mutex;
+   Int4               next_in;   /* block numbers handed out and written */
+   Int4               next_out;
+   Int4               num_mrna;
+   SPI_BatchBlockPtr  pending;   /* finished blocks waiting for their turn */
+} SPI_Batch, PNTR SPI_BatchPtr;
+
 static void SPI_FindAllNuc(SeqEntryPtr sep, Pointer data, Int4 index, Int2 indent);
 static CharPtr ReadALine (CharPtr str, size_t size, FILE *fp);
 static BioseqPtr SPI_GetBspFromGIOrAcc(CharPtr str);
 static void SPI_GetSpliceInfo(SPI_OptionsPtr spot, FILE *sfp, Boolean donor);
 static void SPI_ReadFeatureTable(FILE *ifp, SPI_bsinfoPtr spim_head);
+static void SPI_BatchAlign(SPI_bsinfoPtr spig, SPI_bsinfoPtr spim_head, FILE *ofp, FILE *ofp2, SPI_OptionsPtr spot, Int4 num_threads);
 
 Int2 Main()
 {
@@ -484,8 +516,18 @@ Int2 Main()
       SPI_GetSpliceInfo(spot, sfp, FALSE);
       FileClose(sfp);
    }
+   /* encode the genomic interval once for all the mRNAs */
+   if (spot->draftfile == NULL)
+      SPI_PrepareGenomic(spig_head->bsp, spot);
    h_head = h_prev = NULL;
    srip_head = srip_prev = NULL;
+   if (myargs[MYARGTHREADS].intvalue > 0 && spot->makemult)
+      ErrPostEx(SEV_ERROR, 0, 0, "The multiple alignment needs all the mRNAs at once; batch mode is off.\n");
+   else if (myargs[MYARGTHREADS].intvalue > 0 && spot->draftfile == NULL)
+   {
+      SPI_BatchAlign(spig_head, spim, ofp, ofp2, spot, myargs[MYARGTHREADS].intvalue);
+      spim = NULL;
+   }
    while (spim != NULL)
    {
       spot->lcaseloc = spim->lcaseloc;
@@ -532,6 +574,7 @@ Int2 Main()
    }
    FileClose(ofp);
    FileClose(ofp2);
+   Blast2SeqSubjectFree(spot->genomic);
    SPI_OptionsFree(spot);
    SPI_bsinfoFreeList(spim_head);
    SPI_bsinfoFreeList(spig_head);
@@ -797,3 +840,191 @@ static void SPI_GetSpliceInfo(SPI_OptionsPtr spot, FILE *sfp, Boolean donor)
        }
    }
 }
+
+/***************************************************************************
+*
+*  SPI_BatchCopyFile appends a block's temporary file to an output file
+*  and closes (and so removes) the temporary file.
+*
+***************************************************************************/
+static void SPI_BatchCopyFile(FILE *from, FILE *to)
+{
+   Char    buf[8192];
+   size_t  n;
+
+   if (from == NULL)
+      return;
+   rewind(from);
+   while ((n = fread(buf, 1, sizeof(buf), from)) > 0)
+   {
+      fwrite(buf, 1, n, to);
+   }
+   fclose(from);
+}
+
+/***************************************************************************
+*
+*  SPI_BatchWriteBlock appends the output of a block to the real output
+*  files and the block's alignments to the ASN.1 list, then frees the
+*  block. Called with out_mutex held.
+*
+***************************************************************************/
+static void SPI_BatchWriteBlock(SPI_BatchPtr batch, SPI_BatchBlockPtr block)
+{
+   SeqAlignPtr  sap;
+
+   SPI_BatchCopyFile(block->ofp, batch->ofp);
+   SPI_BatchCopyFile(block->ofp2, batch->ofp2);
+   if (block->sap != NULL)
+   {
+      if (*(batch->spot->sap_head) == NULL)
+         *(batch->spot->sap_head) = block->sap;
+      else
+      {
+         sap = *(batch->spot->sap_head);
+         while (sap->next != NULL)
+         {
+            sap = sap->next;
+         }
+         sap->next = block->sap;
+      }
+   }
+   MemFree(block);
+}
+
+/***************************************************************************
+*
+*  SPI_BatchOutput queues a finished block and writes out every block
+*  that is next in input order, so the output doesn't depend on the
+*  number of threads.
+*
+***************************************************************************/
+static void SPI_BatchOutput(SPI_BatchPtr batch, SPI_BatchBlockPtr block)
+{
+   SPI_BatchBlockPtr  PNTR bp;
+
+   NlmMutexLockEx(&batch->out_mutex);
+   bp = &batch->pending;
+   while (*bp != NULL && (*bp)->index < block->index)
+   {
+      bp = &(*bp)->next;
+   }
+   block->next = *bp;
+   *bp = block;
+   while (batch->pending != NULL && batch->pending->index == batch->next_out)
+   {
+      block = batch->pending;
+      batch->pending = block->next;
+      SPI_BatchWriteBlock(batch, block);
+      batch->next_out++;
+   }
+   NlmMutexUnlock(batch->out_mutex);
+}
+
+/***************************************************************************
+*
+*  SPI_BatchWorker takes blocks of mRNAs from the shared list and aligns
+*  them to the genomic sequence with its own copy of the options, writing
+*  each block's results to temporary files.
+*
+***************************************************************************/
+static VoidPtr SPI_BatchWorker(VoidPtr arg)
+{
+   SPI_BatchPtr       batch;
+   SPI_BatchBlockPtr  block;
+   Int4               i;
+   SPI_OptionsPtr     spot;
+   SPI_RegionInfoPtr  srip;
+
+   batch = (SPI_BatchPtr)arg;
+   /* the options are changed for each mRNA; the genomic encoding is shared */
+   spot = (SPI_OptionsPtr)MemNew(sizeof(SPI_Options));
+   MemCopy(spot, batch->spot, sizeof(SPI_Options));
+   while (TRUE)
+   {
+      block = (SPI_BatchBlockPtr)MemNew(sizeof(SPI_BatchBlock));
+      NlmMutexLockEx(&batch->in_mutex);
+      while (block->count < SPI_BATCH_BLOCK && batch->spim_next != NULL)
+      {
+         block->spim[block->count++] = batch->spim_next;
+         batch->spim_next = batch->spim_next->next;
+      }
+      if (block->count > 0)
+      {
+         block->index = batch->next_in++;
+         batch->num_mrna += block->count;
+      }
+      NlmMutexUnlock(batch->in_mutex);
+      if (block->count == 0)
+      {
+         MemFree(block);
+         break;
+      }
+      if (batch->ofp != NULL && (block->ofp = tmpfile()) == NULL)
+         ErrPostEx(SEV_ERROR, 0, 0, "Unable to open a temporary file, results of a block are lost\n");
+      if (batch->ofp2 != NULL && (block->ofp2 = tmpfile()) == NULL)
+         ErrPostEx(SEV_ERROR, 0, 0, "Unable to open a temporary file, results of a block are lost\n");
+      spot->sap_head = &block->sap;
+      for (i=0; i<block->count; i++)
+      {
+         spot->lcaseloc = block->spim[i]->lcaseloc;
+         srip = SPI_AlnSinglemRNAToGen(batch->spig, block->spim[i], block->ofp, block->ofp2, spot);
+         SPI_RegionListFree(srip);
+      }
+      SPI_BatchOutput(batch, block);
+   }
+   MemFree(spot);
+   return NULL;
+}
+
+/***************************************************************************
+*
+*  SPI_BatchAlign is the batch mode: the mRNAs are aligned in blocks by
+*  num_threads threads against the genomic sequence encoded once, and the
+*  results are written in input order. The throughput is reported on
+*  stderr.
+*
+***************************************************************************/
+static void SPI_BatchAlign(SPI_bsinfoPtr spig, SPI_bsinfoPtr spim_head, FILE *ofp, FILE *ofp2, SPI_OptionsPtr spot, Int4 num_threads)
+{
+   SPI_Batch        batch;
+   FloatHi          elapsed;
+   Int4             i;
+   Int4             started;
+   TNlmThread PNTR  threads;
+
+   MemSet(&batch, 0, sizeof(SPI_Batch));
+   batch.spig = spig;
+   batch.spim_next = spim_head;
+   batch.spot = spot;
+   batch.ofp = ofp;
+   batch.ofp2 = ofp2;
+   elapsed = MBStatsClock();
+   started = 0;
+   if (num_threads > 1 && NlmThreadsAvailable())
+   {
+      threads = (TNlmThread PNTR)MemNew(num_threads*sizeof(TNlmThread));
+      for (i=0; i<num_threads; i++)
+      {
+         threads[started] = NlmThreadCreateEx(SPI_BatchWorker, &batch, THREAD_RUN|THREAD_BOUND, eTP_Default, NULL, NULL);
+         if (NlmThreadCompare(threads[started], NULL_thread))
+            ErrPostEx(SEV_WARNING, 0, 0, "Unable to open thread.\n");
+         else
+            started++;
+      }
+      for (i=0; i<started; i++)
+      {
+         NlmThreadJoin(threads[i], NULL);
+      }
+      MemFree(threads);
+   }
+   if (started == 0)
+   {
+      SPI_BatchWorker(&batch);
+      started = 1;
+   }
+   elapsed = MBStatsClock() - elapsed;
+   NlmMutexDestroy(batch.in_mutex);
+   NlmMutexDestroy(batch.out_mutex);
+   fprintf(stderr, "spidey: %ld mRNAs in %.2f s, %.1f mRNAs/s (%ld threads)\n", (long)batch.num_mrna, elapsed, elapsed > 0 ? batch.num_mrna/elapsed : 0.0, (long)started);
+}
@@ -71,9 +71,12 @@
 #include <blfmtutl.h>
 
 
-#define NUMARG 4
+#define NUMARG 6
 #define VECSCREEN_INFO "VecScreen"
 
+/* Queries read and screened together by one batch mode thread */
+#define VS_BATCH_BLOCK 16
+
 static Args myargs [NUMARG] = {
   { "Query File", 
 	"stdin", NULL, NULL, FALSE, 'i', ARG_FILE_IN, 0.0, 0, NULL},
@@ -81,10 +84,192 @@ static Args myargs [NUMARG] = {
 	"stdout", NULL, NULL, FALSE, 'o', ARG_FILE_OUT, 0.0, 0, NULL},
   { "Database", 
 	"UniVec", NULL, NULL, FALSE, 'd', ARG_STRING, 0.0, 0, NULL},
-  { "Output format:\n      0 = HTML format, with alignments\n      1 = HTML format, no alignments\n      2 = Text list, with alignments\n      3 = Text list, no alignments\n     ",
-	"0", NULL, NULL, FALSE, 'f', ARG_INT, 0.0, 0, NULL}
+  { "Output format:\n      0 = HTML format, with alignments\n      1 = HTML format, no alignments\n      2 = Text list, with alignments\n      3 = Text list, no alignments\n      4 = Tabular batch mode (id, start, stop, class)\n     ",
+	"0", NULL, NULL, FALSE, 'f', ARG_INT, 0.0, 0, NULL},
+  { "Number of threads for the tabular batch mode (-f 4)",
+	"1", NULL, NULL, FALSE, 'a', ARG_INT, 0.0, 0, NULL},
+  { "Output file for the queries with vector segments in lower case,\n      for mgblast -U (-f 4 only)",
+	NULL, NULL, NULL, TRUE, 'M', ARG_FILE_OUT, 0.0, 0, NULL}
 };
 
+typedef struct vsbatchblock {
+	Int4 index, count;
+	SeqEntryPtr sep[VS_BATCH_BLOCK];
+	BioseqPtr bsp[VS_BATCH_BLOCK];
+	ValNodePtr vnp[VS_BATCH_BLOCK];
+	Int2 hits[VS_BATCH_BLOCK];
+	struct vsbatchblock PNTR next;
+} VSBatchBlock, PNTR VSBatchBlockPtr;
+
+/* State shared by the batch mode threads */
+typedef struct vsbatch {
+	FILE *infp, *outfp, *maskfp;
+	CharPtr database;
+	ReadDBFILEPtr rdfp;		/* opened once, attached by every search */
+	VSOptionsPtr options;		/* read only */
+	TNlmMutex in_mutex, out_mutex;
+	Int4 next_in, next_out;		/* block numbers read and written */
+	VSBatchBlockPtr pending;	/* screened blocks waiting for their turn */
+	Boolean failed;
+} VSBatch, PNTR VSBatchPtr;
+
+/*
+	Writes the results of a block, freeing it.  Called with out_mutex held.
+*/
+static void VSBatchWriteBlock(VSBatchPtr batch, VSBatchBlockPtr block)
+{
+	Int4 i;
+	ValNodePtr vnp;
+
+	for (i = 0; i < block->count; i++)
+	{
+		if (block->hits[i] < 0)
+		{
+			ErrPostEx(SEV_ERROR, 0, 0, "VSScreenSequence: screen failed\n");
+			batch->failed = TRUE;
+		}
+		else if (block->bsp[i])
+		{
+			VSPrintTabFromSeqLocs(block->vnp[i], block->bsp[i], batch->outfp);
+			if (batch->maskfp)
+				VSPrintMaskedFasta(block->vnp[i], block->bsp[i], batch->maskfp);
+		}
+		for (vnp = block->vnp[i]; vnp; vnp = vnp->next)
+			SeqLocFree(vnp->data.ptrvalue);
+		ValNodeFree(block->vnp[i]);
+		SeqEntryFree(block->sep[i]);
+	}
+	MemFree(block);
+}
+
+/*
+	Queues a screened block and writes every block that is next in input
+	order, so the output does not depend on the number of threads.
+*/
+static void VSBatchOutput(VSBatchPtr batch, VSBatchBlockPtr block)
+{
+	VSBatchBlockPtr PNTR bp;
+
+	NlmMutexLockEx(&batch->out_mutex);
+	for (bp = &batch->pending; *bp && (*bp)->index < block->index; bp = &(*bp)->next)
+		;
+	block->next = *bp;
+	*bp = block;
+	while (batch->pending && batch->pending->index == batch->next_out)
+	{
+		block = batch->pending;
+		batch->pending = block->next;
+		VSBatchWriteBlock(batch, block);
+		batch->next_out++;
+	}
+	NlmMutexUnlock(batch->out_mutex);
+}
+
+static VoidPtr VSBatchWorker(VoidPtr arg)
+{
+	BLAST_OptionsBlkPtr blast_options;
+	SeqEntryPtr sep;
+	VSBatchBlockPtr block;
+	VSBatchPtr batch = (VSBatchPtr) arg;
+	ValNodePtr error_returns;
+	Int4 i;
+
+	/* BLAST options are modified by the search and can not be shared */
+	if ((blast_options = VSBlastOptionNew()) == NULL)
+		return NULL;
+
+	for (;;)
+	{
+		block = (VSBatchBlockPtr) MemNew(sizeof(VSBatchBlock));
+
+		NlmMutexLockEx(&batch->in_mutex);
+		while (block->count < VS_BATCH_BLOCK &&
+			(sep = FastaToSeqEntryEx(batch->infp, TRUE, NULL, FALSE)) != NULL)
+		{
+			block->sep[block->count++] = sep;
+		}
+		if (block->count > 0)
+			block->index = batch->next_in++;
+		NlmMutexUnlock(batch->in_mutex);
+
+		if (block->count == 0)
+		{
+			MemFree(block);
+			break;
+		}
+
+		for (i = 0; i < block->count; i++)
+		{
+			SeqEntryExplore(block->sep[i], &block->bsp[i], FindNuc);
+			if (block->bsp[i] == NULL)
+			{
+				ErrPostEx(SEV_ERROR, 1, 0, "Unable to obtain bioseq\n");
+				block->hits[i] = -1;
+				continue;
+			}
+			error_returns = NULL;
+			block->hits[i] = VSScreenSequenceWithReadDb(block->bsp[i], batch->options, blast_options, batch->rdfp, batch->database, &block->vnp[i], &error_returns);
+			BlastErrorPrint(error_returns);
+			BlastErrorChainDestroy(error_returns);
+		}
+
+		VSBatchOutput(batch, block);
+	}
+
+	BLASTOptionDelete(blast_options);
+
+	return NULL;
+}
+
+/*
+	Tabular batch mode: the database is opened once and the queries are
+	screened in blocks by num_threads threads.
+*/
+static Int2 VSBatchScreen(FILE *infp, FILE *outfp, FILE *maskfp, CharPtr database, Int4 num_threads)
+{
+	TNlmThread PNTR threads;
+	VSBatch batch;
+	Int4 i, started;
+
+	MemSet(&batch, 0, sizeof(VSBatch));
+	batch.infp = infp;
+	batch.outfp = outfp;
+	batch.maskfp = maskfp;
+	batch.database = database;
+	if ((batch.rdfp = readdb_new(database, FALSE)) == NULL)
+	{
+		ErrPostEx(SEV_FATAL, 1, 0, "vecscreen: Unable to open database %s\n", database);
+		return 1;
+	}
+	batch.options = VSOptionsNew();
+
+	started = 0;
+	if (num_threads > 1 && NlmThreadsAvailable())
+	{
+		threads = (TNlmThread PNTR) MemNew(num_threads * sizeof(TNlmThread));
+		for (i = 0; i < num_threads; i++)
+		{
+			threads[started] = NlmThreadCreateEx(VSBatchWorker, &batch, THREAD_RUN|THREAD_BOUND, eTP_Default, NULL, NULL);
+			if (NlmThreadCompare(threads[started], NULL_thread))
+				ErrPostEx(SEV_WARNING, 0, 0, "Unable to open thread.");
+			else
+				started++;
+		}
+		for (i = 0; i < started; i++)
+			NlmThreadJoin(threads[i], NULL);
+		MemFree(threads);
+	}
+	if (started == 0)
+		VSBatchWorker(&batch);
+
+	NlmMutexDestroy(batch.in_mutex);
+	NlmMutexDestroy(batch.out_mutex);
+	VSOptionsFree(batch.options);
+	readdb_destruct(batch.rdfp);
+
+	return batch.failed ? 3 : 0;
+}
+
 Int2 Main (void)
  
 {
@@ -106,7 +291,7 @@ Int2 Main (void)
 	ValNodePtr  mask_loc, vnp, vnp1=NULL, other_returns, error_returns;
 
 	CharPtr blast_inputfile, blast_outputfile;
-	FILE *infp, *outfp;
+	FILE *infp, *outfp, *maskfp;
 
 	if (! GetArgs ("vecscreen", NUMARG, myargs))
 	{
@@ -146,6 +331,22 @@ Int2 Main (void)
 		return (1);
 	}
 
+	if (myargs [3].intvalue == 4)
+	{
+		maskfp = NULL;
+		if (myargs [5].strvalue != NULL &&
+			(maskfp = FileOpen(myargs [5].strvalue, "w")) == NULL)
+		{
+			ErrPostEx(SEV_FATAL, 1, 0, "vecscreen: Unable to open output file %s\n", myargs [5].strvalue);
+			return (1);
+		}
+		hits = VSBatchScreen(infp, outfp, maskfp, database, myargs [4].intvalue);
+		FileClose(infp);
+		FileClose(outfp);
+		FileClose(maskfp);
+		return hits;
+	}
+
 	align_type = BlastGetTypes("blastn", &query_is_na, &db_is_na);
 
 	align_options = 0;
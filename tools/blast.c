@@ -3259,6 +3259,170 @@ Boolean BlastGetDbChunk(ReadDBFILEPtr rdfp, Int4Ptr start, Int4Ptr stop,
     return done;
 }
 
+/*
+	Marks the database sequences to be searched by megablast: those long
+	enough when a minimum subject length is given, those with seeds 
+	when the seeds come from a database word index, and those with 
+	candidate queries when a sketch prefilters the pairs. Only the .nin offsets
+	are read for the lengths: the packed length counts the last byte as 
+	four bases, so less one it is an upper bound of the real length, up to
+	three bases over it, and a sequence is skipped only when even that 
+	bound is too short. The lengths are not read again when the caller 
+	gives them as a mask built once for the database (mb_length_mask).
+*/
+static void
+BlastSetupSubjectLengthMask(BlastSearchBlkPtr search, Int4 start_seq, 
+                            Int4 end_seq)
+{
+    BlastThrInfoPtr thr_info = search->thr_info;
+    MBWordSeedsPtr word_seeds = thr_info->word_seeds;
+    MBSketchPairsPtr sketch_pairs = thr_info->sketch_pairs;
+    Int4 min_length, index, num_skipped = 0, num_seeds = 0, num_queries = 0;
+    Uint4Ptr mask, length_mask;
+    Boolean long_enough;
+
+    thr_info->subject_length_mask = 
+       MemFree(thr_info->subject_length_mask);
+    if (search->pbp->mb_params == NULL || search->rdfp == NULL)
+       return;
+    min_length = search->pbp->mb_params->min_subject_length;
+    if (search->pbp->mb_params->sketch_recall)
+       sketch_pairs = NULL;
+    if (min_length <= 0 && word_seeds == NULL && sketch_pairs == NULL)
+       return;
+    length_mask = search->pbp->mb_params->length_mask;
+
+    if (length_mask && word_seeds == NULL && sketch_pairs == NULL) {
+       /* Only the lengths decide: take the caller's mask as it is */
+       thr_info->subject_length_mask = (Uint4Ptr) 
+          MemDup(length_mask, (end_seq/32 + 1)*sizeof(Uint4));
+       thr_info->subject_mask_start = start_seq;
+       thr_info->subject_mask_end = end_seq;
+       return;
+    }
+
+    mask = (Uint4Ptr) MemNew((end_seq/32 + 1)*sizeof(Uint4));
+    for (index = start_seq; index < end_seq; index++) {
+       if (word_seeds)
+          MBWordSeedsGet(word_seeds, index, &num_seeds);
+       if (sketch_pairs)
+          MBSketchPairsGet(sketch_pairs, index, &num_queries);
+       if (min_length <= 0)
+          long_enough = TRUE;
+       else if (length_mask)
+          long_enough = (Boolean) 
+             ((length_mask[index>>5] >> (index & 31)) & 1);
+       else
+          long_enough = (Boolean) 
+             (readdb_get_sequence_length_approx(search->rdfp, index) - 1 >=
+              min_length);
+       if (long_enough && (word_seeds == NULL || num_seeds > 0) &&
+           (sketch_pairs == NULL || num_queries > 0))
+          mask[index>>5] |= ((Uint4) 1 << (index & 31));
+       else
+          num_skipped++;
+    }
+    if (num_skipped == 0)
+       MemFree(mask);
+    else {
+       thr_info->subject_length_mask = mask;
+       thr_info->subject_mask_start = start_seq;
+       thr_info->subject_mask_end = end_seq;
+    }
+}
+
+/*
+	Takes the seeds of the database sequences start_seq to end_seq - 1 
+	from the megablast database word index, if there is one and the
+	lookup table has contiguous words.
+*/
+static void
+BlastSetupWordSeeds(BlastSearchBlkPtr search, Int4 start_seq, Int4 end_seq)
+{
+    BlastThrInfoPtr thr_info = search->thr_info;
+    MegaBlastParameterBlkPtr mb_params = search->pbp->mb_params;
+    FloatHi start_time;
+
+    thr_info->word_seeds = MBWordSeedsFree(thr_info->word_seeds);
+    if (mb_params == NULL || mb_params->word_index == NULL || 
+        mb_params->disc_word || search->rdfp == NULL || 
+        search->wfp == NULL || search->wfp->lookup == NULL)
+       return;
+
+    start_time = MBStatsClock();
+    thr_info->word_seeds = 
+       MBWordIndexSeeds(mb_params->word_index, search->wfp->lookup,
+                        start_seq, end_seq);
+    search->stage_stats.time[MB_STAGE_LOOKUP] += MBStatsClock() - start_time;
+}
+
+/*
+	Finds the candidate pairs of the queries with the database sequences
+	start_seq to end_seq - 1 in the megablast database sketch, if there
+	is one. Each query is sketched from its plus strand (its minus strand
+	when only that one is searched); the minimizers are canonical, so 
+	either gives the same pairs.
+*/
+static void
+BlastSetupSketchPairs(BlastSearchBlkPtr search, Int4 start_seq, 
+                      Int4 end_seq)
+{
+    BlastThrInfoPtr thr_info = search->thr_info;
+    MegaBlastParameterBlkPtr mb_params = search->pbp->mb_params;
+    Uint1Ptr sequence, PNTR query_seqs;
+    Int4Ptr offsets = search->query_context_offsets, query_lengths;
+    Int4 num_queries, index, context;
+    FloatHi start_time;
+
+    thr_info->sketch_pairs = MBSketchPairsFree(thr_info->sketch_pairs);
+    if (mb_params == NULL || mb_params->sketch_index == NULL || 
+        search->rdfp == NULL || offsets == NULL)
+       return;
+
+    start_time = MBStatsClock();
+    sequence = search->context[search->first_context].query->sequence;
+    num_queries = search->last_context/2 + 1;
+    query_seqs = (Uint1Ptr PNTR) MemNew(num_queries*sizeof(Uint1Ptr));
+    query_lengths = (Int4Ptr) MemNew(num_queries*sizeof(Int4));
+    for (index = 0; index < num_queries; index++) {
+       context = (offsets[2*index+1] > offsets[2*index]) ? 
+          2*index : 2*index + 1;
+       if (offsets[context+1] > offsets[context]) {
+          query_seqs[index] = sequence + offsets[context];
+          query_lengths[index] = offsets[context+1] - offsets[context] - 1;
+       }
+    }
+    thr_info->sketch_pairs = 
+       MBSketchPairsNew(mb_params->sketch_index, query_seqs, query_lengths,
+                        num_queries, start_seq, end_seq);
+    MemFree(query_lengths);
+    MemFree(query_seqs);
+    if (thr_info->sketch_pairs) {
+       search->stage_stats.sketch_pairs += 
+          (Int8) num_queries * thr_info->sketch_pairs->num_oids;
+       search->stage_stats.sketch_candidates += 
+          thr_info->sketch_pairs->num_pairs;
+    }
+    search->stage_stats.time[MB_STAGE_LOOKUP] += MBStatsClock() - start_time;
+}
+
+/* Next database sequence at or after index (and before stop) that is long
+   enough to be searched; whole mask words of short ones are skipped at 
+   once */
+static Int4
+BlastNextLongSubject(Uint4Ptr mask, Int4 index, Int4 stop)
+{
+    while (index < stop) {
+       if (mask[index>>5] == 0)
+          index = (index | 31) + 1;
+       else if (mask[index>>5] & ((Uint4) 1 << (index & 31)))
+          break;
+       else
+          index++;
+    }
+    return MIN(index, stop);
+}
+
 static VoidPtr
 do_gapped_blast_search(VoidPtr ptr)
 
@@ -3376,8 +3540,13 @@ do_blast_search(VoidPtr ptr)
     Int4 index, index1, start=0, stop=0, id_list_length;
     Int4Ptr id_list=NULL;
     Uint4 i; /* AM: Query multiplexing. */
+    Uint4Ptr length_mask;
+    Int4 mask_start, mask_end;
 
     search = (BlastSearchBlkPtr) ptr;
+    length_mask = search->thr_info->subject_length_mask;
+    mask_start = search->thr_info->subject_mask_start;
+    mask_end = search->thr_info->subject_mask_end;
 	if (search->thr_info->blast_gi_list || BlastGetVirtualOIDList(search->rdfp))
     {                                     /* FIXME: magic constant? */
         id_list = MemNew((search->thr_info->db_chunk_size+33)
@@ -3389,6 +3558,13 @@ do_blast_search(VoidPtr ptr)
         if (search->thr_info->realdb_done && id_list) {
             for (index=0; index<id_list_length; index++) {
                 index1 = id_list[index];
+                /* The ids of a gi or virtual OID list need not be in the
+                   range the mask was set up for; those are searched */
+                if (length_mask && index1 >= mask_start && index1 < mask_end &&
+                    !(length_mask[index1>>5] & ((Uint4) 1 << (index1 & 31)))) {
+                   search->stage_stats.subjects_skipped++;
+                   continue;
+                }
                 if ((status = BLASTPerformSearchWithReadDb(search, index1))
                     != 0)
                    break;
@@ -3402,7 +3578,16 @@ do_blast_search(VoidPtr ptr)
                    if (!search->handle_results)
                       status = BlastReevaluateWithAmbiguities(search, index1);
                 } else {
+                   Boolean timing = search->pbp->mb_params->stage_timing;
+                   FloatHi start_time = timing ? MBStatsClock() : 0.0;
+
                    MegaBlastReevaluateWithAmbiguities(search);
+                   if (timing)
+                      search->stage_stats.time[MB_STAGE_TRACEBACK] += 
+                         MBStatsClock() - start_time;
+                   if (search->current_hitlist)
+                      search->stage_stats.hsps_found += 
+                         search->current_hitlist->hspcnt;
                 }
 		
                 if (search->handle_results)
@@ -3423,6 +3608,12 @@ do_blast_search(VoidPtr ptr)
             }
         } else if (!search->thr_info->realdb_done) {
             for (index=start; index<stop; index++) {
+                if (length_mask) {
+                   index1 = BlastNextLongSubject(length_mask, index, stop);
+                   search->stage_stats.subjects_skipped += index1 - index;
+                   if ((index = index1) == stop)
+                      break;
+                }
                 if ((status = BLASTPerformSearchWithReadDb(search, index))
                     != 0)
                    break;
@@ -3436,7 +3627,16 @@ do_blast_search(VoidPtr ptr)
                    if (!search->handle_results)
                       status = BlastReevaluateWithAmbiguities(search, index);
                 } else {
+                   Boolean timing = search->pbp->mb_params->stage_timing;
+                   FloatHi start_time = timing ? MBStatsClock() : 0.0;
+
                    MegaBlastReevaluateWithAmbiguities(search);
+                   if (timing)
+                      search->stage_stats.time[MB_STAGE_TRACEBACK] += 
+                         MBStatsClock() - start_time;
+                   if (search->current_hitlist)
+                      search->stage_stats.hsps_found += 
+                         search->current_hitlist->hspcnt;
                 }
                 if (search->handle_results)
                    search->handle_results((VoidPtr) search);
@@ -3492,6 +3692,28 @@ do_blast_search(VoidPtr ptr)
     return (VoidPtr) search;
 } 
 
+/* Greedy alignment memory of the search blocks duplicated for the threads,
+   kept from one do_the_blast_run to the next as it only depends on the
+   database and the scoring parameters; indexed by thread */
+static GreedyAlignMemPtr PNTR blast_spare_abmp = NULL;
+static Int4 blast_num_spare_abmp = 0;
+static TNlmMutex blast_spare_mutex = NULL;
+
+void LIBCALL
+BlastFreeSpareGreedyMem(void)
+{
+    Int4 index;
+
+    NlmMutexLockEx(&blast_spare_mutex);
+    for (index = 0; index < blast_num_spare_abmp; index++) {
+       if (blast_spare_abmp[index])
+          GreedyAlignMemFree(blast_spare_abmp[index]);
+    }
+    blast_spare_abmp = MemFree(blast_spare_abmp);
+    blast_num_spare_abmp = 0;
+    NlmMutexUnlock(blast_spare_mutex);
+}
+
 void LIBCALL
 do_the_blast_run(BlastSearchBlkPtr search)
 
@@ -3500,6 +3722,9 @@ do_the_blast_run(BlastSearchBlkPtr search)
     Char buffer[256];
     Int2 index;
     TNlmThread PNTR thread_array;
+    TNlmThreadStart thread_func;
+    GreedyAlignMemPtr PNTR spare_abmp;
+    Int4 num_spare_abmp;
     VoidPtr status=NULL;
     int num_entries_total;
     int num_entries_total_real;
@@ -3535,6 +3760,14 @@ do_the_blast_run(BlastSearchBlkPtr search)
     }
     
     start_seq = MAX(0, MIN(search->pbp->first_db_seq, end_seq));
+
+    /* Queries that are a slice of the database are not searched against
+       the sequences up to their own: none of them is against those up to
+       the first query's (see MegaBlastSetQueryLimit) */
+    if (search->pbp->mb_params && search->pbp->mb_params->query_oids)
+        start_seq = MAX(start_seq, 
+                        MIN(search->pbp->mb_params->query_oids[0] + 1, 
+                            end_seq));
     
     /* Set BlastGetDbChunk()'s pointers and counters */
     
@@ -3545,16 +3778,33 @@ do_the_blast_run(BlastSearchBlkPtr search)
     search->thr_info->final_db_seq = end_seq;
     
     ConfigureDbChunkSize(search, search->dbseq_num);
+    BlastSetupWordSeeds(search, start_seq, end_seq);
+    BlastSetupSketchPairs(search, start_seq, end_seq);
+    BlastSetupSubjectLengthMask(search, start_seq, end_seq);
 
     if (NlmThreadsAvailable() && search->pbp->process_num > 1) {
         NlmMutexInit(&search->thr_info->db_mutex);
         NlmMutexInit(&search->thr_info->results_mutex);
         NlmMutexInit(&search->thr_info->ambiguities_mutex);
         
+        /* Take the spare greedy memory; a search running at the same
+           time in another thread allocates its own */
+        NlmMutexLockEx(&blast_spare_mutex);
+        spare_abmp = blast_spare_abmp;
+        num_spare_abmp = blast_num_spare_abmp;
+        blast_spare_abmp = NULL;
+        blast_num_spare_abmp = 0;
+        NlmMutexUnlock(blast_spare_mutex);
+
         array = (BlastSearchBlkPtr PNTR) MemNew((search->pbp->process_num)*sizeof(BlastSearchBlkPtr));
         array[0] = search;
         for (index=1; index<search->pbp->process_num; index++) {
-            array[index] = BlastSearchBlkDuplicate(search);
+            if (index < num_spare_abmp) {
+               array[index] = 
+                  BlastSearchBlkDuplicateEx(search, spare_abmp[index]);
+               spare_abmp[index] = NULL;
+            } else
+               array[index] = BlastSearchBlkDuplicate(search);
             if (array[index] == NULL) {
                search->pbp->process_num = index;
                ErrPostEx(SEV_WARNING, 0, 0, "Number of threads reduced to %d", index);
@@ -3562,21 +3812,48 @@ do_the_blast_run(BlastSearchBlkPtr search)
             }
         }
         
-        thread_array = (TNlmThread PNTR) MemNew((search->pbp->process_num)*sizeof(TNlmThread));
-        for (index=0; index<search->pbp->process_num; index++) {
-            if (search->pbp->gapped_calculation && StringCmp(search->prog_name, "blastn") != 0)
-                thread_array[index] = NlmThreadCreateEx(do_gapped_blast_search, (VoidPtr) array[index], THREAD_RUN|THREAD_BOUND, eTP_Default, NULL, NULL);
-            else
-                thread_array[index] = NlmThreadCreateEx(do_blast_search, (VoidPtr) array[index], THREAD_RUN|THREAD_BOUND, eTP_Default, NULL, NULL);
-            
-            if (NlmThreadCompare(thread_array[index], NULL_thread)) {
-                ErrPostEx(SEV_ERROR, 0, 0, "Unable to open thread.");
-            }
+        if (search->pbp->gapped_calculation && StringCmp(search->prog_name, "blastn") != 0)
+            thread_func = do_gapped_blast_search;
+        else
+            thread_func = do_blast_search;
+
+        /* The threads of the process wide pool stay up between searches;
+           if it is busy with another search, threads are started for 
+           this one. BLAST_PIN_THREADS in the environment pins the pool
+           threads to CPUs */
+        if (NlmThreadPoolRun(NlmThreadPoolShared((Boolean)
+                                (getenv("BLAST_PIN_THREADS") != NULL)),
+                             thread_func, (VoidPtr PNTR) array, NULL,
+                             search->pbp->process_num) != 0) {
+           thread_array = (TNlmThread PNTR) MemNew((search->pbp->process_num)*sizeof(TNlmThread));
+           for (index=0; index<search->pbp->process_num; index++) {
+              thread_array[index] = NlmThreadCreateEx(thread_func, (VoidPtr) array[index], THREAD_RUN|THREAD_BOUND, eTP_Default, NULL, NULL);
+              
+              if (NlmThreadCompare(thread_array[index], NULL_thread)) {
+                 ErrPostEx(SEV_ERROR, 0, 0, "Unable to open thread.");
+              }
+           }
+
+           for (index=0; index<search->pbp->process_num; index++) {
+              NlmThreadJoin(thread_array[index], &status);
+           }
+           thread_array = MemFree(thread_array);
         }
 
-        for (index=0; index<search->pbp->process_num; index++) {
-            NlmThreadJoin(thread_array[index], &status);
+#ifdef BLAST_COLLECT_STATS
+        /* Keep the per thread statistics before they are summed up */
+        if (search->thread_stats == NULL) {
+            search->num_thread_stats = search->pbp->process_num;
+            search->thread_stats = (MBStageStatsPtr) 
+                MemNew(search->num_thread_stats*sizeof(MBStageStats));
+        }
+        for (index=0; index<search->pbp->process_num && 
+                 index<search->num_thread_stats; index++) {
+            BlastStageStatsUpdate(array[index]);
+            MBStageStatsAdd(&search->thread_stats[index], 
+                            &array[index]->stage_stats);
         }
+#endif
 
         for (index=1; index<search->pbp->process_num; index++) {
 #ifdef BLAST_COLLECT_STATS
@@ -3592,6 +3869,7 @@ do_the_blast_run(BlastSearchBlkPtr search)
             search->prelim_gap_passed += array[index]->prelim_gap_passed;
             search->prelim_gap_attempts += array[index]->prelim_gap_attempts;
             search->real_gap_number_of_hsps += array[index]->real_gap_number_of_hsps;
+            MBStageStatsAdd(&search->stage_stats, &array[index]->stage_stats);
 #endif
 
             if( array[index]->mult_queries ) { /* AM: query concatenation: free resources */
@@ -3602,12 +3880,36 @@ do_the_blast_run(BlastSearchBlkPtr search)
                 MemFree( array[index]->mult_queries->HitListArray );
                 MemFree( array[index]->mult_queries );
             }
+            /* Kept for the next search */
+            if (array[index]->abmp) {
+               if (index >= num_spare_abmp) {
+                  spare_abmp = (GreedyAlignMemPtr PNTR) 
+                     Realloc(spare_abmp, (index+1)*sizeof(GreedyAlignMemPtr));
+                  MemSet(spare_abmp + num_spare_abmp, 0, 
+                         (index + 1 - num_spare_abmp)*sizeof(GreedyAlignMemPtr));
+                  num_spare_abmp = index + 1;
+               }
+               spare_abmp[index] = array[index]->abmp;
+               array[index]->abmp = NULL;
+            }
             /* Not copied at thread start. */
             array[index] = BlastSearchBlkDestruct(array[index]);	
         }
         array = MemFree(array);
 
-        thread_array = MemFree(thread_array);
+        NlmMutexLockEx(&blast_spare_mutex);
+        if (blast_spare_abmp == NULL) {
+           blast_spare_abmp = spare_abmp;
+           blast_num_spare_abmp = num_spare_abmp;
+           spare_abmp = NULL;
+           num_spare_abmp = 0;
+        }
+        NlmMutexUnlock(blast_spare_mutex);
+        for (index=0; index<num_spare_abmp; index++) {
+           if (spare_abmp[index])
+              GreedyAlignMemFree(spare_abmp[index]);
+        }
+        MemFree(spare_abmp);
         
         NlmMutexDestroy(search->thr_info->db_mutex);
         search->thr_info->db_mutex = NULL;
@@ -3621,6 +3923,12 @@ do_the_blast_run(BlastSearchBlkPtr search)
         else
             do_blast_search((VoidPtr) search);
     }
+    search->thr_info->word_seeds = 
+       MBWordSeedsFree(search->thr_info->word_seeds);
+    if (search->pbp->mb_params == NULL || 
+        !search->pbp->mb_params->sketch_recall)
+       search->thr_info->sketch_pairs = 
+          MBSketchPairsFree(search->thr_info->sketch_pairs);
     if (search->rdfp->parameters & READDB_CONTENTS_ALLOCATED)
         search->rdfp = ReadDBCloseMHdrAndSeqFiles(search->rdfp); 
     if (time_out_boolean) {
@@ -5258,6 +5566,7 @@ available) this needs to be set higher up. */
 	search->pbp->gap_open = options->gap_open;
 	search->pbp->gap_extend = options->gap_extend;
         search->pbp->decline_align = options->decline_align;
+        search->pbp->vector_dp = options->vector_dp;
         search->pbp->total_hsp_limit = options->total_hsp_limit;
 
 	search->pbp->hsp_num_max = options->hsp_num_max;
@@ -6463,6 +6772,11 @@ BLASTPerformSearchWithReadDb (BlastSearchBlkPtr search, Int4 sequence_number)
 
 	subject_length = readdb_get_sequence(search->rdfp, sequence_number, &subject_seq);
 
+	search->stage_stats.subjects++;
+	if (search->rdfp->parameters & READDB_IS_PROT)
+		search->stage_stats.db_bytes += subject_length;
+	else
+		search->stage_stats.db_bytes += (subject_length + 3) / 4;
 	search->dblen_eff_real += MAX(subject_length-search->length_adjustment, 1);
 	search->subject_id = sequence_number;
 
@@ -6631,6 +6945,14 @@ BLASTPerformFinalSearch (BlastSearchBlkPtr search, Int4 subject_length, Uint1Ptr
     Uint1Ptr prot_seq;
     
     BlastHitListPurge(search->current_hitlist);
+    /* The Mega BLAST HSPs of the previous subject are gone with the purge;
+       take their memory back in one go */
+    if (search->pbp->mb_params) {
+       if (search->hsp_arena)
+          ArenaReset(search->hsp_arena);
+       else
+          search->hsp_arena = ArenaNew(0);
+    }
     if (subject_length == 0)
        /* Normal return */
 	return 0;
@@ -6972,9 +7294,23 @@ BlastWordFinder(BlastSearchBlkPtr search)
 
 	if (search->prog_number == blast_type_blastn)
 	{
-	   if (search->pbp->mb_params)
-	      return MegaBlastWordFinder(search, lookup);
-	   else
+	   if (search->pbp->mb_params) {
+	      /* Extension is timed on its own, inside the word finder */
+	      Boolean timing = search->pbp->mb_params->stage_timing;
+	      FloatHi start_time = timing ? MBStatsClock() : 0.0;
+	      FloatHi extend_time = 
+		 search->stage_stats.time[MB_STAGE_EXTEND];
+	      Int4 status = MegaBlastWordFinder(search, lookup);
+
+	      if (timing) {
+		 search->stage_stats.time[MB_STAGE_SCAN] += 
+		    MBStatsClock() - start_time - 
+		    (search->stage_stats.time[MB_STAGE_EXTEND] - extend_time);
+		 MBStageStatsNotePeak(&search->stage_stats, MB_STAGE_SCAN,
+				      MB_STAGE_EXTEND);
+	      }
+	      return status;
+	   } else
 	      return BlastNtWordFinder(search, lookup);
 	}
 	else
@@ -468,6 +468,7 @@ Contents: prototypes for "public" BLAST functions (ones that other utilitiles
 
 #include <ncbi.h>
 #include <blastdef.h>
+#include <seqport.h>
 
 /* AM: Support for query multiplexing. */
 #include "blastconcatdef.h"
@@ -537,6 +538,10 @@ BLASTSubjectInfoPtr LIBCALL BLASTSubjectInfoDestruct PROTO((BLASTSubjectInfoPtr
 
 void LIBCALL do_the_blast_run PROTO((BlastSearchBlkPtr search));
 
+/* Free the greedy alignment memory do_the_blast_run keeps for the next
+   search; to be called once the program runs no more searches */
+void LIBCALL BlastFreeSpareGreedyMem PROTO((void));
+
 Int2 LIBCALL BlastSequenceAddSequence PROTO((BlastSequenceBlkPtr sequence_blk, Uint1Ptr sequence, Uint1Ptr sequence_start, Int4 length, Int4 original_seq, Int4 effective_length));
 
 BlastSequenceBlkPtr LIBCALL
@@ -555,6 +560,25 @@ SeqAlignPtr LIBCALL BlastTwoSequencesByLoc PROTO((SeqLocPtr slp1, SeqLocPtr slp2
 
 SeqAlignPtr LIBCALL BlastTwoSequencesByLocEx PROTO((SeqLocPtr slp1, SeqLocPtr slp2, CharPtr progname, BLAST_OptionsBlkPtr options, ValNodePtr *other_returns, ValNodePtr *error_returns));
 
+/*
+	A blastn subject location encoded once (Blast2SeqSubjectNew) and then
+	searched by any number of queries, possibly from several threads, with
+	BlastTwoSequencesByLocWithSubject.  The query is always slp1.
+*/
+typedef struct blast2seqsubject {
+	SeqLocPtr slp;		/* the subject location, as given */
+	Int4 length;
+	SPCompressPtr spc;	/* plus strand in ncbi2na, for the word scan */
+	Uint1Ptr blastna_start;	/* plus strand in blastna between two gap
+				   sentinels, for the traceback */
+} Blast2SeqSubject, PNTR Blast2SeqSubjectPtr;
+
+Blast2SeqSubjectPtr LIBCALL Blast2SeqSubjectNew PROTO((SeqLocPtr slp));
+
+Blast2SeqSubjectPtr LIBCALL Blast2SeqSubjectFree PROTO((Blast2SeqSubjectPtr subject));
+
+SeqAlignPtr LIBCALL BlastTwoSequencesByLocWithSubject PROTO((SeqLocPtr slp1, Blast2SeqSubjectPtr subject, BLAST_OptionsBlkPtr options, ValNodePtr *other_returns, ValNodePtr *error_returns));
+
 /* Notes for psi-blast2sequences (compare a PSSM with sequence slp2):  (CC)
  * =============================
  * 1) This functionality requires (at least) the residue frequencies
@@ -684,6 +708,11 @@ void LIBCALL updateLambdaK PROTO((BlastMatrixRescalePtr matrix_rescale, Boolean
 
 BlastSearchBlkPtr GreedyAlignMemAlloc PROTO((BlastSearchBlkPtr search));
 
+/* GreedyAlignMemAlloc taking over spare, greedy alignment memory kept
+   from an earlier search, if it fits (spare is freed otherwise) */
+BlastSearchBlkPtr GreedyAlignMemAllocEx PROTO((BlastSearchBlkPtr search,
+                                               GreedyAlignMemPtr spare));
+
 Boolean parse_blast_options(BLAST_OptionsBlkPtr options, CharPtr string_options, CharPtr PNTR error_message, CharPtr PNTR database, Int4Ptr descriptions, Int4Ptr alignments);
 
 Int2
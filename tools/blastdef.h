@@ -913,6 +913,9 @@ Contents: #defines and definitions for structures used by BLAST.
 #include <readdb.h>
 #include <gapxdrop.h>
 #include <mbalign.h>
+#include <mbstats.h>
+#include <mbwindex.h>
+#include <mbsketch.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -1179,9 +1182,52 @@ typedef struct _blast_optionsblk {
         Int2 mb_template_length;  /* Length of the discontiguous word */
         Boolean mb_use_dyn_prog;  /* Use dynamic programming gapped extension in
                                      megablast with affine gap scores */ 
+        Boolean vector_dp;  /* Score the nucleotide dynamic programming
+                               extension with the vectorized kernel */
         MBDiscWordType mb_disc_type;
 	Uint4 NumQueries;		/*--KM for query concatenation in [t]blastn */
         Boolean ignore_gilist;    /* Used in traceback stage to not lookup gi's */
+        MBSearchStatsPtr search_stats; /* If set, receives the per stage 
+                                          statistics of each megablast 
+                                          search; owned by the caller */
+        Boolean mb_stage_timing; /* Also time the stages of the search into
+                                    search_stats and record the peak memory;
+                                    this costs clock calls per database 
+                                    sequence, the counters are always kept */
+        Int4 mb_min_subject_length; /* Skip database sequences shorter 
+                                       than this */
+        Uint4Ptr mb_length_mask; /* If set, the sequences of the database
+                                    long enough for mb_min_subject_length
+                                    (see MegaBlastSubjectLengthMask), so
+                                    that their lengths are not read again
+                                    for each search; owned by the caller */
+        ReadDBFILEPtr shared_rdfp; /* If set, megablast attaches to this 
+                                      already open database instead of 
+                                      opening it again; owned by the caller */
+        Int4 mb_hsp_buffer_max; /* If positive, keep at most this many HSPs
+                                   per database sequence in each thread */
+        MBWordIndexPtr mb_word_index; /* If set, megablast takes its seeds
+                                         from this database word index 
+                                         instead of scanning the database;
+                                         owned by the caller */
+        Int4Ptr mb_query_oids; /* If set, the queries are a slice of the 
+                                  database: the ordinal id of each query,
+                                  in increasing order. A query is then not
+                                  searched against the sequences up to its
+                                  own, whose pairs with it are found from
+                                  the other side; owned by the caller */
+        MBSketchIndexPtr mb_sketch_index; /* If set, megablast only extends
+                                             the seeds of the query-subject
+                                             pairs this minimizer sketch 
+                                             finds; owned by the caller */
+        Boolean mb_sketch_recall; /* Search all pairs anyway, only counting
+                                     the candidate ones (recall check) */
+        Int4 mb_verify_overhang; /* If positive, megablast seeds that
+                                    cannot give an overlap passing the
+                                    mgblast filter (perc_identity, this 
+                                    maximum overhang and the minimum
+                                    overlap mb_min_subject_length) are
+                                    rejected before the gapped extension */
       } BLAST_OptionsBlk, PNTR BLAST_OptionsBlkPtr;
 
 
@@ -1326,6 +1372,25 @@ typedef struct _mb_parameter_blk_ {
                                scores */
    MBTemplateType template_type; /* Type of a discontiguous template */
    Boolean use_two_templates;
+   Int4 min_subject_length; /* Database sequences shorter than this cannot
+                               give a reportable hit and are not searched */
+   Boolean stage_timing;    /* Time the stages into the search's 
+                               stage_stats (see mb_stage_timing) */
+   Uint4Ptr length_mask;    /* Bit of each database sequence of at least
+                               min_subject_length, NULL to read the lengths */
+   Int4 hsp_buffer_max;     /* Memory cap on the HSPs of one database 
+                               sequence; the lowest scoring ones are 
+                               dropped beyond it (0 = no cap) */
+   MBWordIndexPtr word_index; /* Database word index to take the seeds 
+                                 from, NULL to scan the database */
+   Int4Ptr query_oids;        /* Database ordinal id of each query, if the
+                                 queries are a slice of the database */
+   MBSketchIndexPtr sketch_index; /* Database sketch giving the candidate
+                                     query-subject pairs, NULL to search
+                                     all pairs */
+   Boolean sketch_recall;     /* The candidate pairs are only counted */
+   Int4 verify_overhang;      /* Maximum overhang of the overlaps the seeds
+                                 are verified against, 0 not to verify */
 } MegaBlastParameterBlk, PNTR MegaBlastParameterBlkPtr;
 
 /****************************************************************************
@@ -1385,6 +1450,7 @@ typedef struct _blast_parameterblk {
 			gap_x_dropoff,	/* X-dropoff used by Gapped align routine. */
 			gap_x_dropoff_final;	/* X-dropoff (in bits) used by Gapped align routine for FINAL alignment. */
         Int4            decline_align;  /* Cost for declining alignment */
+        Boolean         vector_dp;  /* Use the vectorized nucleotide DP */
 
 	Nlm_FloatHi	gap_trigger; /* Score (in bits) to gap, if an HSP gaps well.*/
 
@@ -1541,6 +1607,8 @@ typedef struct _blast_hsp {
 /*which method if any was used for compositional adjustment?
   relevant only for blastp*/
 		Int2		comp_adjustment_method; 
+/* Allocated from the hsp_arena of the search, not to be freed alone */
+		Boolean		in_arena;
 	} BLAST_HSP, PNTR BLAST_HSPPtr;
 
 /* The helper arrays contains the info used frequently in the inner for loops. -cfj
@@ -1817,6 +1885,19 @@ typedef struct _BlastThrInfo {
     /* whether real databases are done */
     Boolean	realdb_done;
 
+    /* Megablast: bit set for each database sequence long enough to be 
+       searched (see mb_params->min_subject_length), NULL if all are */
+    Uint4Ptr subject_length_mask;
+    /* Ordinal ids covered by subject_length_mask: the sequences from 
+       subject_mask_start to subject_mask_end - 1 */
+    Int4 subject_mask_start, subject_mask_end;
+    /* Megablast: seeds of the database sequences searched, from the
+       database word index (see mb_params->word_index) */
+    MBWordSeedsPtr word_seeds;
+    /* Megablast: candidate pairs of the query block with the database
+       sequences searched (see mb_params->sketch_index) */
+    MBSketchPairsPtr sketch_pairs;
+
 } BlastThrInfo, PNTR BlastThrInfoPtr;
     
 /*
@@ -2086,7 +2167,20 @@ a field is allocated, then it's bit is non-zero.
         prelim_gap_attempts,	/* No. of HSP's we attempted to gap. */
         real_gap_number_of_hsps, /* How many HSP's were gapped in BlastGetGappedScore. */
         semid;                  /* Here will be stored ID of load-ballance semaphore */
+    MBStageStats stage_stats; /* Megablast per stage timing and counters */
+    Int4 num_thread_stats;    /* Number of entries in thread_stats */
+    MBStageStatsPtr thread_stats; /* stage_stats of each thread, saved by 
+                                     do_the_blast_run */
+    Int4 query_limit;         /* Seeds of the query block ending past this
+                                 offset are not extended against the 
+                                 current subject (mb_params->query_oids) */
+    Int4Ptr sketch_queries;   /* Only the seeds of these queries are 
+                                 extended against the current subject, */
+    Int4 num_sketch_queries;  /* -1 for all (thr_info->sketch_pairs) */
     GreedyAlignMemPtr abmp; /* Memory for megablast greedy extension */
+    Nlm_ArenaPtr hsp_arena; /* Mega BLAST HSPs and edit scripts of the 
+                               current subject sequence; reset when its
+                               hitlist is purged */
     Int4 PNTR query_context_offsets; /* offsets for all queries and strands in a 
                                         concatenated sequence */
     SeqIdPtr PNTR qid_array; /* Ids of all queries in Mega BLAST search */
@@ -734,6 +734,10 @@ Int2 LIBCALL BlastTimeFillStructure PROTO((BlastTimeKeeperPtr btkp));
 
 BlastSearchBlkPtr LIBCALL BlastSearchBlkDuplicate PROTO((BlastSearchBlkPtr search));
 
+/* BlastSearchBlkDuplicate taking over spare_abmp, greedy alignment memory
+   kept from an earlier search, see GreedyAlignMemAllocEx */
+BlastSearchBlkPtr LIBCALL BlastSearchBlkDuplicateEx PROTO((BlastSearchBlkPtr search, GreedyAlignMemPtr spare_abmp));
+
 BlastSearchBlkPtr LIBCALL BlastSearchBlkNew PROTO((Int2 wordsize, Int4 qlen, CharPtr dbname, Boolean multiple_hits, BLAST_Score threshold_first, BLAST_Score threshold_second, Int4 result_size, CharPtr prog_name, BlastAllWordPtr all_words, Int2 first_context, Int2 last_context, Int4 window_size));
 
 /* Allocates a search Block, except it only attaches to the rdfp, does not allocate it. */
@@ -852,6 +856,8 @@ BlastErrorMsgPtr BlastDestroyErrorMessage PROTO((BlastErrorMsgPtr error_msg));
 ValNodePtr BlastErrorChainDestroy PROTO((ValNodePtr vnp));
 
 ValNodePtr LIBCALL BlastOtherReturnsPrepare PROTO((BlastSearchBlkPtr search));
+void LIBCALL BlastStageStatsUpdate PROTO((BlastSearchBlkPtr search));
+void LIBCALL BlastSearchStatsPrepare PROTO((BlastSearchBlkPtr search, MBSearchStatsPtr stats));
 void LIBCALL BlastOtherReturnsFree PROTO((ValNodePtr other_returns));
 
 SeqLocPtr BlastBioseqFilter PROTO((BioseqPtr bsp, CharPtr instructions));
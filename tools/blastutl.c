@@ -2760,8 +2760,13 @@ static BLAST_ScorePtr *RPS2SeqImpalaStatCorrections
     return retval;
 }
 
+/*
+	subject_blastna, if not NULL, is the blastn subject already in blastna
+	with a gap sentinel on both sides (see Blast2SeqSubjectNew); otherwise
+	it is read from slp for the traceback.
+*/
 static SeqAlignPtr 
-BlastTwoSequencesCore (BlastSearchBlkPtr search, SeqLocPtr slp, Uint1Ptr subject_seq, Int4 subject_length, Boolean reverse)
+BlastTwoSequencesCore (BlastSearchBlkPtr search, SeqLocPtr slp, Uint1Ptr subject_seq, Int4 subject_length, Boolean reverse, Uint1Ptr subject_blastna)
 
 {
 	BLASTResultsStructPtr result_struct;
@@ -2814,7 +2819,12 @@ BlastTwoSequencesCore (BlastSearchBlkPtr search, SeqLocPtr slp, Uint1Ptr subject
 		   search->pbp->gapped_calculation == TRUE) {
              result_struct = search->result_struct;
              hitlist_count = result_struct->hitlist_count;
-             if (hitlist_count > 0)
+             if (hitlist_count > 0 && subject_blastna != NULL)
+	     {
+                sequence_start = NULL;
+                sequence = subject_blastna;
+	     }
+             else if (hitlist_count > 0)
 	     {
                 spp = SeqPortNewByLoc(slp, Seq_code_ncbi4na);
                 if (subject_bsp->repr == Seq_repr_delta) 
@@ -2835,6 +2845,10 @@ BlastTwoSequencesCore (BlastSearchBlkPtr search, SeqLocPtr slp, Uint1Ptr subject
                 }
                 /* Gap character in last space. */
                 sequence[index] = ncbi4na_to_blastna[0];
+                spp = SeqPortFree(spp);
+             }
+             if (hitlist_count > 0)
+             {
                 
                 if (!search->pbp->mb_params) {
                    /* Traditional Blastn */
@@ -2848,7 +2862,6 @@ BlastTwoSequencesCore (BlastSearchBlkPtr search, SeqLocPtr slp, Uint1Ptr subject
                 }
 
                 sequence_start = MemFree(sequence_start);
-                spp = SeqPortFree(spp);
              }
 	  }
 	  else if (search->pbp->gapped_calculation == TRUE)
@@ -3407,7 +3420,7 @@ SeqAlignPtr LIBCALL B2SPssmOnTheFlyByLoc(BlastSearchBlkPtr search,
     }
 
     seqalign = BlastTwoSequencesCore(search, subj_slp, subject_seq, 
-            subject_length, FALSE);
+            subject_length, FALSE, NULL);
 
     MemFree(subject_seq_start);
     AdjustOffSetsInSeqAlign(seqalign, search->query_slp, subj_slp);
@@ -3677,7 +3690,7 @@ BlastTwoSequencesByLocWithCallback(SeqLocPtr slp1, SeqLocPtr slp2, CharPtr
     search->handle_results = handle_results;
     search->output = options->output;
 
-	seqalign = BlastTwoSequencesCore(search, subject_slp, subject_seq, subject_length, reverse);
+	seqalign = BlastTwoSequencesCore(search, subject_slp, subject_seq, subject_length, reverse, NULL);
 
 	if (complement)
 	{
@@ -3725,6 +3738,153 @@ BlastTwoSequencesByLoc(SeqLocPtr slp1, SeqLocPtr slp2, CharPtr progname, BLAST_O
 	return BlastTwoSequencesByLocEx(slp1, slp2, progname, options, NULL, NULL);
 }
 
+/*
+	Encodes a blastn subject location once for BlastTwoSequencesByLocWithSubject:
+	the plus strand of the interval in ncbi2na for the word scan and in blastna
+	for the traceback.
+*/
+Blast2SeqSubjectPtr LIBCALL
+Blast2SeqSubjectNew(SeqLocPtr slp)
+{
+	Blast2SeqSubjectPtr subject;
+	BioseqPtr bsp;
+	Int4 index, length;
+	SeqLocPtr plus_slp;
+	SeqPortPtr spp;
+
+	if (slp == NULL || (length = SeqLocLen(slp)) <= 0)
+		return NULL;
+
+	subject = (Blast2SeqSubjectPtr) MemNew(sizeof(Blast2SeqSubject));
+	subject->slp = SeqLocCopy(slp);
+	subject->length = length;
+
+	plus_slp = SeqLocIntNew(SeqLocStart(slp), SeqLocStop(slp), Seq_strand_plus, SeqLocId(slp));
+	spp = SeqPortNewByLoc(plus_slp, Seq_code_ncbi4na);
+	bsp = BioseqFindCore(SeqLocId(slp));
+	if (bsp != NULL && bsp->repr == Seq_repr_delta)
+		SeqPortSet_do_virtual(spp, TRUE);
+	subject->spc = SPCompressDNA(spp);
+	spp = SeqPortFree(spp);
+
+	/* A gap sentinel on each side "protects" ALIGN. */
+	subject->blastna_start = (Uint1Ptr) MemNew((length+2)*sizeof(Uint1));
+	if (subject->spc == NULL || subject->blastna_start == NULL ||
+	    SeqPortBulkReadLoc(plus_slp, Seq_code_ncbi4na, subject->blastna_start+1) != length)
+	{
+		SeqLocFree(plus_slp);
+		return Blast2SeqSubjectFree(subject);
+	}
+	subject->blastna_start[0] = ncbi4na_to_blastna[0];
+	for (index=1; index<=length; index++)
+		subject->blastna_start[index] = ncbi4na_to_blastna[subject->blastna_start[index]];
+	subject->blastna_start[length+1] = ncbi4na_to_blastna[0];
+
+	SeqLocFree(plus_slp);
+
+	return subject;
+}
+
+Blast2SeqSubjectPtr LIBCALL
+Blast2SeqSubjectFree(Blast2SeqSubjectPtr subject)
+{
+	if (subject == NULL)
+		return NULL;
+
+	SeqLocFree(subject->slp);
+	if (subject->spc)
+		SPCompressFree(subject->spc);
+	MemFree(subject->blastna_start);
+
+	return (Blast2SeqSubjectPtr) MemFree(subject);
+}
+
+/*
+	BlastTwoSequencesByLocEx for blastn against a subject encoded by
+	Blast2SeqSubjectNew, so that many queries can be searched against one
+	long subject without decoding it again.  slp1 is always the query.
+	The subject is only read, so it may be shared by concurrent searches.
+*/
+SeqAlignPtr LIBCALL
+BlastTwoSequencesByLocWithSubject(SeqLocPtr slp1, Blast2SeqSubjectPtr subject, BLAST_OptionsBlkPtr options, ValNodePtr *other_returns, ValNodePtr *error_returns)
+{
+	BlastSearchBlkPtr search;
+	Boolean complement=FALSE;
+	Int2 status;
+	SeqAlignPtr seqalign=NULL;
+	SeqLocPtr subject_slp;
+
+	if (error_returns)
+		*error_returns = NULL;
+	if (other_returns)
+		*other_returns = NULL;
+
+	if (slp1 == NULL || subject == NULL || options == NULL)
+		return NULL;
+
+	status = BLASTOptionValidateEx(options, "blastn", error_returns);
+	if (status != 0)
+		return NULL;
+
+	/* The strands are handled as in BlastTwoSequencesByLocWithCallback,
+	   on a copy of the shared subject location. */
+	subject_slp = SeqLocCopy(subject->slp);
+	if (SeqLocStrand(slp1) != Seq_strand_both && 
+	    SeqLocStrand(subject_slp) == Seq_strand_both) {
+		Change_Loc_Strand(subject_slp, SeqLocStrand(slp1));
+		Change_Loc_Strand(slp1, Seq_strand_both);
+	}
+	if (SeqLocStrand(subject_slp) == Seq_strand_minus)
+	{
+		complement = TRUE;
+		if(SeqLocStrand(slp1) == Seq_strand_plus ||
+		   SeqLocStrand(slp1) == Seq_strand_minus)
+			SeqLocRevCmp(slp1);
+		SeqLocRevCmp(subject_slp);
+	}
+
+	if (options->db_length == 0)
+		options->db_length = subject->length;
+
+	options->dbseq_num = 1;
+
+	search = BLASTSetUpSearchByLoc(slp1, "blastn", SeqLocLen(slp1), subject->length, NULL, options, NULL);
+
+	if (search == NULL || search->query_invalid)
+	{
+		search = BlastSearchBlkDestruct(search);
+		SeqLocFree(subject_slp);
+		return NULL;
+	}
+
+	search->output = options->output;
+
+	seqalign = BlastTwoSequencesCore(search, subject_slp, subject->spc->buffer, subject->length, FALSE, subject->blastna_start+1);
+
+	if (complement)
+	{
+		seqalign = SeqAlignListReverseStrand(seqalign);
+		SeqLocRevCmp(slp1);
+		SeqLocRevCmp(subject_slp);
+	}
+
+	if (search->error_return)
+	{
+		ValNodeLink(error_returns, search->error_return);
+		search->error_return = NULL;
+	}
+
+	if (other_returns)
+		*other_returns = BlastOtherReturnsPrepare(search);
+
+	AdjustOffSetsInSeqAlign(seqalign, slp1, subject_slp);
+
+	search = BlastSearchBlkDestruct(search);
+	SeqLocFree(subject_slp);
+
+	return seqalign;
+}
+
 SeqAlignPtr LIBCALL
 BlastTwoSequencesEx(BioseqPtr bsp1, BioseqPtr bsp2, CharPtr progname, BLAST_OptionsBlkPtr options, ValNodePtr *other_returns, ValNodePtr *error_returns)
 {
@@ -3929,7 +4089,7 @@ BlastSequencesOnTheFlyByLoc(BlastSearchBlkPtr search, SeqLocPtr subject_slp)
 		return NULL;
 	}
 
-	seqalign = BlastTwoSequencesCore(search, subject_slp, subject_seq, subject_length, FALSE);
+	seqalign = BlastTwoSequencesCore(search, subject_slp, subject_seq, subject_length, FALSE, NULL);
 
 	if (spc)
 	{
@@ -5381,6 +5541,47 @@ void LIBCALL BlastOtherReturnsFree(ValNodePtr other_returns)
     return;
 }
 
+/*
+	Copies the BLAST_COLLECT_STATS counters of the search into its
+	stage statistics.
+*/
+void LIBCALL
+BlastStageStatsUpdate(BlastSearchBlkPtr search)
+
+{
+    search->stage_stats.word_hits = 
+        search->first_pass_hits + search->second_pass_hits;
+    search->stage_stats.extensions = 
+        search->first_pass_extends + search->second_pass_extends;
+    search->stage_stats.good_extensions = 
+        search->first_pass_good_extends + search->second_pass_good_extends;
+}
+
+/*
+	Fills stats with the statistics of a finished search: the totals
+	and, for a threaded search, those of each thread.
+*/
+void LIBCALL
+BlastSearchStatsPrepare(BlastSearchBlkPtr search, MBSearchStatsPtr stats)
+
+{
+    if (search == NULL || stats == NULL)
+        return;
+
+    BlastStageStatsUpdate(search);
+    MBSearchStatsClear(stats);
+    stats->total = search->stage_stats;
+    if (search->thread_stats) {
+        stats->num_threads = search->num_thread_stats;
+        stats->threads = (MBStageStatsPtr) MemDup(search->thread_stats, 
+                            search->num_thread_stats*sizeof(MBStageStats));
+    } else {
+        stats->num_threads = 1;
+        stats->threads = (MBStageStatsPtr) MemDup(&search->stage_stats, 
+                                                  sizeof(MBStageStats));
+    }
+}
+
 ValNodePtr LIBCALL
 BlastOtherReturnsPrepare(BlastSearchBlkPtr search)
 
@@ -5737,6 +5938,9 @@ void BlastThrInfoFree(BlastThrInfoPtr thr_info)
         }
     }
     BlastGiListDestruct(thr_info->blast_gi_list, TRUE);
+    MemFree(thr_info->subject_length_mask);
+    MBWordSeedsFree(thr_info->word_seeds);
+    MBSketchPairsFree(thr_info->sketch_pairs);
     
     NlmMutexDestroy(thr_info->db_mutex);
     NlmMutexDestroy(thr_info->results_mutex);
@@ -5765,17 +5969,33 @@ BlastThrInfoPtr BlastThrInfoNew(void)
 BlastSearchBlkPtr LIBCALL
 BlastSearchBlkDuplicate (BlastSearchBlkPtr search)
 
+{
+	return BlastSearchBlkDuplicateEx(search, NULL);
+}
+
+BlastSearchBlkPtr LIBCALL 
+BlastSearchBlkDuplicateEx (BlastSearchBlkPtr search, 
+                           GreedyAlignMemPtr spare_abmp)
+
 {
 
 	BlastSearchBlkPtr new_search;
 	Int2 index;
 
+	if (search == NULL || search->abmp == NULL) {
+		if (spare_abmp)
+			GreedyAlignMemFree(spare_abmp);
+		spare_abmp = NULL;
+	}
 	if (search == NULL)
 		return NULL;
 
 	new_search = (BlastSearchBlkPtr) MemNew(sizeof(BlastSearchBlk));
-	if (new_search == NULL)
+	if (new_search == NULL) {
+		if (spare_abmp)
+			GreedyAlignMemFree(spare_abmp);
 		return NULL;
+	}
 
 	/* What's allocated here? */
 	new_search->allocated = 0;	
@@ -5793,6 +6013,8 @@ BlastSearchBlkDuplicate (BlastSearchBlkPtr search)
 	new_search->rdfp = readdb_attach(search->rdfp);
 	if (new_search->rdfp == NULL)
 	{
+		if (spare_abmp)
+			GreedyAlignMemFree(spare_abmp);
 		new_search = BlastSearchBlkDestruct(new_search);
 		return NULL;
 	}
@@ -5906,11 +6128,12 @@ BlastSearchBlkDuplicate (BlastSearchBlkPtr search)
 	new_search->prelim_gap_passed = 0;
 	new_search->prelim_gap_attempts = 0;
 	new_search->real_gap_number_of_hsps = 0;
+	MemSet(&new_search->stage_stats, 0, sizeof(MBStageStats));
 #endif
 	new_search->output = search->output;
 
 	if (search->abmp) {
-	   new_search = GreedyAlignMemAlloc(new_search);
+	   new_search = GreedyAlignMemAllocEx(new_search, spare_abmp);
            if (new_search->abmp == NULL) {
               new_search = BlastSearchBlkDestruct(new_search);
               return NULL;
@@ -6100,6 +6323,7 @@ BlastSearchBlkNewExtra (Int2 wordsize, Int4 qlen, CharPtr dbname, Boolean multip
 		search->prelim_gap_passed = 0;
 		search->prelim_gap_attempts = 0;
 		search->real_gap_number_of_hsps = 0;
+		MemSet(&search->stage_stats, 0, sizeof(MBStageStats));
 #endif
 	}
 
@@ -6177,6 +6401,8 @@ BlastSearchBlkDestruct (BlastSearchBlkPtr search)
         if (search->current_hitlist) {
             search->current_hitlist = BlastHitListDestruct(search->current_hitlist);
         }
+        /* After the hitlist, whose HSPs may be in it */
+        search->hsp_arena = ArenaFree(search->hsp_arena);
         search->subject_info = BLASTSubjectInfoDestruct(search->subject_info);
         
         
@@ -6225,6 +6451,7 @@ BlastSearchBlkDestruct (BlastSearchBlkPtr search)
         
         if (search->abmp)
             search->abmp = GreedyAlignMemFree(search->abmp);
+        search->thread_stats = MemFree(search->thread_stats);
         
         search->query_context_offsets = MemFree(search->query_context_offsets);
         
@@ -7702,8 +7929,13 @@ FilterWithSeg (Uint1Ptr sequence, Int4 length, Uint1 alphabet)
 
 BLAST_HSPPtr BLAST_HSPFree(BLAST_HSPPtr hsp)
 {
-if (hsp)
-   hsp->gap_info = GapXEditBlockDelete(hsp->gap_info);
+if (hsp == NULL)
+   return NULL;
+
+hsp->gap_info = GapXEditBlockDelete(hsp->gap_info);
+/* Arena HSPs go when the arena is reset */
+if (hsp->in_arena)
+   return NULL;
 
 return (BLAST_HSPPtr) MemFree(hsp);
 }
@@ -9023,6 +9255,7 @@ RealBlastGetGappedAlignmentTraceback(BlastSearchBlkPtr search, Uint1Ptr subject,
     gap_align->gap_open = pbp->gap_open;
     gap_align->gap_extend = pbp->gap_extend;
     gap_align->decline_align = pbp->decline_align;
+    gap_align->vector_dp = pbp->vector_dp;
     gap_align->x_parameter = pbp->gap_x_dropoff_final;
     gap_align->matrix = search->sbp->matrix;
     gap_align->posMatrix = search->sbp->posMatrix;
@@ -9886,6 +10119,7 @@ BlastPreliminaryGappedScore (BlastSearchBlkPtr search, Uint1Ptr subject, Int4 su
 		gap_align->gap_open = pbp->gap_open;
 		gap_align->gap_extend = pbp->gap_extend;
                 gap_align->decline_align = pbp->decline_align;
+                gap_align->vector_dp = pbp->vector_dp;
 		gap_align->x_parameter = pbp->gap_x_dropoff;
 		gap_align->matrix = search->sbp->matrix;
 		gap_align->posMatrix = search->sbp->posMatrix;
@@ -10042,6 +10276,7 @@ BlastNTPreliminaryGappedScore (BlastSearchBlkPtr search, Uint1Ptr subject, Int4
 		gap_align->gap_open = pbp->gap_open;
 		gap_align->gap_extend = pbp->gap_extend;
                 gap_align->decline_align = pbp->decline_align;
+                gap_align->vector_dp = pbp->vector_dp;
 		gap_align->x_parameter = pbp->gap_x_dropoff;
 		gap_align->matrix = search->sbp->matrix;
 		gap_align->posMatrix = search->sbp->posMatrix;
@@ -10206,6 +10441,7 @@ BlastGetGappedScore (BlastSearchBlkPtr search, Int4 subject_length, Uint1Ptr sub
 		gap_align->gap_open = pbp->gap_open;
 		gap_align->gap_extend = pbp->gap_extend;
                 gap_align->decline_align = pbp->decline_align;
+                gap_align->vector_dp = pbp->vector_dp;
 		gap_align->x_parameter = pbp->gap_x_dropoff;
 		gap_align->matrix = search->sbp->matrix;
 		gap_align->posMatrix = search->sbp->posMatrix;
@@ -10330,6 +10566,7 @@ BlastNTGetGappedScore (BlastSearchBlkPtr search, Int4 subject_length, Uint1Ptr s
 		gap_align->gap_open = pbp->gap_open;
 		gap_align->gap_extend = pbp->gap_extend;
                 gap_align->decline_align = pbp->decline_align;
+                gap_align->vector_dp = pbp->vector_dp;
 		gap_align->x_parameter = pbp->gap_x_dropoff;
 		gap_align->matrix = search->sbp->matrix;
 		gap_align->posMatrix = search->sbp->posMatrix;
@@ -10605,8 +10842,12 @@ BlastNtSaveCurrentHspGapped(BlastSearchBlkPtr search, BLAST_Score score,
                  so far, to accommodate for possible inclusion check 
                  failures and score changes because of ambiguities */
               new_hspmax = MIN(new_hspmax, 2*search->pbp->hsp_num_max);
+           if (search->pbp->mb_params && 
+               search->pbp->mb_params->hsp_buffer_max > 0)
+              new_hspmax = MIN(new_hspmax, 
+                               search->pbp->mb_params->hsp_buffer_max);
            if (new_hspmax > current_hitlist->hspmax) {
-		hsp_array = (BLAST_HSPPtr PNTR) Realloc(hsp_array, current_hitlist->hspmax*2*sizeof(BLAST_HSPPtr));
+		hsp_array = (BLAST_HSPPtr PNTR) Realloc(hsp_array, new_hspmax*sizeof(BLAST_HSPPtr));
 		if (hsp_array == NULL)
 		{
 			ErrPostEx(SEV_WARNING, 0, 0, "UNABLE to reallocate in BlastSaveCurrentHsp for ordinal id %ld, continuing with fixed array of %ld HSP's", (long) search->subject_id, (long) hspmax);
@@ -10631,7 +10872,12 @@ BlastNtSaveCurrentHspGapped(BlastSearchBlkPtr search, BLAST_Score score,
            }
 	}
 
-	new_hsp = (BLAST_HSPPtr) MemNew(sizeof(BLAST_HSP));
+	if (search->hsp_arena) {
+	   new_hsp = (BLAST_HSPPtr) 
+	      ArenaAlloc(search->hsp_arena, sizeof(BLAST_HSP));
+	   new_hsp->in_arena = TRUE;
+	} else
+	   new_hsp = (BLAST_HSPPtr) MemNew(sizeof(BLAST_HSP));
 	new_hsp->score = score;
 	new_hsp->query.offset = q_offset;
 	new_hsp->subject.offset = s_offset;
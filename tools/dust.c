@@ -124,12 +124,14 @@ typedef struct localcurrents {
 
 /* local functions */
 
-static Int4 dust_segs PROTO ((Int4, SeqPortPtr, Int4, DREGION PNTR,
+static Int4 dust_segs PROTO ((Int4, SeqPortPtr, Uint1Ptr, Int4, DREGION PNTR,
 		       Int4, Int4, Int4, Int4));
-static Int4 wo PROTO ((Int4, SeqPortPtr, Int4, DCURLOC PNTR, Int4 PNTR, UcharPtr seq));
+static Int4 wo PROTO ((Int4, SeqPortPtr, Uint1Ptr, Int4, DCURLOC PNTR, Int4 PNTR, UcharPtr seq));
 static void wo1 PROTO ((Int4, UcharPtr, Int4, DCURLOC PNTR));
 static Int4 dusttripfind PROTO ((SeqPortPtr, UcharPtr, Int4, Int4,
 				 Int4 PNTR));
+static Int4 dusttripbuf PROTO ((Uint1Ptr, UcharPtr, Int4, Int4));
+static Uint1Ptr dustbulkread PROTO ((BioseqPtr, Int4, Int4, Int4));
 static SeqLocPtr slpDust PROTO ((SeqPortPtr, SeqLocPtr, SeqIdPtr,
 				 ValNodePtr PNTR, DREGION PNTR,
 				 Int4, Int4));
@@ -143,6 +145,7 @@ SeqLocPtr BioseqDust (BioseqPtr bsp, Int4 start, Int4 end,
 	ValNodePtr	vnp = NULL;
 
 	SeqPortPtr	spp;
+	Uint1Ptr	seq2na;
 
 	DREGION	PNTR reg, PNTR regold;
 	Int4	nreg;
@@ -194,10 +197,12 @@ SeqLocPtr BioseqDust (BioseqPtr bsp, Int4 start, Int4 end,
 	}
 
 	l = spp->totlen;
-	nreg = dust_segs (l, spp, start, reg, (Int4)level, (Int4)window, (Int4)minwin, (Int4)linker);
+	seq2na = dustbulkread (bsp, start, end, l);
+	nreg = dust_segs (l, spp, seq2na, start, reg, (Int4)level, (Int4)window, (Int4)minwin, (Int4)linker);
 	slp = slpDust (spp, NULL, bsp->id, &vnp, reg, nreg, loopDustMax);
 
 /* clean up memory */
+	MemFree (seq2na);
 	SeqPortFree (spp);
 	while (reg)
 	{
@@ -220,6 +225,7 @@ SeqLocPtr SeqLocDust (SeqLocPtr this_slp,
 	SeqIdPtr	id;
 	BioseqPtr	bsp;
 	SeqPortPtr	spp;
+	Uint1Ptr	seq2na;
 
 	DREGION	PNTR reg, PNTR regold;
 	Int4 nreg;
@@ -295,9 +301,9 @@ SeqLocPtr SeqLocDust (SeqLocPtr this_slp,
 			continue;
 		}
 		spp = SeqPortNew (bsp, start, end, 0, Seq_code_ncbi2na);
-		BioseqUnlock (bsp);
 		if (!spp)
 		{
+			BioseqUnlock (bsp);
 			ErrPostEx (SEV_ERROR, 2, 7,
 				   "sequence port open failed");
 			ErrShow ();
@@ -305,13 +311,16 @@ SeqLocPtr SeqLocDust (SeqLocPtr this_slp,
 		}
 
 		l = spp->totlen;
-		nreg = dust_segs (l, spp, start, reg,
+		seq2na = dustbulkread (bsp, start, end, l);
+		BioseqUnlock (bsp);
+		nreg = dust_segs (l, spp, seq2na, start, reg,
 				  (Int4)level, (Int4)window, (Int4)minwin, (Int4)linker);
 		slp = slpDust (spp, slp, id, &vnp,
 			       reg, nreg, loopDustMax);
 /* find tail - this way avoids referencing the pointer */
 		while (reg->next) reg = reg->next;
 
+		MemFree (seq2na);
 		SeqPortFree (spp);
 	}
 
@@ -327,9 +336,32 @@ SeqLocPtr SeqLocDust (SeqLocPtr this_slp,
 	return slp;
 }
 
+/* raw sequence without ambiguities is decoded to ncbi2na in one pass -
+   otherwise NULL and the windows are read through the SeqPort, which
+   resolves ambiguities at random on every read */
+
+static Uint1Ptr dustbulkread (BioseqPtr bsp, Int4 start, Int4 end, Int4 length)
+{
+	Uint1Ptr seq2na;
+	Int4 i;
+	static Uint1 na4to2na[16] = {255, 0, 1, 255, 2, 255, 255, 255,
+				     3, 255, 255, 255, 255, 255, 255, 255};
+
+	if (bsp->repr != Seq_repr_raw && bsp->repr != Seq_repr_const)
+		return NULL;
+	if ((seq2na = MemNew (length + 1)) == NULL)
+		return NULL;
+	if (SeqPortBulkRead (bsp, start, end, 0, Seq_code_ncbi4na, seq2na) != length)
+		return MemFree (seq2na);
+	for (i = 0; i < length; i++)
+		if ((seq2na[i] = na4to2na[seq2na[i]]) == 255)
+			return MemFree (seq2na);
+	return seq2na;
+}
+
 /* entry point for dusting - from BioseqDust or SeqLocDust */
 
-static Int4 dust_segs (Int4 length, SeqPortPtr spp, Int4 start,
+static Int4 dust_segs (Int4 length, SeqPortPtr spp, Uint1Ptr seq2na, Int4 start,
 		       DREGION PNTR reg,
 		       Int4 level, Int4 windowsize, Int4 minwin, Int4 linker)
 {
@@ -365,7 +397,7 @@ static Int4 dust_segs (Int4 length, SeqPortPtr spp, Int4 start,
 	{
 		len = (Int4) ((length > i+windowsize) ? windowsize : length-i);
 		len -= 2;
-		retlen = wo (len, spp, i, &cloc, &invrescount, seq);
+		retlen = wo (len, spp, seq2na, i, &cloc, &invrescount, seq);
 
 /* get rid of itsy-bitsy's, dusttripfind aborts - move 1 triplet away */
 		if ((cloc.curend - cloc.curstart + 1) < minwin)
@@ -425,7 +457,7 @@ static Int4 dust_segs (Int4 length, SeqPortPtr spp, Int4 start,
 	return nreg;
 }
 
-static Int4 wo (Int4 len, SeqPortPtr spp, Int4 iseg, DCURLOC PNTR cloc,
+static Int4 wo (Int4 len, SeqPortPtr spp, Uint1Ptr seq2na, Int4 iseg, DCURLOC PNTR cloc,
 			Int4 PNTR invrescount, UcharPtr seq)
 {
 	Int4 i, flen;
@@ -436,9 +468,14 @@ static Int4 wo (Int4 len, SeqPortPtr spp, Int4 iseg, DCURLOC PNTR cloc,
 
 /* get the chunk of sequence in triplets */
 
-	SeqPortSeek (spp, iseg, SEEK_SET);
         MemSet (seq,0,len+2);        /* Zero the triplet buffer */
-	flen = dusttripfind (spp, seq, iseg, len, invrescount);
+	if (seq2na)
+		flen = dusttripbuf (seq2na, seq, iseg, len);
+	else
+	{
+		SeqPortSeek (spp, iseg, SEEK_SET);
+		flen = dusttripfind (spp, seq, iseg, len, invrescount);
+	}
 
 /* dust the chunk */
 	for (i = 0; i < flen; i++)
@@ -594,6 +631,20 @@ static Int4 dusttripfind (SeqPortPtr spp, UcharPtr s1, Int4 icur, Int4 max,
 	return n;
 }
 
+/* the same triplets from sequence already decoded to ncbi2na */
+
+static Int4 dusttripbuf (Uint1Ptr seq2na, UcharPtr s1, Int4 icur, Int4 max)
+{
+	Int4 n;
+	Uint1Ptr p;
+
+	p = seq2na + icur;
+	for (n = 0; n < max; n++)
+		s1[n] = (Uchar) ((p[n] << 4) | (p[n+1] << 2) | p[n+2]);
+
+	return n;
+}
+
 /* look for dustable locations */
 
 static SeqLocPtr slpDust (SeqPortPtr spp, SeqLocPtr slp, SeqIdPtr id,
@@ -702,7 +753,7 @@ extern FloatHiPtr DustGraph (SeqPortPtr spp, Int4 length, Int2 level,
   {
     len = (length > i+window) ? window : (Int2) (length-i);
     len -= 2;
-    retlen = wo (len, spp, i, &cloc, &invrescount, seq);
+    retlen = wo (len, spp, NULL, i, &cloc, &invrescount, seq);
 
     if ((cloc.curend - cloc.curstart + 1) < minwin)
     {
@@ -367,6 +367,10 @@ Contents: Functions to perform a gapped alignment on two sequences.
 
 #include <gapxdrop.h>
 #include <blast.h>
+#if defined(__SSE2__) && defined(__GNUC__)
+#define GAPXDROP_VECTOR_DP
+#include <emmintrin.h>
+#endif
 
 
 /* A PACKAGE FOR LOCALLY ALIGNING TWO SEQUENCES WITHIN A BAND:
@@ -520,6 +524,299 @@ GapXDropStateDestroy(GapXDropStateArrayStructPtr state_struct)
 	return NULL;
 }
 
+#ifdef GAPXDROP_VECTOR_DP
+/*
+	The vectorized DP keeps the cells in Int2, relative to the best score
+	when their row was computed, eight to a vector.  Cells far enough
+	below that score to fail the X-dropoff test saturate at INT2_MIN.
+	The scores, the gap costs and the X-dropoff are bounded so that the
+	cells which can pass the test always fit.
+*/
+#define GXD_VEC_MAX_SCORE 1024
+#define GXD_VEC_MAX_X 16384
+#define GXD_VEC_PAD 16	/* columns kept before and after each array */
+#define GXD_VEC_ARRAYS 6	/* CC, DD and the scores against each base */
+
+/* Prefix maximum of the lanes of a */
+static __m128i GapXDropVecPrefixMax(__m128i a, __m128i vMin)
+{
+  a = _mm_max_epi16(a, _mm_or_si128(_mm_slli_si128(a, 2),
+				    _mm_srli_si128(vMin, 14)));
+  a = _mm_max_epi16(a, _mm_or_si128(_mm_slli_si128(a, 4),
+				    _mm_srli_si128(vMin, 12)));
+  return _mm_max_epi16(a, _mm_or_si128(_mm_slli_si128(a, 8),
+				       _mm_srli_si128(vMin, 8)));
+}
+
+/* Lane 7 of a in all lanes */
+#define GXD_VEC_LAST(a) \
+  _mm_unpackhi_epi64(_mm_shufflehi_epi16(a, 0xFF), \
+		     _mm_shufflehi_epi16(a, 0xFF))
+
+/*
+	Makes room for the columns [-GXD_VEC_PAD, size + GXD_VEC_PAD) of
+	each of the arrays of the vectorized DP, keeping the columns
+	[-GXD_VEC_PAD, used).
+*/
+static Boolean GapXDropVecReserve(GapAlignBlkPtr gap_align, Int4 size,
+				  Int4 used)
+{
+  Int2Ptr mem;
+  Int4 k, old_stride, stride;
+
+  if (size <= gap_align->vec_dp_alloc)
+     return TRUE;
+  stride = size + 2*GXD_VEC_PAD;
+  mem = (Int2Ptr) Nlm_Malloc(GXD_VEC_ARRAYS*stride*sizeof(Int2));
+  if (mem == NULL) {
+     ErrPostEx(SEV_ERROR, 0, 0,
+               "Cannot allocate %ld bytes for dynamic programming",
+               (long) (GXD_VEC_ARRAYS*stride*sizeof(Int2)));
+     return FALSE;
+  }
+  if (gap_align->vec_dp != NULL) {
+     old_stride = gap_align->vec_dp_alloc + 2*GXD_VEC_PAD;
+     for (k = 0; k < GXD_VEC_ARRAYS; k++)
+        MemCpy(mem + k*stride, gap_align->vec_dp + k*old_stride,
+               (used + GXD_VEC_PAD)*sizeof(Int2));
+     MemFree(gap_align->vec_dp);
+  }
+  gap_align->vec_dp = mem;
+  gap_align->vec_dp_alloc = size;
+  return TRUE;
+}
+
+/* Do the scores and the gap costs fit the vectorized DP? */
+static Boolean GapXDropVecApplies(GapAlignBlkPtr gap_align)
+{
+  Int4 b, k, score;
+
+  if (gap_align->gap_open < 0 || gap_align->gap_extend < 0 ||
+      gap_align->gap_open + gap_align->gap_extend > GXD_VEC_MAX_SCORE ||
+      gap_align->x_parameter > GXD_VEC_MAX_X)
+     return FALSE;
+  /* The rows of the bases against the ncbi4na letters */
+  for (k = 0; k < 4; k++) {
+     for (b = 0; b < 16; b++) {
+        score = gap_align->matrix[k][b];
+        if (score != MININT &&
+            (score > GXD_VEC_MAX_SCORE || score < -GXD_VEC_MAX_SCORE))
+           return FALSE;
+     }
+  }
+  return TRUE;
+}
+
+/*
+	ALIGN_packed_nucl without the decline-to-align column, eight cells
+	of a row at a time.  The diagonal and vertical scores of the cells
+	come first; the horizontal gaps and the best score before each cell
+	are then prefix maxima over the row.  A cell that fails the
+	X-dropoff test is set to INT2_MIN as in the scalar code; the values
+	derived from it stay below the test, so the cells that pass it, the
+	bounds of the band and the best score and its position are the
+	same as there.
+*/
+static Int4 ALIGN_packed_nucl_vec(Uint1Ptr B, Uint1Ptr A, Int4 N, Int4 M,
+		Int4Ptr pej, Int4Ptr pei, GapAlignBlkPtr gap_align,
+		Boolean reverse_sequence)
+{
+  Int4 i, i0, j, tt, cb, j_r, k, m, h, X, c, e, end, bits;
+  Int4 best_score = 0, bias = 0, row_best, row_pos, first_alive, last_alive;
+  Int4 stride, filled;
+  Int4Ptr *matrix;
+  Int2Ptr CC, DD, S, prof[4];
+  Int2 cc_carry, e_carry, e_lanes[8];
+  Uint1 base_pair;
+  __m128i vS, vCC, vV, vG, vGm, vE, vH, vB, vAlive, vValid, vDelta;
+  __m128i vLane, vMin, vM, vH1, vH2, vH4, vX;
+
+  matrix = gap_align->matrix;
+  *pei = *pej = 0;
+  m = gap_align->gap_open + gap_align->gap_extend;
+  h = gap_align->gap_extend;
+  X = gap_align->x_parameter;
+
+  if (X < m)
+	X = m;
+
+  if(N <= 0 || M <= 0) return 0;
+
+  vLane = _mm_set_epi16(7, 6, 5, 4, 3, 2, 1, 0);
+  vMin = _mm_set1_epi16(INT2_MIN);
+  vM = _mm_set1_epi16((Int2) m);
+  vH1 = _mm_set1_epi16((Int2) h);
+  vH2 = _mm_set1_epi16((Int2) (2*h));
+  vH4 = _mm_set1_epi16((Int2) (4*h));
+  vX = _mm_set1_epi16((Int2) (X + 1));
+
+  /* The band is rarely much wider than X / h */
+  i = (h > 0 && X / h + 64 < N + 9) ? X / h + 64 : N + 9;
+  if (!GapXDropVecReserve(gap_align, i, 0))
+     return -1;
+
+#define GXD_VEC_SET_ARRAYS() \
+  stride = gap_align->vec_dp_alloc + 2*GXD_VEC_PAD; \
+  CC = gap_align->vec_dp + GXD_VEC_PAD; \
+  DD = CC + stride; \
+  for (k = 0; k < 4; k++) \
+     prof[k] = CC + (k + 2)*stride;
+#define GXD_VEC_RESERVE(size) \
+  if ((size) > gap_align->vec_dp_alloc) { \
+     if (!GapXDropVecReserve(gap_align, \
+            MIN(N + 9, MAX(size, 2*gap_align->vec_dp_alloc)), \
+            MAX(j, filled) + 1)) \
+        return -1; \
+     GXD_VEC_SET_ARRAYS() \
+  }
+
+  GXD_VEC_SET_ARRAYS()
+
+  CC[0] = 0; c = -m;
+  DD[0] = (Int2) c;
+  for(i = 1; i <= N; i++) {
+    if(c < -X) break;
+    CC[i] = (Int2) c;
+    DD[i] = (Int2) (c - m);
+    c -= h;
+  }
+  /* The decline-to-align column starts at -m, which passes the X-dropoff
+     test: the cell (1, 1) takes it as both a vertical and a horizontal
+     gap */
+  DD[1] = (Int2) MAX(DD[1], -m);
+
+  for (k = 0; k < 4; k++)
+      prof[k][0] = 0;
+  filled = 0;
+  tt = 0;  j = i;
+  for (j_r = 1; j_r <= M; j_r++) {
+      if(reverse_sequence)
+	  base_pair = READDB_UNPACK_BASE_N(A[(M-j_r)/4], ((j_r-1)%4));
+      else
+	  base_pair = READDB_UNPACK_BASE_N(A[1+((j_r-1)/4)], (3-((j_r-1)%4)));
+
+      /* The scores of the columns against each base, filled in as the
+	 band moves right; MININT and the columns past N are INT2_MIN */
+      GXD_VEC_RESERVE(j + 8)
+      for (; filled < j + 8; filled++) {
+	  i = filled + 1;
+	  for (k = 0; k < 4; k++) {
+	      c = (i > N) ? MININT :
+		  matrix[k][reverse_sequence ? B[N-i] : B[i]];
+	      prof[k][i] = (Int2) ((c == MININT) ? INT2_MIN : c);
+	  }
+      }
+      S = prof[base_pair];
+
+      vDelta = _mm_set1_epi16((Int2) MIN(best_score - bias, INT2_MAX));
+      bias = best_score;
+      end = j;
+      cc_carry = e_carry = INT2_MIN;
+      vB = _mm_setzero_si128();
+      row_best = row_pos = 0;
+      first_alive = last_alive = -1;
+      for (i0 = tt; i0 < end; i0 += 8) {
+	  vS = _mm_loadu_si128((__m128i *) (S + i0));
+	  vCC = _mm_subs_epi16(_mm_loadu_si128((__m128i *) (CC + i0)),
+			       vDelta);
+	  vV = _mm_subs_epi16(_mm_loadu_si128((__m128i *) (DD + i0)),
+			      vDelta);
+
+	  /* A MININT score ends the row before its column */
+	  bits = _mm_movemask_epi8(_mm_cmpeq_epi16(vS, vMin)) & 0x5555;
+	  if (i0 == tt)
+	      bits &= ~1;
+	  if (bits && i0 + __builtin_ctz(bits) / 2 < end)
+	      end = i0 + __builtin_ctz(bits) / 2;
+	  vValid = _mm_cmplt_epi16(vLane,
+				   _mm_set1_epi16((Int2) MIN(end - i0, 8)));
+
+	  vG = _mm_adds_epi16(_mm_insert_epi16(_mm_slli_si128(vCC, 2),
+					       cc_carry, 0), vS);
+	  cc_carry = (Int2) _mm_extract_epi16(vCC, 7);
+	  vG = _mm_max_epi16(vG, vV);
+
+	  /* E(i) = MAX(G(i-1) - m, E(i-1) - h) */
+	  vGm = _mm_subs_epi16(vG, vM);
+	  vE = _mm_insert_epi16(_mm_slli_si128(vGm, 2), e_carry, 0);
+	  if (j_r == 1 && i0 == 0)
+	      vE = _mm_insert_epi16(vE, (Int2) MAX(-m,
+				    (Int2) _mm_extract_epi16(vE, 1)), 1);
+	  vE = _mm_max_epi16(vE, _mm_subs_epi16(_mm_or_si128(
+			 _mm_slli_si128(vE, 2), _mm_srli_si128(vMin, 14)), vH1));
+	  vE = _mm_max_epi16(vE, _mm_subs_epi16(_mm_or_si128(
+			 _mm_slli_si128(vE, 4), _mm_srli_si128(vMin, 12)), vH2));
+	  vE = _mm_max_epi16(vE, _mm_subs_epi16(_mm_or_si128(
+			 _mm_slli_si128(vE, 8), _mm_srli_si128(vMin, 8)), vH4));
+	  vH = _mm_max_epi16(vG, vE);
+	  vH = _mm_or_si128(_mm_and_si128(vValid, vH),
+			    _mm_andnot_si128(vValid, vMin));
+
+	  /* E of the column after each cell */
+	  vE = _mm_max_epi16(vGm, _mm_subs_epi16(vE, vH1));
+	  if (i0 + 8 < end) {
+	      e_carry = (Int2) _mm_extract_epi16(vE, 7);
+	  } else if (end > i0) {
+	      _mm_storeu_si128((__m128i *) e_lanes, vE);
+	      e_carry = e_lanes[end - 1 - i0];
+	  }
+
+	  /* The best score before each cell */
+	  vE = _mm_max_epi16(_mm_or_si128(_mm_slli_si128(
+			 GapXDropVecPrefixMax(vH, vMin), 2),
+					  _mm_srli_si128(vMin, 14)), vB);
+	  vB = GXD_VEC_LAST(_mm_max_epi16(vE, vH));
+	  vAlive = _mm_cmpgt_epi16(vH, _mm_subs_epi16(vE, vX));
+
+	  _mm_storeu_si128((__m128i *) (CC + i0),
+			   _mm_or_si128(_mm_and_si128(vAlive, vH),
+					_mm_andnot_si128(vAlive, vMin)));
+	  _mm_storeu_si128((__m128i *) (DD + i0),
+			   _mm_or_si128(_mm_and_si128(vAlive,
+				 _mm_max_epi16(_mm_subs_epi16(vH, vM),
+					       _mm_subs_epi16(vV, vH1))),
+					_mm_andnot_si128(vAlive, vV)));
+
+	  bits = _mm_movemask_epi8(vAlive) & 0x5555;
+	  if (bits) {
+	      if (first_alive < 0)
+		  first_alive = i0 + __builtin_ctz(bits) / 2;
+	      last_alive = i0 + (31 - __builtin_clz(bits)) / 2;
+	  }
+	  c = (Int2) _mm_cvtsi128_si32(vB);
+	  if (c > row_best) {
+	      row_best = c;
+	      row_pos = i0 + __builtin_ctz(_mm_movemask_epi8(
+			    _mm_cmpeq_epi16(vH, vB))) / 2;
+	  }
+      }
+      if (row_best > 0) {
+	  best_score = bias + row_best;
+	  *pei = j_r; *pej = row_pos;
+      }
+      cb = (last_alive >= 0) ? last_alive : tt;
+      e = e_carry;
+      tt = (first_alive >= 0) ? first_alive : end;
+
+      if (tt == j) break;
+      if (cb < j-1) { j = cb+1;}
+      else while (e >= best_score - bias - X && j <= N) {
+	  GXD_VEC_RESERVE(j + 8)
+	  CC[j] = (Int2) e; DD[j] = (Int2) (e-m);
+	  e -= h; j++;
+      }
+      if (j <= N) {
+	  DD[j] = CC[j] = INT2_MIN; j++;
+      }
+  }
+
+#undef GXD_VEC_RESERVE
+#undef GXD_VEC_SET_ARRAYS
+
+  return best_score;
+}
+#endif
+
 /*
         Aligns two nucleotide sequences, one (A) should be packed in the
         same way as the BLAST databases, the other (B) should contain one
@@ -541,6 +838,7 @@ static Int4 ALIGN_packed_nucl(Uint1Ptr B, Uint1Ptr A, Int4 N, Int4 M,
   Uint1Ptr Bptr;
   Uint1 base_pair;
   Int4 B_increment=1;
+  Boolean keep_ff, use_ff;
   
   matrix = gap_align->matrix;
   *pei = *pej = 0;
@@ -552,8 +850,20 @@ static Int4 ALIGN_packed_nucl(Uint1Ptr B, Uint1Ptr A, Int4 N, Int4 M,
   if (X < m)
 	X = m;
 
+  /* Every FF value but FF[0] = -m is at most best_score - g -
+     decline_penalty, so unless that can pass the X-dropoff test (it
+     cannot with the blastn default decline_align = INT2_MAX) the FF
+     column is only kept for the first row */
+  keep_ff = (decline_penalty + g <= X);
+
   if(N <= 0 || M <= 0) return 0;
 
+#ifdef GAPXDROP_VECTOR_DP
+  if (gap_align->vector_dp && !keep_ff && GapXDropVecApplies(gap_align))
+     return ALIGN_packed_nucl_vec(B, A, N, M, pej, pei, gap_align,
+                                  reverse_sequence);
+#endif
+
   j = (N + 2) * sizeof(GapXDP);
   if (gap_align->dyn_prog)
      dyn_prog = gap_align->dyn_prog;
@@ -591,6 +901,7 @@ static Int4 ALIGN_packed_nucl(Uint1Ptr B, Uint1Ptr A, Int4 N, Int4 M,
 		base_pair = READDB_UNPACK_BASE_N(A[1+((j_r-1)/4)], (3-((j_r-1)%4)));
             	wa = matrix[base_pair];
 	}
+      use_ff = (keep_ff || j_r == 1);
       e = c =f = MININT;
       Bptr = &B[tt];
       if(reverse_sequence)
@@ -603,8 +914,10 @@ static Int4 ALIGN_packed_nucl(Uint1Ptr B, Uint1Ptr A, Int4 N, Int4 M,
          new_score = wa[*Bptr];
 
 	  d = dp->DD;
-	  if (e < f) e = f;
-	  if (d < f) d = f;
+	  if (use_ff) {
+	      if (e < f) e = f;
+	      if (d < f) d = f;
+	  }
 	  if (c < d || c < e) {
 	      if (d < e) {
 		  c = e;
@@ -612,7 +925,8 @@ static Int4 ALIGN_packed_nucl(Uint1Ptr B, Uint1Ptr A, Int4 N, Int4 M,
 		  c = d; 
 	      }
 	      if (best_score - c > X) {
-		  c = dp->CC+new_score; f = dp->FF;
+		  c = dp->CC+new_score;
+		  if (use_ff) f = dp->FF;
 		  if (tt == i) tt++;
 		  else { dp->CC =dp->FF= MININT;}
 	      } else {
@@ -627,11 +941,14 @@ static Int4 ALIGN_packed_nucl(Uint1Ptr B, Uint1Ptr A, Int4 N, Int4 M,
                   }
                   c+=m;
 		  d = dp->CC+new_score; dp->CC = c; c=d;
-		  d = dp->FF; dp->FF = f-decline_penalty; f = d;
+		  if (use_ff) {
+		      d = dp->FF; dp->FF = f-decline_penalty; f = d;
+		  }
 	      }
 	  } else {
 	      if (best_score - c > X){
-		  c = dp->CC+new_score; f= dp->FF;
+		  c = dp->CC+new_score;
+		  if (use_ff) f= dp->FF;
 		  if (tt == i) tt++;
 		  else { dp->CC =dp->FF= MININT;}
 	      } else {
@@ -649,9 +966,11 @@ static Int4 ALIGN_packed_nucl(Uint1Ptr B, Uint1Ptr A, Int4 N, Int4 M,
 		      e = c;
 		  } 
 		  c+=m;
-		  d = dp->FF;
-		  if (c-g>f) dp->FF = c-g-decline_penalty; else dp->FF = f-decline_penalty;
-		  f = d;
+		  if (use_ff) {
+		      d = dp->FF;
+		      if (c-g>f) dp->FF = c-g-decline_penalty; else dp->FF = f-decline_penalty;
+		      f = d;
+		  }
 		  d = dp->CC+new_score; dp->CC = c; c = d;
 	      }
 	  }
@@ -1715,6 +2034,7 @@ GapAlignBlkDelete(GapAlignBlkPtr gap_align)
     /* GapXEditBlockDelete(gap_align->edit_block); */
     
     gap_align->dyn_prog = MemFree(gap_align->dyn_prog);
+    gap_align->vec_dp = MemFree(gap_align->vec_dp);
     gap_align = MemFree(gap_align);
     
     return gap_align;
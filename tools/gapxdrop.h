@@ -266,6 +266,10 @@ typedef struct _gapalign_blk {
     Boolean is_ooframe;
     Boolean discontinuous;
     GapXDPPtr dyn_prog;
+    Boolean vector_dp;	/* Use the vectorized score-only DP for the packed
+                           nucleotide extension when it applies. */
+    Int2Ptr vec_dp;	/* Working arrays of the vectorized DP. */
+    Int4 vec_dp_alloc;	/* Number of columns allocated in vec_dp. */
 } GapAlignBlk, PNTR GapAlignBlkPtr;
 
 GapXDropStateArrayStructPtr GapXDropStateDestroy PROTO((GapXDropStateArrayStructPtr state_struct));
@@ -212,7 +212,12 @@ static Int4 edit_script_ready(edit_script_t *es, Uint4 n)
     Uint4 m = n + n/2;
     
     if (es->size <= n) {
-        p = Realloc(es->op, m*sizeof(edit_op_t));
+        if (es->arena) {
+            p = ArenaAlloc(es->arena, m*sizeof(edit_op_t));
+            if (p && es->op)
+                MemCpy(p, es->op, es->size*sizeof(edit_op_t));
+        } else
+            p = Realloc(es->op, m*sizeof(edit_op_t));
         if (p == 0) {
             return 0;
         } else {
@@ -300,9 +305,26 @@ edit_script_t *edit_script_new(void)
     return edit_script_init(es);
 }
 
+/* External */
+edit_script_t *edit_script_arena_new(ArenaPtr arena)
+{
+    edit_script_t *es;
+
+    if (!arena)
+        return edit_script_new();
+    es = ArenaAlloc(arena, sizeof(*es));
+    if (!es)
+        return 0;
+    es->arena = arena;
+
+    return edit_script_init(es);
+}
+
 /* External */
 edit_script_t *edit_script_free(edit_script_t *es)
 {
+    if (es && es->arena)
+        return 0;
     if (es) {
         if (es->op)
             MemFree(es->op);
@@ -503,65 +525,57 @@ static Int4 get_last(Int4 **flast_d, Int4 d, Int4 diag, Int4 *row1)
 
 
 /* ------ Functions, that create SeqAlignPtr from gap_align_ptr */
-BlastSearchBlkPtr GreedyAlignMemAlloc(BlastSearchBlkPtr search)
+GreedyAlignMemPtr GreedyAlignMemNew(Int4 max_len, Int4 reward, Int4 penalty,
+                                    Int4 Xdrop, Int4 gap_open, 
+                                    Int4 gap_extend, Boolean traceback)
 {
-   Int4 max_d, max_d_1, Xdrop, d_diff, max_len, max_cost, gd, i;
-   Int4 reward, penalty, gap_open, gap_extend;
+   GreedyAlignMemPtr abmp;
+   Int4 max_d, max_d_1, d_diff, max_cost, gd, i;
    Int4 Mis_cost, GE_cost;
+   Boolean affine = (gap_open != 0 || gap_extend != 0);
    
-   if (search == NULL) 
-      return search;
-   
-   if (search->sbp->reward % 2 == 1) {
-      reward = 2*search->sbp->reward;
-      penalty = -2*search->sbp->penalty;
-      Xdrop = 2*search->pbp->gap_x_dropoff;
-      gap_open = 2*search->pbp->gap_open;
-      gap_extend = 2*search->pbp->gap_extend;
-   } else {
-      reward = search->sbp->reward;
-      penalty = -search->sbp->penalty;
-      Xdrop = search->pbp->gap_x_dropoff;
-      gap_open = search->pbp->gap_open;
-      gap_extend = search->pbp->gap_extend;
+   if (reward % 2 == 1) {
+      reward *= 2;
+      penalty *= 2;
+      Xdrop *= 2;
+      gap_open *= 2;
+      gap_extend *= 2;
    }
 
    if (gap_open == 0 && gap_extend == 0)
       gap_extend = reward / 2 + penalty;
 
-   if (search->rdfp) {
-      ReadDBFILEPtr rdfp;
-      for (rdfp = search->rdfp, max_len = 0; rdfp; rdfp = rdfp->next)
-         max_len = MAX(max_len, readdb_get_maxlen(rdfp));
-   } else
-      max_len = search->subject->length;
-
    max_len = MIN(max_len, MAX_DBSEQ_LEN);
  
    max_d = (Int4) (max_len / ERROR_FRACTION + 1);
 
-   search->abmp = (GreedyAlignMemPtr) MemNew(sizeof(GreedyAlignMem));
+   abmp = (GreedyAlignMemPtr) MemNew(sizeof(GreedyAlignMem));
+   abmp->max_len = max_len;
+   abmp->reward = reward;
+   abmp->penalty = penalty;
+   abmp->x_dropoff = Xdrop;
+   abmp->gap_open = gap_open;
+   abmp->gap_extend = gap_extend;
+   abmp->traceback = traceback;
+   abmp->affine = affine;
 
-   if (search->pbp->gap_open==0 && search->pbp->gap_extend==0) {
+   if (!affine) {
       d_diff = (Xdrop+reward/2) / (penalty+reward) + 1;
    
-      search->abmp->flast_d = (Int4Ptr PNTR) Malloc((max_d + 2) * sizeof(Int4Ptr));
-      if (search->abmp->flast_d == NULL) {
-         search->abmp = MemFree(search->abmp);
-         return search;
-      }
-      search->abmp->flast_d[0] = Malloc((max_d + max_d + 6) * sizeof(Int4) * 2);
-      if (search->abmp->flast_d[0] == NULL) {
+      abmp->flast_d = (Int4Ptr PNTR) Malloc((max_d + 2) * sizeof(Int4Ptr));
+      if (abmp->flast_d == NULL)
+         return (GreedyAlignMemPtr) MemFree(abmp);
+      abmp->flast_d[0] = Malloc((max_d + max_d + 6) * sizeof(Int4) * 2);
+      if (abmp->flast_d[0] == NULL) {
 	 ErrPostEx(SEV_WARNING, 0, 0, "Failed to allocate %ld bytes for abmp", (max_d + max_d + 6) * sizeof(Int4) * 2);
-         search->abmp = GreedyAlignMemFree(search->abmp);
-         return search;
+         return GreedyAlignMemFree(abmp);
       }
 
-      search->abmp->flast_d[1] = search->abmp->flast_d[0] + max_d + max_d + 6;
-      search->abmp->flast_d_affine = NULL;
-      search->abmp->uplow_free = NULL;
+      abmp->flast_d[1] = abmp->flast_d[0] + max_d + max_d + 6;
+      abmp->flast_d_affine = NULL;
+      abmp->uplow_free = NULL;
    } else {
-      search->abmp->flast_d = NULL;
+      abmp->flast_d = NULL;
       Mis_cost = reward + penalty;
       GE_cost = gap_extend+reward/2;
       max_d_1 = max_d;
@@ -569,32 +583,99 @@ BlastSearchBlkPtr GreedyAlignMemAlloc(BlastSearchBlkPtr search)
       max_cost = MAX(Mis_cost, gap_open+GE_cost);
       gd = gdb3(&Mis_cost, &gap_open, &GE_cost);
       d_diff = (Xdrop+reward/2) / gd + 1;
-      search->abmp->uplow_free = MemNew(sizeof(Int4)*2*(max_d+1+max_cost));
-      search->abmp->flast_d_affine = (ThreeValPtr PNTR) 
+      abmp->uplow_free = MemNew(sizeof(Int4)*2*(max_d+1+max_cost));
+      abmp->flast_d_affine = (ThreeValPtr PNTR) 
 	 Malloc((MAX(max_d, max_cost) + 2) * sizeof(ThreeValPtr));
-      if (!search->abmp->uplow_free || !search->abmp->flast_d_affine) {
-         search->abmp = GreedyAlignMemFree(search->abmp);
-         return search;
-      }
-      search->abmp->flast_d_affine[0] = 
+      if (!abmp->uplow_free || !abmp->flast_d_affine)
+         return GreedyAlignMemFree(abmp);
+      abmp->flast_d_affine[0] = 
 	 MemNew((2*max_d_1 + 6) * sizeof(ThreeVal) * (max_cost+1));
+      if (!abmp->flast_d_affine[0])
+         return GreedyAlignMemFree(abmp);
       for (i = 1; i <= max_cost; i++)
-	 search->abmp->flast_d_affine[i] = 
-	    search->abmp->flast_d_affine[i-1] + 2*max_d_1 + 6;
-      if (!search->abmp->flast_d_affine || !search->abmp->flast_d_affine[0])
-         search->abmp = GreedyAlignMemFree(search->abmp);
+	 abmp->flast_d_affine[i] = 
+	    abmp->flast_d_affine[i-1] + 2*max_d_1 + 6;
    }
-   search->abmp->max_row_free = Malloc(sizeof(Int4) * (max_d + 1 + d_diff));
-   if (!search->pbp->mb_params->no_traceback)
-     search->abmp->space = new_mb_space();
-   if (!search->abmp->max_row_free ||
-       (!search->pbp->mb_params->no_traceback && !search->abmp->space))
+   abmp->max_row_free = Malloc(sizeof(Int4) * (max_d + 1 + d_diff));
+   if (traceback)
+     abmp->space = new_mb_space();
+   if (!abmp->max_row_free || (traceback && !abmp->space))
       /* Failure in one of the memory allocations */
-      search->abmp = GreedyAlignMemFree(search->abmp);
+      abmp = GreedyAlignMemFree(abmp);
+
+   return abmp;
+}
+
+Boolean GreedyAlignMemFits(GreedyAlignMemPtr abmp, Int4 max_len, 
+                           Int4 reward, Int4 penalty, Int4 Xdrop, 
+                           Int4 gap_open, Int4 gap_extend, Boolean traceback)
+{
+   Boolean affine = (gap_open != 0 || gap_extend != 0);
+
+   if (abmp == NULL)
+      return FALSE;
+
+   /* the same adjustments as in GreedyAlignMemNew; a linear gap cost can
+      then look like an affine one with no opening cost */
+   if (reward % 2 == 1) {
+      reward *= 2;
+      penalty *= 2;
+      Xdrop *= 2;
+      gap_open *= 2;
+      gap_extend *= 2;
+   }
+   if (gap_open == 0 && gap_extend == 0)
+      gap_extend = reward / 2 + penalty;
+   max_len = MIN(max_len, MAX_DBSEQ_LEN);
+
+   return (abmp->max_len == max_len && abmp->reward == reward &&
+           abmp->penalty == penalty && abmp->x_dropoff == Xdrop &&
+           abmp->gap_open == gap_open && abmp->gap_extend == gap_extend &&
+           abmp->traceback == traceback && abmp->affine == affine);
+}
+
+BlastSearchBlkPtr GreedyAlignMemAllocEx(BlastSearchBlkPtr search, 
+                                        GreedyAlignMemPtr spare)
+{
+   Int4 max_len;
+   
+   if (search == NULL) {
+      if (spare)
+         GreedyAlignMemFree(spare);
+      return search;
+   }
+   
+   if (search->rdfp) {
+      ReadDBFILEPtr rdfp;
+      for (rdfp = search->rdfp, max_len = 0; rdfp; rdfp = rdfp->next)
+         max_len = MAX(max_len, readdb_get_maxlen(rdfp));
+   } else
+      max_len = search->subject->length;
+
+   if (GreedyAlignMemFits(spare, max_len, search->sbp->reward, 
+          -search->sbp->penalty, search->pbp->gap_x_dropoff, 
+          search->pbp->gap_open, search->pbp->gap_extend,
+          !search->pbp->mb_params->no_traceback)) {
+      search->abmp = spare;
+      return search;
+   }
+   if (spare)
+      GreedyAlignMemFree(spare);
+
+   search->abmp = 
+      GreedyAlignMemNew(max_len, search->sbp->reward, -search->sbp->penalty,
+                        search->pbp->gap_x_dropoff, search->pbp->gap_open,
+                        search->pbp->gap_extend, 
+                        !search->pbp->mb_params->no_traceback);
 
    return search;
 }
 
+BlastSearchBlkPtr GreedyAlignMemAlloc(BlastSearchBlkPtr search)
+{
+   return GreedyAlignMemAllocEx(search, NULL);
+}
+
 GreedyAlignMemPtr GreedyAlignMemFree(GreedyAlignMemPtr abmp)
 {
    if (abmp->flast_d) {
@@ -12,10 +12,14 @@ typedef struct {
     edit_op_t *op;                  /* array of edit operations */
     Uint4 size, num;         /* size of allocation, number in use */
     edit_op_t last;                 /* most recent operation added */
+    ArenaPtr arena;                 /* where it is allocated, if not NULL */
 } edit_script_t;
 
 edit_script_t *edit_script_free(edit_script_t *es);
 edit_script_t *edit_script_new(void);
+/* edit_script_new allocating from an arena (the heap if NULL); freeing
+   such a script is left to the arena */
+edit_script_t *edit_script_arena_new(ArenaPtr arena);
 edit_script_t *edit_script_append(edit_script_t *es, edit_script_t *et);
 
 enum {
@@ -58,6 +62,10 @@ typedef struct greedy_align_mem {
    ThreeValPtr PNTR flast_d_affine;
    Int4Ptr uplow_free;
    MBSpacePtr space;
+   /* the GreedyAlignMemNew arguments, see GreedyAlignMemFits */
+   Int4 max_len, reward, penalty, x_dropoff, gap_open, gap_extend;
+   Boolean traceback;
+   Boolean affine; /* flast_d_affine rather than flast_d is allocated */
 } GreedyAlignMem, PNTR GreedyAlignMemPtr;
 
 Int4 
@@ -79,9 +87,23 @@ MegaBlastAffineGreedyAlign PROTO((const UcharPtr s1, Int4 len1,
 
 
 
+/* Work memory for the greedy aligners on subjects of up to max_len bases;
+   penalty is positive, traceback allocates the edit script space */
+GreedyAlignMemPtr 
+GreedyAlignMemNew PROTO((Int4 max_len, Int4 reward, Int4 penalty, 
+                         Int4 x_dropoff, Int4 gap_open, Int4 gap_extend,
+                         Boolean traceback));
+
 GreedyAlignMemPtr 
 GreedyAlignMemFree PROTO((GreedyAlignMemPtr abmp));
 
+/* TRUE if abmp was allocated by GreedyAlignMemNew with these arguments,
+   so it can serve another search instead of a new allocation */
+Boolean
+GreedyAlignMemFits PROTO((GreedyAlignMemPtr abmp, Int4 max_len, 
+                          Int4 reward, Int4 penalty, Int4 x_dropoff, 
+                          Int4 gap_open, Int4 gap_extend, Boolean traceback));
+
 #ifdef __cplusplus
 }
 #endif
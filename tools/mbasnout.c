@@ -0,0 +1,89 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbasnout.c
+
+Contents: streaming Seq-align output of mgblast, see mbasnout.h.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <ncbithr.h>
+#include <objseq.h>
+#include <jzmisc.h>
+#include <mbasnout.h>
+
+MBAsnWriterPtr LIBCALL MBAsnWriterNew(AsnIoPtr aip, Uint1 align_type)
+{
+   MBAsnWriterPtr writer;
+
+   if (aip == NULL)
+      return NULL;
+
+   writer = (MBAsnWriterPtr) MemNew(sizeof(MBAsnWriter));
+   writer->aip = aip;
+   writer->align_type = align_type;
+   NlmMutexInit(&writer->mutex);
+   return writer;
+}
+
+Boolean LIBCALL MBAsnWriterWrite(MBAsnWriterPtr writer, SeqAlignPtr seqalign)
+{
+   SeqAnnotPtr annot;
+   SeqAlignPtr sap;
+   Int4 num_aligns = 0;
+
+   if (seqalign == NULL)
+      return TRUE;
+
+   for (sap = seqalign; sap; sap = sap->next)
+      num_aligns++;
+   annot = SeqAnnotNew();
+   annot->type = 2;
+   AddAlignInfoToSeqAnnot(annot, writer->align_type);
+   annot->data = seqalign;
+
+   NlmMutexLockEx(&writer->mutex);
+   if (!SeqAnnotAsnWrite(annot, writer->aip, NULL))
+      writer->error = TRUE;
+   AsnIoReset(writer->aip);
+   writer->num_annots++;
+   writer->num_aligns += num_aligns;
+   NlmMutexUnlock(writer->mutex);
+
+   SeqAnnotFree(annot);
+   return !writer->error;
+}
+
+MBAsnWriterPtr LIBCALL MBAsnWriterFree(MBAsnWriterPtr writer)
+{
+   if (writer == NULL)
+      return NULL;
+
+   AsnIoFlush(writer->aip);
+   if (writer->error)
+      ErrPostEx(SEV_ERROR, 0, 0, "Error writing the Seq-align output");
+   NlmMutexDestroy(writer->mutex);
+   return (MBAsnWriterPtr) MemFree(writer);
+}
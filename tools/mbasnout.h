@@ -0,0 +1,70 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbasnout.h
+
+Contents: streaming Seq-align output of mgblast (-m 10 and -m 11).
+
+          The alignments of each database sequence are written as one
+          Seq-annot as soon as the search is done with that sequence, and
+          freed right away, instead of being kept for the whole query block
+          and packed by query at its end. The file is the same sequence of
+          top level Seq-annot's the block output gives, only grouped by
+          subject rather than by query.
+
+******************************************************************************/
+#ifndef __MBASNOUT__
+#define __MBASNOUT__
+
+#include <ncbi.h>
+#include <ncbithr.h>
+#include <asn.h>
+#include <objalign.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mb_asn_writer {
+   AsnIoPtr aip;        /* not owned */
+   Uint1 align_type;    /* for AddAlignInfoToSeqAnnot */
+   Int8 num_annots;
+   Int8 num_aligns;
+   Boolean error;
+   TNlmMutex mutex;
+} MBAsnWriter, PNTR MBAsnWriterPtr;
+
+MBAsnWriterPtr LIBCALL MBAsnWriterNew PROTO((AsnIoPtr aip, Uint1 align_type));
+/* Write a chain of Seq-aligns as one Seq-annot and free it. Thread safe. */
+Boolean LIBCALL MBAsnWriterWrite PROTO((MBAsnWriterPtr writer, 
+                                        SeqAlignPtr seqalign));
+/* Flush the output; closing aip is left to the caller */
+MBAsnWriterPtr LIBCALL MBAsnWriterFree PROTO((MBAsnWriterPtr writer));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBASNOUT__ */
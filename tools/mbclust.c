@@ -0,0 +1,312 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbclust.c
+
+Contents: in-process single linkage clustering of Mega BLAST hits.
+          Hits passing the output filter are merged into a union-find
+          forest indexed by sequence ordinal; clusters are printed in
+          blastclust format once the search is finished.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <ncbithr.h>
+#include <mbclust.h>
+
+#define MB_CLUST_MIN_ALLOC 1024
+
+static void MBClusterSetReserve PROTO((MBClusterSetPtr set, Int4 ordinal));
+
+MBClusterSetPtr LIBCALL MBClusterSetNew(Int4 num_hint)
+{
+   MBClusterSetPtr set;
+
+   set = (MBClusterSetPtr) MemNew(sizeof(MBClusterSet));
+   set->max_ordinal = -1;
+   if (num_hint < MB_CLUST_MIN_ALLOC)
+      num_hint = MB_CLUST_MIN_ALLOC;
+   MBClusterSetReserve(set, num_hint - 1);
+   NlmMutexInit(&set->mutex);
+   return set;
+}
+
+MBClusterSetPtr LIBCALL MBClusterSetFree(MBClusterSetPtr set)
+{
+   Int4 index;
+
+   if (set == NULL)
+      return NULL;
+   for (index = 0; index < set->allocated; index++)
+      MemFree(set->name[index]);
+   MemFree(set->name);
+   MemFree(set->parent);
+   MemFree(set->size);
+   MemFree(set->seqlen);
+   MemFree(set->hash_head);
+   MemFree(set->hash_next);
+   NlmMutexDestroy(set->mutex);
+   return (MBClusterSetPtr) MemFree(set);
+}
+
+Boolean LIBCALL MBClusterThreshParse(CharPtr str, MBClusterThreshPtr thresh)
+{
+   double pid = 0.0, bits = 0.0;
+   long ovl = 0;
+   int num_read;
+
+   MemSet(thresh, 0, sizeof(MBClusterThresh));
+   if (str == NULL || *str == NULLB)
+      return TRUE;
+   num_read = sscanf(str, "%ld,%lf,%lf", &ovl, &pid, &bits);
+   if (num_read < 1 || ovl < 0 || pid < 0.0 || pid > 100.0 || bits < 0.0)
+      return FALSE;
+   thresh->min_overlap = (Int4) ovl;
+   thresh->min_perc_ident = pid;
+   thresh->min_bit_score = bits;
+   return TRUE;
+}
+
+Boolean LIBCALL MBClusterHitPasses(MBClusterSetPtr set, Int4 overlap,
+                                   FloatHi perc_ident, FloatHi bit_score)
+{
+   return (overlap >= set->thresh.min_overlap &&
+           perc_ident >= set->thresh.min_perc_ident &&
+           bit_score >= set->thresh.min_bit_score);
+}
+
+/* Grow the per-ordinal arrays so that ordinal fits; called with the
+   mutex held */
+static void MBClusterSetReserve(MBClusterSetPtr set, Int4 ordinal)
+{
+   Int4 new_alloc, index;
+
+   if (ordinal < set->allocated)
+      return;
+   new_alloc = MAX(2*set->allocated, MB_CLUST_MIN_ALLOC);
+   while (new_alloc <= ordinal)
+      new_alloc *= 2;
+   set->parent = (Int4Ptr) Realloc(set->parent, new_alloc*sizeof(Int4));
+   set->size = (Int4Ptr) Realloc(set->size, new_alloc*sizeof(Int4));
+   set->seqlen = (Int4Ptr) Realloc(set->seqlen, new_alloc*sizeof(Int4));
+   set->name = (CharPtr PNTR) Realloc(set->name, new_alloc*sizeof(CharPtr));
+   for (index = set->allocated; index < new_alloc; index++) {
+      set->parent[index] = -1;
+      set->size[index] = 0;
+      set->seqlen[index] = 0;
+      set->name[index] = NULL;
+   }
+   if (set->hash_next) {
+      set->hash_next =
+         (Int4Ptr) Realloc(set->hash_next, new_alloc*sizeof(Int4));
+      for (index = set->allocated; index < new_alloc; index++)
+         set->hash_next[index] = -1;
+   }
+   set->allocated = new_alloc;
+}
+
+/* Record an ordinal the first time it is seen; mutex held */
+static void MBClusterSetAddNode(MBClusterSetPtr set, Int4 ordinal,
+                                CharPtr name, Int4 len)
+{
+   MBClusterSetReserve(set, ordinal);
+   if (set->parent[ordinal] >= 0)
+      return;
+   set->parent[ordinal] = ordinal;
+   set->size[ordinal] = 1;
+   set->seqlen[ordinal] = len;
+   if (set->name[ordinal] == NULL)
+      set->name[ordinal] = StringSave(name);
+   if (ordinal > set->max_ordinal)
+      set->max_ordinal = ordinal;
+}
+
+static Int4 MBClusterSetFind(MBClusterSetPtr set, Int4 ordinal)
+{
+   Int4 root, next;
+
+   for (root = ordinal; set->parent[root] != root; root = set->parent[root]);
+   /* Path compression */
+   while (ordinal != root) {
+      next = set->parent[ordinal];
+      set->parent[ordinal] = root;
+      ordinal = next;
+   }
+   return root;
+}
+
+static Uint4 MBClusterHashName(CharPtr name)
+{
+   Uint4 h = 0;
+
+   for (; *name != NULLB; name++)
+      h = 31*h + (Uint1) *name;
+   return h;
+}
+
+Int4 LIBCALL MBClusterSetIntern(MBClusterSetPtr set, CharPtr name)
+{
+   Int4 ordinal, bucket, index;
+
+   NlmMutexLockEx(&set->mutex);
+   if (set->hash_size == 0) {
+      set->hash_size = 65521;
+      set->hash_head = (Int4Ptr) MemNew(set->hash_size*sizeof(Int4));
+      for (index = 0; index < set->hash_size; index++)
+         set->hash_head[index] = -1;
+      set->hash_next = (Int4Ptr) MemNew(MAX(set->allocated, 1)*sizeof(Int4));
+      for (index = 0; index < set->allocated; index++)
+         set->hash_next[index] = -1;
+   }
+   bucket = (Int4) (MBClusterHashName(name) % (Uint4) set->hash_size);
+   for (ordinal = set->hash_head[bucket]; ordinal >= 0;
+        ordinal = set->hash_next[ordinal]) {
+      if (StringCmp(set->name[ordinal], name) == 0) {
+         NlmMutexUnlock(set->mutex);
+         return ordinal;
+      }
+   }
+   ordinal = set->next_interned++;
+   MBClusterSetReserve(set, ordinal);
+   set->name[ordinal] = StringSave(name);
+   set->hash_next[ordinal] = set->hash_head[bucket];
+   set->hash_head[bucket] = ordinal;
+   NlmMutexUnlock(set->mutex);
+   return ordinal;
+}
+
+void LIBCALL MBClusterSetLink(MBClusterSetPtr set,
+                              Int4 a, CharPtr a_name, Int4 a_len,
+                              Int4 b, CharPtr b_name, Int4 b_len)
+{
+   Int4 root_a, root_b;
+
+   if (a < 0 || b < 0)
+      return;
+   NlmMutexLockEx(&set->mutex);
+   MBClusterSetAddNode(set, a, a_name, a_len);
+   MBClusterSetAddNode(set, b, b_name, b_len);
+   root_a = MBClusterSetFind(set, a);
+   root_b = MBClusterSetFind(set, b);
+   if (root_a != root_b) {
+      /* Union by size */
+      if (set->size[root_a] < set->size[root_b]) {
+         set->parent[root_a] = root_b;
+         set->size[root_b] += set->size[root_a];
+      } else {
+         set->parent[root_b] = root_a;
+         set->size[root_a] += set->size[root_b];
+      }
+      set->num_links++;
+   }
+   NlmMutexUnlock(set->mutex);
+}
+
+typedef struct mb_clust_member {
+   Int4 ordinal;
+   Int4 len;
+} MBClustMember, PNTR MBClustMemberPtr;
+
+typedef struct mb_clust_range {
+   Int4 start;
+   Int4 size;
+} MBClustRange, PNTR MBClustRangePtr;
+
+static int LIBCALLBACK MBClustMemberCmp(VoidPtr v1, VoidPtr v2)
+{
+   MBClustMemberPtr m1 = (MBClustMemberPtr) v1, m2 = (MBClustMemberPtr) v2;
+
+   if (m1->len != m2->len)
+      return (m1->len > m2->len) ? -1 : 1;
+   return (m1->ordinal < m2->ordinal) ? -1 : (m1->ordinal > m2->ordinal);
+}
+
+static int LIBCALLBACK MBClustRangeCmp(VoidPtr v1, VoidPtr v2)
+{
+   MBClustRangePtr r1 = (MBClustRangePtr) v1, r2 = (MBClustRangePtr) v2;
+
+   if (r1->size != r2->size)
+      return (r1->size > r2->size) ? -1 : 1;
+   return (r1->start < r2->start) ? -1 : (r1->start > r2->start);
+}
+
+Int4 LIBCALL MBClusterSetWrite(MBClusterSetPtr set, FILE *fp)
+{
+   Int4 index, root, num_nodes, num_clusters, pos;
+   Int4Ptr cluster_index;
+   MBClustMemberPtr members;
+   MBClustRangePtr ranges;
+
+   if (set == NULL || fp == NULL || set->max_ordinal < 0)
+      return 0;
+
+   NlmMutexLockEx(&set->mutex);
+   num_nodes = set->max_ordinal + 1;
+   cluster_index = (Int4Ptr) MemNew(num_nodes*sizeof(Int4));
+   ranges = (MBClustRangePtr) MemNew(num_nodes*sizeof(MBClustRange));
+   num_clusters = 0;
+   /* Assign each root a range of the members array */
+   for (index = 0; index < num_nodes; index++) {
+      if (set->parent[index] == index) {
+         cluster_index[index] = num_clusters;
+         ranges[num_clusters].size = 0;
+         num_clusters++;
+      }
+   }
+   pos = 0;
+   for (index = 0; index < num_nodes; index++) {
+      if (set->parent[index] == index) {
+         ranges[cluster_index[index]].start = pos;
+         pos += set->size[index];
+      }
+   }
+   members = (MBClustMemberPtr) MemNew(MAX(pos, 1)*sizeof(MBClustMember));
+   for (index = 0; index < num_nodes; index++) {
+      if (set->parent[index] < 0)
+         continue;
+      root = MBClusterSetFind(set, index);
+      pos = ranges[cluster_index[root]].start +
+         ranges[cluster_index[root]].size++;
+      members[pos].ordinal = index;
+      members[pos].len = set->seqlen[index];
+   }
+   for (index = 0; index < num_clusters; index++) {
+      HeapSort(members + ranges[index].start, ranges[index].size,
+               sizeof(MBClustMember), MBClustMemberCmp);
+   }
+   HeapSort(ranges, num_clusters, sizeof(MBClustRange), MBClustRangeCmp);
+
+   for (index = 0; index < num_clusters; index++) {
+      for (pos = ranges[index].start;
+           pos < ranges[index].start + ranges[index].size; pos++)
+         fprintf(fp, "%s ", set->name[members[pos].ordinal]);
+      fprintf(fp, "\n");
+   }
+   NlmMutexUnlock(set->mutex);
+
+   MemFree(members);
+   MemFree(ranges);
+   MemFree(cluster_index);
+   return num_clusters;
+}
@@ -0,0 +1,101 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbclust.h
+
+Contents: in-process single linkage clustering of Mega BLAST hits
+          (union-find over sequence ordinals), fed directly from the
+          results callback so that the hit table does not have to be
+          written out and parsed back.
+
+******************************************************************************/
+#ifndef __MBCLUST__
+#define __MBCLUST__
+
+#include <ncbi.h>
+#include <ncbithr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Minimal values a hit must reach to link its two sequences */
+typedef struct mb_cluster_thresh {
+   Int4 min_overlap;      /* shorter of the query/subject overlaps */
+   FloatHi min_perc_ident;
+   FloatHi min_bit_score;
+} MBClusterThresh, PNTR MBClusterThreshPtr;
+
+typedef struct mb_cluster_set {
+   Int4Ptr parent;     /* union-find forest; -1 = ordinal not seen yet */
+   Int4Ptr size;       /* number of members, valid for the roots only */
+   Int4Ptr seqlen;     /* sequence length, used to order cluster members */
+   CharPtr PNTR name;  /* sequence name for each ordinal seen */
+   Int4 allocated;     /* allocated length of the arrays above */
+   Int4 max_ordinal;   /* highest ordinal seen so far */
+   Int4 num_links;     /* number of calls that merged two clusters */
+   Int4Ptr hash_head;  /* name -> ordinal hash, for MBClusterSetIntern */
+   Int4Ptr hash_next;
+   Int4 hash_size;
+   Int4 next_interned; /* next ordinal to hand out by name */
+   MBClusterThresh thresh;
+   TNlmMutex mutex;    /* the callback runs in all search threads */
+} MBClusterSet, PNTR MBClusterSetPtr;
+
+/* Create an empty set; num_hint is the expected number of sequences
+   (e.g. the number of database sequences), 0 if unknown */
+MBClusterSetPtr LIBCALL MBClusterSetNew PROTO((Int4 num_hint));
+MBClusterSetPtr LIBCALL MBClusterSetFree PROTO((MBClusterSetPtr set));
+
+/* Parse thresholds given as "min_overlap,min_perc_ident,min_bit_score";
+   trailing fields may be omitted. Returns FALSE on a malformed string. */
+Boolean LIBCALL MBClusterThreshParse PROTO((CharPtr str,
+                                            MBClusterThreshPtr thresh));
+
+/* Returns TRUE if a hit with these values is good enough to link */
+Boolean LIBCALL MBClusterHitPasses PROTO((MBClusterSetPtr set,
+                   Int4 overlap, FloatHi perc_ident, FloatHi bit_score));
+
+/* Return the ordinal assigned to a sequence name, assigning a new one if
+   the name was not seen before. Use either this or caller-supplied
+   ordinals (e.g. database OIDs) for a given set, never both. */
+Int4 LIBCALL MBClusterSetIntern PROTO((MBClusterSetPtr set, CharPtr name));
+
+/* Put sequences a and b in the same cluster; names and lengths are only
+   recorded the first time an ordinal is seen. Thread safe. */
+void LIBCALL MBClusterSetLink PROTO((MBClusterSetPtr set,
+                   Int4 a, CharPtr a_name, Int4 a_len,
+                   Int4 b, CharPtr b_name, Int4 b_len));
+
+/* Print the clusters in blastclust format: one cluster per line, largest
+   clusters first, members separated by spaces and sorted by decreasing
+   length. Returns the number of clusters written. */
+Int4 LIBCALL MBClusterSetWrite PROTO((MBClusterSetPtr set, FILE *fp));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBCLUST__ */
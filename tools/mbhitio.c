@@ -0,0 +1,336 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbhitio.c
+
+Contents: writer and reader for the binary mgblast hit format, see
+          mbhitio.h for the file layout.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <ncbithr.h>
+#include <mbhitio.h>
+
+#define MBHIT_NAME_SUFFIX ".nam"
+#define MBHIT_GAP_SUFFIX ".gap"
+
+static FILE *MBHitOpenSideFile(CharPtr basename, CharPtr suffix, CharPtr mode)
+{
+   CharPtr filename;
+   FILE *fp;
+
+   filename = (CharPtr) MemNew(StringLen(basename) + StringLen(suffix) + 1);
+   sprintf(filename, "%s%s", basename, suffix);
+   fp = FileOpen(filename, mode);
+   if (fp == NULL)
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open %s", filename);
+   MemFree(filename);
+   return fp;
+}
+
+MBHitWriterPtr LIBCALL MBHitWriterNew(FILE *hit_fp, CharPtr basename,
+                                      Uint4 flags)
+{
+   MBHitWriterPtr writer;
+   MBHitFileHeader header;
+
+   if (hit_fp == NULL || basename == NULL)
+      return NULL;
+
+   writer = (MBHitWriterPtr) MemNew(sizeof(MBHitWriter));
+   writer->hit_fp = hit_fp;
+   if ((writer->name_fp =
+        MBHitOpenSideFile(basename, MBHIT_NAME_SUFFIX, "wb")) == NULL) {
+      MemFree(writer);
+      return NULL;
+   }
+   if ((flags & MBHIT_FLAG_GAPINFO) && (writer->gap_fp =
+        MBHitOpenSideFile(basename, MBHIT_GAP_SUFFIX, "wb")) == NULL) {
+      FileClose(writer->name_fp);
+      MemFree(writer);
+      return NULL;
+   }
+
+   MemSet(&header, 0, sizeof(header));
+   MemCpy(header.magic, MBHIT_MAGIC, 4);
+   header.byte_order = MBHIT_BYTE_ORDER;
+   header.version = MBHIT_VERSION;
+   header.record_size = sizeof(MBHitRecord);
+   header.flags = flags;
+   FileWrite(&header, sizeof(header), 1, hit_fp);
+   NlmMutexInit(&writer->mutex);
+   return writer;
+}
+
+MBHitWriterPtr LIBCALL MBHitWriterFree(MBHitWriterPtr writer)
+{
+   if (writer == NULL)
+      return NULL;
+   fflush(writer->hit_fp);
+   FileClose(writer->name_fp);
+   FileClose(writer->gap_fp);
+   MemFree(writer->seen[0]);
+   MemFree(writer->seen[1]);
+   NlmMutexDestroy(writer->mutex);
+   return (MBHitWriterPtr) MemFree(writer);
+}
+
+/* Write a name table entry unless the ordinal was already written; called
+   with the mutex held */
+static void MBHitWriteName(MBHitWriterPtr writer, Int4 kind, Int4 ordinal,
+                           CharPtr name, Int4 length)
+{
+   Int4 byte = ordinal >> 3, new_size;
+   Uint1 mask = (Uint1) (1 << (ordinal & 7)), tag;
+   Uint2 name_len;
+
+   if (ordinal < 0)
+      return;
+   if (byte >= writer->seen_size[kind]) {
+      new_size = MAX(2*writer->seen_size[kind], 4096);
+      while (new_size <= byte)
+         new_size *= 2;
+      writer->seen[kind] = (Uint1Ptr) Realloc(writer->seen[kind], new_size);
+      MemSet(writer->seen[kind] + writer->seen_size[kind], 0,
+             new_size - writer->seen_size[kind]);
+      writer->seen_size[kind] = new_size;
+   }
+   if (writer->seen[kind][byte] & mask)
+      return;
+   writer->seen[kind][byte] |= mask;
+
+   tag = (kind == 0) ? 'Q' : 'S';
+   name_len = (Uint2) MIN(StringLen(name), UINT2_MAX);
+   FileWrite(&tag, 1, 1, writer->name_fp);
+   FileWrite(&ordinal, sizeof(Int4), 1, writer->name_fp);
+   FileWrite(&length, sizeof(Int4), 1, writer->name_fp);
+   FileWrite(&name_len, sizeof(Uint2), 1, writer->name_fp);
+   FileWrite(name, 1, name_len, writer->name_fp);
+}
+
+Boolean LIBCALL MBHitWriterAdd(MBHitWriterPtr writer, MBHitRecordPtr rec,
+                               CharPtr query_name, Int4 query_len,
+                               CharPtr subject_name, Int4 subject_len,
+                               CharPtr gap_info)
+{
+   Boolean ok;
+
+   NlmMutexLockEx(&writer->mutex);
+   MBHitWriteName(writer, 0, rec->query_ord, query_name, query_len);
+   MBHitWriteName(writer, 1, rec->subject_oid, subject_name, subject_len);
+   rec->gap_offset = -1;
+   rec->gap_length = 0;
+   if (writer->gap_fp && gap_info) {
+      rec->gap_offset = writer->gap_offset;
+      rec->gap_length = StringLen(gap_info);
+      FileWrite(gap_info, 1, rec->gap_length, writer->gap_fp);
+      writer->gap_offset += rec->gap_length;
+   }
+   ok = (FileWrite(rec, sizeof(MBHitRecord), 1, writer->hit_fp) == 1);
+   writer->num_hits++;
+   NlmMutexUnlock(writer->mutex);
+   return ok;
+}
+
+static void MBHitNamesAdd(MBHitNamesPtr names, Int4 ordinal, CharPtr name,
+                          Int4 length)
+{
+   Int4 new_alloc, index;
+
+   if (ordinal >= names->allocated) {
+      new_alloc = MAX(2*names->allocated, 1024);
+      while (new_alloc <= ordinal)
+         new_alloc *= 2;
+      names->name = (CharPtr PNTR) Realloc(names->name,
+                                           new_alloc*sizeof(CharPtr));
+      names->length = (Int4Ptr) Realloc(names->length,
+                                        new_alloc*sizeof(Int4));
+      for (index = names->allocated; index < new_alloc; index++) {
+         names->name[index] = NULL;
+         names->length[index] = 0;
+      }
+      names->allocated = new_alloc;
+   }
+   MemFree(names->name[ordinal]);
+   names->name[ordinal] = name;
+   names->length[ordinal] = length;
+}
+
+static Boolean MBHitReadNames(MBHitReaderPtr reader, FILE *fp)
+{
+   Uint1 tag;
+   Int4 ordinal, length;
+   Uint2 name_len;
+   CharPtr name;
+
+   while (FileRead(&tag, 1, 1, fp) == 1) {
+      if (FileRead(&ordinal, sizeof(Int4), 1, fp) != 1 ||
+          FileRead(&length, sizeof(Int4), 1, fp) != 1 ||
+          FileRead(&name_len, sizeof(Uint2), 1, fp) != 1 ||
+          (tag != 'Q' && tag != 'S') || ordinal < 0)
+         return FALSE;
+      name = (CharPtr) MemNew(name_len + 1);
+      if (FileRead(name, 1, name_len, fp) != name_len) {
+         MemFree(name);
+         return FALSE;
+      }
+      MBHitNamesAdd(&reader->names[tag == 'Q' ? 0 : 1], ordinal, name,
+                    length);
+   }
+   return TRUE;
+}
+
+MBHitReaderPtr LIBCALL MBHitReaderOpen(CharPtr filename)
+{
+   MBHitReaderPtr reader;
+   FILE *name_fp;
+   Int8 file_size;
+
+   reader = (MBHitReaderPtr) MemNew(sizeof(MBHitReader));
+   if ((reader->hit_fp = FileOpen(filename, "rb")) == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open %s", filename);
+      return MBHitReaderFree(reader);
+   }
+   if (FileRead(&reader->header, sizeof(MBHitFileHeader), 1,
+                reader->hit_fp) != 1 ||
+       MemCmp(reader->header.magic, MBHIT_MAGIC, 4) != 0) {
+      ErrPostEx(SEV_ERROR, 0, 0, "%s is not a binary mgblast hit file",
+                filename);
+      return MBHitReaderFree(reader);
+   }
+   if (reader->header.byte_order != MBHIT_BYTE_ORDER ||
+       reader->header.version != MBHIT_VERSION ||
+       reader->header.record_size != sizeof(MBHitRecord)) {
+      ErrPostEx(SEV_ERROR, 0, 0, "%s was written by an incompatible host "
+                "or mgblast version", filename);
+      return MBHitReaderFree(reader);
+   }
+   file_size = FileLength(filename);
+   reader->num_hits = (file_size - sizeof(MBHitFileHeader)) /
+      sizeof(MBHitRecord);
+
+   if ((name_fp = MBHitOpenSideFile(filename, MBHIT_NAME_SUFFIX, "rb"))
+       == NULL)
+      return MBHitReaderFree(reader);
+   if (!MBHitReadNames(reader, name_fp)) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Corrupt name table for %s", filename);
+      FileClose(name_fp);
+      return MBHitReaderFree(reader);
+   }
+   FileClose(name_fp);
+
+   if (reader->header.flags & MBHIT_FLAG_GAPINFO)
+      reader->gap_fp = MBHitOpenSideFile(filename, MBHIT_GAP_SUFFIX, "rb");
+   return reader;
+}
+
+MBHitReaderPtr LIBCALL MBHitReaderFree(MBHitReaderPtr reader)
+{
+   Int4 kind, index;
+
+   if (reader == NULL)
+      return NULL;
+   FileClose(reader->hit_fp);
+   FileClose(reader->gap_fp);
+   for (kind = 0; kind < 2; kind++) {
+      for (index = 0; index < reader->names[kind].allocated; index++)
+         MemFree(reader->names[kind].name[index]);
+      MemFree(reader->names[kind].name);
+      MemFree(reader->names[kind].length);
+   }
+   return (MBHitReaderPtr) MemFree(reader);
+}
+
+Boolean LIBCALL MBHitReaderGet(MBHitReaderPtr reader, Int8 index,
+                               MBHitRecordPtr rec)
+{
+   if (index < 0 || index >= reader->num_hits)
+      return FALSE;
+   if (index != reader->next_hit) {
+      if (fseek(reader->hit_fp, (long) (sizeof(MBHitFileHeader) +
+                                        index*sizeof(MBHitRecord)),
+                SEEK_SET) != 0)
+         return FALSE;
+   }
+   if (FileRead(rec, sizeof(MBHitRecord), 1, reader->hit_fp) != 1)
+      return FALSE;
+   reader->next_hit = index + 1;
+   return TRUE;
+}
+
+Boolean LIBCALL MBHitReaderNext(MBHitReaderPtr reader, MBHitRecordPtr rec)
+{
+   return MBHitReaderGet(reader, reader->next_hit, rec);
+}
+
+static CharPtr MBHitNamesGet(MBHitNamesPtr names, Int4 ordinal,
+                             Int4Ptr length)
+{
+   if (ordinal < 0 || ordinal >= names->allocated ||
+       names->name[ordinal] == NULL)
+      return NULL;
+   if (length)
+      *length = names->length[ordinal];
+   return names->name[ordinal];
+}
+
+CharPtr LIBCALL MBHitReaderQueryName(MBHitReaderPtr reader, Int4 ordinal,
+                                     Int4Ptr length)
+{
+   return MBHitNamesGet(&reader->names[0], ordinal, length);
+}
+
+CharPtr LIBCALL MBHitReaderSubjectName(MBHitReaderPtr reader, Int4 ordinal,
+                                       Int4Ptr length)
+{
+   return MBHitNamesGet(&reader->names[1], ordinal, length);
+}
+
+FloatHi LIBCALL MBHitRecordPercIdent(MBHitRecordPtr rec)
+{
+   FloatHi perc_ident;
+
+   if (rec->align_length <= 0)
+      return 0.0;
+   perc_ident = (FloatHi) rec->num_ident / rec->align_length * 100;
+   /* Avoid printing 100.00 when the hit is not an exact match */
+   if (perc_ident >= 99.995 && perc_ident < 100.00)
+      perc_ident = 99.99;
+   return perc_ident;
+}
+
+CharPtr LIBCALL MBHitReaderGapInfo(MBHitReaderPtr reader, MBHitRecordPtr rec)
+{
+   CharPtr blob;
+
+   if (reader->gap_fp == NULL || rec->gap_offset < 0)
+      return NULL;
+   if (fseek(reader->gap_fp, (long) rec->gap_offset, SEEK_SET) != 0)
+      return NULL;
+   blob = (CharPtr) MemNew(rec->gap_length + 1);
+   if (FileRead(blob, 1, rec->gap_length, reader->gap_fp) != rec->gap_length)
+      return (CharPtr) MemFree(blob);
+   return blob;
+}
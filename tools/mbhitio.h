@@ -0,0 +1,152 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbhitio.h
+
+Contents: compact binary hit output for mgblast (-D 6 and -D 7) and the
+          reader used by the tools consuming it.
+
+          A binary hit file <name> starts with an MBHitFileHeader and is
+          followed by fixed size MBHitRecord's, so hit number i can be read
+          directly at offset sizeof(MBHitFileHeader) + i*sizeof(MBHitRecord).
+          Two side files go along with it:
+            <name>.nam - query and subject names and lengths, one entry the
+                         first time each ordinal is seen:
+                         Uint1 kind ('Q'/'S'), Int4 ordinal, Int4 length,
+                         Uint2 name length, name characters (no terminator)
+            <name>.gap - gap info blobs (same text as the last two fields
+                         of the -D 5 output, tab separated), addressed by
+                         gap_offset/gap_length of the records; only written
+                         for -D 7
+          All numbers are in the byte order of the writing host; readers
+          check MBHIT_BYTE_ORDER in the header.
+
+******************************************************************************/
+#ifndef __MBHITIO__
+#define __MBHITIO__
+
+#include <ncbi.h>
+#include <ncbithr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBHIT_MAGIC "MGBH"
+#define MBHIT_BYTE_ORDER 0x01020304
+#define MBHIT_VERSION 1
+
+#define MBHIT_FLAG_GAPINFO 0x1   /* .gap side file present */
+#define MBHIT_FLAG_SLICE   0x2   /* query ordinals are database OIDs (-K) */
+
+typedef struct mb_hit_file_header {
+   Char magic[4];
+   Uint4 byte_order;
+   Uint4 version;
+   Uint4 record_size;
+   Uint4 flags;
+   Uint4 reserved;
+} MBHitFileHeader, PNTR MBHitFileHeaderPtr;
+
+/* One hit; coordinates are 1-based and oriented exactly as in the -D 4
+   output (q_start > q_end for hits on the minus strand) */
+typedef struct mb_hit_record {
+   FloatHi evalue;
+   FloatHi bit_score;
+   Int8 gap_offset;     /* offset in the .gap file, -1 if none */
+   Int4 query_ord;      /* query ordinal (OID in -K mode) */
+   Int4 subject_oid;    /* database ordinal id of the subject */
+   Int4 q_start, q_end;
+   Int4 s_start, s_end;
+   Int4 score;          /* raw score */
+   Int4 align_length;
+   Int4 num_ident;      /* identities, see MBHitRecordPercIdent */
+   Uint4 gap_length;    /* length of the gap info blob */
+   Uint1 strand;        /* '+' or '-' */
+   Uint1 reserved[7];
+} MBHitRecord, PNTR MBHitRecordPtr;
+
+typedef struct mb_hit_writer {
+   FILE *hit_fp;        /* not owned, the regular output file */
+   FILE *name_fp;
+   FILE *gap_fp;
+   Int8 gap_offset;
+   Uint1Ptr seen[2];    /* bit arrays of query/subject ordinals written */
+   Int4 seen_size[2];   /* in bytes */
+   Int8 num_hits;
+   TNlmMutex mutex;
+} MBHitWriter, PNTR MBHitWriterPtr;
+
+/* Write the header to hit_fp and create the side files for basename;
+   flags are MBHIT_FLAG_* */
+MBHitWriterPtr LIBCALL MBHitWriterNew PROTO((FILE *hit_fp, CharPtr basename,
+                                             Uint4 flags));
+/* Append one hit; names are written to the name table only the first time
+   an ordinal is seen, gap_info may be NULL. Thread safe. */
+Boolean LIBCALL MBHitWriterAdd PROTO((MBHitWriterPtr writer,
+                   MBHitRecordPtr rec, CharPtr query_name, Int4 query_len,
+                   CharPtr subject_name, Int4 subject_len, CharPtr gap_info));
+/* Close the side files; the hit file itself is left to the caller */
+MBHitWriterPtr LIBCALL MBHitWriterFree PROTO((MBHitWriterPtr writer));
+
+typedef struct mb_hit_names {
+   CharPtr PNTR name;
+   Int4Ptr length;
+   Int4 allocated;
+} MBHitNames, PNTR MBHitNamesPtr;
+
+typedef struct mb_hit_reader {
+   FILE *hit_fp;
+   FILE *gap_fp;
+   MBHitFileHeader header;
+   Int8 num_hits;
+   Int8 next_hit;
+   MBHitNames names[2];  /* query, subject */
+} MBHitReader, PNTR MBHitReaderPtr;
+
+/* Open a binary hit file with its side files and load the name table */
+MBHitReaderPtr LIBCALL MBHitReaderOpen PROTO((CharPtr filename));
+MBHitReaderPtr LIBCALL MBHitReaderFree PROTO((MBHitReaderPtr reader));
+/* Read hit number index, or the next hit; FALSE past the end */
+Boolean LIBCALL MBHitReaderGet PROTO((MBHitReaderPtr reader, Int8 index,
+                                      MBHitRecordPtr rec));
+Boolean LIBCALL MBHitReaderNext PROTO((MBHitReaderPtr reader,
+                                       MBHitRecordPtr rec));
+/* Name and length of a query or subject ordinal; NULL if unknown */
+CharPtr LIBCALL MBHitReaderQueryName PROTO((MBHitReaderPtr reader,
+                                            Int4 ordinal, Int4Ptr length));
+CharPtr LIBCALL MBHitReaderSubjectName PROTO((MBHitReaderPtr reader,
+                                              Int4 ordinal, Int4Ptr length));
+/* Percent identity of a hit, computed as for the -D 4 output */
+FloatHi LIBCALL MBHitRecordPercIdent PROTO((MBHitRecordPtr rec));
+/* Gap info blob of a hit, allocated; NULL if the hit has none */
+CharPtr LIBCALL MBHitReaderGapInfo PROTO((MBHitReaderPtr reader,
+                                          MBHitRecordPtr rec));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBHITIO__ */
@@ -717,6 +717,7 @@ Detailed Contents:
 #include <gapxdrop.h>
 #include <dust.h>
 #include <mbalign.h>
+#include <mbverify.h>
 #include <mblast.h>
 #include <time.h>
 
@@ -757,20 +758,13 @@ Boolean MegaBlastGetFirstAndLastContext (CharPtr prog_name,
             SeqLocPtr query_slp, Int2Ptr first_context,
             Int2Ptr last_context, Uint1 strand_options);
 
-SeqAlignPtr PNTR
-BioseqMegaBlastEngine (BioseqPtr PNTR bspp, CharPtr progname, CharPtr database,
-		       BLAST_OptionsBlkPtr options, ValNodePtr *other_returns,
-		       ValNodePtr *error_returns, int (LIBCALLBACK
-						       *callback)(Int4 done,
-								  Int4
-								  positives),
-		       SeqIdPtr seqid_list, BlastDoubleInt4Ptr gi_list,
-		       Int4 gi_list_total,
-		       int (LIBCALLBACK *results_callback)PROTO((VoidPtr Ptr)))
+/* The locations of the bspp queries, NULL terminated; the location given
+   in the options applies to the first one */
+static SeqLocPtr
+MegaBlastQueryLocs(BioseqPtr PNTR bspp, BLAST_OptionsBlkPtr options)
 {
-   SeqLocPtr slp, next_slp;
+   SeqLocPtr slp;
    Int4 index = 0;
-   SeqAlignPtr PNTR head;
    Int4 from = options->required_start, to = options->required_end;
 
    slp = NULL;
@@ -794,12 +788,15 @@ BioseqMegaBlastEngine (BioseqPtr PNTR bspp, CharPtr progname, CharPtr database,
    for ( ; bspp[index] != NULL; index++)
       ValNodeAddPointer(&slp, SEQLOC_WHOLE, SeqIdSetDup(bspp[index]->id));
 
-   head = BioseqMegaBlastEngineByLoc(slp, progname, database, options,
-                                     other_returns, error_returns, callback,
-                                     seqid_list, gi_list, gi_list_total,
-                                     results_callback);
+   return slp;
+}
+
+static void
+MegaBlastQueryLocsFree(SeqLocPtr slp)
+{
+   SeqLocPtr next_slp;
 
-   if (slp->choice == SEQLOC_INT) {
+   if (slp != NULL && slp->choice == SEQLOC_INT) {
      next_slp = slp->next;
      SeqLocFree(slp);
      slp = next_slp;
@@ -811,48 +808,45 @@ BioseqMegaBlastEngine (BioseqPtr PNTR bspp, CharPtr progname, CharPtr database,
      MemFree(slp);
      slp = next_slp;
    }
-
-   return head;
 }
 
 SeqAlignPtr PNTR
-BioseqMegaBlastEngineByLoc (SeqLocPtr slp, CharPtr progname, CharPtr database,
-                            BLAST_OptionsBlkPtr options, ValNodePtr *other_returns,
-                            ValNodePtr *error_returns,
-                            int (LIBCALLBACK *callback)(Int4 done, Int4 positives),
-                            SeqIdPtr seqid_list, BlastDoubleInt4Ptr gi_list,
-                            Int4 gi_list_total,
-                            int (LIBCALLBACK *results_callback)PROTO((VoidPtr Ptr)))
+BioseqMegaBlastEngine (BioseqPtr PNTR bspp, CharPtr progname, CharPtr database,
+		       BLAST_OptionsBlkPtr options, ValNodePtr *other_returns,
+		       ValNodePtr *error_returns, int (LIBCALLBACK
+						       *callback)(Int4 done,
+								  Int4
+								  positives),
+		       SeqIdPtr seqid_list, BlastDoubleInt4Ptr gi_list,
+		       Int4 gi_list_total,
+		       int (LIBCALLBACK *results_callback)PROTO((VoidPtr Ptr)))
 {
-	Boolean options_allocated=FALSE;
-	BlastSearchBlkPtr search;
-	Int2 status;
-	SeqAlignPtr PNTR head;
-	SeqLocPtr whole_slp=NULL, slp_var;
-	Int4 index;
-
+   SeqLocPtr slp;
+   SeqAlignPtr PNTR head;
 
-	head = NULL;
+   if ((slp = MegaBlastQueryLocs(bspp, options)) == NULL)
+      return NULL;
 
-	if (error_returns)
-	{
-		*error_returns = NULL;
-	}
+   head = BioseqMegaBlastEngineByLoc(slp, progname, database, options,
+                                     other_returns, error_returns, callback,
+                                     seqid_list, gi_list, gi_list_total,
+                                     results_callback);
 
-	if (other_returns)
-	{
-		*other_returns = NULL;
-	}
+   MegaBlastQueryLocsFree(slp);
 
-	if (progname == NULL)
-		return NULL;
+   return head;
+}
 
-	/* If no options, use default. */
-        if (options == NULL)
-	{
-		options = BLASTOptionNewEx(progname, TRUE, TRUE);
-		options_allocated = TRUE;
-	}
+/* Validates the options and sets up the search of the slp queries: the
+   queries are concatenated and filtered and the lookup table is built */
+static BlastSearchBlkPtr
+MegaBlastEngineSetUp(SeqLocPtr slp, CharPtr progname, CharPtr database,
+                     BLAST_OptionsBlkPtr options, ValNodePtr *error_returns,
+                     SeqIdPtr seqid_list, BlastDoubleInt4Ptr gi_list,
+                     Int4 gi_list_total)
+{
+	BlastSearchBlkPtr search;
+	Int2 status;
 
 	status = BLASTOptionValidateEx(options, progname, error_returns);
 	if (status != 0)
@@ -867,7 +861,8 @@ BioseqMegaBlastEngineByLoc (SeqLocPtr slp, CharPtr progname, CharPtr database,
 							0,
 							database, options, NULL,
 							seqid_list, gi_list,
-							gi_list_total, NULL);
+							gi_list_total, 
+                                                        options->shared_rdfp);
 
         if (search == NULL) {
            /* We need to veryfy if database name is wrong and to set error
@@ -888,9 +883,23 @@ BioseqMegaBlastEngineByLoc (SeqLocPtr slp, CharPtr progname, CharPtr database,
             }
 
             readdb_destruct(rdfp);
-            return NULL;
         }
 
+	return search;
+}
+
+/* Runs a search set up by MegaBlastEngineSetUp and destroys it */
+static SeqAlignPtr PNTR
+MegaBlastEngineRunSetUp(BlastSearchBlkPtr search, SeqLocPtr slp,
+                        BLAST_OptionsBlkPtr options, ValNodePtr *other_returns,
+                        ValNodePtr *error_returns,
+                        int (LIBCALLBACK *callback)(Int4 done, Int4 positives),
+                        int (LIBCALLBACK *results_callback)PROTO((VoidPtr Ptr)))
+{
+	SeqAlignPtr PNTR head;
+	SeqLocPtr whole_slp=NULL, slp_var;
+	Int4 index;
+
 	search->thr_info->tick_callback = callback;
 	search->thr_info->star_callback = callback;
 	search->handle_results = results_callback;
@@ -898,6 +907,9 @@ BioseqMegaBlastEngineByLoc (SeqLocPtr slp, CharPtr progname, CharPtr database,
 
 	head = BioseqMegaBlastEngineCore(search, options);
 	
+	if (options->search_stats)
+           BlastSearchStatsPrepare(search, options->search_stats);
+
 	if (search->error_return)
 	{
 		ValNodeLink(error_returns, search->error_return);
@@ -909,11 +921,6 @@ BioseqMegaBlastEngineByLoc (SeqLocPtr slp, CharPtr progname, CharPtr database,
 		*other_returns = BlastOtherReturnsPrepare(search);
 	}
 
-	if (options_allocated)
-	{
-		options = BLASTOptionDelete(options);
-	}
- 
 	search = BlastSearchBlkDestruct(search);
 
 	/* Adjsut the offset if the query does not cover the entire sequence. */
@@ -931,6 +938,115 @@ BioseqMegaBlastEngineByLoc (SeqLocPtr slp, CharPtr progname, CharPtr database,
 	return head;
 }
 
+SeqAlignPtr PNTR
+BioseqMegaBlastEngineByLoc (SeqLocPtr slp, CharPtr progname, CharPtr database,
+                            BLAST_OptionsBlkPtr options, ValNodePtr *other_returns,
+                            ValNodePtr *error_returns,
+                            int (LIBCALLBACK *callback)(Int4 done, Int4 positives),
+                            SeqIdPtr seqid_list, BlastDoubleInt4Ptr gi_list,
+                            Int4 gi_list_total,
+                            int (LIBCALLBACK *results_callback)PROTO((VoidPtr Ptr)))
+{
+	Boolean options_allocated=FALSE;
+	BlastSearchBlkPtr search;
+	SeqAlignPtr PNTR head;
+
+
+	head = NULL;
+
+	if (error_returns)
+	{
+		*error_returns = NULL;
+	}
+
+	if (other_returns)
+	{
+		*other_returns = NULL;
+	}
+
+	if (progname == NULL)
+		return NULL;
+
+	/* If no options, use default. */
+        if (options == NULL)
+	{
+		options = BLASTOptionNewEx(progname, TRUE, TRUE);
+		options_allocated = TRUE;
+	}
+
+	search = MegaBlastEngineSetUp(slp, progname, database, options,
+                                      error_returns, seqid_list, gi_list,
+                                      gi_list_total);
+	if (search == NULL)
+		return NULL;
+
+	head = MegaBlastEngineRunSetUp(search, slp, options, other_returns,
+                                       error_returns, callback,
+                                       results_callback);
+
+	if (options_allocated)
+	{
+		options = BLASTOptionDelete(options);
+	}
+
+	return head;
+}
+
+MBPreparedSearchPtr LIBCALL
+BioseqMegaBlastEnginePrepare(BioseqPtr PNTR bspp, CharPtr progname,
+                             CharPtr database, BLAST_OptionsBlkPtr options,
+                             SeqIdPtr seqid_list, BlastDoubleInt4Ptr gi_list,
+                             Int4 gi_list_total)
+{
+   MBPreparedSearchPtr prep;
+
+   if (bspp == NULL || progname == NULL || options == NULL)
+      return NULL;
+
+   prep = (MBPreparedSearchPtr) MemNew(sizeof(MBPreparedSearch));
+   if ((prep->slp = MegaBlastQueryLocs(bspp, options)) != NULL)
+      prep->search = MegaBlastEngineSetUp(prep->slp, progname, database, 
+                        options, &prep->error_returns, seqid_list, gi_list,
+                        gi_list_total);
+
+   return prep;
+}
+
+SeqAlignPtr PNTR LIBCALL
+BioseqMegaBlastEngineRun(MBPreparedSearchPtr prep, BLAST_OptionsBlkPtr options,
+                         ValNodePtr *other_returns, ValNodePtr *error_returns,
+                         int (LIBCALLBACK *callback)(Int4 done, Int4 positives),
+                         int (LIBCALLBACK *results_callback)PROTO((VoidPtr Ptr)))
+{
+   SeqAlignPtr PNTR head = NULL;
+   ValNodePtr vnp;
+
+   if (other_returns)
+      *other_returns = NULL;
+   if (error_returns)
+      *error_returns = NULL;
+   if (prep == NULL)
+      return NULL;
+
+   if (error_returns) {
+      *error_returns = prep->error_returns;
+   } else {
+      for (vnp = prep->error_returns; vnp; vnp = vnp->next)
+         BlastDestroyErrorMessage((BlastErrorMsgPtr) vnp->data.ptrvalue);
+      ValNodeFree(prep->error_returns);
+   }
+
+   if (prep->search != NULL)
+      head = MegaBlastEngineRunSetUp(prep->search, prep->slp, options, 
+                                     other_returns, error_returns, callback,
+                                     results_callback);
+
+   MegaBlastQueryLocsFree(prep->slp);
+   MemFree(prep);
+
+   return head;
+}
+
 static Int2 mb_two_hit_min_step;
 
 SeqAlignPtr PNTR
@@ -1041,7 +1157,9 @@ MegaBlastSetUpSearchWithReadDbInternal (SeqLocPtr query_slp, BioseqPtr
 					options->window_size);
 
 	if (search) {
-	   if (NlmThreadsAvailable() && query_length > INDEX_THR_MIN_SIZE) {
+	   /* the ticker only reports progress through the callback */
+	   if (NlmThreadsAvailable() && query_length > INDEX_THR_MIN_SIZE &&
+               callback != NULL) {
 	      search->thr_info->awake_index = TRUE;
 	      search->thr_info->last_tick = Nlm_GetSecs();
 	      search->thr_info->index_thr = 
@@ -1154,10 +1272,9 @@ MegaBlastSetUpSearchInternalByLoc (BlastSearchBlkPtr search, SeqLocPtr
       index, length, length_adjustment=0,
       min_query_length, full_query_length=0;
    Int4 context, num_queries;
-   Nlm_FloatHi avglen;
+   Nlm_FloatHi avglen, start_time;
    SeqIdPtr qid=NULL;
    SeqLocPtr filter_slp=NULL, private_slp=NULL, private_slp_rev=NULL, slp=NULL, tmp_slp=NULL;
-   Uint1 residue;
    Uint1Ptr query_seq=NULL, query_seq_start=NULL, query_seq_rev=NULL, query_seq_start_rev=NULL;
    Uint1Ptr query_seq_combined=NULL;
    CharPtr filter_string=NULL;
@@ -1165,7 +1282,6 @@ MegaBlastSetUpSearchInternalByLoc (BlastSearchBlkPtr search, SeqLocPtr
    Int4 homo_gilist_size, mouse_gilist_size, rat_gilist_size;
    BlastDoubleInt4Ptr homo_gilist=NULL, mouse_gilist=NULL, rat_gilist=NULL;
    SeqLocPtr mask_slp=NULL, next_mask_slp=NULL;
-   SeqPortPtr spp = NULL;
    
    if (options == NULL) {
       ErrPostEx(SEV_FATAL, 1, 0, "BLAST_OptionsBlkPtr is NULL\n");
@@ -1378,12 +1494,6 @@ MegaBlastSetUpSearchInternalByLoc (BlastSearchBlkPtr search, SeqLocPtr
 	 mask_slp = NULL;
 
       if (private_slp) {
-         if (private_slp->choice == SEQLOC_INT) {
-            spp = SeqPortNewByLoc(private_slp, Seq_code_ncbi4na);
-            SeqPortSet_do_virtual(spp, TRUE);
-         }
-
-
 	 if ((query_seq_start = (Uint1Ptr)
               Malloc(((query_length)+2)*sizeof(Char))) == NULL) {
             ErrPostEx(SEV_WARNING, 0, 0, "Memory allocation for query sequence failed");
@@ -1393,15 +1503,12 @@ MegaBlastSetUpSearchInternalByLoc (BlastSearchBlkPtr search, SeqLocPtr
 
 	 query_seq = query_seq_start+1;
 
-	 index=0;
-         if (spp) {
-            while ((residue=SeqPortGetResidue(spp)) != SEQPORT_EOF) {
-               if (IS_residue(residue)) {
-                  query_seq[index] = ncbi4na_to_blastna[residue];
-                  index++;
-               }
-            }
-            spp = SeqPortFree(spp);
+         /* Decode the whole query at once, then map it to blastna */
+         if (private_slp->choice == SEQLOC_INT) {
+            length = SeqPortBulkReadLoc(private_slp, Seq_code_ncbi4na,
+                                        query_seq);
+            for (index = 0; index < length; index++)
+               query_seq[index] = ncbi4na_to_blastna[query_seq[index]];
          }
 
 	 query_seq_start[0] = query_seq[query_length] = 0x0f;
@@ -1428,8 +1535,6 @@ MegaBlastSetUpSearchInternalByLoc (BlastSearchBlkPtr search, SeqLocPtr
       }
 
       if (private_slp_rev) {
-         spp = SeqPortNewByLoc(private_slp_rev, Seq_code_ncbi4na);
-         SeqPortSet_do_virtual(spp, TRUE);
 	 if ((query_seq_start_rev = (Uint1Ptr)
 	    Malloc(((query_length)+2)*sizeof(Char))) == NULL) {
             ErrPostEx(SEV_WARNING, 0, 0, "Memory allocation for query sequence failed");
@@ -1437,16 +1542,10 @@ MegaBlastSetUpSearchInternalByLoc (BlastSearchBlkPtr search, SeqLocPtr
             goto MegaBlastSetUpReturn;
          }
 	 query_seq_rev = query_seq_start_rev+1;
-	 index=0;
-         if (spp) {
-            while ((residue=SeqPortGetResidue(spp)) != SEQPORT_EOF) {
-               if (IS_residue(residue)) {
-                  query_seq_rev[index] = ncbi4na_to_blastna[residue];
-                  index++;
-               }
-            }
-            spp = SeqPortFree(spp);
-         }
+         length = SeqPortBulkReadLoc(private_slp_rev, Seq_code_ncbi4na,
+                                     query_seq_rev);
+         for (index = 0; index < length; index++)
+            query_seq_rev[index] = ncbi4na_to_blastna[query_seq_rev[index]];
 
 	 query_seq_start_rev[0] = query_seq_rev[query_length] = 0x0f;
          if (filter_slp && !mask_at_hash) {
@@ -1641,6 +1740,7 @@ available) this needs to be set higher up. */
    search->pbp->gap_open = options->gap_open;
    search->pbp->gap_extend = options->gap_extend;
    search->pbp->decline_align = options->decline_align;
+   search->pbp->vector_dp = options->vector_dp;
    
    if (options->hsp_num_max) {
       search->pbp->hsp_num_max = options->hsp_num_max;
@@ -1691,10 +1791,15 @@ available) this needs to be set higher up. */
    search->pbp->ignore_small_gaps = TRUE;
    
    search->wfp = search->wfp_second;
+   start_time = MBStatsClock();
    if (!MegaBlastBuildLookupTable(search)) {
       ErrPostEx(SEV_WARNING, 0, 0, "Failed to construct a lookup table");
       return 1;
    }
+   search->stage_stats.time[MB_STAGE_LOOKUP] += MBStatsClock() - start_time;
+   if (search->pbp->mb_params->stage_timing)
+      MBStageStatsNotePeak(&search->stage_stats, MB_STAGE_LOOKUP, 
+                           MB_STAGE_LOOKUP);
    
    return 0;
 }
@@ -1961,6 +2066,28 @@ MegaBlastSequenceAddSequence (BlastSequenceBlkPtr sequence_blk, Uint1Ptr sequenc
    return 0;
 }
 
+/* Whether the query at concatenated offset q_off is one of the candidate
+   queries of the current subject */
+static Boolean
+MegaBlastIsSketchQuery(BlastSearchBlkPtr search, Int4 q_off)
+{
+   Int4Ptr queries = search->sketch_queries;
+   Int4 query, low, high, middle;
+
+   query = BinarySearchInt4(q_off, search->query_context_offsets,
+                            (Int4) (search->last_context + 1)) / 2;
+   low = 0;
+   high = search->num_sketch_queries;
+   while (low < high) {
+      middle = (low + high) / 2;
+      if (queries[middle] < query)
+         low = middle + 1;
+      else
+         high = middle;
+   }
+   return (low < search->num_sketch_queries && queries[low] == query);
+}
+
 static Boolean
 MegaBlastSaveExactMatch(BlastSearchBlkPtr search, Int4 q_off, Int4 s_off) 
 {
@@ -1970,6 +2097,17 @@ MegaBlastSaveExactMatch(BlastSearchBlkPtr search, Int4 q_off, Int4 s_off)
    if (!search || !search->wfp || !search->wfp->lookup || 
        !search->wfp->lookup->mb_lt)
       return FALSE;
+   /* Not extended: a query from the subject's own sequence on. The word
+      has gone through the diagonal bookkeeping of MegaBlastExtendHit, 
+      which the words of all queries share, so the other hits are the 
+      same */
+   if (q_off > search->query_limit)
+      return TRUE;
+   /* Nor is a query the sketch prefilter found no shared minimizers of
+      with the subject */
+   if (search->num_sketch_queries >= 0 && 
+       !MegaBlastIsSketchQuery(search, q_off))
+      return TRUE;
    
    num = search->current_hitlist->hspcnt;
    num_avail = search->current_hitlist->exact_match_max;
@@ -2722,7 +2860,115 @@ MegaBlastWordFinder_disc_1b(BlastSearchBlkPtr search, LookupTablePtr lookup)
    else return 0;
 }
 
-/* Contiguous words, database scanned 4 bases at a time */
+/* Extends the seeds of the subject from the database word index instead
+   of scanning it. They come by offset, as the scan would find them; the 
+   offsets are those in the whole database sequence, so for a chunk of a
+   long one only the words the scan of the chunk would see are taken. 
+   With an index of every 4th base the seeds are the hits of the scan. A
+   sparser index gives one word of each longer exact match: the hits the
+   scan would need to build the match up to the word size are then found
+   by scanning the subject around each such word */
+static void
+MegaBlastIndexedExtendHits(BlastSearchBlkPtr search, LookupTablePtr lookup)
+{
+   MbLookupTablePtr mb_lt = lookup->mb_lt;
+   MBWordSeedPtr seed;
+   Uint1Ptr subject = search->subject->sequence;
+   Int4 num_seeds, s_off, q_off, ecode, reach, scan_end = 0;
+   Int4 chunk_start = search->subject->original_length;
+   Int4 subj_length = search->subject->length;
+   Int4 word_length = READDB_COMPRESSION_RATIO*mb_lt->width;
+   Boolean sparse;
+
+   sparse = (search->pbp->mb_params->word_index->header.stride > 
+             READDB_COMPRESSION_RATIO);
+   /* Hits further apart on a diagonal than the word size plus the two
+      hit window do not add up */
+   reach = mb_lt->lpm + search->pbp->window_size + READDB_COMPRESSION_RATIO;
+   reach -= reach % READDB_COMPRESSION_RATIO;
+
+   seed = MBWordSeedsGet(search->thr_info->word_seeds, search->subject_id,
+                         &num_seeds);
+   for (; num_seeds > 0; seed++, num_seeds--) {
+      s_off = seed->s_off - chunk_start;
+      if (s_off < word_length)
+         continue;
+      if (s_off > subj_length)
+         break;
+      if (!sparse) {
+         ecode = seed->ecode;
+      } else {
+         /* Scan from reach before the word to reach after it, going on
+            from where the previous scan stopped if it overlaps */
+         if (s_off + reach <= scan_end)
+            continue;
+         s_off = MAX(MAX(s_off - reach, scan_end + READDB_COMPRESSION_RATIO),
+                     word_length);
+         scan_end = MIN(seed->s_off - chunk_start + reach, subj_length);
+      }
+      do {
+         if (sparse)
+            ecode = (subject[s_off/READDB_COMPRESSION_RATIO - 3] << 16) |
+               (subject[s_off/READDB_COMPRESSION_RATIO - 2] << 8) |
+               subject[s_off/READDB_COMPRESSION_RATIO - 1];
+         for (q_off = mb_lt->hashtable[ecode]; q_off > 0; 
+              q_off = mb_lt->next_pos[q_off]) {
+            search->second_pass_hits++;
+            MegaBlastExtendHit(search, lookup, s_off, q_off);
+         }
+         s_off += READDB_COMPRESSION_RATIO;
+      } while (sparse && s_off <= scan_end);
+   }
+}
+
+/* When the queries are a slice of the database, each of them is searched
+   only against the database sequences after its own: the pairs with the
+   earlier ones are found when those are the queries, and the pair with 
+   itself is not wanted. As the queries come in the order of their ordinal
+   ids, the queries not searched against the subject are those from the 
+   first one with an ordinal id of at least the subject's on, so the seeds
+   not to extend are those past a single query offset */
+static void
+MegaBlastSetQueryLimit(BlastSearchBlkPtr search)
+{
+   Int4Ptr query_oids = search->pbp->mb_params->query_oids;
+   Int4 low, high, middle;
+
+   search->query_limit = INT4_MAX;
+   if (query_oids == NULL || search->rdfp == NULL)
+      return;
+   low = 0;
+   high = search->last_context/2 + 1;
+   while (low < high) {
+      middle = (low + high) / 2;
+      if (query_oids[middle] < search->subject_id)
+         low = middle + 1;
+      else
+         high = middle;
+   }
+   if (low <= search->last_context/2)
+      search->query_limit = search->query_context_offsets[2*low];
+}
+
+/* With a sketch prefilter, only the seeds of the candidate queries of the
+   subject are extended */
+static void
+MegaBlastSetSketchQueries(BlastSearchBlkPtr search)
+{
+   MBSketchPairsPtr pairs = 
+      search->thr_info ? search->thr_info->sketch_pairs : NULL;
+
+   search->sketch_queries = NULL;
+   search->num_sketch_queries = -1;
+   if (pairs == NULL || search->pbp->mb_params->sketch_recall ||
+       search->rdfp == NULL)
+      return;
+   search->sketch_queries = MBSketchPairsGet(pairs, search->subject_id, 
+                                             &search->num_sketch_queries);
+}
+
+/* Contiguous words, database scanned 4 bases at a time, or their seeds
+   taken from the database word index */
 
 Int4 
 MegaBlastWordFinder(BlastSearchBlkPtr search, LookupTablePtr lookup)
@@ -2734,6 +2980,8 @@ MegaBlastWordFinder(BlastSearchBlkPtr search, LookupTablePtr lookup)
    PV_ARRAY_TYPE *pv_array = lookup->pv_array;
    Int4 pv_array_bts;
 
+   MegaBlastSetQueryLimit(search);
+   MegaBlastSetSketchQueries(search);
    if (search->pbp->mb_params->disc_word) {
       if (search->pbp->mb_params->one_base_step)
          return MegaBlastWordFinder_disc_1b(search, lookup);
@@ -2760,31 +3008,35 @@ MegaBlastWordFinder(BlastSearchBlkPtr search, LookupTablePtr lookup)
 
    pv_array_bts = PV_ARRAY_BTS + ((lookup->mb_lt->width < 3) ? 0 : 5);
 
-   for (s_off = 0; s_off < (lookup->mb_lt->width - 1)*4; s_off += 4) {
-      ecode = (ecode << 8) + *++subject;
-   }
-
-   s_off += 4;
-   while (s_off<=subj_length) {
-      if (pv_array) {
-         ecode = ((ecode & mask) << 8) + *++subject;
-         while ((s_off < subj_length) && ((pv_array[ecode>>pv_array_bts]&
-                 (((PV_ARRAY_TYPE) 1)<<(ecode&PV_ARRAY_MASK))) == 0)) {
-            ecode = ((ecode & mask) << 8) + *++subject;
-            s_off += 4;
-         } 
-         if (s_off > subj_length)
-            break;
-      } else {
-         ecode = ((ecode & mask) << 8) + *++subject;
-      }
-      for (q_off = lookup->mb_lt->hashtable[ecode]; q_off>0; 
-	   q_off = lookup->mb_lt->next_pos[q_off]) {
-         search->second_pass_hits++;
-	 MegaBlastExtendHit(search, lookup, s_off, q_off);
+   if (search->thr_info && search->thr_info->word_seeds) {
+      MegaBlastIndexedExtendHits(search, lookup);
+   } else {
+      for (s_off = 0; s_off < (lookup->mb_lt->width - 1)*4; s_off += 4) {
+         ecode = (ecode << 8) + *++subject;
       }
+
       s_off += 4;
-   } 
+      while (s_off<=subj_length) {
+         if (pv_array) {
+            ecode = ((ecode & mask) << 8) + *++subject;
+            while ((s_off < subj_length) && ((pv_array[ecode>>pv_array_bts]&
+                    (((PV_ARRAY_TYPE) 1)<<(ecode&PV_ARRAY_MASK))) == 0)) {
+               ecode = ((ecode & mask) << 8) + *++subject;
+               s_off += 4;
+            } 
+            if (s_off > subj_length)
+               break;
+         } else {
+            ecode = ((ecode & mask) << 8) + *++subject;
+         }
+         for (q_off = lookup->mb_lt->hashtable[ecode]; q_off>0; 
+              q_off = lookup->mb_lt->next_pos[q_off]) {
+            search->second_pass_hits++;
+            MegaBlastExtendHit(search, lookup, s_off, q_off);
+         }
+         s_off += 4;
+      } 
+   }
 
    if (!lookup->mb_lt->estack)
       BlastExtendWordExit(search);
@@ -2811,7 +3063,253 @@ diag_compare_match(VoidPtr v1, VoidPtr v2)
    return (h1->q_off - h1->s_off) - (h2->q_off - h2->s_off);
 }
 
+/* A seed is not extended if it lies inside an HSP within MB_DIAG_CLOSE
+   diagonals, among the HSPs saved after the last one that is MB_DIAG_NEAR
+   or more diagonals away from the seed. Scanning the HSPs back from the
+   last one is quadratic when a subject has many HSPs on close diagonals,
+   so for subjects with many seeds the HSPs are indexed: each HSP is
+   entered in the hash chains of the cells (band of diagonals, stretch of
+   the subject) it covers, so only the HSPs covering the seed's cell are
+   tested. As the seeds come in order of their diagonals, a heap and a
+   stack give the last HSP far from the current seed. */
+#define MB_DIAG_INDEX_MIN_SEEDS 64
+#define MB_DIAG_BAND_SHIFT 4
+#define MB_DIAG_CELL_SHIFT 8
+
+#define MB_DIAG_CELL_SLOT(dindex, band, cell) \
+((((Uint4) (band))*0x9E3779B1U + (Uint4) (cell)) & (dindex)->chain_mask)
+
+typedef struct mb_diag_index {
+   Int4 num_indexed;     /* HSPs 0..num_indexed-1 of the hitlist */
+   Int4 allocated;
+   Int4Ptr diag;         /* query offset - subject offset of each HSP */
+   Int4Ptr low_heap;     /* HSPs not yet far below the seeds, by diagonal */
+   Int4 low_count;
+   Int4 last_low;        /* last HSP far below the current seed */
+   Int4Ptr high_stack;   /* HSPs that may be far above the current seed */
+   Int4 high_count;
+   Int4Ptr chain;        /* last entry of each chain, -1 if none */
+   Uint4 chain_mask;
+   Int4Ptr entry_hsp;    /* HSP of a chain entry */
+   Int4Ptr entry_next;   /* previous entry in the same chain */
+   Int4 num_entries, entries_allocated;
+} MBDiagIndex, PNTR MBDiagIndexPtr;
+
+static MBDiagIndexPtr MBDiagIndexNew(Int4 num_seeds)
+{
+   MBDiagIndexPtr dindex;
+   Int4 size;
+
+   dindex = (MBDiagIndexPtr) MemNew(sizeof(MBDiagIndex));
+   for (size = 256; size < 2*num_seeds && size < (1<<20); size <<= 1);
+   dindex->chain_mask = size - 1;
+   dindex->chain = (Int4Ptr) Malloc(size*sizeof(Int4));
+   MemSet(dindex->chain, 0xff, size*sizeof(Int4));
+   dindex->last_low = -1;
+   return dindex;
+}
+
+static MBDiagIndexPtr MBDiagIndexFree(MBDiagIndexPtr dindex)
+{
+   if (dindex == NULL)
+      return NULL;
+   MemFree(dindex->diag);
+   MemFree(dindex->low_heap);
+   MemFree(dindex->high_stack);
+   MemFree(dindex->chain);
+   MemFree(dindex->entry_hsp);
+   MemFree(dindex->entry_next);
+   return (MBDiagIndexPtr) MemFree(dindex);
+}
+
+static void MBDiagIndexLowPush(MBDiagIndexPtr dindex, Int4 hsp_index)
+{
+   Int4Ptr heap = dindex->low_heap, diag = dindex->diag;
+   Int4 i, parent;
+
+   for (i = dindex->low_count++; i > 0; i = parent) {
+      parent = (i - 1) / 2;
+      if (diag[heap[parent]] <= diag[hsp_index])
+         break;
+      heap[i] = heap[parent];
+   }
+   heap[i] = hsp_index;
+}
+
+static void MBDiagIndexLowPop(MBDiagIndexPtr dindex)
+{
+   Int4Ptr heap = dindex->low_heap, diag = dindex->diag;
+   Int4 i, child, last;
+
+   last = heap[--dindex->low_count];
+   for (i = 0; (child = 2*i + 1) < dindex->low_count; i = child) {
+      if (child + 1 < dindex->low_count && 
+          diag[heap[child+1]] < diag[heap[child]])
+         child++;
+      if (diag[last] <= diag[heap[child]])
+         break;
+      heap[i] = heap[child];
+   }
+   heap[i] = last;
+}
+
+static void MBDiagIndexAddEntry(MBDiagIndexPtr dindex, Uint4 slot, 
+                                Int4 hsp_index)
+{
+   if (dindex->num_entries == dindex->entries_allocated) {
+      dindex->entries_allocated = 
+         MAX(2*dindex->entries_allocated, 1024);
+      dindex->entry_hsp = (Int4Ptr) Realloc(dindex->entry_hsp, 
+                             dindex->entries_allocated*sizeof(Int4));
+      dindex->entry_next = (Int4Ptr) Realloc(dindex->entry_next, 
+                             dindex->entries_allocated*sizeof(Int4));
+   }
+   dindex->entry_hsp[dindex->num_entries] = hsp_index;
+   dindex->entry_next[dindex->num_entries] = dindex->chain[slot];
+   dindex->chain[slot] = dindex->num_entries++;
+}
+
+/* Index the HSPs saved since the previous seed and move the far limits
+   to the diagonal of the next seed */
+static void MBDiagIndexUpdate(MBDiagIndexPtr dindex, 
+                              BLAST_HitListPtr hitlist, Int4 seed_diag)
+{
+   BLAST_HSPPtr hsp;
+   Int4 index, band, cell, last_cell;
+
+   if (hitlist->hspcnt > dindex->allocated) {
+      dindex->allocated = MAX(2*dindex->allocated, hitlist->hspcnt + 64);
+      dindex->diag = (Int4Ptr) 
+         Realloc(dindex->diag, dindex->allocated*sizeof(Int4));
+      dindex->low_heap = (Int4Ptr) 
+         Realloc(dindex->low_heap, dindex->allocated*sizeof(Int4));
+      dindex->high_stack = (Int4Ptr) 
+         Realloc(dindex->high_stack, dindex->allocated*sizeof(Int4));
+   }
+   for (index = dindex->num_indexed; index < hitlist->hspcnt; index++) {
+      hsp = hitlist->hsp_array[index];
+      dindex->diag[index] = hsp->query.offset - hsp->subject.offset;
+      band = dindex->diag[index] >> MB_DIAG_BAND_SHIFT;
+      last_cell = hsp->subject.end >> MB_DIAG_CELL_SHIFT;
+      for (cell = hsp->subject.offset >> MB_DIAG_CELL_SHIFT; 
+           cell <= last_cell; cell++)
+         MBDiagIndexAddEntry(dindex, MB_DIAG_CELL_SLOT(dindex, band, cell),
+                             index);
+      MBDiagIndexLowPush(dindex, index);
+      /* The seed diagonals only grow, so an HSP not far above this
+         seed is never far above a later one */
+      if (dindex->diag[index] >= seed_diag + MB_DIAG_NEAR)
+         dindex->high_stack[dindex->high_count++] = index;
+   }
+   dindex->num_indexed = hitlist->hspcnt;
+
+   while (dindex->low_count > 0 && 
+          dindex->diag[dindex->low_heap[0]] <= seed_diag - MB_DIAG_NEAR) {
+      dindex->last_low = MAX(dindex->last_low, dindex->low_heap[0]);
+      MBDiagIndexLowPop(dindex);
+   }
+   while (dindex->high_count > 0 && 
+          dindex->diag[dindex->high_stack[dindex->high_count-1]] < 
+          seed_diag + MB_DIAG_NEAR)
+      dindex->high_count--;
+}
+
+/* Same answer as the backward scan over the hitlist in 
+   MegaBlastGappedAlign */
+static Boolean MBDiagIndexContains(MBDiagIndexPtr dindex, 
+                                   BLAST_HitListPtr hitlist,
+                                   MegaBlastExactMatchPtr e_hsp, 
+                                   Int8Ptr num_tests)
+{
+   BLAST_HSPPtr hsp;
+   Int4 seed_diag = e_hsp->q_off - e_hsp->s_off;
+   Int4 band, last_band, cell, entry, stop;
+
+   stop = dindex->last_low;
+   if (dindex->high_count > 0)
+      stop = MAX(stop, dindex->high_stack[dindex->high_count-1]);
+
+   cell = e_hsp->s_off >> MB_DIAG_CELL_SHIFT;
+   last_band = (seed_diag + MB_DIAG_CLOSE - 1) >> MB_DIAG_BAND_SHIFT;
+   for (band = (seed_diag - MB_DIAG_CLOSE + 1) >> MB_DIAG_BAND_SHIFT; 
+        band <= last_band; band++) {
+      /* Chains hold the entries in the order of their HSPs, newest first */
+      for (entry = dindex->chain[MB_DIAG_CELL_SLOT(dindex, band, cell)];
+           entry >= 0 && dindex->entry_hsp[entry] > stop; 
+           entry = dindex->entry_next[entry]) {
+         (*num_tests)++;
+         hsp = hitlist->hsp_array[dindex->entry_hsp[entry]];
+         if (MB_HSP_CONTAINED(e_hsp->q_off, hsp->query.offset, 
+                              hsp->query.end, e_hsp->s_off, 
+                              hsp->subject.offset, hsp->subject.end, 
+                              MB_DIAG_CLOSE))
+            return TRUE;
+      }
+   }
+   return FALSE;
+}
+
 #define MB_MAX_LENGTH_TO_UNPACK 400
+
+/* Whether the seed can give an overlap passing the mgblast filter:
+   identity of at least perc_identity, overhangs of at most the larger of
+   verify_overhang and the fraction of the overlap mgblast allows, overlap
+   of at least min_subject_length. With f the fraction of differences
+   allowed, an alignment of the overlap of length L along the seed 
+   diagonal has at most E = f (L + 3E) edits, counting its drift of at 
+   most E from the diagonal, and must cover the query but for the 
+   overhangs and the drift at both ends; the bit-parallel bound on the
+   edits of that part tells whether it can */
+static Boolean
+MegaBlastVerifySeed(BlastSearchBlkPtr search, Uint1Ptr subject0, 
+                    Int4 q_off, Int4 s_off)
+{
+   MegaBlastParameterBlkPtr mb_params = search->pbp->mb_params;
+   Int4 context, q_start, query_length, subject_length, diag;
+   Int4 overlap_start, overlap_end, overlap, shorter, max_edits, max_ovh;
+   Int4 edits;
+   Uint1Ptr query;
+   Boolean packed;
+   FloatHi diff_fraction;
+
+   diff_fraction = (100.0 - mb_params->perc_identity) / 100.0;
+   if (mb_params->verify_overhang <= 0 || diff_fraction >= 0.25)
+      return TRUE;
+   context = BinarySearchInt4(q_off, search->query_context_offsets,
+                              (Int4) (search->last_context + 1));
+   q_start = search->query_context_offsets[context];
+   query_length = search->query_context_offsets[context+1] - q_start - 1;
+   subject_length = search->subject->length;
+   diag = s_off - (q_off - q_start);
+   overlap_start = MAX(0, -diag);
+   overlap_end = MIN(query_length, subject_length - diag);
+   overlap = overlap_end - overlap_start;
+   max_edits = (Int4) (diff_fraction * overlap / (1 - 3*diff_fraction)) + 1;
+   if (overlap + 2*max_edits < mb_params->min_subject_length)
+      return FALSE;
+
+   /* mgblast allows the larger of -H and a tenth of the overlap or 8% of
+      the shorter sequence, if that is at most a third of it */
+   shorter = MIN(query_length, subject_length);
+   max_ovh = MAX((overlap + 2*max_edits)/10, shorter*8/100);
+   max_ovh = MAX(mb_params->verify_overhang, MIN(max_ovh, shorter/3));
+   overlap_start += max_ovh + max_edits;
+   overlap_end -= max_ovh + max_edits;
+   if (overlap_end <= overlap_start)
+      return TRUE;
+   search->stage_stats.verify_tests++;
+   query = search->context[search->first_context].query->sequence + q_start;
+   packed = (Boolean) (search->rdfp && 
+                       subject_length > MB_MAX_LENGTH_TO_UNPACK);
+   edits = MBVerifyEditBound(query, overlap_start, overlap_end, subject0,
+                             subject_length, packed, diag, max_edits, 
+                             max_edits);
+   if (edits <= max_edits)
+      return TRUE;
+   search->stage_stats.verify_rejected++;
+   return FALSE;
+}
+
 Int2 MegaBlastGappedAlign(BlastSearchBlkPtr search)
 {
    MegaBlastExactMatchPtr PNTR e_hsp_array;
@@ -2819,20 +3317,30 @@ Int2 MegaBlastGappedAlign(BlastSearchBlkPtr search)
    Int4 index, i, hspcnt, buf_len=0;
    Uint1Ptr subject0 = NULL;
    Boolean delete_hsp;
-   GapAlignBlkPtr gap_align;
+   GapAlignBlkPtr gap_align = NULL;
    Boolean use_dyn_prog = search->pbp->mb_params->use_dyn_prog;
+   Boolean timing;
+   FloatHi start_time;
+   MBDiagIndexPtr dindex = NULL;
 
    hspcnt = search->current_hitlist->hspcnt;
    
    if (hspcnt == 0) 
      return 0;
 
+   timing = search->pbp->mb_params->stage_timing;
+   start_time = timing ? MBStatsClock() : 0.0;
+
    /* Make current hitlist available for rewriting of extended hsps 
       without freeing the hsp_array since it's used in this function */
    search->current_hitlist->hspcnt = 0;
 
-   e_hsp_array = (MegaBlastExactMatchPtr PNTR) 
-      Malloc(hspcnt*sizeof(MegaBlastExactMatchPtr));
+   if (search->hsp_arena)
+      e_hsp_array = (MegaBlastExactMatchPtr PNTR) 
+         ArenaAlloc(search->hsp_arena, hspcnt*sizeof(MegaBlastExactMatchPtr));
+   else
+      e_hsp_array = (MegaBlastExactMatchPtr PNTR) 
+         Malloc(hspcnt*sizeof(MegaBlastExactMatchPtr));
 
    if (e_hsp_array == NULL)
       return 1;
@@ -2855,6 +3363,7 @@ Int2 MegaBlastGappedAlign(BlastSearchBlkPtr search)
          readdb_get_sequence_ex(search->rdfp, search->subject_id, 
                                 &search->subject->sequence_start, 
                                 &buf_len, TRUE);
+         search->stage_stats.subject_unpacks++;
       }
       subject0 = 
          (&search->subject->sequence_start[search->subject->original_length])
@@ -2873,6 +3382,7 @@ Int2 MegaBlastGappedAlign(BlastSearchBlkPtr search)
       gap_align->gap_open = search->pbp->gap_open;
       gap_align->gap_extend = search->pbp->gap_extend;
       gap_align->x_parameter = search->pbp->gap_x_dropoff;
+      gap_align->vector_dp = search->pbp->vector_dp;
       gap_align->matrix = search->sbp->matrix;
       gap_align->query =
          search->context[search->first_context].query->sequence;
@@ -2884,23 +3394,44 @@ Int2 MegaBlastGappedAlign(BlastSearchBlkPtr search)
       gap_align->subject_length = search->subject->length;
    }
 
+   if (hspcnt >= MB_DIAG_INDEX_MIN_SEEDS)
+      dindex = MBDiagIndexNew(hspcnt);
+
    for (index=0; index<hspcnt; index++) {
       e_hsp = e_hsp_array[index];
       delete_hsp = FALSE;
+      /* A full hitlist is kept sorted by score, so the HSP order the
+         index relies on is lost */
+      if (dindex && search->current_hitlist->do_not_reallocate)
+         dindex = MBDiagIndexFree(dindex);
+      if (dindex) {
+         MBDiagIndexUpdate(dindex, search->current_hitlist, 
+                           e_hsp->q_off - e_hsp->s_off);
+         delete_hsp = MBDiagIndexContains(dindex, search->current_hitlist, 
+                         e_hsp, &search->stage_stats.containment_tests);
+      } else {
       for (i = search->current_hitlist->hspcnt-1; 
 	   i >= 0 && MB_HSP_CLOSE(e_hsp->q_off, search->current_hitlist->hsp_array[i]->query.offset, e_hsp->s_off, search->current_hitlist->hsp_array[i]->subject.offset, MB_DIAG_NEAR);
 	   i--) {
+        search->stage_stats.containment_tests++;
 	if (MB_HSP_CONTAINED(e_hsp->q_off, search->current_hitlist->hsp_array[i]->query.offset, search->current_hitlist->hsp_array[i]->query.end, e_hsp->s_off, search->current_hitlist->hsp_array[i]->subject.offset, search->current_hitlist->hsp_array[i]->subject.end, MB_DIAG_CLOSE)) {
 	  delete_hsp = TRUE;
 	  break;
 	}
       }
+      }
+      if (delete_hsp)
+         search->stage_stats.seeds_contained++;
       if (!delete_hsp) {
          if ((search->pbp->mb_params->disc_word && 
              (search->pbp->window_size == 0))) {
             delete_hsp = BlastNtWordUngappedExtend(search, e_hsp->q_off, 
                               e_hsp->s_off, search->pbp->cutoff_s2);
          }
+         if (!delete_hsp && !use_dyn_prog && 
+             search->pbp->mb_params->verify_overhang > 0)
+            delete_hsp = !MegaBlastVerifySeed(search, subject0, e_hsp->q_off,
+                                              e_hsp->s_off);
          if (!delete_hsp) {
             search->second_pass_extends++;
 
@@ -2909,8 +3440,12 @@ Int2 MegaBlastGappedAlign(BlastSearchBlkPtr search)
                gap_align->q_start = e_hsp->q_off - 1 - rem;
                gap_align->s_start = e_hsp->s_off - 1 - rem;
                gap_align->decline_align = INT2_MAX;
-               if (!PerformNtGappedAlignment(gap_align))
+               if (!PerformNtGappedAlignment(gap_align)) {
+                  if (!search->hsp_arena)
+                     MemFree(e_hsp_array);
+                  MBDiagIndexFree(dindex);
                   return 1;
+               }
                if (gap_align->score >= search->pbp->cutoff_s2) {
                   BlastNtSaveCurrentHspGapped(search, gap_align->score, 
                       gap_align->query_start, gap_align->subject_start, 
@@ -2925,7 +3460,11 @@ Int2 MegaBlastGappedAlign(BlastSearchBlkPtr search)
       }
    }
 
-   MemFree(e_hsp_array);
+   if (!search->hsp_arena)
+      MemFree(e_hsp_array);
+   MBDiagIndexFree(dindex);
+   if (timing)
+      search->stage_stats.time[MB_STAGE_EXTEND] += MBStatsClock() - start_time;
    return 0;
 }
 
@@ -3100,6 +3639,7 @@ MegaBlastNtWordExtend(BlastSearchBlkPtr search, Uint1Ptr subject0,
 	Boolean good_hit;
         Uint1 rem;
         GapXEditScriptPtr esp = NULL;
+        ArenaMark mark;
 	
 	good_hit = TRUE;
         sbp=search->sbp;
@@ -3123,9 +3663,11 @@ MegaBlastNtWordExtend(BlastSearchBlkPtr search, Uint1Ptr subject0,
 
 	X = pbp->gap_x_dropoff;
 
+	/* The edit scripts are only needed until the HSP is saved */
+	mark = ArenaGetMark(search->hsp_arena);
 	if (!search->pbp->mb_params->no_traceback) {
-	   ed_script_fwd = edit_script_new();
-	   ed_script_rev = edit_script_new();
+	   ed_script_fwd = edit_script_arena_new(search->hsp_arena);
+	   ed_script_rev = edit_script_arena_new(search->hsp_arena);
 	}
 
 	/* extend to the right */
@@ -3164,12 +3706,16 @@ MegaBlastNtWordExtend(BlastSearchBlkPtr search, Uint1Ptr subject0,
 	else if (sbp->reward % 2 == 1)
 	   score /= 2;
 
-	if (good_hit && score >= pbp->cutoff_s2) { /* Score is reportable */
-	   if (!search->pbp->mb_params->no_traceback) {
-	      edit_script_append(ed_script_rev, ed_script_fwd);
-              esp = MBToGapXEditScript(ed_script_rev);
-	   }
+	good_hit = (good_hit && score >= pbp->cutoff_s2);
+	if (good_hit && !search->pbp->mb_params->no_traceback) {
+	   edit_script_append(ed_script_rev, ed_script_fwd);
+	   esp = MBToGapXEditScript(ed_script_rev);
+	}
+        edit_script_free(ed_script_fwd);
+        edit_script_free(ed_script_rev);
+	ArenaRelease(search->hsp_arena, mark);
 
+	if (good_hit) { /* Score is reportable */
 	   search->second_pass_good_extends++;
            
 	   BlastNtSaveCurrentHspGapped(search, score, q_off-q_ext_l,
@@ -3177,8 +3723,6 @@ MegaBlastNtWordExtend(BlastSearchBlkPtr search, Uint1Ptr subject0,
 				     s_ext_l+s_ext_r, q_off, s_off,
                                      search->first_context, esp); 
 	}
-        edit_script_free(ed_script_fwd);
-        edit_script_free(ed_script_rev);
 
 	return 0;
 }
@@ -3739,6 +4283,94 @@ Boolean ReevaluateScoreWithAmbiguities(BlastSearchBlkPtr search,
    return delete_hsp;
 }
 
+/* Ambiguity records of the database, see RebuildDNA_4na in sequtil.c */
+#define MB_AMB_VALUE(x)   ((x)>>28)
+#define MB_AMB_LEN(x)     (((x)>>24) & 0xF)
+#define MB_AMB_LEN_NEW(x) (((x)>>16) & 0xFFF)
+#define MB_AMB_OFFSET(x)  ((x) & 0xFFFFFF)
+
+/* Decode into the blastna buffer only the subject regions covered by the 
+   HSPs: from the packed ncbi2na data, then patching the ambiguity runs
+   that overlap these regions. Sentinels are set as in
+   readdb_get_sequence_ex; the rest of the buffer is left undefined, so
+   this can be used only when the HSPs already have their traceback.
+   Returns NULL if the sequence cannot be retrieved. */
+static Uint1Ptr 
+MegaBlastGetSubjectHspRegions(BlastSearchBlkPtr search, 
+                              BLAST_HSPPtr PNTR hsp_array, Int4 hspcnt)
+{
+   Uint1Ptr packed, buffer, seq;
+   Uint4Ptr ambchar = NULL, amb_buff;
+   Uint4 amb_num, i;
+   Int4 length, index, from, to, pos, amb_len, amb_end;
+   Boolean new_format;
+   Uint1 amb_value;
+   BLAST_HSPPtr hsp;
+   BoolPtr ambiguous;
+
+   length = readdb_get_sequence(search->rdfp, search->subject_id, &packed);
+   if (length <= 0 || packed == NULL)
+      return NULL;
+   if (readdb_ambchar_present(search->rdfp, search->subject_id) &&
+       (!readdb_get_ambchar(search->rdfp, search->subject_id, &ambchar) ||
+        ambchar == NULL))
+      return NULL;
+
+   buffer = (Uint1Ptr) Malloc(length + 2);
+   buffer[0] = buffer[length+1] = ncbi4na_to_blastna[0];
+   seq = buffer + 1;
+
+   for (index = 0; index < hspcnt; index++) {
+      if ((hsp = hsp_array[index]) == NULL)
+         continue;
+      from = MAX(hsp->subject.offset, 0);
+      to = MIN(hsp->subject.end, length);
+      /* ncbi2na and blastna codes are the same for A, C, G and T */
+      for (pos = from; pos < to; pos++)
+         seq[pos] = READDB_UNPACK_BASE_N(packed[pos>>2], 3 - (pos&3));
+   }
+
+   if (ambchar == NULL)
+      return buffer;
+
+   ambiguous = (BoolPtr) MemNew(hspcnt*sizeof(Boolean));
+   amb_num = ambchar[0];
+   amb_buff = ambchar + 1;
+   new_format = ((amb_num & 0x80000000) != 0);
+   amb_num &= 0x7FFFFFFF;
+   for (i = 0; i < amb_num; i++) {
+      amb_value = ncbi4na_to_blastna[MB_AMB_VALUE(amb_buff[i])];
+      if (new_format) {
+         amb_len = MB_AMB_LEN_NEW(amb_buff[i]) + 1;
+         pos = amb_buff[i+1];
+         /* 8 bytes for each element in the new format */
+         i++;
+      } else {
+         amb_len = MB_AMB_LEN(amb_buff[i]) + 1;
+         pos = MB_AMB_OFFSET(amb_buff[i]);
+      }
+      amb_end = MIN(pos + amb_len, length);
+      for (index = 0; index < hspcnt; index++) {
+         if ((hsp = hsp_array[index]) == NULL)
+            continue;
+         from = MAX(hsp->subject.offset, pos);
+         to = MIN(hsp->subject.end, amb_end);
+         if (from < to)
+            ambiguous[index] = TRUE;
+         for ( ; from < to; from++)
+            seq[from] = amb_value;
+      }
+   }
+   for (index = 0; index < hspcnt; index++) {
+      if (ambiguous[index])
+         search->stage_stats.ambig_hsps++;
+   }
+   MemFree(ambiguous);
+   MemFree(ambchar);
+
+   return buffer;
+}
+
 /* In the following function the forward strand is assumed */
 
 Int2
@@ -3795,10 +4427,27 @@ MegaBlastReevaluateWithAmbiguities(BlastSearchBlkPtr search)
    
    /* Can happen only when subject was being unpacked on the fly 
       during gapped extensions */
-   if (!search->subject->sequence_start)
-      readdb_get_sequence_ex(search->rdfp, search->subject_id, 
-                             &search->subject->sequence_start, 
-                             &buf_len, TRUE);
+   if (!search->subject->sequence_start) {
+      /* With greedy traceback only the aligned regions are needed */
+      if (!search->pbp->mb_params->use_dyn_prog) {
+         for (index=0; index<hspcnt; index++) {
+            if (hsp_array[index] != NULL && hsp_array[index]->gap_info == NULL)
+               break;
+         }
+         if (index == hspcnt) {
+            search->subject->sequence_start = 
+               MegaBlastGetSubjectHspRegions(search, hsp_array, hspcnt);
+            if (search->subject->sequence_start)
+               search->stage_stats.subject_unpacks_avoided++;
+         }
+      }
+      if (!search->subject->sequence_start) {
+         readdb_get_sequence_ex(search->rdfp, search->subject_id, 
+                                &search->subject->sequence_start, 
+                                &buf_len, TRUE);
+         search->stage_stats.subject_unpacks++;
+      }
+   }
    /* The sequence in blastna encoding is now stored in sequence_start */
    subject_start = search->subject->sequence_start + 1;
 
@@ -3943,25 +4592,16 @@ void PrintMaskedSequence(BioseqPtr query_bsp, SeqLocPtr mask_slp,
                          FILE *fp, Int2 line_len, Boolean lcase_masking)
 {
    SeqLocPtr query_slp = NULL;
-   SeqPortPtr spp;
    Uint1Ptr query_seq, seq_line;
    Int4 index, id_length = 0, defline_len;
-   Uint1 residue;
    CharPtr buffer = NULL;
 
    ValNodeAddPointer(&query_slp, SEQLOC_WHOLE, SeqIdDup(SeqIdFindBest(query_bsp->id, SEQID_GI)));
    
 
-   spp = SeqPortNewByLoc(query_slp, Seq_code_iupacna);
-   SeqPortSet_do_virtual(spp, TRUE);
    query_seq = (Uint1Ptr) MemNew((query_bsp->length + 1)*sizeof(Uint1));
-   index=0;
-   while ((residue=SeqPortGetResidue(spp)) != SEQPORT_EOF) {
-      if (IS_residue(residue)) {
-	 query_seq[index] = residue;
-	 index++;
-      }
-   }
+   SeqPortBulkRead(query_bsp, 0, -1, Seq_strand_plus, Seq_code_iupacna,
+                   query_seq);
    if (lcase_masking)
       BlastLCaseMaskTheResidues(query_seq, query_bsp->length, mask_slp, FALSE,
                                 SeqLocStart(query_slp));
@@ -3991,7 +4631,6 @@ void PrintMaskedSequence(BioseqPtr query_bsp, SeqLocPtr mask_slp,
       seq_line += line_len;
    }
       
-   spp = SeqPortFree(spp);
    MemFree(buffer);
    query_seq = MemFree(query_seq);
 }
@@ -4345,10 +4984,100 @@ MegaBlastParameterBlkPtr MegaBlastParameterBlkNew(BLAST_OptionsBlkPtr options)
    }
    mb_params->one_base_step = options->mb_one_base_step;
    mb_params->use_dyn_prog = options->mb_use_dyn_prog;
+   mb_params->min_subject_length = options->mb_min_subject_length;
+   if (mb_params->min_subject_length > 0)
+      mb_params->length_mask = options->mb_length_mask;
+   mb_params->stage_timing = 
+      (Boolean) (options->search_stats != NULL && options->mb_stage_timing);
+   mb_params->hsp_buffer_max = options->mb_hsp_buffer_max;
+   mb_params->word_index = options->mb_word_index;
+   mb_params->query_oids = options->mb_query_oids;
+   mb_params->sketch_index = options->mb_sketch_index;
+   mb_params->sketch_recall = options->mb_sketch_recall;
+   mb_params->verify_overhang = options->mb_verify_overhang;
 
    return mb_params;
 }
 
+/* Only the .nin offsets are read, as in BlastSetupSubjectLengthMask: the
+   packed length less one is an upper bound of the real length */
+Uint4Ptr LIBCALL MegaBlastSubjectLengthMask(ReadDBFILEPtr rdfp, Int4 min_length)
+{
+   Int4 num_seqs, index;
+   Uint4Ptr mask;
+
+   if (rdfp == NULL || min_length <= 0)
+      return NULL;
+   num_seqs = readdb_get_num_entries_total(rdfp);
+   mask = (Uint4Ptr) MemNew((num_seqs/32 + 1)*sizeof(Uint4));
+   if (mask == NULL)
+      return NULL;
+   for (index = 0; index < num_seqs; index++) {
+      if (readdb_get_sequence_length_approx(rdfp, index) - 1 >= min_length)
+         mask[index>>5] |= ((Uint4) 1 << (index & 31));
+   }
+   return mask;
+}
+
+/* Program, database index and I/O buffers */
+#define MB_MEMORY_BASE (8<<20)
+/* Per query base: both strands in the search block, the lookup table
+   position chains and the query Bioseqs kept by the caller */
+#define MB_MEMORY_PER_QUERY_BASE 16
+/* Per query: SeqEntry, ids, deflines and the masking locations */
+#define MB_MEMORY_PER_QUERY 2048
+/* Per thread: search block copy, diagonal arrays, hit lists */
+#define MB_MEMORY_PER_THREAD (1<<20)
+
+Int8 LIBCALL MegaBlastMemoryEstimate(BLAST_OptionsBlkPtr options,
+                                     Int8 query_length, Int4 num_queries,
+                                     Int4 max_subject_length)
+{
+   Int8 bytes, hashsize, per_thread;
+   Int4 width, num_threads, max_d, max_cost;
+   Int4 reward, penalty, gap_open, gap_extend;
+
+   if (options == NULL)
+      return 0;
+
+   /* The lookup table, see MegaBlastBuildLookupTable */
+   width = ((options->wordsize - 3) / 4 + 1 < 3) ? 2 : 3;
+   hashsize = ((Int8) 1) << (8*width);
+   if (options->mb_template_length > 0 &&
+       options->mb_disc_type == MB_TWO_TEMPLATES && options->wordsize >= 12)
+      hashsize *= 2;
+   bytes = MB_MEMORY_BASE + hashsize*sizeof(Int4) + 
+      query_length*MB_MEMORY_PER_QUERY_BASE + 
+      (Int8) num_queries*MB_MEMORY_PER_QUERY;
+
+   /* Each thread has the greedy alignment memory (sized for the longest
+      database sequence) and an unpacked subject */
+   max_subject_length = MIN(max_subject_length, MAX_DBSEQ_LEN);
+   max_d = max_subject_length / ERROR_FRACTION + 1;
+   per_thread = MB_MEMORY_PER_THREAD + max_subject_length;
+   if (options->gap_open == 0 && options->gap_extend == 0) {
+      per_thread += (Int8) (4*max_d + 6)*sizeof(Int4);
+   } else {
+      reward = options->reward;
+      penalty = -options->penalty;
+      gap_open = options->gap_open;
+      gap_extend = options->gap_extend;
+      if (reward % 2 == 1) {
+         reward *= 2;
+         penalty *= 2;
+         gap_open *= 2;
+         gap_extend *= 2;
+      }
+      max_cost = MAX(reward + penalty, gap_open + gap_extend + reward/2);
+      per_thread += (Int8) (2*max_d + 6)*sizeof(ThreeVal)*(max_cost + 1) +
+         (Int8) 2*max_d*(gap_extend + reward/2)*sizeof(Int4);
+   }
+   num_threads = MAX(options->number_of_cpus, 1);
+   bytes += per_thread*num_threads;
+
+   return bytes;
+}
+
 MBTemplateType GetMBTemplateType(Int2 weight, Int2 length, MBDiscWordType type)
 {
    if (weight == 11) {
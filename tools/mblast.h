@@ -238,6 +238,33 @@ BioseqMegaBlastEngineByLoc PROTO((SeqLocPtr slp, CharPtr progname, CharPtr datab
                             Int4 gi_list_total, 
                             int (LIBCALLBACK *results_callback)PROTO((VoidPtr Ptr))));
 
+/* A Mega BLAST search set up ahead of its run: BioseqMegaBlastEngine in
+   two steps, so that the queries of the next search can be filtered and
+   their lookup table built while the current search runs */
+typedef struct mb_prepared_search {
+   SeqLocPtr slp;                /* the query locations */
+   BlastSearchBlkPtr search;     /* the search with its lookup table, NULL
+                                    if the setup failed */
+   ValNodePtr error_returns;     /* messages from the setup */
+} MBPreparedSearch, PNTR MBPreparedSearchPtr;
+
+/* Sets up the search of the bspp queries, see BioseqMegaBlastEngine. The
+   options must stay unchanged until BioseqMegaBlastEngineRun */
+MBPreparedSearchPtr LIBCALL
+BioseqMegaBlastEnginePrepare PROTO((BioseqPtr PNTR bspp, CharPtr progname,
+                            CharPtr database, BLAST_OptionsBlkPtr options,
+                            SeqIdPtr seqid_list, BlastDoubleInt4Ptr gi_list,
+                            Int4 gi_list_total));
+
+/* Runs a prepared search and frees it */
+SeqAlignPtr PNTR LIBCALL
+BioseqMegaBlastEngineRun PROTO((MBPreparedSearchPtr prep,
+                            BLAST_OptionsBlkPtr options,
+                            ValNodePtr *other_returns,
+                            ValNodePtr *error_returns,
+                            int (LIBCALLBACK *callback)(Int4 done, Int4 positives),
+                            int (LIBCALLBACK *results_callback)PROTO((VoidPtr Ptr))));
+
 SeqAlignPtr PNTR
 BioseqMegaBlastEngineCore PROTO((BlastSearchBlkPtr search, BLAST_OptionsBlkPtr options));
 
@@ -285,6 +312,20 @@ MegaBlastGetHspPercentIdentity PROTO((BlastSearchBlkPtr search, BLAST_HSPPtr hsp
 MegaBlastParameterBlkPtr
 MegaBlastParameterBlkNew PROTO((BLAST_OptionsBlkPtr options));
 
+/* Rough estimate in bytes of the memory a megablast search needs for a
+   block of num_queries queries of query_length bases in total against a
+   database whose longest sequence has max_subject_length bases */
+Int8 LIBCALL
+MegaBlastMemoryEstimate PROTO((BLAST_OptionsBlkPtr options,
+                               Int8 query_length, Int4 num_queries,
+                               Int4 max_subject_length));
+
+/* Bit mask of the sequences of rdfp that may be at least min_length
+   long, by ordinal id, for mb_length_mask; NULL if min_length is not 
+   positive. To be freed with MemFree */
+Uint4Ptr LIBCALL
+MegaBlastSubjectLengthMask PROTO((ReadDBFILEPtr rdfp, Int4 min_length));
+
 Int4 
 MegaBlastWordFinder PROTO((BlastSearchBlkPtr search, LookupTablePtr lookup));
 
@@ -0,0 +1,206 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbserver.c
+
+Contents: request protocol of the resident mgblast search server, see
+          mbserver.h.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <connect/ncbi_socket.h>
+#include <mbserver.h>
+
+#define MBSRV_LINE_SIZE 4096
+
+Boolean LIBCALL MBServerReadRequest(FILE *fp, CharPtr PNTR PNTR argv,
+                                    Int4Ptr argc, BoolPtr quit)
+{
+   CharPtr line = NULL, ptr, next;
+   Int4 line_size = 0, len = 0, num_args = 0;
+   CharPtr PNTR args;
+
+   *argv = NULL;
+   *argc = 0;
+   *quit = FALSE;
+   /* Grow the buffer until the newline is in, up to MBSRV_MAX_REQUEST */
+   do {
+      if (len + MBSRV_LINE_SIZE > line_size) {
+         line_size = len + 2*MBSRV_LINE_SIZE;
+         line = (CharPtr) Realloc(line, line_size);
+      }
+      if (fgets(line + len, line_size - len, fp) == NULL)
+         break;
+      len += StringLen(line + len);
+   } while (len > 0 && line[len-1] != '\n' && len <= MBSRV_MAX_REQUEST);
+   if (len > MBSRV_MAX_REQUEST) {
+      ErrPostEx(SEV_ERROR, 0, 0, "mgblast server: request longer than %d "
+                "bytes", MBSRV_MAX_REQUEST);
+      MemFree(line);
+      return FALSE;
+   }
+   if (len == 0 || line[len-1] != '\n') {
+      MemFree(line);
+      return FALSE;
+   }
+   line[--len] = NULLB;
+   if (len > 0 && line[len-1] == '\r')
+      line[--len] = NULLB;
+
+   if (StringCmp(line, MBSRV_QUIT) == 0) {
+      *quit = TRUE;
+      MemFree(line);
+      return TRUE;
+   }
+   len = StringLen(MBSRV_REQUEST);
+   if (StringNCmp(line, MBSRV_REQUEST, len) != 0 ||
+       (line[len] != NULLB && line[len] != '\t')) {
+      MemFree(line);
+      return FALSE;
+   }
+
+   args = (CharPtr PNTR) MemNew((MBSRV_MAX_ARGS + 1)*sizeof(CharPtr));
+   for (ptr = line + len; *ptr == '\t'; ptr = next) {
+      ptr++;
+      if ((next = StringChr(ptr, '\t')) == NULL)
+         next = ptr + StringLen(ptr);
+      if (num_args == MBSRV_MAX_ARGS) {
+         ErrPostEx(SEV_ERROR, 0, 0, "mgblast server: request with more than"
+                   " %d arguments", MBSRV_MAX_ARGS);
+         MemFree(line);
+         MBServerArgsFree(args);
+         return FALSE;
+      }
+      args[num_args] = (CharPtr) MemNew(next - ptr + 1);
+      MemCpy(args[num_args++], ptr, next - ptr);
+   }
+   MemFree(line);
+   *argv = args;
+   *argc = num_args;
+   return TRUE;
+}
+
+CharPtr PNTR LIBCALL MBServerArgsFree(CharPtr PNTR argv)
+{
+   Int4 index;
+
+   if (argv == NULL)
+      return NULL;
+   for (index = 0; argv[index] != NULL; index++)
+      MemFree(argv[index]);
+   return (CharPtr PNTR) MemFree(argv);
+}
+
+/* Write out the complete lines of buf[0..len), except the status line,
+   and return how many bytes were used */
+static Int4 MBServerCopyLines(CharPtr buf, Int4 len, FILE *outfp, 
+                              Int4Ptr status)
+{
+   CharPtr ptr = buf, eol;
+   Int4 end_len = StringLen(MBSRV_END);
+
+   while ((eol = (CharPtr) MemChr(ptr, '\n', buf + len - ptr)) != NULL) {
+      if (eol - ptr > end_len && StringNCmp(ptr, MBSRV_END, end_len) == 0)
+         *status = atoi(ptr + end_len + 1);
+      else
+         FileWrite(ptr, 1, eol - ptr + 1, outfp);
+      ptr = eol + 1;
+   }
+   return (Int4) (ptr - buf);
+}
+
+Int4 LIBCALL MBServerClientRun(CharPtr host, Uint2 port, Int4 argc,
+                               CharPtr PNTR argv, FILE *infp, FILE *outfp)
+{
+   SOCK sock;
+   CharPtr buf;
+   Int4 index, buf_size = MBSRV_LINE_SIZE, len, used, status = -1;
+   size_t n_io;
+   EIO_Status io_status;
+
+   for (index = 0, len = StringLen(MBSRV_REQUEST) + 2; index < argc; 
+        index++) {
+      if (StringChr(argv[index], '\t') || StringChr(argv[index], '\n')) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Arguments sent to the mgblast server "
+                   "cannot contain tabs or newlines: %s", argv[index]);
+         return -1;
+      }
+      len += StringLen(argv[index]) + 1;
+   }
+   buf_size = MAX(buf_size, len);
+   buf = (CharPtr) MemNew(buf_size);
+   if (infp == NULL)
+      sprintf(buf, "%s\n", MBSRV_QUIT);
+   else {
+      StringCpy(buf, MBSRV_REQUEST);
+      for (index = 0; index < argc; index++) {
+         StringCat(buf, "\t");
+         StringCat(buf, argv[index]);
+      }
+      StringCat(buf, "\n");
+   }
+
+   if (SOCK_Create(host, port, NULL, &sock) != eIO_Success) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Cannot connect to the mgblast server at "
+                "%s:%d", host, (int) port);
+      MemFree(buf);
+      return -1;
+   }
+   /* The server answers while the queries are still coming in: read
+      what it sends whenever our writes would block, or both ends could 
+      end up waiting on full socket buffers */
+   SOCK_SetReadOnWrite(sock, eOn);
+   io_status = SOCK_Write(sock, buf, StringLen(buf), &n_io, 
+                          eIO_WritePersist);
+   while (io_status == eIO_Success && infp != NULL &&
+          (len = (Int4) FileRead(buf, 1, buf_size, infp)) > 0)
+      io_status = SOCK_Write(sock, buf, len, &n_io, eIO_WritePersist);
+   if (io_status == eIO_Success)
+      io_status = SOCK_Shutdown(sock, eIO_Write);
+
+   if (infp == NULL)
+      status = 0;
+   len = 0;
+   while (io_status == eIO_Success) {
+      if (len == buf_size) {
+         buf_size *= 2;
+         buf = (CharPtr) Realloc(buf, buf_size);
+      }
+      io_status = SOCK_Read(sock, buf + len, buf_size - len, &n_io, 
+                            eIO_ReadPlain);
+      len += (Int4) n_io;
+      used = MBServerCopyLines(buf, len, outfp, &status);
+      MemMove(buf, buf + used, len - used);
+      len -= used;
+   }
+   if (len > 0)
+      FileWrite(buf, 1, len, outfp);
+   if (io_status != eIO_Closed)
+      status = -1;
+
+   SOCK_Close(sock);
+   MemFree(buf);
+   return status;
+}
@@ -0,0 +1,80 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbserver.h
+
+Contents: request protocol of the resident mgblast search server (mgblast
+          -N) and the client side of it used by mgblastc.
+
+          The server listens on a local TCP port and serves one request per
+          connection, one connection at a time:
+            client: MBSRV_REQUEST followed by the mgblast arguments, each
+                    preceded by a tab, and a newline; then the query FASTA
+                    text until the client shuts down its sending side.
+                    MBSRV_QUIT and a newline stops the server instead.
+            server: the -D 4/-D 5 hit lines, then a last line
+                    MBSRV_END followed by a space and the exit status of
+                    the search (0 on success).
+          The request arguments are applied over the ones the server was
+          started with, so a request only needs the options it changes;
+          the output files (-o, -c, -u) cannot be changed.
+
+******************************************************************************/
+#ifndef __MBSERVER__
+#define __MBSERVER__
+
+#include <ncbi.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBSRV_REQUEST "MGBLAST"
+#define MBSRV_QUIT    "MGBLAST-QUIT"
+#define MBSRV_END     "#MGBLAST-END"
+#define MBSRV_MAX_ARGS 256
+#define MBSRV_MAX_REQUEST 65536 /* longest request line, in bytes */
+
+/* Read a request line from fp into a NULL terminated argument array
+   (free with MBServerArgsFree). Returns FALSE on a malformed request or
+   one over MBSRV_MAX_REQUEST bytes or MBSRV_MAX_ARGS arguments; *quit is
+   set for a MBSRV_QUIT request */
+Boolean LIBCALL MBServerReadRequest PROTO((FILE *fp, CharPtr PNTR PNTR argv,
+                                           Int4Ptr argc, BoolPtr quit));
+CharPtr PNTR LIBCALL MBServerArgsFree PROTO((CharPtr PNTR argv));
+
+/* Send a request with the given arguments to the server at host:port,
+   stream the queries from infp and copy the hits to outfp. Returns the
+   status reported by the server, or -1 if it could not be reached or the
+   connection was lost. A NULL infp sends a MBSRV_QUIT request */
+Int4 LIBCALL MBServerClientRun PROTO((CharPtr host, Uint2 port, Int4 argc,
+                                      CharPtr PNTR argv, FILE *infp,
+                                      FILE *outfp));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBSERVER__ */
@@ -0,0 +1,351 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbsim.c
+
+Contents: deterministic EST-like data set generator, see mbsim.h.
+
+          All randomness comes from one xorshift128 generator seeded from
+          params.seed and is drawn in a fixed order, so a data set can be
+          reproduced from its parameters alone.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <ncbimath.h>
+#include <mbsim.h>
+
+static Char mb_sim_bases[4] = { 'A', 'C', 'G', 'T' };
+
+void LIBCALL MBSimParamsDefault(MBSimParamsPtr params)
+{
+   MemSet(params, 0, sizeof(MBSimParams));
+   params->seed = 1;
+   params->num_transcripts = 2000;
+   params->transcript_min = 500;
+   params->transcript_max = 4000;
+   params->num_repeats = 10;
+   params->repeat_length = 300;
+   params->repeat_rate = 0.1;
+   params->repeat_divergence = 0.15;
+   params->expression_skew = 2.0;
+   params->num_reads = 20000;
+   params->read_mean = 550;
+   params->read_sd = 150;
+   params->read_min = 100;
+   params->end3_fraction = 0.5;
+   params->polya_min = 10;
+   params->polya_max = 40;
+   params->minus_fraction = 0.5;
+   params->error_rate = 0.01;
+   params->indel_fraction = 0.3;
+   params->n_rate = 0.001;
+}
+
+Uint4 LIBCALL MBSimRandom(MBSimPtr sim)
+{
+   Uint4 t = sim->state[3];
+
+   t ^= t << 11;
+   t ^= t >> 8;
+   sim->state[3] = sim->state[2];
+   sim->state[2] = sim->state[1];
+   sim->state[1] = sim->state[0];
+   t ^= sim->state[0] ^ (sim->state[0] >> 19);
+   sim->state[0] = t;
+   return t;
+}
+
+FloatHi LIBCALL MBSimUniform(MBSimPtr sim)
+{
+   return MBSimRandom(sim) / 4294967296.0;
+}
+
+/* Uniform integer in [low, high] */
+static Int4 MBSimRange(MBSimPtr sim, Int4 low, Int4 high)
+{
+   if (high <= low)
+      return low;
+   return low + (Int4) (MBSimUniform(sim) * (high - low + 1));
+}
+
+/* Approximately standard normal: sum of 12 uniforms */
+static FloatHi MBSimNormal(MBSimPtr sim)
+{
+   FloatHi sum = 0.0;
+   Int4 index;
+
+   for (index = 0; index < 12; index++)
+      sum += MBSimUniform(sim);
+   return sum - 6.0;
+}
+
+static Char MBSimBase(MBSimPtr sim)
+{
+   return mb_sim_bases[MBSimRandom(sim) >> 30];
+}
+
+/* A base different from the given one */
+static Char MBSimSubstitute(MBSimPtr sim, Char base)
+{
+   Char new_base;
+
+   while ((new_base = MBSimBase(sim)) == base)
+      ;
+   return new_base;
+}
+
+CharPtr LIBCALL MBSimRandomSequence(MBSimPtr sim, Int4 length)
+{
+   CharPtr seq;
+   Int4 index;
+
+   seq = (CharPtr) MemNew(length + 1);
+   for (index = 0; index < length; index++)
+      seq[index] = MBSimBase(sim);
+   return seq;
+}
+
+Int4 LIBCALL MBSimMutate(MBSimPtr sim, CharPtr src, Int4 length, 
+                         FloatHi rate, FloatHi indel_fraction, CharPtr dst)
+{
+   Int4 index, new_length = 0;
+   FloatHi u;
+
+   for (index = 0; index < length; index++) {
+      u = MBSimUniform(sim);
+      if (u >= rate) {
+         dst[new_length++] = src[index];
+      } else if (u >= rate*indel_fraction) {
+         dst[new_length++] = MBSimSubstitute(sim, src[index]);
+      } else if (u >= rate*indel_fraction/2) {
+         /* insertion before this base */
+         dst[new_length++] = MBSimBase(sim);
+         dst[new_length++] = src[index];
+      } 
+      /* else deletion */
+   }
+   dst[new_length] = NULLB;
+   return new_length;
+}
+
+void LIBCALL MBSimReverseComplement(CharPtr seq, Int4 length)
+{
+   CharPtr left, right;
+   Char tmp;
+
+   for (left = seq; left < seq + length; left++) {
+      switch (*left) {
+      case 'A': *left = 'T'; break;
+      case 'C': *left = 'G'; break;
+      case 'G': *left = 'C'; break;
+      case 'T': *left = 'A'; break;
+      default: break;
+      }
+   }
+   for (left = seq, right = seq + length - 1; left < right; left++, right--) {
+      tmp = *left;
+      *left = *right;
+      *right = tmp;
+   }
+}
+
+/* Make room for a read of up to length bases in the work buffers */
+static void MBSimReserve(MBSimPtr sim, Int4 length)
+{
+   if (2*length + 1 <= sim->buffer_size)
+      return;
+   sim->buffer_size = 2*length + 1;
+   MemFree(sim->buffer);
+   MemFree(sim->work);
+   sim->buffer = (CharPtr) MemNew(sim->buffer_size);
+   sim->work = (CharPtr) MemNew(sim->buffer_size);
+}
+
+/* Random transcript with diverged repeat copies inserted */
+static CharPtr MBSimMakeTranscript(MBSimPtr sim, Int4Ptr length_ptr)
+{
+   MBSimParamsPtr params = &sim->params;
+   CharPtr seq, new_seq;
+   Int4 length, num_copies, copy, copy_length, pos;
+
+   length = MBSimRange(sim, params->transcript_min, params->transcript_max);
+   seq = MBSimRandomSequence(sim, length);
+   if (params->num_repeats <= 0 || params->repeat_length <= 0) {
+      *length_ptr = length;
+      return seq;
+   }
+
+   num_copies = (Int4) (length / 1000.0 * params->repeat_rate + 
+                        MBSimUniform(sim));
+   MBSimReserve(sim, params->repeat_length);
+   for (copy = 0; copy < num_copies; copy++) {
+      copy_length = 
+         MBSimMutate(sim, sim->repeats[MBSimRange(sim, 0, 
+                                                  params->num_repeats-1)],
+                     params->repeat_length, params->repeat_divergence,
+                     0.3, sim->buffer);
+      pos = MBSimRange(sim, 0, length);
+      new_seq = (CharPtr) MemNew(length + copy_length + 1);
+      MemCpy(new_seq, seq, pos);
+      MemCpy(new_seq + pos, sim->buffer, copy_length);
+      MemCpy(new_seq + pos + copy_length, seq + pos, length - pos);
+      MemFree(seq);
+      seq = new_seq;
+      length += copy_length;
+   }
+   *length_ptr = length;
+   return seq;
+}
+
+MBSimPtr LIBCALL MBSimNew(MBSimParamsPtr params)
+{
+   MBSimPtr sim;
+   Uint4 x;
+   Int4 index;
+
+   sim = (MBSimPtr) MemNew(sizeof(MBSim));
+   MemCpy(&sim->params, params, sizeof(MBSimParams));
+   params = &sim->params;
+   params->transcript_min = MAX(params->transcript_min, 1);
+   params->transcript_max = MAX(params->transcript_max, 
+                                params->transcript_min);
+   params->num_transcripts = MAX(params->num_transcripts, 1);
+   params->read_min = MAX(params->read_min, 1);
+   params->polya_max = MAX(params->polya_max, params->polya_min);
+
+   /* Spread the seed over the whole state; xorshift needs it non zero */
+   x = params->seed;
+   for (index = 0; index < 4; index++) {
+      x = x*1664525 + 1013904223;
+      sim->state[index] = x ^ (x >> 16);
+   }
+   if ((sim->state[0] | sim->state[1] | sim->state[2] | sim->state[3]) == 0)
+      sim->state[0] = 1;
+
+   if (params->num_repeats > 0) {
+      sim->repeats = (CharPtr PNTR) 
+         MemNew(params->num_repeats*sizeof(CharPtr));
+      for (index = 0; index < params->num_repeats; index++)
+         sim->repeats[index] = 
+            MBSimRandomSequence(sim, params->repeat_length);
+   }
+   sim->transcripts = (CharPtr PNTR) 
+      MemNew(params->num_transcripts*sizeof(CharPtr));
+   sim->transcript_lengths = (Int4Ptr) 
+      MemNew(params->num_transcripts*sizeof(Int4));
+   for (index = 0; index < params->num_transcripts; index++) {
+      sim->transcripts[index] = 
+         MBSimMakeTranscript(sim, &sim->transcript_lengths[index]);
+      sim->transcript_bases += sim->transcript_lengths[index];
+   }
+   return sim;
+}
+
+MBSimPtr LIBCALL MBSimFree(MBSimPtr sim)
+{
+   Int4 index;
+
+   if (sim == NULL)
+      return NULL;
+   if (sim->repeats) {
+      for (index = 0; index < sim->params.num_repeats; index++)
+         MemFree(sim->repeats[index]);
+      MemFree(sim->repeats);
+   }
+   for (index = 0; index < sim->params.num_transcripts; index++)
+      MemFree(sim->transcripts[index]);
+   MemFree(sim->transcripts);
+   MemFree(sim->transcript_lengths);
+   MemFree(sim->buffer);
+   MemFree(sim->work);
+   return (MBSimPtr) MemFree(sim);
+}
+
+Boolean LIBCALL MBSimNextRead(MBSimPtr sim, MBSimReadPtr read)
+{
+   MBSimParamsPtr params = &sim->params;
+   CharPtr transcript;
+   Int4 length, transcript_length, fragment, index;
+   FloatHi u;
+
+   if (sim->num_reads >= params->num_reads)
+      return FALSE;
+
+   MemSet(read, 0, sizeof(MBSimRead));
+   read->ordinal = sim->num_reads++;
+
+   /* Expression level: a skew above 1 favours the first transcripts */
+   u = MBSimUniform(sim);
+   if (params->expression_skew != 1.0 && params->expression_skew > 0)
+      u = pow(u, params->expression_skew);
+   read->transcript = MIN((Int4) (u * params->num_transcripts), 
+                          params->num_transcripts - 1);
+   transcript = sim->transcripts[read->transcript];
+   transcript_length = sim->transcript_lengths[read->transcript];
+
+   length = (Int4) (params->read_mean + params->read_sd*MBSimNormal(sim) +
+                    0.5);
+   length = MAX(length, params->read_min);
+   MBSimReserve(sim, length + params->polya_max);
+
+   if (MBSimUniform(sim) < params->end3_fraction) {
+      read->polya = MBSimRange(sim, params->polya_min, params->polya_max);
+      fragment = MIN(MAX(length - read->polya, 1), transcript_length);
+      read->start = transcript_length - fragment;
+   } else {
+      fragment = MIN(length, transcript_length);
+      read->start = MBSimRange(sim, 0, transcript_length - fragment);
+   }
+   read->end = read->start + fragment;
+   MemCpy(sim->work, transcript + read->start, fragment);
+   MemSet(sim->work + fragment, 'A', read->polya);
+
+   length = MBSimMutate(sim, sim->work, fragment + read->polya, 
+                        params->error_rate, params->indel_fraction, 
+                        sim->buffer);
+   if (params->n_rate > 0) {
+      for (index = 0; index < length; index++)
+         if (MBSimUniform(sim) < params->n_rate)
+            sim->buffer[index] = 'N';
+   }
+   read->strand = '+';
+   if (MBSimUniform(sim) < params->minus_fraction) {
+      MBSimReverseComplement(sim->buffer, length);
+      read->strand = '-';
+   }
+   read->sequence = sim->buffer;
+   read->length = length;
+   return TRUE;
+}
+
+void LIBCALL MBSimWriteFasta(FILE *fp, CharPtr defline, CharPtr sequence,
+                             Int4 length)
+{
+   Int4 index;
+
+   fprintf(fp, ">%s\n", defline);
+   for (index = 0; index < length; index += 60)
+      fprintf(fp, "%.*s\n", (int) MIN(60, length - index), sequence + index);
+}
@@ -0,0 +1,116 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbsim.h
+
+Contents: deterministic generator of EST-like data sets for benchmarking
+          mgblast. A set of transcripts is made from random sequence with
+          copies of a few diverged repeat families inserted; reads are then
+          sampled from the transcripts with a skewed expression level, a
+          normal length distribution, 3' reads ending in a poly-A tail,
+          either strand, and substitution/indel errors. The same parameters
+          (including the seed) always give the same data on any platform.
+
+******************************************************************************/
+#ifndef __MBSIM__
+#define __MBSIM__
+
+#include <ncbi.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mb_sim_params {
+   Uint4 seed;
+   Int4 num_transcripts;
+   Int4 transcript_min, transcript_max;  /* uniform length range */
+   Int4 num_repeats;           /* repeat families */
+   Int4 repeat_length;
+   FloatHi repeat_rate;        /* repeat copies per kb of transcript */
+   FloatHi repeat_divergence;  /* error rate of each copy */
+   FloatHi expression_skew;    /* 1: uniform; larger: fewer, deeper 
+                                  clusters */
+   Int4 num_reads;
+   Int4 read_mean, read_sd, read_min;  /* read length distribution */
+   FloatHi end3_fraction;      /* reads ending at the poly-A site */
+   Int4 polya_min, polya_max;  /* tail length of those */
+   FloatHi minus_fraction;     /* reads from the minus strand */
+   FloatHi error_rate;         /* sequencing errors per base */
+   FloatHi indel_fraction;     /* share of the errors that are indels */
+   FloatHi n_rate;             /* N calls per base */
+} MBSimParams, PNTR MBSimParamsPtr;
+
+typedef struct mb_sim_read {
+   CharPtr sequence;           /* owned by the generator, valid until the 
+                                  next read */
+   Int4 length;
+   Int4 ordinal;               /* 0-based read number */
+   Int4 transcript;            /* origin: transcript and 0-based range */
+   Int4 start, end;
+   Char strand;                /* '+' or '-' */
+   Int4 polya;                 /* poly-A bases added */
+} MBSimRead, PNTR MBSimReadPtr;
+
+typedef struct mb_sim {
+   MBSimParams params;
+   Uint4 state[4];             /* xorshift128 state */
+   CharPtr PNTR repeats;
+   CharPtr PNTR transcripts;   /* IUPAC upper case, NUL terminated */
+   Int4Ptr transcript_lengths;
+   Int8 transcript_bases;
+   Int4 num_reads;             /* reads made so far */
+   CharPtr buffer, work;
+   Int4 buffer_size;
+} MBSim, PNTR MBSimPtr;
+
+void LIBCALL MBSimParamsDefault PROTO((MBSimParamsPtr params));
+/* Make the repeat families and transcripts */
+MBSimPtr LIBCALL MBSimNew PROTO((MBSimParamsPtr params));
+MBSimPtr LIBCALL MBSimFree PROTO((MBSimPtr sim));
+/* Uniform 32 bit random number, and a uniform number in [0, 1) */
+Uint4 LIBCALL MBSimRandom PROTO((MBSimPtr sim));
+FloatHi LIBCALL MBSimUniform PROTO((MBSimPtr sim));
+/* Random A/C/G/T sequence of the given length, NUL terminated, MemNew'd */
+CharPtr LIBCALL MBSimRandomSequence PROTO((MBSimPtr sim, Int4 length));
+/* Copy src to dst with errors at the given rate, indel_fraction of them
+   insertions or deletions; dst must hold 2*length+1 bytes. Returns the
+   length of the copy */
+Int4 LIBCALL MBSimMutate PROTO((MBSimPtr sim, CharPtr src, Int4 length,
+                                FloatHi rate, FloatHi indel_fraction,
+                                CharPtr dst));
+/* Reverse complement of seq in place */
+void LIBCALL MBSimReverseComplement PROTO((CharPtr seq, Int4 length));
+/* Next read of the data set; FALSE once params.num_reads were made */
+Boolean LIBCALL MBSimNextRead PROTO((MBSimPtr sim, MBSimReadPtr read));
+/* Write one FASTA record, 60 bases per line */
+void LIBCALL MBSimWriteFasta PROTO((FILE *fp, CharPtr defline, 
+                                    CharPtr sequence, Int4 length));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBSIM__ */
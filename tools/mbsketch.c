@@ -0,0 +1,430 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbsketch.c
+
+Contents: minimizer sketch prefilter of query-subject pairs for megablast
+          all-vs-all searches, see mbsketch.h.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <readdb.h>
+#include <mbsketch.h>
+
+/* A minimizer hit of a query in a database sequence */
+typedef struct mb_sketch_hit {
+   Int4 oid;
+   Int4 strand;         /* 0 if the k-mers are on the same strand */
+   Int4 diag;           /* subject offset - query offset, the query
+                           reverse complemented if strand is 1 */
+} MBSketchHit, PNTR MBSketchHitPtr;
+
+/* Thomas Wang's integer hash, invertible so that distinct k-mers never 
+   tie */
+static Uint4 MBSketchHash(Uint4 key)
+{
+   key = ~key + (key << 15);
+   key = key ^ (key >> 12);
+   key = key + (key << 2);
+   key = key ^ (key >> 4);
+   key = key * 2057;
+   key = key ^ (key >> 16);
+   return key;
+}
+
+/* Minimizers of a sequence of bases 0-3, one per byte, other values
+   breaking the k-mers. Each is stored once, even if it is the minimizer
+   of several windows; entries must have room for length entries. Returns
+   the number stored */
+static Int4 MBSketchMinimizers(Uint1Ptr seq, Int4 length, Int4 kmer,
+                               Int4 window, MBSketchEntryPtr entries)
+{
+   Uint4 hashes[MBSK_MAX_WINDOW], fcode = 0, rcode = 0, canonical;
+   Int4 strands[MBSK_MAX_WINDOW];
+   Uint4 mask = (kmer < 16) ? ((1U << (2*kmer)) - 1) : 0xffffffffU;
+   Int4 shift = 2*(kmer - 1);
+   Int4 i, j, valid = 0, count = 0, min_index = -1, last_stored = -1;
+   Int4 kmers = 0, pos;
+
+   for (i = 0; i < length; i++) {
+      if (seq[i] > 3) {
+         valid = kmers = 0;
+         min_index = -1;
+         continue;
+      }
+      fcode = ((fcode << 2) | seq[i]) & mask;
+      rcode = (rcode >> 2) | ((Uint4) (3 - seq[i]) << shift);
+      if (++valid < kmer)
+         continue;
+      /* K-mer starting at pos; the last window k-mers are in the ring 
+         buffer, the one at p in slot p % window */
+      pos = i - kmer + 1;
+      canonical = MIN(fcode, rcode);
+      hashes[pos % window] = MBSketchHash(canonical);
+      strands[pos % window] = (rcode < fcode);
+      kmers++;
+      if (min_index >= 0 && min_index <= pos - window)
+         min_index = -1;
+      if (min_index < 0) {
+         /* Rescan the window, keeping the leftmost of equal minima */
+         for (j = MAX(pos - window + 1, pos - kmers + 1); j <= pos; j++) {
+            if (min_index < 0 || 
+                hashes[j % window] < hashes[min_index % window])
+               min_index = j;
+         }
+      } else if (hashes[pos % window] < hashes[min_index % window])
+         min_index = pos;
+      if (kmers < window || min_index == last_stored)
+         continue;
+      entries[count].hash = hashes[min_index % window];
+      entries[count].oid = 0;
+      entries[count].pos = 2*min_index + strands[min_index % window];
+      count++;
+      last_stored = min_index;
+   }
+   return count;
+}
+
+static int MBSketchEntryCompare(const void* v1, const void* v2)
+{
+   MBSketchEntryPtr entry1 = (MBSketchEntryPtr) v1;
+   MBSketchEntryPtr entry2 = (MBSketchEntryPtr) v2;
+
+   if (entry1->hash != entry2->hash)
+      return (entry1->hash < entry2->hash) ? -1 : 1;
+   if (entry1->oid != entry2->oid)
+      return (entry1->oid < entry2->oid) ? -1 : 1;
+   if (entry1->pos < entry2->pos)
+      return -1;
+   return (entry1->pos > entry2->pos);
+}
+
+MBSketchIndexPtr LIBCALL MBSketchIndexNew(ReadDBFILEPtr rdfp, 
+                  Int4 first_oid, Int4 last_oid, Int4 word_size,
+                  Int4 min_shared, Int4 min_overlap)
+{
+   MBSketchIndexPtr index;
+   MBSketchEntryPtr entries = NULL;
+   Uint1Ptr packed, seq = NULL;
+   Int4 oid, length, max_length = 0, count, i, kmer, window;
+   Int8 num_entries = 0, max_entries = 0, start, stop, kept;
+
+   if (rdfp == NULL || word_size < 1)
+      return NULL;
+   if (last_oid <= 0 || last_oid > readdb_get_num_entries_total(rdfp))
+      last_oid = readdb_get_num_entries_total(rdfp);
+   if (first_oid < 0)
+      first_oid = 0;
+   if (first_oid >= last_oid)
+      return NULL;
+   kmer = MIN(MBSK_MAX_KMER, word_size);
+   window = MAX(1, word_size - kmer + 1);
+   window = MIN(window, MBSK_MAX_WINDOW);
+
+   index = (MBSketchIndexPtr) MemNew(sizeof(MBSketchIndex));
+   if (index == NULL)
+      return NULL;
+   index->kmer = kmer;
+   index->window = window;
+   index->first_oid = first_oid;
+   index->num_oids = last_oid - first_oid;
+   index->min_shared = MAX(1, min_shared);
+   index->min_overlap = MAX(0, min_overlap);
+   index->lengths = (Int4Ptr) MemNew(index->num_oids*sizeof(Int4));
+   if (index->lengths == NULL)
+      return MBSketchIndexFree(index);
+
+   for (oid = first_oid; oid < last_oid; oid++) {
+      length = readdb_get_sequence(rdfp, oid, &packed);
+      index->lengths[oid - first_oid] = length;
+      if (length > max_length) {
+         seq = (Uint1Ptr) Realloc(seq, length);
+         max_length = length;
+      }
+      if (num_entries + length > max_entries) {
+         max_entries = 2*(num_entries + length);
+         entries = (MBSketchEntryPtr) 
+            Realloc(entries, (size_t) max_entries*sizeof(MBSketchEntry));
+      }
+      if (length > 0 && (seq == NULL || entries == NULL)) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Not enough memory for the sketch "
+                   "of the database");
+         MemFree(seq);
+         MemFree(entries);
+         return MBSketchIndexFree(index);
+      }
+      for (i = 0; i < length; i++)
+         seq[i] = READDB_UNPACK_BASE_N(packed[i/READDB_COMPRESSION_RATIO],
+                     READDB_COMPRESSION_RATIO - 1 - 
+                     i % READDB_COMPRESSION_RATIO);
+      count = MBSketchMinimizers(seq, length, kmer, window, 
+                                 entries + num_entries);
+      for (i = 0; i < count; i++)
+         entries[num_entries + i].oid = oid;
+      num_entries += count;
+   }
+   MemFree(seq);
+   if (num_entries > 1)
+      qsort((void*) entries, (size_t) num_entries, sizeof(MBSketchEntry), 
+            MBSketchEntryCompare);
+
+   /* Minimizers of repeats and low complexity sequence would make most
+      pairs candidates */
+   for (start = kept = 0; start < num_entries; start = stop) {
+      for (stop = start + 1; stop < num_entries && 
+              entries[stop].hash == entries[start].hash; stop++);
+      if (stop - start > MBSK_MAX_OCCURRENCES) {
+         index->num_dropped += stop - start;
+         continue;
+      }
+      if (kept != start)
+         MemMove(entries + kept, entries + start, 
+                 (size_t) (stop - start)*sizeof(MBSketchEntry));
+      kept += stop - start;
+   }
+   index->num_entries = kept;
+   index->entries = entries;
+   return index;
+}
+
+MBSketchIndexPtr LIBCALL MBSketchIndexFree(MBSketchIndexPtr index)
+{
+   if (index == NULL)
+      return NULL;
+   MemFree(index->entries);
+   MemFree(index->lengths);
+   return (MBSketchIndexPtr) MemFree(index);
+}
+
+static int MBSketchHitCompare(const void* v1, const void* v2)
+{
+   MBSketchHitPtr hit1 = (MBSketchHitPtr) v1, hit2 = (MBSketchHitPtr) v2;
+
+   if (hit1->oid != hit2->oid)
+      return (hit1->oid < hit2->oid) ? -1 : 1;
+   if (hit1->strand != hit2->strand)
+      return (hit1->strand < hit2->strand) ? -1 : 1;
+   if (hit1->diag < hit2->diag)
+      return -1;
+   return (hit1->diag > hit2->diag);
+}
+
+/* First entry of the index with a hash */
+static Int8 MBSketchLowerBound(MBSketchIndexPtr index, Uint4 hash)
+{
+   Int8 start = 0, stop = index->num_entries, middle;
+
+   while (start < stop) {
+      middle = (start + stop) / 2;
+      if (index->entries[middle].hash < hash)
+         start = middle + 1;
+      else
+         stop = middle;
+   }
+   return start;
+}
+
+/* Whether query and subject can overlap by the minimum on a diagonal */
+static Boolean MBSketchOverlapOK(MBSketchIndexPtr index, Int4 query_length,
+                                 Int4 subject_length, Int4 diag)
+{
+   Int4 overlap;
+
+   overlap = MIN(subject_length, diag + query_length) - MAX(0, diag);
+   return (overlap + MBSK_BAND >= index->min_overlap);
+}
+
+MBSketchPairsPtr LIBCALL MBSketchPairsNew(MBSketchIndexPtr index,
+                   Uint1Ptr PNTR query_seqs, Int4Ptr query_lengths,
+                   Int4 num_queries, Int4 first_oid, Int4 last_oid)
+{
+   MBSketchPairsPtr pairs;
+   MBSketchEntryPtr minimizers = NULL, entry, last_entry;
+   MBSketchHitPtr hits = NULL;
+   Int4Ptr pair_oids = NULL, pair_queries = NULL, cursor;
+   Int4 query, max_length = 0, count, i, qpos, spos, strand, oid;
+   Int4 num_hits, max_hits = 0, first, length, subject_length;
+   Int8 num_pairs = 0, max_pairs = 0, start;
+
+   if (index == NULL)
+      return NULL;
+   first_oid = MAX(first_oid, index->first_oid);
+   if (last_oid <= 0 || last_oid > index->first_oid + index->num_oids)
+      last_oid = index->first_oid + index->num_oids;
+   pairs = (MBSketchPairsPtr) MemNew(sizeof(MBSketchPairs));
+   if (pairs == NULL)
+      return NULL;
+   pairs->first_oid = first_oid;
+   pairs->num_oids = MAX(0, last_oid - first_oid);
+   pairs->start = (Int4Ptr) MemNew((pairs->num_oids + 1)*sizeof(Int4));
+   if (pairs->start == NULL)
+      return MBSketchPairsFree(pairs);
+
+   for (query = 0; query < num_queries; query++) {
+      length = query_lengths[query];
+      if (query_seqs[query] == NULL || length <= 0)
+         continue;
+      if (length > max_length) {
+         minimizers = (MBSketchEntryPtr) 
+            Realloc(minimizers, length*sizeof(MBSketchEntry));
+         if (minimizers == NULL)
+            goto nomem;
+         max_length = length;
+      }
+      count = MBSketchMinimizers(query_seqs[query], length, index->kmer,
+                                 index->window, minimizers);
+      /* Hits of the query's minimizers in the sequences searched */
+      for (num_hits = 0, i = 0; i < count; i++) {
+         start = MBSketchLowerBound(index, minimizers[i].hash);
+         last_entry = index->entries + index->num_entries;
+         qpos = minimizers[i].pos / 2;
+         for (entry = index->entries + start; entry < last_entry && 
+                 entry->hash == minimizers[i].hash; entry++) {
+            if (entry->oid < first_oid || entry->oid >= last_oid)
+               continue;
+            if (num_hits == max_hits) {
+               max_hits = 2*max_hits + 1024;
+               hits = (MBSketchHitPtr) 
+                  Realloc(hits, max_hits*sizeof(MBSketchHit));
+               if (hits == NULL)
+                  goto nomem;
+            }
+            spos = entry->pos / 2;
+            strand = (entry->pos ^ minimizers[i].pos) & 1;
+            hits[num_hits].oid = entry->oid;
+            hits[num_hits].strand = strand;
+            hits[num_hits].diag = strand ? 
+               spos - (length - index->kmer - qpos) : spos - qpos;
+            num_hits++;
+         }
+      }
+      if (num_hits > 1)
+         qsort((void*) hits, num_hits, sizeof(MBSketchHit), 
+               MBSketchHitCompare);
+
+      /* A subject is a candidate if min_shared hits fall in one band of
+         diagonals */
+      for (first = i = 0; i < num_hits; i++) {
+         if (hits[i].oid != hits[first].oid || 
+             hits[i].strand != hits[first].strand)
+            first = i;
+         while (hits[i].diag - hits[first].diag >= MBSK_BAND)
+            first++;
+         oid = hits[i].oid;
+         subject_length = index->lengths[oid - index->first_oid];
+         if (i - first + 1 < index->min_shared || 
+             !MBSketchOverlapOK(index, length, subject_length, hits[i].diag))
+            continue;
+         if (num_pairs == max_pairs) {
+            max_pairs = 2*max_pairs + 1024;
+            pair_oids = (Int4Ptr) Realloc(pair_oids, max_pairs*sizeof(Int4));
+            pair_queries = 
+               (Int4Ptr) Realloc(pair_queries, max_pairs*sizeof(Int4));
+            if (pair_oids == NULL || pair_queries == NULL)
+               goto nomem;
+         }
+         pair_oids[num_pairs] = oid;
+         pair_queries[num_pairs] = query;
+         num_pairs++;
+         /* Skip the other hits of this subject */
+         while (i + 1 < num_hits && hits[i+1].oid == oid)
+            i++;
+      }
+   }
+   MemFree(hits);
+   MemFree(minimizers);
+   hits = NULL;
+   minimizers = NULL;
+
+   /* By subject; the queries of each stay in increasing order */
+   pairs->queries = (Int4Ptr) MemNew((num_pairs + 1)*sizeof(Int4));
+   cursor = (Int4Ptr) MemNew((pairs->num_oids + 1)*sizeof(Int4));
+   if (pairs->queries == NULL || cursor == NULL) {
+      MemFree(cursor);
+      goto nomem;
+   }
+   for (start = 0; start < num_pairs; start++)
+      pairs->start[pair_oids[start] - first_oid + 1]++;
+   for (i = 0; i < pairs->num_oids; i++)
+      pairs->start[i+1] += pairs->start[i];
+   MemCpy(cursor, pairs->start, pairs->num_oids*sizeof(Int4));
+   for (start = 0; start < num_pairs; start++)
+      pairs->queries[cursor[pair_oids[start] - first_oid]++] = 
+         pair_queries[start];
+   pairs->num_pairs = num_pairs;
+   MemFree(cursor);
+   MemFree(pair_oids);
+   MemFree(pair_queries);
+   return pairs;
+
+nomem:
+   ErrPostEx(SEV_ERROR, 0, 0, "Not enough memory for the sketch candidate "
+             "pairs");
+   MemFree(hits);
+   MemFree(minimizers);
+   MemFree(pair_oids);
+   MemFree(pair_queries);
+   return MBSketchPairsFree(pairs);
+}
+
+MBSketchPairsPtr LIBCALL MBSketchPairsFree(MBSketchPairsPtr pairs)
+{
+   if (pairs == NULL)
+      return NULL;
+   MemFree(pairs->queries);
+   MemFree(pairs->start);
+   return (MBSketchPairsPtr) MemFree(pairs);
+}
+
+Int4Ptr LIBCALL MBSketchPairsGet(MBSketchPairsPtr pairs, Int4 oid,
+                                 Int4Ptr num_queries)
+{
+   oid -= pairs->first_oid;
+   if (oid < 0 || oid >= pairs->num_oids) {
+      *num_queries = 0;
+      return NULL;
+   }
+   *num_queries = pairs->start[oid+1] - pairs->start[oid];
+   return pairs->queries + pairs->start[oid];
+}
+
+Boolean LIBCALL MBSketchPairsHas(MBSketchPairsPtr pairs, Int4 oid,
+                                 Int4 query)
+{
+   Int4Ptr queries;
+   Int4 num_queries, start, stop, middle;
+
+   if (pairs == NULL)
+      return FALSE;
+   queries = MBSketchPairsGet(pairs, oid, &num_queries);
+   for (start = 0, stop = num_queries; start < stop; ) {
+      middle = (start + stop) / 2;
+      if (queries[middle] < query)
+         start = middle + 1;
+      else
+         stop = middle;
+   }
+   return (start < num_queries && queries[start] == query);
+}
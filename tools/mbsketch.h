@@ -0,0 +1,121 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbsketch.h
+
+Contents: minimizer sketch prefilter of query-subject pairs for megablast
+          all-vs-all searches (mgblast -h).
+
+          Every database sequence searched is sketched once: its
+          minimizers are the smallest (hashed) canonical k-mers of each 
+          window of w consecutive k-mers. An inverted index maps each 
+          minimizer to the sequences and offsets that have it. The
+          minimizers of a query are looked up in the index, and the hits
+          are grouped by subject, relative strand and diagonal band. A
+          subject is a candidate for the query when one band has at
+          least min_shared hits and the overlap of the two sequences
+          along that band can reach the minimum overlap (-C).
+
+          k and w are chosen from the megablast word size W so that
+          k + w - 1 <= W: the window that a word hit of length W contains
+          is the same in both sequences, so is its minimizer, and every
+          pair megablast can find an HSP for shares at least one 
+          minimizer (min_shared = 1 only loses pairs to masking 
+          differences, very frequent minimizers and the overlap test).
+
+******************************************************************************/
+#ifndef __MBSKETCH__
+#define __MBSKETCH__
+
+#include <ncbi.h>
+#include <readdb.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBSK_MAX_KMER 15        /* k-mer length for word sizes from 15 */
+#define MBSK_MAX_WINDOW 64      /* a smaller window only adds minimizers */
+#define MBSK_BAND 32            /* width of a diagonal band */
+#define MBSK_MAX_OCCURRENCES 5000 /* more frequent minimizers are not
+                                     indexed */
+
+typedef struct mb_sketch_entry {
+   Uint4 hash;          /* of the canonical k-mer */
+   Int4 oid;
+   Int4 pos;            /* 2 * offset of the k-mer, + 1 if the canonical 
+                           k-mer is its reverse complement */
+} MBSketchEntry, PNTR MBSketchEntryPtr;
+
+typedef struct mb_sketch_index {
+   Int4 kmer, window;   /* k and w */
+   Int4 first_oid;      /* sequences first_oid to first_oid + num_oids - 1 */
+   Int4 num_oids;
+   Int4Ptr lengths;     /* of each of them */
+   Int4 min_shared;     /* minimizer hits a candidate needs in one band */
+   Int4 min_overlap;    /* overlap a candidate's band must allow */
+   Int8 num_entries;
+   MBSketchEntryPtr entries; /* by hash, then OID and offset */
+   Int8 num_dropped;    /* entries of the too frequent minimizers */
+} MBSketchIndex, PNTR MBSketchIndexPtr;
+
+/* Candidate pairs of a query block with the database sequences */
+typedef struct mb_sketch_pairs {
+   Int4 first_oid;
+   Int4 num_oids;
+   Int4Ptr start;       /* candidate queries of OID first_oid + i are 
+                           queries[start[i]] to queries[start[i+1]-1], in
+                           increasing order */
+   Int4Ptr queries;
+   Int8 num_pairs;
+} MBSketchPairs, PNTR MBSketchPairsPtr;
+
+/* Sketch the database sequences first_oid to last_oid - 1 (0 = to the end
+   of the database) for a megablast word size; NULL if there is nothing to
+   sketch or no memory */
+MBSketchIndexPtr LIBCALL MBSketchIndexNew PROTO((ReadDBFILEPtr rdfp, 
+                   Int4 first_oid, Int4 last_oid, Int4 word_size,
+                   Int4 min_shared, Int4 min_overlap));
+MBSketchIndexPtr LIBCALL MBSketchIndexFree PROTO((MBSketchIndexPtr index));
+
+/* Candidate pairs of queries with the database sequences first_oid to
+   last_oid - 1. The queries are in blastna, one base per byte; values
+   above 3 (ambiguities, masked bases) break the k-mers */
+MBSketchPairsPtr LIBCALL MBSketchPairsNew PROTO((MBSketchIndexPtr index,
+                   Uint1Ptr PNTR query_seqs, Int4Ptr query_lengths,
+                   Int4 num_queries, Int4 first_oid, Int4 last_oid));
+MBSketchPairsPtr LIBCALL MBSketchPairsFree PROTO((MBSketchPairsPtr pairs));
+/* Candidate queries of a database sequence, *num_queries of them */
+Int4Ptr LIBCALL MBSketchPairsGet PROTO((MBSketchPairsPtr pairs, Int4 oid,
+                                        Int4Ptr num_queries));
+/* Whether query and database sequence oid are a candidate pair */
+Boolean LIBCALL MBSketchPairsHas PROTO((MBSketchPairsPtr pairs, Int4 oid,
+                                        Int4 query));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBSKETCH__ */
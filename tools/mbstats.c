@@ -0,0 +1,200 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbstats.c
+
+Contents: Mega BLAST per stage statistics, see mbstats.h.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <mbstats.h>
+#ifdef OS_UNIX
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+static CharPtr mb_stage_names[MB_NUM_STAGES] = {
+   "lookup", "scan", "extend", "traceback", "filter", "output"
+};
+
+static CharPtr mb_drop_names[MB_NUM_DROPS] = {
+   "evalue", "identity", "self", "overlap", "overhang"
+};
+
+FloatHi LIBCALL MBStatsClock(void)
+{
+#ifdef OS_UNIX
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return (FloatHi) tv.tv_sec + (FloatHi) tv.tv_usec / 1000000.0;
+#else
+   return (FloatHi) GetSecs();
+#endif
+}
+
+Int8 LIBCALL MBStatsPeakMemory(void)
+{
+#ifdef OS_UNIX
+   struct rusage usage;
+
+   if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0;
+#ifdef OS_UNIX_DARWIN
+   return (Int8) usage.ru_maxrss / 1024;  /* bytes there */
+#else
+   return (Int8) usage.ru_maxrss;
+#endif
+#else
+   return 0;
+#endif
+}
+
+void LIBCALL MBStageStatsNotePeak(MBStageStatsPtr stats, Int4 first_stage,
+                                  Int4 last_stage)
+{
+   Int8 peak = MBStatsPeakMemory();
+   Int4 index;
+
+   for (index = first_stage; index <= last_stage; index++)
+      stats->peak_rss_kb[index] = MAX(stats->peak_rss_kb[index], peak);
+}
+
+void LIBCALL MBStageStatsAdd(MBStageStatsPtr dst, MBStageStatsPtr src)
+{
+   Int4 index;
+
+   for (index = 0; index < MB_NUM_STAGES; index++) {
+      dst->time[index] += src->time[index];
+      dst->peak_rss_kb[index] = 
+         MAX(dst->peak_rss_kb[index], src->peak_rss_kb[index]);
+   }
+   for (index = 0; index < MB_NUM_DROPS; index++)
+      dst->hsps_dropped[index] += src->hsps_dropped[index];
+   dst->subjects += src->subjects;
+   dst->subjects_skipped += src->subjects_skipped;
+   dst->queries_skipped += src->queries_skipped;
+   dst->db_bytes += src->db_bytes;
+   dst->word_hits += src->word_hits;
+   dst->extensions += src->extensions;
+   dst->good_extensions += src->good_extensions;
+   dst->hsps_found += src->hsps_found;
+   dst->hsps_kept += src->hsps_kept;
+   dst->subject_unpacks += src->subject_unpacks;
+   dst->subject_unpacks_avoided += src->subject_unpacks_avoided;
+   dst->ambig_hsps += src->ambig_hsps;
+   dst->seeds_contained += src->seeds_contained;
+   dst->containment_tests += src->containment_tests;
+   dst->sketch_pairs += src->sketch_pairs;
+   dst->sketch_candidates += src->sketch_candidates;
+   dst->sketch_hsps_kept += src->sketch_hsps_kept;
+   dst->verify_tests += src->verify_tests;
+   dst->verify_rejected += src->verify_rejected;
+}
+
+void LIBCALL MBSearchStatsAdd(MBSearchStatsPtr dst, MBSearchStatsPtr src)
+{
+   Int4 index;
+
+   MBStageStatsAdd(&dst->total, &src->total);
+   if (src->num_threads > dst->num_threads) {
+      dst->threads = (MBStageStatsPtr) 
+         Realloc(dst->threads, src->num_threads*sizeof(MBStageStats));
+      MemSet(dst->threads + dst->num_threads, 0, 
+             (src->num_threads - dst->num_threads)*sizeof(MBStageStats));
+      dst->num_threads = src->num_threads;
+   }
+   for (index = 0; index < src->num_threads; index++)
+      MBStageStatsAdd(&dst->threads[index], &src->threads[index]);
+}
+
+void LIBCALL MBSearchStatsClear(MBSearchStatsPtr stats)
+{
+   stats->threads = (MBStageStatsPtr) MemFree(stats->threads);
+   MemSet(stats, 0, sizeof(MBSearchStats));
+}
+
+static void MBStageStatsWriteJSON(FILE *fp, MBStageStatsPtr stats)
+{
+   Int4 index;
+
+   fprintf(fp, "{\"time\":{");
+   for (index = 0; index < MB_NUM_STAGES; index++)
+      fprintf(fp, "%s\"%s\":%.6f", index ? "," : "", mb_stage_names[index],
+              stats->time[index]);
+   fprintf(fp, "},\"subjects\":%ld,\"subjects_skipped\":%ld,"
+           "\"queries_skipped\":%ld,\"db_bytes\":%ld,\"word_hits\":%ld,"
+           "\"extensions\":%ld,\"good_extensions\":%ld,\"hsps_found\":%ld,"
+           "\"hsps_kept\":%ld,\"hsps_dropped\":{",
+           (long) stats->subjects, (long) stats->subjects_skipped,
+           (long) stats->queries_skipped, (long) stats->db_bytes, 
+           (long) stats->word_hits, (long) stats->extensions, 
+           (long) stats->good_extensions, (long) stats->hsps_found,
+           (long) stats->hsps_kept);
+   for (index = 0; index < MB_NUM_DROPS; index++)
+      fprintf(fp, "%s\"%s\":%ld", index ? "," : "", mb_drop_names[index],
+              (long) stats->hsps_dropped[index]);
+   fprintf(fp, "},\"subject_unpacks\":%ld,\"subject_unpacks_avoided\":%ld,"
+           "\"ambig_hsps\":%ld,\"seeds_contained\":%ld,"
+           "\"containment_tests\":%ld,\"sketch_pairs\":%ld,"
+           "\"sketch_candidates\":%ld,\"sketch_hsps_kept\":%ld,"
+           "\"verify_tests\":%ld,\"verify_rejected\":%ld,"
+           "\"stage_peak_rss_kb\":{", 
+           (long) stats->subject_unpacks, 
+           (long) stats->subject_unpacks_avoided, (long) stats->ambig_hsps,
+           (long) stats->seeds_contained, (long) stats->containment_tests,
+           (long) stats->sketch_pairs, (long) stats->sketch_candidates,
+           (long) stats->sketch_hsps_kept, (long) stats->verify_tests,
+           (long) stats->verify_rejected);
+   for (index = 0; index < MB_NUM_STAGES; index++)
+      fprintf(fp, "%s\"%s\":%ld", index ? "," : "", mb_stage_names[index],
+              (long) stats->peak_rss_kb[index]);
+   fprintf(fp, "}}");
+}
+
+void LIBCALL MBSearchStatsWriteJSON(FILE *fp, CharPtr kind, Int4 block,
+                                    Int4 num_queries, MBSearchStatsPtr stats)
+{
+   Int4 index;
+
+   if (fp == NULL || stats == NULL)
+      return;
+
+   fprintf(fp, "{\"type\":\"%s\",", kind);
+   if (block > 0)
+      fprintf(fp, "\"block\":%ld,", (long) block);
+   fprintf(fp, "\"queries\":%ld,\"threads\":%ld,\"peak_rss_kb\":%ld,"
+           "\"total\":", (long) num_queries, (long) stats->num_threads,
+           (long) MBStatsPeakMemory());
+   MBStageStatsWriteJSON(fp, &stats->total);
+   fprintf(fp, ",\"per_thread\":[");
+   for (index = 0; index < stats->num_threads; index++) {
+      if (index)
+         fprintf(fp, ",");
+      MBStageStatsWriteJSON(fp, &stats->threads[index]);
+   }
+   fprintf(fp, "]}\n");
+   fflush(fp);
+}
@@ -0,0 +1,117 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbstats.h
+
+Contents: per stage timing and counters of Mega BLAST searches, collected
+          per thread and per query block, and their JSON report.
+
+******************************************************************************/
+#ifndef __MBSTATS__
+#define __MBSTATS__
+
+#include <ncbi.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Search stages timed */
+#define MB_STAGE_LOOKUP    0  /* lookup table construction */
+#define MB_STAGE_SCAN      1  /* database scanning for word hits */
+#define MB_STAGE_EXTEND    2  /* ungapped and gapped (greedy) extension */
+#define MB_STAGE_TRACEBACK 3  /* rescoring and traceback of the HSPs */
+#define MB_STAGE_FILTER    4  /* results callback, apart from output */
+#define MB_STAGE_OUTPUT    5  /* formatting and writing the hits */
+#define MB_NUM_STAGES      6
+
+/* Reasons for the results callback to discard an HSP */
+#define MB_DROP_EVALUE     0  /* above the e-value cutoff */
+#define MB_DROP_IDENT      1  /* below the identity cutoff (-p) */
+#define MB_DROP_SELF       2  /* self hit, or pair already seen (-K) */
+#define MB_DROP_OVERLAP    3  /* overlap shorter than -C */
+#define MB_DROP_OVERHANG   4  /* overhang longer than -H allows */
+#define MB_NUM_DROPS       5
+
+typedef struct mb_stage_stats {
+   FloatHi time[MB_NUM_STAGES];  /* wall clock seconds */
+   Int8 subjects;                /* database sequences scanned */
+   Int8 subjects_skipped;        /* too short for the minimum overlap */
+   Int8 queries_skipped;         /* same, for queries */
+   Int8 db_bytes;                /* sequence bytes read from the database */
+   Int8 word_hits;
+   Int8 extensions;
+   Int8 good_extensions;
+   Int8 hsps_found;              /* HSPs handed to the results stage */
+   Int8 hsps_kept;               /* HSPs that passed the callback filters */
+   Int8 hsps_dropped[MB_NUM_DROPS];
+   Int8 subject_unpacks;         /* subjects unpacked with ambiguities */
+   Int8 subject_unpacks_avoided; /* subjects rescored from packed data */
+   Int8 ambig_hsps;              /* HSPs overlapping subject ambiguities */
+   Int8 seeds_contained;         /* seeds skipped as inside a gapped HSP */
+   Int8 containment_tests;       /* HSPs compared against seeds for that */
+   Int8 sketch_pairs;            /* query-subject pairs of the searches 
+                                    with a sketch prefilter (mgblast -h) */
+   Int8 sketch_candidates;       /* the candidate pairs among them */
+   Int8 sketch_hsps_kept;        /* kept HSPs of candidate pairs */
+   Int8 verify_tests;            /* seeds verified before extension (-w) */
+   Int8 verify_rejected;         /* those that could not give an overlap */
+   Int8 peak_rss_kb[MB_NUM_STAGES]; /* process peak RSS when the stage was
+                                       last left */
+} MBStageStats, PNTR MBStageStatsPtr;
+
+/* Statistics of one search (or the sum of several), total and per thread */
+typedef struct mb_search_stats {
+   MBStageStats total;
+   Int4 num_threads;
+   MBStageStatsPtr threads;
+} MBSearchStats, PNTR MBSearchStatsPtr;
+
+/* Wall clock time in seconds, with sub-second resolution where available */
+FloatHi LIBCALL MBStatsClock PROTO((void));
+/* Peak resident set size of the process so far, in kilobytes (0 where it
+   is not available) */
+Int8 LIBCALL MBStatsPeakMemory PROTO((void));
+/* Record the current peak RSS for the stages first_stage to last_stage */
+void LIBCALL MBStageStatsNotePeak PROTO((MBStageStatsPtr stats, 
+                                         Int4 first_stage, Int4 last_stage));
+/* Add the counters and times of src to dst */
+void LIBCALL MBStageStatsAdd PROTO((MBStageStatsPtr dst, MBStageStatsPtr src));
+/* Add src to dst, thread by thread */
+void LIBCALL MBSearchStatsAdd PROTO((MBSearchStatsPtr dst, 
+                                     MBSearchStatsPtr src));
+/* Free the per thread array; the structure itself is the caller's */
+void LIBCALL MBSearchStatsClear PROTO((MBSearchStatsPtr stats));
+/* Write one line JSON record; kind is "block" or "run", block is the 
+   1-based query block number (0 for a run record) */
+void LIBCALL MBSearchStatsWriteJSON PROTO((FILE *fp, CharPtr kind, 
+                                           Int4 block, Int4 num_queries,
+                                           MBSearchStatsPtr stats));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBSTATS__ */
@@ -0,0 +1,114 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbverify.c
+
+Contents: bit-parallel edit distance bound for megablast seed 
+          verification, see mbverify.h.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <readdb.h>
+#include <mbverify.h>
+
+/* Best edit distance of the query chunk with the bit vectors peq to a
+   substring of subject[s_start] to subject[s_end - 1] (Myers 1999, the
+   search version: the text may start and end anywhere) */
+static Int4 MBVerifyChunk(Uint8Ptr peq, Int4 length, Uint1Ptr subject, 
+                          Int4 s_start, Int4 s_end, Boolean packed)
+{
+   Uint8 mask, high, pv, mv, eq, xv, xh, ph, mh;
+   Int4 score, best, s_off;
+   Uint1 base;
+
+   mask = (length < MBV_CHUNK) ? 
+      (((Uint8) 1) << length) - 1 : ~((Uint8) 0);
+   high = ((Uint8) 1) << (length - 1);
+   pv = mask;
+   mv = 0;
+   score = best = length;
+   for (s_off = s_start; s_off < s_end; s_off++) {
+      if (packed)
+         base = READDB_UNPACK_BASE_N(subject[s_off/READDB_COMPRESSION_RATIO],
+                   READDB_COMPRESSION_RATIO - 1 - 
+                   s_off % READDB_COMPRESSION_RATIO);
+      else
+         base = subject[s_off];
+      eq = (base > 3) ? mask : peq[base];
+      xv = eq | mv;
+      xh = (((eq & pv) + pv) ^ pv) | eq;
+      ph = mv | ~(xh | pv);
+      mh = pv & xh;
+      if (ph & high)
+         score++;
+      else if (mh & high)
+         score--;
+      ph <<= 1;
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+      if (score < best)
+         best = score;
+   }
+   return best;
+}
+
+Int4 LIBCALL MBVerifyEditBound(Uint1Ptr query, Int4 q_start, Int4 q_end, 
+                   Uint1Ptr subject, Int4 subject_length, Boolean packed, 
+                   Int4 diag, Int4 band, Int4 max_edits)
+{
+   Uint8 peq[4];
+   Int4 num_chunks, index, chunk, length, offset, s_start, s_end, edits = 0;
+   Uint1 base;
+
+   /* From the ends inward: an overlap that is not one usually parts from
+      the seed diagonal towards an end */
+   num_chunks = (q_end - q_start + MBV_CHUNK - 1) / MBV_CHUNK;
+   for (index = 0; index < num_chunks && edits <= max_edits; index++) {
+      chunk = (index % 2 == 0) ? index / 2 : num_chunks - 1 - index / 2;
+      chunk = q_start + chunk*MBV_CHUNK;
+      length = MIN(MBV_CHUNK, q_end - chunk);
+      peq[0] = peq[1] = peq[2] = peq[3] = 0;
+      for (offset = 0; offset < length; offset++) {
+         base = query[chunk + offset];
+         if (base > 3) {
+            peq[0] |= ((Uint8) 1) << offset;
+            peq[1] |= ((Uint8) 1) << offset;
+            peq[2] |= ((Uint8) 1) << offset;
+            peq[3] |= ((Uint8) 1) << offset;
+         } else
+            peq[base] |= ((Uint8) 1) << offset;
+      }
+      /* The subject bases the chunk can be aligned to */
+      s_start = MAX(0, chunk + diag - band);
+      s_end = MIN(subject_length, chunk + length + diag + band);
+      if (s_end <= s_start)
+         edits += length;
+      else
+         edits += MBVerifyChunk(peq, length, subject, s_start, s_end, 
+                                packed);
+   }
+   return edits;
+}
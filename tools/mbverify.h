@@ -0,0 +1,67 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbverify.h
+
+Contents: bit-parallel edit distance bound used to reject megablast seeds
+          that cannot give an overlap passing the identity and overhang
+          thresholds of mgblast, before their gapped extension (mgblast -w).
+
+          The query part that every passing alignment through the seed
+          must cover is cut into 64 base chunks; each chunk is matched with
+          Myers' bit-vector algorithm against the subject window its
+          alignment can fall in, around the seed diagonal. The sum of the
+          best edit distances of the chunks is a lower bound on the edits
+          of the whole alignment, so a seed is only rejected when no
+          alignment through it could have the identity asked for.
+
+******************************************************************************/
+#ifndef __MBVERIFY__
+#define __MBVERIFY__
+
+#include <ncbi.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBV_CHUNK 64    /* query bases per bit vector */
+
+/* Lower bound on the number of edits (mismatches and gap positions) of an
+   alignment of query[q_start] to query[q_end - 1] to the subject that 
+   stays on the diagonals diag - band to diag + band (subject offset minus
+   query offset). The query is in blastna, the subject in blastna one base
+   per byte or, if packed, in ncbi2na four bases per byte; ambiguity codes
+   (values above 3) match any base. The chunks stop as soon as the bound
+   exceeds max_edits */
+Int4 LIBCALL MBVerifyEditBound PROTO((Uint1Ptr query, Int4 q_start, 
+                   Int4 q_end, Uint1Ptr subject, Int4 subject_length, 
+                   Boolean packed, Int4 diag, Int4 band, Int4 max_edits));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBVERIFY__ */
@@ -0,0 +1,408 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbwindex.c
+
+Contents: persistent database word index for megablast, see mbwindex.h.
+
+          The index is built in two passes over the database: the first
+          counts the postings of each word, the second stores them. The
+          second pass keeps at most MBWX_BUILD_MAX_POSTINGS postings in
+          memory: the words are split into ranges of about that many 
+          postings and the database is read once per range.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <readdb.h>
+#include <lookup.h>
+#include <mbwindex.h>
+
+#define MBWX_BUILD_MAX_POSTINGS (1 << 25)
+
+/* Code of the word of packed sequence seq ending at offset s_off, a
+   multiple of 4 */
+#define MBWX_WORD_CODE(seq, s_off) \
+   (((seq)[(s_off)/READDB_COMPRESSION_RATIO - 3] << 16) | \
+    ((seq)[(s_off)/READDB_COMPRESSION_RATIO - 2] << 8) | \
+    (seq)[(s_off)/READDB_COMPRESSION_RATIO - 1])
+
+static CharPtr MBWordIndexFileName(CharPtr dbname)
+{
+   CharPtr file_name;
+
+   file_name = (CharPtr) 
+      MemNew(StringLen(dbname) + StringLen(MBWX_SUFFIX) + 1);
+   sprintf(file_name, "%s%s", dbname, MBWX_SUFFIX);
+   return file_name;
+}
+
+Boolean LIBCALL MBWordIndexBuild(CharPtr dbname, Int4 stride)
+{
+   ReadDBFILEPtr rdfp;
+   MBWordIndexHeader header;
+   Uint4Ptr starts = NULL, cursor = NULL;
+   MBWordPostingPtr postings = NULL;
+   Uint1Ptr seq;
+   CharPtr file_name = NULL;
+   FILE *fp = NULL;
+   Int4 oid, length, s_off, ecode, first_word, last_word, num_oids;
+   Int8 total, db_length;
+   Boolean success = FALSE;
+
+   if (stride <= 0 || stride % READDB_COMPRESSION_RATIO != 0) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Word index stride must be a positive "
+                "multiple of %d", READDB_COMPRESSION_RATIO);
+      return FALSE;
+   }
+   if ((rdfp = readdb_new(dbname, FALSE)) == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open nucleotide database %s",
+                dbname);
+      return FALSE;
+   }
+   num_oids = readdb_get_num_entries_total(rdfp);
+   readdb_get_totals_ex(rdfp, &db_length, &length, FALSE);
+
+   /* Count the postings of each word, shifted by one so that the running
+      sums below give each word's start */
+   starts = (Uint4Ptr) MemNew((MBWX_NUM_WORDS + 1)*sizeof(Uint4));
+   cursor = (Uint4Ptr) MemNew((MBWX_NUM_WORDS + 1)*sizeof(Uint4));
+   if (starts == NULL || cursor == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Not enough memory for the word index");
+      goto cleanup;
+   }
+   for (oid = 0; oid < num_oids; oid++) {
+      length = readdb_get_sequence(rdfp, oid, &seq);
+      for (s_off = MBWX_WORD_LENGTH; s_off <= length; s_off += stride)
+         starts[MBWX_WORD_CODE(seq, s_off) + 1]++;
+   }
+   for (total = 0, ecode = 0; ecode < MBWX_NUM_WORDS; ecode++) {
+      total += starts[ecode+1];
+      if (total > UINT4_MAX) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Database %s is too large for a word "
+                   "index with stride %ld, use a larger one", dbname,
+                   (long) stride);
+         goto cleanup;
+      }
+      starts[ecode+1] = (Uint4) total;
+   }
+
+   file_name = MBWordIndexFileName(dbname);
+   fp = FileOpen(file_name, "wb");
+   if (fp == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open %s for writing", file_name);
+      goto cleanup;
+   }
+   MemSet(&header, 0, sizeof(header));
+   MemCpy(header.magic, MBWX_MAGIC, sizeof(header.magic));
+   header.byte_order = MBWX_BYTE_ORDER;
+   header.version = MBWX_VERSION;
+   header.word_length = MBWX_WORD_LENGTH;
+   header.stride = stride;
+   header.num_oids = num_oids;
+   header.db_length = db_length;
+   header.num_postings = total;
+   if (FileWrite(&header, sizeof(header), 1, fp) != 1 ||
+       FileWrite(starts, sizeof(Uint4), MBWX_NUM_WORDS + 1, fp) != 
+       MBWX_NUM_WORDS + 1) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Error writing %s", file_name);
+      goto cleanup;
+   }
+
+   /* Store the postings of a range of words per pass; as the sequences
+      are read in order, each word's postings come in order of OID and 
+      offset */
+   postings = (MBWordPostingPtr) 
+      Malloc(MIN(total, MBWX_BUILD_MAX_POSTINGS)*sizeof(MBWordPosting) + 1);
+   for (first_word = 0; first_word < MBWX_NUM_WORDS; 
+        first_word = last_word) {
+      for (last_word = first_word + 1; last_word < MBWX_NUM_WORDS && 
+              starts[last_word+1] - starts[first_word] <= 
+              MBWX_BUILD_MAX_POSTINGS; last_word++);
+      if (starts[last_word] - starts[first_word] > MBWX_BUILD_MAX_POSTINGS)
+         postings = (MBWordPostingPtr) Realloc(postings, 
+            (starts[last_word] - starts[first_word])*sizeof(MBWordPosting));
+      if (starts[last_word] == starts[first_word])
+         continue;
+      MemCpy(cursor + first_word, starts + first_word, 
+             (last_word - first_word)*sizeof(Uint4));
+      for (oid = 0; oid < num_oids; oid++) {
+         length = readdb_get_sequence(rdfp, oid, &seq);
+         for (s_off = MBWX_WORD_LENGTH; s_off <= length; s_off += stride) {
+            ecode = MBWX_WORD_CODE(seq, s_off);
+            if (ecode >= first_word && ecode < last_word) {
+               MBWordPostingPtr posting = 
+                  postings + (cursor[ecode]++ - starts[first_word]);
+
+               posting->oid = oid;
+               posting->s_off = s_off;
+            }
+         }
+      }
+      if (FileWrite(postings, sizeof(MBWordPosting), 
+                    starts[last_word] - starts[first_word], fp) !=
+          starts[last_word] - starts[first_word]) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Error writing %s", file_name);
+         goto cleanup;
+      }
+   }
+   success = TRUE;
+
+cleanup:
+   if (fp != NULL) {
+      if (success && fflush(fp) != 0) {
+         ErrPostEx(SEV_ERROR, 0, 0, "Error writing %s", file_name);
+         success = FALSE;
+      }
+      FileClose(fp);
+      /* A partial index would only be rejected when opened */
+      if (!success)
+         FileRemove(file_name);
+   }
+   MemFree(file_name);
+   MemFree(postings);
+   MemFree(cursor);
+   MemFree(starts);
+   readdb_destruct(rdfp);
+   return success;
+}
+
+MBWordIndexPtr LIBCALL MBWordIndexOpen(CharPtr dbname, ReadDBFILEPtr rdfp)
+{
+   MBWordIndexPtr index;
+   MBWordIndexHeaderPtr header;
+   CharPtr file_name;
+   Uint1Ptr data;
+   Int8 file_size, db_length;
+   Int4 num_oids;
+   FILE *fp;
+
+   file_name = MBWordIndexFileName(dbname);
+   index = (MBWordIndexPtr) MemNew(sizeof(MBWordIndex));
+   if (Nlm_MemMapAvailable() && 
+       (index->mem_mapp = Nlm_MemMapInit(file_name)) != NULL) {
+      data = (Uint1Ptr) index->mem_mapp->mmp_begin;
+      file_size = index->mem_mapp->file_size;
+   } else if ((file_size = FileLength(file_name)) > 0 && 
+              (index->data = (Uint1Ptr) Malloc(file_size)) != NULL &&
+              (fp = FileOpen(file_name, "rb")) != NULL) {
+      data = index->data;
+      if (FileRead(data, 1, file_size, fp) != file_size)
+         file_size = 0;
+      FileClose(fp);
+   } else {
+      ErrPostEx(SEV_ERROR, 0, 0, "Unable to open the word index %s",
+                file_name);
+      MemFree(file_name);
+      return MBWordIndexFree(index);
+   }
+
+   header = (MBWordIndexHeaderPtr) data;
+   if (file_size < sizeof(MBWordIndexHeader) || 
+       MemCmp(header->magic, MBWX_MAGIC, sizeof(header->magic)) != 0) {
+      ErrPostEx(SEV_ERROR, 0, 0, "%s is not a word index", file_name);
+      MemFree(file_name);
+      return MBWordIndexFree(index);
+   }
+   if (header->byte_order != MBWX_BYTE_ORDER || 
+       header->version != MBWX_VERSION ||
+       header->word_length != MBWX_WORD_LENGTH ||
+       file_size != sizeof(MBWordIndexHeader) + 
+       (MBWX_NUM_WORDS + 1)*sizeof(Uint4) + 
+       header->num_postings*sizeof(MBWordPosting)) {
+      ErrPostEx(SEV_ERROR, 0, 0, "The word index %s was written by another "
+                "version or on another platform, rebuild it with "
+                "formatdb -W", file_name);
+      MemFree(file_name);
+      return MBWordIndexFree(index);
+   }
+   readdb_get_totals_ex(rdfp, &db_length, &num_oids, FALSE);
+   num_oids = readdb_get_num_entries_total(rdfp);
+   if (header->num_oids != num_oids || header->db_length != db_length) {
+      ErrPostEx(SEV_ERROR, 0, 0, "The word index %s is out of date, "
+                "rebuild it with formatdb -W", file_name);
+      MemFree(file_name);
+      return MBWordIndexFree(index);
+   }
+   MemFree(file_name);
+
+   MemCpy(&index->header, header, sizeof(MBWordIndexHeader));
+   index->starts = (Uint4Ptr) (data + sizeof(MBWordIndexHeader));
+   index->postings = (MBWordPostingPtr) (index->starts + MBWX_NUM_WORDS + 1);
+   return index;
+}
+
+MBWordIndexPtr LIBCALL MBWordIndexFree(MBWordIndexPtr index)
+{
+   if (index == NULL)
+      return NULL;
+   if (index->mem_mapp)
+      Nlm_MemMapFini(index->mem_mapp);
+   MemFree(index->data);
+   return (MBWordIndexPtr) MemFree(index);
+}
+
+/* First of the postings from start to stop - 1 with an OID of at least
+   oid */
+static Uint4 MBWordPostingsLowerBound(MBWordPostingPtr postings, Uint4 start,
+                                      Uint4 stop, Int4 oid)
+{
+   Uint4 middle;
+
+   while (start < stop) {
+      middle = start + (stop - start) / 2;
+      if (postings[middle].oid < oid)
+         start = middle + 1;
+      else
+         stop = middle;
+   }
+   return start;
+}
+
+static int LIBCALLBACK MBWordSeedCompare(VoidPtr v1, VoidPtr v2)
+{
+   MBWordSeedPtr seed1 = (MBWordSeedPtr) v1, seed2 = (MBWordSeedPtr) v2;
+
+   if (seed1->s_off < seed2->s_off)
+      return -1;
+   return (seed1->s_off > seed2->s_off);
+}
+
+MBWordSeedsPtr LIBCALL MBWordIndexSeeds(MBWordIndexPtr index, 
+                  LookupTablePtr lookup, Int4 first_oid, Int4 last_oid)
+{
+   MbLookupTablePtr mb_lt = (lookup != NULL) ? lookup->mb_lt : NULL;
+   PV_ARRAY_TYPE *pv_array = (lookup != NULL) ? lookup->pv_array : NULL;
+   /* The presence bits of 12-mers are shared, as in the scan */
+   Int4 pv_array_bts = PV_ARRAY_BTS + 5;
+   MBWordSeedsPtr word_seeds;
+   MBWordPostingPtr postings = index ? index->postings : NULL;
+   MBWordSeedPtr seed;
+   Uint4Ptr oid_start, cursor;
+   Int4Ptr words = NULL;
+   Uint4 start, stop;
+   Int8 total;
+   Int4 ecode, num_oids, num_words = 0, words_allocated = 0, i;
+
+   if (index == NULL || mb_lt == NULL || mb_lt->width != MBWX_WORD_BYTES)
+      return NULL;
+   first_oid = MAX(first_oid, 0);
+   last_oid = MIN(last_oid, index->header.num_oids);
+   num_oids = MAX(last_oid - first_oid, 0);
+
+   word_seeds = (MBWordSeedsPtr) MemNew(sizeof(MBWordSeeds));
+   word_seeds->first_oid = first_oid;
+   word_seeds->num_oids = num_oids;
+   oid_start = word_seeds->oid_start = 
+      (Uint4Ptr) MemNew((num_oids + 1)*sizeof(Uint4));
+
+   /* The words of the table: those with a presence bit, if the table has
+      the bits, and a chain. Count the seeds each of them gives to each 
+      OID */
+   for (ecode = 0; ecode < MBWX_NUM_WORDS; ecode++) {
+      if (pv_array) {
+         if (pv_array[ecode>>pv_array_bts] == 0) {
+            ecode |= (1 << pv_array_bts) - 1;
+            continue;
+         }
+         if ((pv_array[ecode>>pv_array_bts] & 
+              (((PV_ARRAY_TYPE) 1) << (ecode & PV_ARRAY_MASK))) == 0)
+            continue;
+      }
+      if (mb_lt->hashtable[ecode] <= 0 || 
+          index->starts[ecode] == index->starts[ecode+1])
+         continue;
+      if (num_words == words_allocated) {
+         words_allocated = MAX(2*words_allocated, 1024);
+         words = (Int4Ptr) Realloc(words, words_allocated*sizeof(Int4));
+      }
+      words[num_words++] = ecode;
+      stop = index->starts[ecode+1];
+      start = MBWordPostingsLowerBound(postings, index->starts[ecode], stop,
+                                       first_oid);
+      for (; start < stop && postings[start].oid < last_oid; start++)
+         oid_start[postings[start].oid - first_oid + 1]++;
+   }
+   for (total = 0, i = 0; i < num_oids; i++) {
+      if (oid_start[i+1] > 0)
+         word_seeds->num_subjects++;
+      total += oid_start[i+1];
+      oid_start[i+1] = (Uint4) total;
+   }
+   if (total > UINT4_MAX ||
+       (word_seeds->seeds = (MBWordSeedPtr) 
+        Malloc(total*sizeof(MBWordSeed) + 1)) == NULL ||
+       (cursor = (Uint4Ptr) MemDup(oid_start, (num_oids + 1)*sizeof(Uint4)))
+       == NULL) {
+      ErrPostEx(SEV_ERROR, 0, 0, "Too many seeds from the word index, "
+                "searching a smaller block of queries would help");
+      MemFree(words);
+      return MBWordSeedsFree(word_seeds);
+   }
+
+   /* Store them */
+   for (i = 0; i < num_words; i++) {
+      ecode = words[i];
+      stop = index->starts[ecode+1];
+      start = MBWordPostingsLowerBound(postings, index->starts[ecode], stop,
+                                       first_oid);
+      for (; start < stop && postings[start].oid < last_oid; start++) {
+         seed = word_seeds->seeds + cursor[postings[start].oid - first_oid]++;
+         seed->s_off = postings[start].s_off;
+         seed->ecode = ecode;
+      }
+   }
+   MemFree(cursor);
+   MemFree(words);
+
+   /* The words are extended in the order the database scan finds them */
+   for (i = 0; i < num_oids; i++) {
+      if (oid_start[i+1] - oid_start[i] > 1)
+         HeapSort(word_seeds->seeds + oid_start[i], 
+                  oid_start[i+1] - oid_start[i], sizeof(MBWordSeed), 
+                  MBWordSeedCompare);
+   }
+   return word_seeds;
+}
+
+MBWordSeedsPtr LIBCALL MBWordSeedsFree(MBWordSeedsPtr word_seeds)
+{
+   if (word_seeds == NULL)
+      return NULL;
+   MemFree(word_seeds->oid_start);
+   MemFree(word_seeds->seeds);
+   return (MBWordSeedsPtr) MemFree(word_seeds);
+}
+
+MBWordSeedPtr LIBCALL MBWordSeedsGet(MBWordSeedsPtr word_seeds, Int4 oid,
+                                     Int4Ptr num_seeds)
+{
+   oid -= word_seeds->first_oid;
+   if (oid < 0 || oid >= word_seeds->num_oids) {
+      *num_seeds = 0;
+      return NULL;
+   }
+   *num_seeds = word_seeds->oid_start[oid+1] - word_seeds->oid_start[oid];
+   return word_seeds->seeds + word_seeds->oid_start[oid];
+}
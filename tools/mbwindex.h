@@ -0,0 +1,132 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbwindex.h
+
+Contents: persistent database word index for megablast (formatdb -W,
+          mgblast -t).
+
+          The index of database <name> is the file <name>.mwx:
+            MBWordIndexHeader
+            Uint4 starts[MBWX_NUM_WORDS + 1] - postings of word w are
+                              postings[starts[w]] to postings[starts[w+1]-1]
+            MBWordPosting postings[num_postings]
+          Words are the 12-mers of the packed (2 bits per base) database 
+          sequences that end on a byte boundary, i.e. the words the
+          megablast scan of a subject looks up for word sizes of 11 and
+          more; with a stride larger than 4 only every (stride/4)-th of
+          them is indexed. A word's postings are in order of OID and 
+          offset. All numbers are in the byte order of the writing host.
+
+          For a block of queries, the words of the lookup table are looked
+          up in the index to give the seeds of each database sequence
+          (MBWordSeeds); only the sequences with seeds are searched, and
+          their seeds are extended in the same order the scan would find
+          them, so with stride 4 the results are the same as without the
+          index.
+
+******************************************************************************/
+#ifndef __MBWINDEX__
+#define __MBWINDEX__
+
+#include <ncbi.h>
+#include <readdb.h>
+#include <lookup.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBWX_MAGIC "MGWX"
+#define MBWX_BYTE_ORDER 0x01020304
+#define MBWX_VERSION 1
+#define MBWX_WORD_BYTES 3
+#define MBWX_WORD_LENGTH (MBWX_WORD_BYTES*READDB_COMPRESSION_RATIO)
+#define MBWX_NUM_WORDS (1 << (8*MBWX_WORD_BYTES))
+#define MBWX_SUFFIX ".mwx"
+
+typedef struct mb_word_index_header {
+   Char magic[4];
+   Uint4 byte_order;
+   Uint4 version;
+   Uint4 word_length;   /* bases */
+   Uint4 stride;        /* bases between indexed words, a multiple of 4 */
+   Int4 num_oids;
+   Int8 db_length;      /* to check the index against the database */
+   Int8 num_postings;
+} MBWordIndexHeader, PNTR MBWordIndexHeaderPtr;
+
+typedef struct mb_word_posting {
+   Int4 oid;
+   Int4 s_off;          /* subject offset just past the word */
+} MBWordPosting, PNTR MBWordPostingPtr;
+
+typedef struct mb_word_index {
+   MBWordIndexHeader header;
+   Uint4Ptr starts;
+   MBWordPostingPtr postings;
+   Nlm_MemMapPtr mem_mapp;  /* NULL if the file was read in memory */
+   Uint1Ptr data;           /* the file contents when read in memory */
+} MBWordIndex, PNTR MBWordIndexPtr;
+
+/* Seeds of one query block: a word of the query block at an offset of a
+   database sequence */
+typedef struct mb_word_seed {
+   Int4 s_off;
+   Int4 ecode;          /* word code, as in the lookup table */
+} MBWordSeed, PNTR MBWordSeedPtr;
+
+typedef struct mb_word_seeds {
+   Int4 first_oid;
+   Int4 num_oids;
+   Uint4Ptr oid_start;  /* seeds of OID first_oid + i are seeds[oid_start[i]]
+                           to seeds[oid_start[i+1]-1], by offset */
+   MBWordSeedPtr seeds;
+   Int4 num_subjects;   /* OIDs with at least one seed */
+} MBWordSeeds, PNTR MBWordSeedsPtr;
+
+/* Build the index of nucleotide database dbname in dbname.mwx, indexing
+   every stride-th base (a multiple of 4) */
+Boolean LIBCALL MBWordIndexBuild PROTO((CharPtr dbname, Int4 stride));
+/* Open dbname.mwx and check it against the open database rdfp */
+MBWordIndexPtr LIBCALL MBWordIndexOpen PROTO((CharPtr dbname, 
+                                              ReadDBFILEPtr rdfp));
+MBWordIndexPtr LIBCALL MBWordIndexFree PROTO((MBWordIndexPtr index));
+
+/* Seeds of the database sequences first_oid to last_oid - 1 for the words
+   of a megablast lookup table of contiguous 12-mers; NULL if the table has 
+   other words */
+MBWordSeedsPtr LIBCALL MBWordIndexSeeds PROTO((MBWordIndexPtr index,
+                  LookupTablePtr lookup, Int4 first_oid, Int4 last_oid));
+MBWordSeedsPtr LIBCALL MBWordSeedsFree PROTO((MBWordSeedsPtr seeds));
+/* Seeds of a database sequence, *num_seeds of them (possibly none) */
+MBWordSeedPtr LIBCALL MBWordSeedsGet PROTO((MBWordSeedsPtr seeds, Int4 oid,
+                                            Int4Ptr num_seeds));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBWINDEX__ */
@@ -0,0 +1,244 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbzout.c
+
+Contents: block-parallel gzip compatible output writer, see mbzout.h.
+
+          The blocks form a ring. The thread filling a block hands it to
+          the compressor queue and moves to the next block of the ring; if
+          that block is still pending it is the oldest one, so it waits for
+          its compression to finish and writes it out before reusing it.
+          This keeps the members in order without a separate writer thread.
+
+******************************************************************************/
+#include <ncbi.h>
+#include <ncbithr.h>
+#include <mbzout.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define MBZ_MIN_BLOCK_SIZE 4096
+
+/* Compress one block into a single gzip member */
+static Boolean MBZCompressBlock(MBZBlockPtr block, Int4 level)
+{
+#ifdef HAVE_ZLIB
+   z_stream zs;
+   Int4 bound;
+
+   MemSet(&zs, 0, sizeof(zs));
+   /* windowBits + 16 asks zlib for a gzip header and trailer */
+   if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8,
+                    Z_DEFAULT_STRATEGY) != Z_OK)
+      return FALSE;
+   bound = (Int4) deflateBound(&zs, block->length) + 32;
+   if (bound > block->zallocated) {
+      block->zdata = (Uint1Ptr) Realloc(block->zdata, bound);
+      block->zallocated = bound;
+   }
+   zs.next_in = block->data;
+   zs.avail_in = block->length;
+   zs.next_out = block->zdata;
+   zs.avail_out = block->zallocated;
+   if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+      deflateEnd(&zs);
+      return FALSE;
+   }
+   block->zlength = (Int4) zs.total_out;
+   deflateEnd(&zs);
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+static VoidPtr MBZCompressThread(VoidPtr arg)
+{
+   MBZWriterPtr zw = (MBZWriterPtr) arg;
+   MBZBlockPtr block;
+   Int4 index;
+
+   while (TRUE) {
+      NlmSemaWait(zw->queue_sema);
+      NlmMutexLockEx(&zw->queue_mutex);
+      index = zw->queue[zw->queue_head];
+      zw->queue_head = (zw->queue_head + 1) % zw->queue_size;
+      NlmMutexUnlock(zw->queue_mutex);
+      if (index < 0)
+         break;
+      block = &zw->blocks[index];
+      if (!MBZCompressBlock(block, zw->level))
+         zw->error = TRUE;
+      NlmSemaPost(block->done);
+   }
+   return NULL;
+}
+
+static void MBZEnqueue(MBZWriterPtr zw, Int4 index)
+{
+   NlmMutexLockEx(&zw->queue_mutex);
+   zw->queue[zw->queue_tail] = index;
+   zw->queue_tail = (zw->queue_tail + 1) % zw->queue_size;
+   NlmMutexUnlock(zw->queue_mutex);
+   NlmSemaPost(zw->queue_sema);
+}
+
+/* Wait for a pending block to be compressed and write it out */
+static void MBZWriteBlock(MBZWriterPtr zw, MBZBlockPtr block)
+{
+   if (!block->pending)
+      return;
+   NlmSemaWait(block->done);
+   if (!zw->error &&
+       FileWrite(block->zdata, 1, block->zlength, zw->fp) !=
+       (size_t) block->zlength)
+      zw->error = TRUE;
+   zw->bytes_out += block->zlength;
+   block->pending = FALSE;
+   block->length = 0;
+}
+
+/* Hand the current block over for compression and move to the next one */
+static void MBZSubmitCurrent(MBZWriterPtr zw)
+{
+   MBZBlockPtr block = &zw->blocks[zw->current];
+
+   block->pending = TRUE;
+   if (zw->num_threads == 0) {
+      if (!MBZCompressBlock(block, zw->level))
+         zw->error = TRUE;
+      NlmSemaPost(block->done);
+   } else
+      MBZEnqueue(zw, zw->current);
+
+   zw->current = (zw->current + 1) % zw->num_blocks;
+   MBZWriteBlock(zw, &zw->blocks[zw->current]);
+}
+
+MBZWriterPtr LIBCALL MBZWriterNew(FILE *fp, Int4 block_size,
+                                  Int4 num_threads, Int4 level)
+{
+   MBZWriterPtr zw;
+   Int4 index;
+
+#ifndef HAVE_ZLIB
+   ErrPostEx(SEV_ERROR, 0, 0, "Compressed output is not available: "
+             "this program was built without zlib");
+   return NULL;
+#endif
+   if (fp == NULL)
+      return NULL;
+   if (!NlmThreadsAvailable() || num_threads < 0)
+      num_threads = 0;
+
+   zw = (MBZWriterPtr) MemNew(sizeof(MBZWriter));
+   zw->fp = fp;
+   zw->block_size = MAX(block_size, MBZ_MIN_BLOCK_SIZE);
+   zw->level = (level < 0 || level > 9) ? MBZ_DEFAULT_LEVEL : level;
+   zw->num_threads = num_threads;
+   /* Enough blocks to keep all compressors busy while one is filled and
+      one is written */
+   zw->num_blocks = 2*num_threads + 1;
+   zw->blocks = (MBZBlockPtr) MemNew(zw->num_blocks*sizeof(MBZBlock));
+   for (index = 0; index < zw->num_blocks; index++) {
+      zw->blocks[index].data = (Uint1Ptr) MemNew(zw->block_size);
+      zw->blocks[index].done = NlmSemaInit(0);
+   }
+   NlmMutexInit(&zw->mutex);
+   if (num_threads > 0) {
+      zw->queue_size = zw->num_blocks + num_threads;
+      zw->queue = (Int4Ptr) MemNew(zw->queue_size*sizeof(Int4));
+      NlmMutexInit(&zw->queue_mutex);
+      zw->queue_sema = NlmSemaInit(0);
+      zw->threads =
+         (TNlmThread PNTR) MemNew(num_threads*sizeof(TNlmThread));
+      for (index = 0; index < num_threads; index++)
+         zw->threads[index] = NlmThreadCreate(MBZCompressThread, zw);
+   }
+   return zw;
+}
+
+Boolean LIBCALL MBZWriterWrite(MBZWriterPtr zw, CharPtr buf, Int4 len)
+{
+   MBZBlockPtr block;
+   Int4 chunk;
+
+   NlmMutexLockEx(&zw->mutex);
+   zw->bytes_in += len;
+   while (len > 0) {
+      block = &zw->blocks[zw->current];
+      chunk = MIN(len, zw->block_size - block->length);
+      MemCpy(block->data + block->length, buf, chunk);
+      block->length += chunk;
+      buf += chunk;
+      len -= chunk;
+      if (block->length == zw->block_size)
+         MBZSubmitCurrent(zw);
+   }
+   NlmMutexUnlock(zw->mutex);
+   return !zw->error;
+}
+
+MBZWriterPtr LIBCALL MBZWriterFree(MBZWriterPtr zw)
+{
+   Int4 index;
+   VoidPtr status;
+
+   if (zw == NULL)
+      return NULL;
+
+   NlmMutexLockEx(&zw->mutex);
+   if (zw->blocks[zw->current].length > 0)
+      MBZSubmitCurrent(zw);
+   /* current is the oldest block of the ring now */
+   for (index = 0; index < zw->num_blocks; index++)
+      MBZWriteBlock(zw, &zw->blocks[(zw->current + index) % zw->num_blocks]);
+   fflush(zw->fp);
+   NlmMutexUnlock(zw->mutex);
+
+   if (zw->error)
+      ErrPostEx(SEV_ERROR, 0, 0, "Error writing compressed output");
+
+   for (index = 0; index < zw->num_threads; index++)
+      MBZEnqueue(zw, -1);
+   for (index = 0; index < zw->num_threads; index++)
+      NlmThreadJoin(zw->threads[index], &status);
+   if (zw->num_threads > 0) {
+      MemFree(zw->threads);
+      MemFree(zw->queue);
+      NlmMutexDestroy(zw->queue_mutex);
+      NlmSemaDestroy(zw->queue_sema);
+   }
+   for (index = 0; index < zw->num_blocks; index++) {
+      MemFree(zw->blocks[index].data);
+      MemFree(zw->blocks[index].zdata);
+      NlmSemaDestroy(zw->blocks[index].done);
+   }
+   MemFree(zw->blocks);
+   NlmMutexDestroy(zw->mutex);
+   return (MBZWriterPtr) MemFree(zw);
+}
@@ -0,0 +1,91 @@
+/* ===========================================================================
+*
+*                            PUBLIC DOMAIN NOTICE
+*               National Center for Biotechnology Information
+*
+*  This software/database is a "United States Government Work" under the
+*  terms of the United States Copyright Act.  It was written as part of
+*  the author's official duties as a United States Government employee and
+*  thus cannot be copyrighted.  This software/database is freely available
+*  to the public for use. The National Library of Medicine and the U.S.
+*  Government have not placed any restriction on its use or reproduction.
+*
+*  Although all reasonable efforts have been taken to ensure the accuracy
+*  and reliability of the software and data, the NLM and the U.S.
+*  Government do not and cannot warrant the performance or results that
+*  may be obtained by using this software or data. The NLM and the U.S.
+*  Government disclaim all warranties, express or implied, including
+*  warranties of performance, merchantability or fitness for any particular
+*  purpose.
+*
+*  Please cite the author in any work or product based on this material.
+*
+* ===========================================================================*/
+/*****************************************************************************
+
+File name: mbzout.h
+
+Contents: block-parallel gzip compatible output writer. Output is cut in
+          blocks of a fixed size, each block is compressed by one of the
+          worker threads into an independent gzip member and the members
+          are written to the output file in the original order, so the
+          result can be read with gunzip/zcat. Needs zlib (HAVE_ZLIB);
+          without it MBZWriterNew fails.
+
+******************************************************************************/
+#ifndef __MBZOUT__
+#define __MBZOUT__
+
+#include <ncbi.h>
+#include <ncbithr.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBZ_DEFAULT_LEVEL 6
+
+typedef struct mbz_block {
+   Uint1Ptr data;         /* uncompressed text */
+   Int4 length;
+   Uint1Ptr zdata;        /* compressed gzip member */
+   Int4 zlength;
+   Int4 zallocated;
+   Boolean pending;       /* submitted and not written out yet */
+   TNlmSemaphore done;    /* posted when zdata is ready */
+} MBZBlock, PNTR MBZBlockPtr;
+
+typedef struct mbz_writer {
+   FILE *fp;              /* not owned */
+   Int4 block_size;
+   Int4 level;
+   Int4 num_blocks;       /* blocks in the ring */
+   MBZBlockPtr blocks;
+   Int4 current;          /* block being filled */
+   Int4 num_threads;      /* 0: compress in the calling thread */
+   TNlmThread PNTR threads;
+   Int4Ptr queue;         /* blocks waiting for a compressor, -1 = quit */
+   Int4 queue_size, queue_head, queue_tail;
+   TNlmMutex queue_mutex;
+   TNlmSemaphore queue_sema;
+   TNlmMutex mutex;       /* serializes MBZWriterWrite callers */
+   Boolean error;
+   Int8 bytes_in, bytes_out;
+} MBZWriter, PNTR MBZWriterPtr;
+
+/* Start a compressed writer on fp; block_size in bytes, num_threads
+   compressor threads (0 to compress in the writing thread) */
+MBZWriterPtr LIBCALL MBZWriterNew PROTO((FILE *fp, Int4 block_size,
+                                         Int4 num_threads, Int4 level));
+/* Append len bytes; thread safe. FALSE after a write or zlib error */
+Boolean LIBCALL MBZWriterWrite PROTO((MBZWriterPtr zw, CharPtr buf,
+                                      Int4 len));
+/* Compress and write what is left and stop the threads; fp is not
+   closed */
+MBZWriterPtr LIBCALL MBZWriterFree PROTO((MBZWriterPtr zw));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* !__MBZOUT__ */
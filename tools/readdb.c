@@ -1995,6 +1995,9 @@ static int LIBCALLBACK ID_Compare(VoidPtr i, VoidPtr j);
 static void FDBBlastDefLineSetBit(Int2 bit_no, ValNodePtr PNTR retval);
 static ReadDBFILEPtr readdb_merge_gifiles (ReadDBFILEPtr rdfp_chain);
 static Boolean s_IsTextFile(const char* filename);
+static RDBAccHashPtr RDBAccHashOpen(CharPtr file_name, CharPtr sd_name,
+                                    Int4 num_seqs);
+static RDBAccHashPtr RDBAccHashFree(RDBAccHashPtr ah);
 
 #if defined(OS_UNIX_SOL) || defined(OS_UNIX_LINUX)
 #ifdef  HAVE_MADVISE
@@ -3560,6 +3563,12 @@ readdb_new_internal(CharPtr filename, Uint1 is_prot, Uint1 init_state, CommonInd
            this parameter is available using function above */
         rdfp->sparse_idx = ((ISAMDataPtr) rdfp->sisam_opt)->idx_option;
     }
+
+    /* and the hashed string id index (formatdb -H), if there is one */
+    sprintf(buffer, "%s.%csh", rdfp->full_filename, is_prot? 'p':'n');
+    sprintf(buffer1, "%s.%csd", rdfp->full_filename, is_prot? 'p':'n');
+    if(rdfp->sisam_opt != NULL && FileLength(buffer) > 0)
+        rdfp->acc_hash = RDBAccHashOpen(buffer, buffer1, rdfp->num_seqs);
     
     /* Now initializing PIG ISAM indexes */ 
     if (is_prot) {
@@ -4347,6 +4356,7 @@ readdb_destruct_element (ReadDBFILEPtr rdfp)
         /* is it completely safe to have one rdfp->nisam_opt for all threads. */
         ISAMObjectFree(rdfp->nisam_opt); /* Terminating NISAM */
         ISAMObjectFree(rdfp->sisam_opt); /* Terminating NISAM */
+        rdfp->acc_hash = RDBAccHashFree(rdfp->acc_hash);
         ISAMObjectFree(rdfp->isam_pig);  /* Terminating PIG ISAM */
         OIDListFree(rdfp->oidlist);
         rdfp->gifile = MemFree(rdfp->gifile);
@@ -4761,6 +4771,232 @@ static Boolean readdb_find_best_id(SeqIdPtr sip, Int4Ptr gi, CharPtr tmpbuf)
     return TRUE;
 }
 
+/*
+  Hashed string id index (formatdb -H): the keys readdb_acc2fasta and
+  readdb_seqid2fasta look up in the string ISAM index are found by their
+  fingerprints instead, with a directory lookup and a binary search of a
+  few entries in place of the ISAM sample search and page scan.
+*/
+
+#define RDB_ACCHASH_FNV_BASIS ((((Uint8) 0xcbf29ce4) << 32) | 0x84222325)
+#define RDB_ACCHASH_FNV_PRIME ((((Uint8) 0x100) << 32) | 0x1b3)
+#define RDB_ACCHASH_MAX_DIR_BITS 24
+#define RDB_ACCHASH_NUM_KEYS 3
+
+/* Adds len characters of a key to its fingerprint: the 64-bit FNV-1a
+   hash of the key in lower case, as the ISAM compares ignore case */
+static Uint8 RDBAccHashAdd(Uint8 fp, CharPtr str, Int4 len)
+{
+    for (; len > 0; len--, str++) {
+        fp ^= (Uint1) TO_LOWER(*str);
+        fp *= RDB_ACCHASH_FNV_PRIME;
+    }
+    return fp;
+}
+
+/* The keys readdb_acc2fasta looks up for a string, in the order it tries
+   them: "gb|%s|", "gb||%s" and the string itself, which is the only key
+   of sparse indexes */
+static CharPtr rdb_acchash_prefix[RDB_ACCHASH_NUM_KEYS] = { "gb|", "gb||", "" };
+static CharPtr rdb_acchash_suffix[RDB_ACCHASH_NUM_KEYS] = { "|", "", "" };
+#define RDB_ACCHASH_PLAIN_KEY (RDB_ACCHASH_NUM_KEYS - 1)
+
+/* Fingerprints and kinds (the rdb_acchash_prefix/suffix they use) of the
+   keys of string; returns their number */
+static Int4 RDBAccHashKeys(CharPtr string, Boolean sparse_idx, Uint8 PNTR fps,
+                           Int4Ptr kinds)
+{
+    Int4 len = StringLen(string), key, kind;
+
+    for (key = 0; key < RDB_ACCHASH_NUM_KEYS; key++) {
+        kind = sparse_idx ? RDB_ACCHASH_PLAIN_KEY : key;
+        fps[key] = RDBAccHashAdd(RDB_ACCHASH_FNV_BASIS, 
+                                 rdb_acchash_prefix[kind], 
+                                 StringLen(rdb_acchash_prefix[kind]));
+        fps[key] = RDBAccHashAdd(fps[key], string, len);
+        fps[key] = RDBAccHashAdd(fps[key], rdb_acchash_suffix[kind], 
+                                 StringLen(rdb_acchash_suffix[kind]));
+        kinds[key] = kind;
+        if (sparse_idx)
+            return 1;
+    }
+    return RDB_ACCHASH_NUM_KEYS;
+}
+
+static RDBAccHashPtr RDBAccHashFree(RDBAccHashPtr ah)
+{
+    if (ah == NULL)
+        return NULL;
+    if (ah->mem_mapp)
+        Nlm_MemMapFini(ah->mem_mapp);
+    MemFree(ah->data);
+    if (ah->sd_mapp)
+        Nlm_MemMapFini(ah->sd_mapp);
+    MemFree(ah->sd_data);
+    return (RDBAccHashPtr) MemFree(ah);
+}
+
+/* Maps file_name, or reads it in memory when it cannot be mapped; returns
+   its contents, of *file_size bytes, or NULL */
+static Uint1Ptr RDBAccHashLoad(CharPtr file_name, Nlm_MemMapPtr PNTR mem_mapp,
+                               Uint1Ptr PNTR data, Int8Ptr file_size)
+{
+    FILE *fp;
+
+    if (Nlm_MemMapAvailable() && 
+        (*mem_mapp = Nlm_MemMapInit(file_name)) != NULL) {
+        *file_size = (*mem_mapp)->file_size;
+        return (Uint1Ptr) (*mem_mapp)->mmp_begin;
+    }
+    if ((*file_size = FileLength(file_name)) > 0 &&
+        (*data = (Uint1Ptr) Malloc(*file_size)) != NULL &&
+        (fp = FileOpen(file_name, "rb")) != NULL) {
+        if (FileRead(*data, 1, *file_size, fp) != *file_size)
+            *file_size = 0;
+        FileClose(fp);
+        return *data;
+    }
+    return NULL;
+}
+
+/* Opens the hashed index file_name of the string ISAM index sd_name of a
+   volume of num_seqs sequences */
+static RDBAccHashPtr RDBAccHashOpen(CharPtr file_name, CharPtr sd_name,
+                                    Int4 num_seqs)
+{
+    RDBAccHashPtr ah;
+    RDBAccHashHeaderPtr header;
+    Uint1Ptr data;
+    Int8 file_size;
+
+    ah = (RDBAccHashPtr) MemNew(sizeof(RDBAccHash));
+    if ((data = RDBAccHashLoad(file_name, &ah->mem_mapp, &ah->data,
+                               &file_size)) == NULL) {
+        ErrPostEx(SEV_WARNING, 0, 0, "Unable to open the string id index %s",
+                  file_name);
+        return RDBAccHashFree(ah);
+    }
+
+    header = (RDBAccHashHeaderPtr) data;
+    if (file_size < sizeof(RDBAccHashHeader) ||
+        MemCmp(header->magic, RDB_ACCHASH_MAGIC, sizeof(header->magic)) ||
+        header->byte_order != RDB_ACCHASH_BYTE_ORDER ||
+        header->version != RDB_ACCHASH_VERSION ||
+        header->dir_bits > RDB_ACCHASH_MAX_DIR_BITS ||
+        file_size != sizeof(RDBAccHashHeader) +
+        (((Int8) 1 << header->dir_bits) + 1)*sizeof(Uint4) +
+        (Int8) header->num_keys*sizeof(RDBAccHashEntry)) {
+        ErrPostEx(SEV_WARNING, 0, 0, "The string id index %s was written by "
+                  "another version or on another platform and is not used, "
+                  "rebuild it with formatdb -H", file_name);
+        return RDBAccHashFree(ah);
+    }
+    if (header->num_seqs != (Uint4) num_seqs ||
+        FileLength(sd_name) != (((Int8) header->sd_size_hi << 32) | 
+                                header->sd_size_lo)) {
+        ErrPostEx(SEV_WARNING, 0, 0, "The string id index %s does not match "
+                  "its volume and is not used, rebuild it with formatdb -H",
+                  file_name);
+        return RDBAccHashFree(ah);
+    }
+    /* The .nsd lines confirm the fingerprint matches */
+    if ((ah->sd = (CharPtr) RDBAccHashLoad(sd_name, &ah->sd_mapp, 
+                                           (Uint1Ptr PNTR) &ah->sd_data,
+                                           &ah->sd_size)) == NULL) {
+        ErrPostEx(SEV_WARNING, 0, 0, "Unable to open %s, the string id "
+                  "index %s is not used", sd_name, file_name);
+        return RDBAccHashFree(ah);
+    }
+    MemCpy(&ah->header, header, sizeof(RDBAccHashHeader));
+    ah->dir = (Uint4Ptr) (data + sizeof(RDBAccHashHeader));
+    ah->entries = (RDBAccHashEntryPtr) (ah->dir + 
+                                        ((Int4) 1 << header->dir_bits) + 1);
+    return ah;
+}
+
+/* Directory bucket of fingerprint fp */
+#define RDB_ACCHASH_BUCKET(ah, fp) ((ah)->header.dir_bits ? \
+    (Uint4) ((fp) >> (64 - (ah)->header.dir_bits)) : 0)
+
+/* Whether the .nsd line of entry holds the key of kind of string: the
+   same characters, ignoring case, up to the trailing spaces of the key */
+static Boolean RDBAccHashConfirm(RDBAccHashPtr ah, RDBAccHashEntryPtr entry,
+                                 CharPtr string, Int4 kind)
+{
+    CharPtr parts[3], part, line, end;
+    Int4 i;
+
+    if ((Int8) entry->sd_offset >= ah->sd_size)
+        return FALSE;
+    line = ah->sd + entry->sd_offset;
+    end = ah->sd + ah->sd_size;
+    parts[0] = rdb_acchash_prefix[kind];
+    parts[1] = string;
+    parts[2] = rdb_acchash_suffix[kind];
+    for (i = 0; i < 3; i++) {
+        for (part = parts[i]; *part != NULLB; part++, line++) {
+            if (line == end || TO_LOWER(*line) != TO_LOWER(*part))
+                return FALSE;
+        }
+    }
+    while (line < end && *line == ' ')
+        line++;
+    return (Boolean) (line < end && *line == ISAM_DATA_CHAR);
+}
+
+/* First entry with fingerprint fp whose .nsd line holds the key of kind of
+   string, or -1 */
+static Int4 RDBAccHashFind(RDBAccHashPtr ah, Uint8 fp, CharPtr string,
+                           Int4 kind)
+{
+    Uint4 hi = (Uint4) (fp >> 32), lo = (Uint4) fp;
+    Uint4 bucket = RDB_ACCHASH_BUCKET(ah, fp);
+    Int4 lower = ah->dir[bucket], upper = ah->dir[bucket+1], middle;
+    RDBAccHashEntryPtr entry;
+
+    while (lower < upper) {
+        middle = lower + (upper - lower) / 2;
+        entry = ah->entries + middle;
+        if (entry->fp_hi < hi || (entry->fp_hi == hi && entry->fp_lo < lo))
+            lower = middle + 1;
+        else
+            upper = middle;
+    }
+    for (entry = ah->entries + lower; lower < (Int4) ah->dir[bucket+1] && 
+             entry->fp_hi == hi && entry->fp_lo == lo; lower++, entry++) {
+        if (RDBAccHashConfirm(ah, entry, string, kind))
+            return lower;
+    }
+    return -1;
+}
+
+/* readdb_acc2fasta with the hashed index of volume rdfp: the OID of the
+   first key of string found in the volume or -1 */
+static Int4 RDBAccHashLookup(ReadDBFILEPtr rdfp, CharPtr string)
+{
+    Uint8 fps[RDB_ACCHASH_NUM_KEYS];
+    Int4 kinds[RDB_ACCHASH_NUM_KEYS];
+    Int4 num_keys, key, found;
+
+    num_keys = RDBAccHashKeys(string, 
+                              (Boolean) rdfp->acc_hash->header.sparse_idx, 
+                              fps, kinds);
+    for (key = 0; key < num_keys; key++) {
+        if ((found = RDBAccHashFind(rdfp->acc_hash, fps[key], string, 
+                                    kinds[key])) >= 0)
+            return rdfp->acc_hash->entries[found].oid + rdfp->start;
+    }
+    return -1;
+}
+
+/* Whether readdb_acc2fasta masks OID found in volume rdfp */
+static Boolean RDBAccHashMasked(ReadDBFILEPtr rdfp, Int4 oid)
+{
+    return (!rdfp->acc_hash->header.sparse_idx && rdfp->oidlist && 
+            rdfp->formatdb_ver < FORMATDB_VER_TEXT &&
+            !OID_GI_BelongsToMaskDB(rdfp, oid, -1));
+}
+
 /*
   Returnes Int4 sequence_number by SeqIdPtr using SISAM indexes:
   
@@ -4783,6 +5019,7 @@ readdb_seqid2fasta(ReadDBFILEPtr rdfp, SeqIdPtr sip)
     CharPtr chptr = NULL;
     SeqIdPtr bestid;
     TextSeqIdPtr tsip = NULL;
+    Int4 found;
 
     if(rdfp->sisam_opt == NULL || sip == NULL)
         return -1;
@@ -4848,6 +5085,17 @@ readdb_seqid2fasta(ReadDBFILEPtr rdfp, SeqIdPtr sip)
         }
     }
 
+        if(rdfp->acc_hash != NULL) {
+            /* The same key, from the hashed index */
+            if((found = RDBAccHashFind(rdfp->acc_hash, 
+                        RDBAccHashAdd(RDB_ACCHASH_FNV_BASIS, tmpbuff, 
+                                      StringLen(tmpbuff)), 
+                        tmpbuff, RDB_ACCHASH_PLAIN_KEY)) >= 0)
+                return rdfp->acc_hash->entries[found].oid + rdfp->start;
+            rdfp = rdfp->next;
+            continue;
+        }
+
     NlmMutexLockEx(&isamsearch_mutex);
         if((error = SISAMSearch(rdfp->sisam_opt, tmpbuff, 0, &key_out,
                                 &data, &index)) < 0) {
@@ -4957,6 +5205,14 @@ readdb_acc2fasta(ReadDBFILEPtr rdfp, CharPtr string)
 
     while (rdfp)
     {
+        if(rdfp->acc_hash != NULL) {
+            /* The same keys as below, from the hashed index */
+            if((Value = RDBAccHashLookup(rdfp, string)) >= 0)
+                return RDBAccHashMasked(rdfp, Value) ? -1 : Value;
+            rdfp = rdfp->next;
+            continue;
+        }
+
         if((error = ISAMGetIdxOption(rdfp->sisam_opt, &rdfp->sparse_idx)) < 0) {
             ErrPostEx(SEV_WARNING, 0, 0, "Failed to access string index "
                       "ISAM Error code is %d\n", error);
@@ -5054,6 +5310,121 @@ readdb_acc2fasta(ReadDBFILEPtr rdfp, CharPtr string)
     return -1;
 }
 
+typedef struct rdb_acc_hash_query {
+    Uint8 fp;      /* fingerprint of the key */
+    Int4  index;   /* of the string */
+    Int4  key;     /* which of its keys */
+    Int4  kind;    /* and the kind of that key */
+} RDBAccHashQuery, PNTR RDBAccHashQueryPtr;
+
+Int4 LIBCALL
+readdb_acc2fasta_batch(ReadDBFILEPtr rdfp, CharPtr PNTR strings, Int4 num,
+                       Int4Ptr oids)
+{
+    ReadDBFILEPtr rdfp_tmp;
+    RDBAccHashPtr ah;
+    RDBAccHashQueryPtr queries = NULL, sorted = NULL, query;
+    Int4Ptr best = NULL, starts = NULL;
+    BoolPtr done = NULL;
+    Uint8 fps[RDB_ACCHASH_NUM_KEYS];
+    Int4 kinds[RDB_ACCHASH_NUM_KEYS];
+    Int4 i, key, num_keys, num_queries, num_buckets, found, num_found = 0;
+    Int4 max_buckets = 0;
+    Boolean hashed = (rdfp->sisam_opt != NULL);
+
+    for (rdfp_tmp = rdfp; rdfp_tmp && hashed; rdfp_tmp = rdfp_tmp->next) {
+        hashed = (rdfp_tmp->acc_hash != NULL);
+        if (hashed)
+            max_buckets = MAX(max_buckets, 
+                          (Int4) 1 << rdfp_tmp->acc_hash->header.dir_bits);
+    }
+    if (hashed) {
+        queries = (RDBAccHashQueryPtr) 
+            MemNew(2*num*RDB_ACCHASH_NUM_KEYS*sizeof(RDBAccHashQuery));
+        sorted = queries + num*RDB_ACCHASH_NUM_KEYS;
+        starts = (Int4Ptr) MemNew((max_buckets + 1)*sizeof(Int4));
+        best = (Int4Ptr) MemNew(num*sizeof(Int4));
+        done = (BoolPtr) MemNew(num*sizeof(Boolean));
+        hashed = (queries != NULL && starts != NULL && best != NULL && 
+                  done != NULL);
+    }
+
+    for (i = 0; i < num; i++) {
+        oids[i] = -1;
+        if (!hashed || strings[i] == NULL || 
+            StringChr(strings[i], '|') != NULL) {
+            /* SeqIds go through readdb_seqid2fasta */
+            oids[i] = readdb_acc2fasta(rdfp, strings[i]);
+            if (done)
+                done[i] = TRUE;
+        }
+    }
+
+    /* Look up the keys of the strings not yet resolved in the volumes in
+       turn; the keys are put in the order of the index directory, so each
+       index is read in one pass */
+    for (rdfp_tmp = rdfp; rdfp_tmp && hashed; rdfp_tmp = rdfp_tmp->next) {
+        ah = rdfp_tmp->acc_hash;
+        num_buckets = (Int4) 1 << ah->header.dir_bits;
+        MemSet(starts, 0, (num_buckets + 1)*sizeof(Int4));
+        num_queries = 0;
+        for (i = 0; i < num; i++) {
+            if (done[i])
+                continue;
+            best[i] = -1;
+            num_keys = RDBAccHashKeys(strings[i], 
+                                      (Boolean) ah->header.sparse_idx, 
+                                      fps, kinds);
+            for (key = 0; key < num_keys; key++) {
+                query = queries + num_queries++;
+                query->fp = fps[key];
+                query->index = i;
+                query->key = key;
+                query->kind = kinds[key];
+                starts[RDB_ACCHASH_BUCKET(ah, query->fp) + 1]++;
+            }
+        }
+        if (num_queries == 0)
+            break;
+        for (i = 1; i <= num_buckets; i++)
+            starts[i] += starts[i-1];
+        for (i = 0; i < num_queries; i++)
+            sorted[starts[RDB_ACCHASH_BUCKET(ah, queries[i].fp)]++] = 
+                queries[i];
+
+        for (i = 0; i < num_queries; i++) {
+            query = sorted + i;
+            if ((found = RDBAccHashFind(ah, query->fp, strings[query->index],
+                                        query->kind)) < 0)
+                continue;
+            /* the first key readdb_acc2fasta tries wins */
+            if (best[query->index] < 0 || 
+                sorted[best[query->index]].key > query->key) {
+                best[query->index] = i;
+                oids[query->index] = ah->entries[found].oid + 
+                    rdfp_tmp->start;
+            }
+        }
+
+        for (i = 0; i < num; i++) {
+            if (done[i] || best[i] < 0)
+                continue;
+            if (RDBAccHashMasked(rdfp_tmp, oids[i]))
+                oids[i] = -1;
+            done[i] = TRUE;
+        }
+    }
+
+    for (i = 0; i < num; i++)
+        if (oids[i] >= 0)
+            num_found++;
+    MemFree(queries);
+    MemFree(starts);
+    MemFree(best);
+    MemFree(done);
+    return num_found;
+}
+
 /* 
    This function returnes "Seq-descr" as ValNode. This valnode then may be 
    simply linked to set of descriptors in Bioseq: bsp->descr 
@@ -7564,6 +7935,8 @@ Boolean FDBCleanUpRecursively(CharPtr base_name, Char dbtype)
         FileRemove(filenamebuf); /* string isam index file */
         sprintf(filenamebuf, "%s.%csd", base_name, dbtype);
         FileRemove(filenamebuf); /* string isam data file */
+        sprintf(filenamebuf, "%s.%csh", base_name, dbtype);
+        FileRemove(filenamebuf); /* hashed string id index file */
         sprintf(filenamebuf, "%s.%cni", base_name, dbtype);
         FileRemove(filenamebuf); /* numeric isam index file */
         sprintf(filenamebuf, "%s.%cnd", base_name, dbtype);
@@ -8638,6 +9011,144 @@ static Boolean FormatdbCreateStringIndex(const CharPtr FileName,
     return TRUE;
 }
 
+typedef struct rdb_acc_hash_key {
+    Uint8 fp;      /* fingerprint of the key */
+    Int4  order;   /* of the key in the .nsd file */
+    Int4  oid;
+    Uint4 offset;  /* of its line in the .nsd file */
+} RDBAccHashKey, PNTR RDBAccHashKeyPtr;
+
+static int LIBCALLBACK RDBAccHashKeyCompare(VoidPtr v1, VoidPtr v2)
+{
+    RDBAccHashKeyPtr k1 = (RDBAccHashKeyPtr) v1, k2 = (RDBAccHashKeyPtr) v2;
+
+    if (k1->fp != k2->fp)
+        return (k1->fp < k2->fp) ? -1 : 1;
+    if (k1->order != k2->order)
+        return (k1->order < k2->order) ? -1 : 1;
+    return 0;
+}
+
+#define RDB_ACCHASH_LINE_MAX 4096
+#define RDB_ACCHASH_WRITE_CHUNK 4096
+
+Boolean LIBCALL FD_MakeAccHash(CharPtr base_name, Boolean is_prot,
+                               Boolean sparse_idx, Int4 num_seqs)
+{
+    Char sd_name[FILENAME_MAX], sh_name[FILENAME_MAX];
+    CharPtr line = NULL, data;
+    RDBAccHashKeyPtr keys = NULL;
+    RDBAccHashEntryPtr chunk = NULL;
+    Uint4Ptr dir = NULL;
+    RDBAccHashHeader header;
+    Int4 num_keys = 0, num_alloc = 0, len, i, j, num_buckets;
+    Int8 sd_size, offset = 0;
+    Uint4 bits = 0;
+    FILE *fp = NULL;
+    Boolean success = FALSE;
+
+    sprintf(sd_name, "%s.%csd", base_name, is_prot ? 'p' : 'n');
+    sprintf(sh_name, "%s.%csh", base_name, is_prot ? 'p' : 'n');
+
+    /* The entries record Uint4 offsets in the .nsd */
+    if ((sd_size = FileLength(sd_name)) > UINT4_MAX) {
+        ErrPostEx(SEV_ERROR, 0, 0, "%s is too large for the string id index",
+                  sd_name);
+        return FALSE;
+    }
+    if ((fp = FileOpen(sd_name, "rb")) == NULL) {
+        ErrPostEx(SEV_ERROR, 0, 0, "Unable to open %s", sd_name);
+        return FALSE;
+    }
+    line = (CharPtr) MemNew(RDB_ACCHASH_LINE_MAX);
+    for (; line && FileGets(line, RDB_ACCHASH_LINE_MAX, fp) != NULL; 
+         offset += StringLen(line)) {
+        if ((data = StringChr(line, ISAM_DATA_CHAR)) == NULL)
+            continue;
+        /* ISAM matches ignore the trailing spaces of a key */
+        for (len = data - line; len > 0 && line[len-1] == ' '; len--)
+            continue;
+        if (num_keys == num_alloc) {
+            num_alloc = MAX(2*num_alloc, 1024);
+            keys = (RDBAccHashKeyPtr) 
+                Realloc(keys, num_alloc*sizeof(RDBAccHashKey));
+            if (keys == NULL) {
+                ErrPostEx(SEV_ERROR, 0, 0, "Not enough memory for the "
+                          "string id index");
+                goto cleanup;
+            }
+        }
+        keys[num_keys].fp = RDBAccHashAdd(RDB_ACCHASH_FNV_BASIS, line, len);
+        keys[num_keys].order = num_keys;
+        keys[num_keys].oid = atol(data + 1);
+        keys[num_keys].offset = (Uint4) offset;
+        num_keys++;
+    }
+    FILECLOSE(fp);
+    if (num_keys > 1)
+        HeapSort(keys, num_keys, sizeof(RDBAccHashKey), RDBAccHashKeyCompare);
+
+    /* About 4 entries per directory bucket */
+    while (bits < RDB_ACCHASH_MAX_DIR_BITS && ((Int4) 4 << bits) < num_keys)
+        bits++;
+    num_buckets = (Int4) 1 << bits;
+    dir = (Uint4Ptr) MemNew((num_buckets + 1)*sizeof(Uint4));
+    chunk = (RDBAccHashEntryPtr) 
+        MemNew(RDB_ACCHASH_WRITE_CHUNK*sizeof(RDBAccHashEntry));
+    if (line == NULL || dir == NULL || chunk == NULL) {
+        ErrPostEx(SEV_ERROR, 0, 0, "Not enough memory for the string id "
+                  "index");
+        goto cleanup;
+    }
+    for (i = 0, j = 0; j < num_buckets; j++) {
+        dir[j] = i;
+        while (i < num_keys && 
+               (bits ? (Uint4) (keys[i].fp >> (64 - bits)) : 0) == (Uint4) j)
+            i++;
+    }
+    dir[num_buckets] = num_keys;
+
+    if ((fp = FileOpen(sh_name, "wb")) == NULL) {
+        ErrPostEx(SEV_ERROR, 0, 0, "Unable to open %s for writing", sh_name);
+        goto cleanup;
+    }
+    MemSet(&header, 0, sizeof(header));
+    MemCpy(header.magic, RDB_ACCHASH_MAGIC, sizeof(header.magic));
+    header.byte_order = RDB_ACCHASH_BYTE_ORDER;
+    header.version = RDB_ACCHASH_VERSION;
+    header.num_keys = num_keys;
+    header.dir_bits = bits;
+    header.sparse_idx = sparse_idx;
+    header.num_seqs = num_seqs;
+    header.sd_size_hi = (Uint4) (sd_size >> 32);
+    header.sd_size_lo = (Uint4) sd_size;
+    if (FileWrite(&header, sizeof(header), 1, fp) != 1 ||
+        FileWrite(dir, sizeof(Uint4), num_buckets + 1, fp) != num_buckets + 1)
+        goto write_error;
+    for (i = 0; i < num_keys; i += j) {
+        for (j = 0; j < RDB_ACCHASH_WRITE_CHUNK && i + j < num_keys; j++) {
+            chunk[j].fp_hi = (Uint4) (keys[i+j].fp >> 32);
+            chunk[j].fp_lo = (Uint4) keys[i+j].fp;
+            chunk[j].oid = keys[i+j].oid;
+            chunk[j].sd_offset = keys[i+j].offset;
+        }
+        if (FileWrite(chunk, sizeof(RDBAccHashEntry), j, fp) != j)
+            goto write_error;
+    }
+    success = TRUE;
+
+ write_error:
+    if (!success)
+        ErrPostEx(SEV_ERROR, 0, 0, "Error writing %s", sh_name);
+ cleanup:
+    FILECLOSE(fp);
+    MemFree(line);
+    MemFree(keys);
+    MemFree(dir);
+    MemFree(chunk);
+    return success;
+}
+
 /* This function should expect only single defline - multiple deflines
    usually have multiple tax_ids etc. If this is not TRUE writting
    ASN.1 with '\1' will result in failure. Code below should be removed
@@ -8942,6 +9453,12 @@ static Int4 FDBCreateNewVolume(FormatDBPtr fdbp,
           StringCpy(newnamebuf + len + 3, "si");
           if (FileLength(oldnamebuf) > 0)
             FileRename(oldnamebuf, newnamebuf);
+          StringCpy(oldnamebuf + len, "sh");
+          StringCpy(newnamebuf + len + 3, "sh");
+          if (FileLength(oldnamebuf) > 0)
+            FileRename(oldnamebuf, newnamebuf);
+          else
+            FileRemove(newnamebuf); /* left by an earlier formatdb -H */
          if (options->dump_info) {
              StringCpy(oldnamebuf + len, "di");
              StringCpy(newnamebuf + len + 3, "di");
@@ -9826,6 +10343,18 @@ static    Int2    FDBFinish (FormatDBPtr fdbp)
                                        fdbp->options->sparse_idx,
                                        fdbp->options->test_non_unique))
             return 1;
+        if (fdbp->options->acc_hash &&
+            !FD_MakeAccHash(fdbp->options->base_name,
+                            fdbp->options->is_protein,
+                            fdbp->options->sparse_idx,
+                            fdbp->num_of_seqs))
+            return 1;
+    }
+    if (!fdbp->options->parse_mode || !fdbp->options->acc_hash) {
+        /* an index left by an earlier formatdb -H would not match */
+        sprintf(filenamebuf, "%s.%csh", fdbp->options->base_name,
+                fdbp->options->is_protein ? 'p' : 'n');
+        FileRemove(filenamebuf);
     }
 
 #ifdef FDB_TAXONOMYDB
@@ -11577,6 +12106,9 @@ Int2 Fastacmd_Search_ex (CharPtr searchstr, CharPtr database, Uint1 is_prot,
     SeqLocPtr        slp = NULL;
     Uint1            init_state = 0;
     Int2             retval = FASTACMD_SUCCESS;
+    CharPtr PNTR     accs = NULL;
+    Int4Ptr          acc_fids = NULL;
+    Int4             num_accs = 0;
 
     if (searchstr)
         guess_gi = atol(searchstr);
@@ -11675,13 +12207,25 @@ Int2 Fastacmd_Search_ex (CharPtr searchstr, CharPtr database, Uint1 is_prot,
         }
     }
     
+    /* Resolve the accessions together, in one pass over each volume's
+       hashed string id index if there are such */
+    if (!dupl && TotalItems > 0) {
+        accs = (CharPtr PNTR) MemNew(TotalItems*sizeof(CharPtr));
+        acc_fids = (Int4Ptr) MemNew(TotalItems*sizeof(Int4));
+        for (falp_tmp = falp; falp_tmp != NULL; falp_tmp = falp_tmp->next)
+            if (falp_tmp->gi == 0 && num_accs < TotalItems)
+                accs[num_accs++] = falp_tmp->acc;
+        readdb_acc2fasta_batch(rdfp, accs, num_accs, acc_fids);
+        num_accs = 0;
+    }
+
     for (falp_tmp = falp; falp_tmp != NULL; falp_tmp = falp_tmp->next) {
 
         if(falp_tmp->gi != 0) {
             fid = readdb_gi2seq(rdfp, falp_tmp->gi, NULL);
         } else {
             if(!dupl) {
-                fid = readdb_acc2fasta(rdfp, falp_tmp->acc);
+                fid = acc_fids[num_accs++];
             } else {
                 count = 0;
                 fid = readdb_acc2fastaEx(rdfp, falp_tmp->acc, &ids, &count);
@@ -11738,6 +12282,8 @@ Int2 Fastacmd_Search_ex (CharPtr searchstr, CharPtr database, Uint1 is_prot,
 
     readdb_destruct(rdfp);
     MemFree(buffer);
+    MemFree(accs);
+    MemFree(acc_fids);
     FCMDAccListFree(falp);
     return retval;
 } 
@@ -1056,6 +1056,55 @@ RDBTaxNamesPtr RDBGetTaxNames(RDBTaxInfoPtr tip, Int4 tax_id);
 
 #define TAX_DB_MAGIC_NUMBER 0x8739
 
+/* ----
+      Hashed string id index
+      ----  */
+
+/* The optional index <volume>.nsh (.psh) of the string ids of a volume,
+   built by formatdb -H from its string ISAM index (.nsd): a header, the
+   directory Uint4 dir[(1 << dir_bits) + 1] of the first entry with each
+   value of the top dir_bits bits of the fingerprint, and the entries,
+   the 64-bit fingerprints of the lower case keys with their OIDs within
+   the volume and the offsets of their lines in the .nsd, sorted by
+   fingerprint with equal ones in .nsd order. A fingerprint match is only
+   a candidate: the key is confirmed against its .nsd line. The header
+   records the number of sequences of the volume and the size of the .nsd
+   it was built from, and the index is not used when they do not match.
+   All numbers are in the byte order of the writing host. */
+#define RDB_ACCHASH_MAGIC "RDBACCH"
+#define RDB_ACCHASH_VERSION 2
+#define RDB_ACCHASH_BYTE_ORDER 0x01020304
+
+typedef struct rdb_acc_hash_header {
+    Char  magic[8];     /* RDB_ACCHASH_MAGIC */
+    Uint4 byte_order;   /* RDB_ACCHASH_BYTE_ORDER on the writing host */
+    Uint4 version;      /* RDB_ACCHASH_VERSION */
+    Uint4 num_keys;     /* Number of entries */
+    Uint4 dir_bits;     /* Fingerprint bits of the directory */
+    Uint4 sparse_idx;   /* The .nsd holds sparse indexes */
+    Uint4 num_seqs;     /* Number of sequences in the volume */
+    Uint4 sd_size_hi, sd_size_lo; /* Size of the .nsd */
+    Uint4 reserved;
+} RDBAccHashHeader, PNTR RDBAccHashHeaderPtr;
+
+typedef struct rdb_acc_hash_entry {
+    Uint4 fp_hi, fp_lo; /* Fingerprint of the key */
+    Int4  oid;          /* OID within the volume */
+    Uint4 sd_offset;    /* Offset of the line of the key in the .nsd */
+} RDBAccHashEntry, PNTR RDBAccHashEntryPtr;
+
+typedef struct rdb_acc_hash {
+    RDBAccHashHeader   header;
+    Uint4Ptr           dir;
+    RDBAccHashEntryPtr entries;
+    Nlm_MemMapPtr      mem_mapp; /* Mapping of the file, or */
+    Uint1Ptr           data;     /* its contents read in memory */
+    Nlm_MemMapPtr      sd_mapp;  /* Mapping of the .nsd, or */
+    CharPtr            sd_data;  /* its contents read in memory */
+    CharPtr            sd;       /* The .nsd contents */
+    Int8               sd_size;
+} RDBAccHash, PNTR RDBAccHashPtr;
+
 typedef struct read_db_file {
 	struct read_db_file PNTR next;
         Int4 parameters; /* All boolean parameters */
@@ -1098,6 +1147,7 @@ if there is no mem-mapping or it failed. */
 
     ISAMObjectPtr nisam_opt;  /* Object for numeric search */
     ISAMObjectPtr sisam_opt;  /* Object for string search */
+    RDBAccHashPtr acc_hash;   /* Hashed string id index or NULL */
     ISAMObjectPtr isam_pig;   /* Object for PIG search */
     RDBTaxInfoPtr taxinfo;    /* This object if not NULL - pointer to
                                      the taxonomy names database */
@@ -1300,6 +1350,22 @@ Int4 LIBCALL readdb_acc2fasta(ReadDBFILEPtr rdfp, CharPtr string);
 Int4 LIBCALL readdb_acc2fastaEx(ReadDBFILEPtr rdfp, CharPtr string,
                                 Int4Ptr PNTR ids, Int4Ptr count);
 
+/* Gets the sequence numbers of num Accession/Locus strings into oids[],
+   each as readdb_acc2fasta would return it. When every volume has a
+   hashed string id index (formatdb -H) the strings are resolved in one
+   sorted pass over each index; strings with a '|' and databases without
+   the indexes are looked up one by one. Returns the number found.
+*/
+Int4 LIBCALL readdb_acc2fasta_batch(ReadDBFILEPtr rdfp, CharPtr PNTR strings,
+                                    Int4 num, Int4Ptr oids);
+
+/* Builds the hashed string id index of a volume of num_seqs sequences
+   from its string ISAM index (formatdb -H); sparse_idx tells whether that
+   has sparse indexes. Returns FALSE on failure.
+*/
+Boolean LIBCALL FD_MakeAccHash(CharPtr base_name, Boolean is_prot,
+                               Boolean sparse_idx, Int4 num_seqs);
+
 /*
 Gets a BioseqPtr containing the sequence in sequence_number.
 */
@@ -1600,6 +1666,8 @@ typedef struct _FDB_options {
                              usage in indexes */
     Int4  test_non_unique;    /* Print messages if FASTA database has
                                  non-unique string ids - accessions, locuses*/
+    Int4  acc_hash;           /* Build a hashed index of the string ids
+                                 (.nsh/.psh) for fast batch lookups */
     
     RDBTaxLookupPtr tax_lookup; /* taxonomy lookup table - should be initialized in the main program to be used for creating of taxonomy information*/
 
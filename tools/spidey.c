@@ -553,7 +553,14 @@ NLM_EXTERN SPI_RegionInfoPtr SPI_AlnSinglemRNAToGen(SPI_bsinfoPtr spig, SPI_bsin
    slp1 = SeqLocIntNew(0, spim->bsp->length-1, Seq_strand_plus, spim->bsp->id);
    slp2 = SeqLocIntNew(spot->from, spot->to, spot->strand, spig->bsp->id);
    /* slp2 = SeqLocIntNew(0, spig->bsp->length-1, spot->strand, spig->bsp->id); */
-   sap = BlastTwoSequencesByLoc(slp1, slp2, "blastn", options);
+   /* use the genomic interval encoded by SPI_PrepareGenomic if it is this one */
+   if (spot->genomic != NULL && SeqLocCompare(slp2, spot->genomic->slp) == SLC_A_EQ_B
+       && SeqLocStrand(slp2) == SeqLocStrand(spot->genomic->slp))
+      sap = BlastTwoSequencesByLocWithSubject(slp1, spot->genomic, options, NULL, NULL);
+   else
+      sap = BlastTwoSequencesByLoc(slp1, slp2, "blastn", options);
+   SeqLocFree(slp1);
+   SeqLocFree(slp2);
    /* } */
     
    if (spot->callback != NULL)
@@ -691,6 +698,36 @@ NLM_EXTERN SPI_RegionInfoPtr SPI_AlnSinglemRNAToGen(SPI_bsinfoPtr spig, SPI_bsin
    return NULL;
 }
 
+/***************************************************************************
+*
+*  SPI_PrepareGenomic applies the same checks to the genomic interval as
+*  SPI_AlnSinglemRNAToGen, then encodes the interval for the first-pass
+*  BLAST. Returns FALSE if the interval is empty or can't be encoded.
+*
+***************************************************************************/
+NLM_EXTERN Boolean SPI_PrepareGenomic(BioseqPtr bsp_genomic, SPI_OptionsPtr spot)
+{
+   SeqLocPtr  slp;
+
+   if (bsp_genomic == NULL || spot == NULL)
+      return FALSE;
+   if (spot->to == 0){
+       spot->to = bsp_genomic->length - 1;
+   }
+   else if (spot->to < spot->from){
+       Int4 new_from = spot->to;
+       spot->to = spot->from;
+       spot->from = new_from;
+   }
+   if (spot->from == spot->to){
+       return FALSE;
+   }
+   slp = SeqLocIntNew(spot->from, spot->to, spot->strand, bsp_genomic->id);
+   spot->genomic = Blast2SeqSubjectNew(slp);
+   SeqLocFree(slp);
+   return (Boolean)(spot->genomic != NULL);
+}
+
 /***************************************************************************
 *
 *  SPI_CompareAlnPosForMult is the callback for the HeapSort in
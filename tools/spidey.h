@@ -103,6 +103,7 @@
 #include <alignmgr2.h>
 #include <actutils.h>
 #include <dotseq.h>
+#include <blast.h>
 
 #undef NLM_EXTERN
 #ifdef NLM_IMPORT
@@ -440,6 +441,7 @@ typedef struct spi_options {
     SPI_SpliceInfoPtr     dssp_head;
     Int4                  asplicejunc;
     SPI_SpliceInfoPtr     assp_head;
+    Blast2SeqSubjectPtr   genomic; /* genomic interval encoded once by SPI_PrepareGenomic; not freed by SPI_OptionsFree */
 } SPI_Options, PNTR SPI_OptionsPtr;
     
 typedef struct spi_n {
@@ -458,6 +460,16 @@ typedef struct spi_block {
    struct spi_block PNTR next;
 } SPI_Block, PNTR SPI_BlockPtr;
 
+/***************************************************************************
+*
+*  SPI_PrepareGenomic settles the genomic interval (spot->from, spot->to,
+*  spot->strand) and encodes it once into spot->genomic, so that the
+*  first-pass BLAST of every mRNA searches it without reading the genomic
+*  sequence again. The encoding is only read and may be shared by copies
+*  of the options in several threads; free it with Blast2SeqSubjectFree.
+*
+***************************************************************************/
+NLM_EXTERN Boolean SPI_PrepareGenomic(BioseqPtr bsp_genomic, SPI_OptionsPtr spot);
 NLM_EXTERN SPI_RegionInfoPtr SPI_AlnSinglemRNAToGen(SPI_bsinfoPtr spig, SPI_bsinfoPtr spim, FILE *ofp, FILE *ofp2, SPI_OptionsPtr spot);
 NLM_EXTERN SPI_mRNAToHerdPtr SPI_AlnSinglemRNAToPieces(SPI_bsinfoPtr spig_head, SPI_bsinfoPtr spim, FILE *ofp, FILE *ofp2, SPI_OptionsPtr spot);
 NLM_EXTERN void SPI_MakeMultipleAlignment(SPI_RegionInfoPtr srip_head);
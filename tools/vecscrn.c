@@ -981,6 +981,67 @@ VSScreenSequenceByLoc(SeqLocPtr slp, VSOptionsPtr options, CharPtr database, Seq
 	return retval;
 }
 
+/* 
+Performs VecScreen for stand-alone application against a database opened
+once by the caller, for screening many sequences in one or more threads.
+
+Note: if 'options' is NULL, default values will be used.  This is STRONGLY recommended.
+*/
+
+Int2 LIBCALL
+VSScreenSequenceWithReadDb(BioseqPtr bsp, VSOptionsPtr options, BLAST_OptionsBlkPtr blast_options, ReadDBFILEPtr rdfp, CharPtr database, ValNodePtr PNTR vnpp, ValNodePtr *error_returns)
+
+{
+	BlastSearchBlkPtr search;
+	Int2 retval=0;
+	SeqAlignPtr seqalign;
+	SeqLocPtr slp;
+
+	if (vnpp)
+		*vnpp = NULL;
+	if (error_returns)
+		*error_returns = NULL;
+
+	if (bsp == NULL || blast_options == NULL || rdfp == NULL || vnpp == NULL)
+		return -1;
+
+	if (BLASTOptionValidateEx(blast_options, "blastn", error_returns) != 0)
+		return -1;
+
+	slp = NULL;
+	ValNodeAddPointer(&slp, SEQLOC_WHOLE, SeqIdDup(SeqIdFindBest(bsp->id, SEQID_GI)));
+
+	/* The search attaches to rdfp rather than opening the database */
+	search = BLASTSetUpSearchWithReadDbInternal(slp, NULL, "blastn", SeqLocLen(slp), database ? database : "UniVec_Core", blast_options, NULL, NULL, NULL, 0, rdfp);
+	if (search == NULL)
+	{
+		SeqLocFree(slp);
+		return -1;
+	}
+	search->thr_info->tick_callback = NULL;
+	search->thr_info->star_callback = NULL;
+
+	seqalign = BioseqBlastEngineCore(search, blast_options, NULL);
+
+	if (search->error_return) {
+		if (error_returns)
+			ValNodeLink(error_returns, search->error_return);
+		else
+			BlastErrorChainDestroy(search->error_return);
+		search->error_return = NULL;
+	}
+	search = BlastSearchBlkDestruct(search);
+	SeqLocFree(slp);
+
+	if (seqalign)
+	{
+		retval = VSMakeCombinedSeqLoc(&seqalign, vnpp, bsp->length, options);
+		SeqAlignSetFree(seqalign);
+	}
+
+	return retval;
+}
+
 /* 
 	Prints bar overview and list of matching segments by category
 */
@@ -1234,27 +1295,16 @@ VSPrintListFromSeqLocs (ValNodePtr vnp, FILE *outfp)
 
 #define BUFFER_LENGTH 255
 
-/* 
-	Prints Id line for list results format
+/*
+	Copies the query id (first word of the title, or a quoted
+	string) into idbuf, "Id_unknown" if there is none.
 */
 
-Boolean LIBCALL
-VSPrintListIdLine (BioseqPtr query_bsp, CharPtr proginfo, CharPtr database, FILE *outfp)
-
-{ 
-
-	Char            idbuf [BUFFER_LENGTH];
-	CharPtr         dbdef, ptr, chptr;
-	Int4            length;
-	ReadDBFILEPtr   rdfp, rdfp_var;
-	Boolean         first_title;
-
-
-	if (outfp == NULL)
-		return FALSE;
-
+static void
+VSGetQueryId (BioseqPtr query_bsp, CharPtr idbuf)
 
-	/* prepare Query ID string for output */
+{
+	CharPtr         ptr, chptr;
 
 	ptr = NULL; chptr = NULL;
 
@@ -1280,6 +1330,31 @@ VSPrintListIdLine (BioseqPtr query_bsp, CharPtr proginfo, CharPtr database, FILE
 	else {
 		StringCpy (idbuf, "Id_unknown");
 	}
+}
+
+/* 
+	Prints Id line for list results format
+*/
+
+Boolean LIBCALL
+VSPrintListIdLine (BioseqPtr query_bsp, CharPtr proginfo, CharPtr database, FILE *outfp)
+
+{ 
+
+	Char            idbuf [BUFFER_LENGTH];
+	CharPtr         dbdef, ptr, chptr;
+	Int4            length;
+	ReadDBFILEPtr   rdfp, rdfp_var;
+	Boolean         first_title;
+
+
+	if (outfp == NULL)
+		return FALSE;
+
+
+	/* prepare Query ID string for output */
+
+	VSGetQueryId (query_bsp, idbuf);
 
 
 	/* prepare database description(s) for output */
@@ -1347,3 +1422,96 @@ VSPrintListIdLine (BioseqPtr query_bsp, CharPtr proginfo, CharPtr database, FILE
 }
 
 
+/* 
+	Prints one tab-delimited line per matching segment:
+	query id, start, stop (1-based) and match class
+*/
+
+Boolean LIBCALL
+VSPrintTabFromSeqLocs (ValNodePtr vnp, BioseqPtr query_bsp, FILE *outfp)
+
+{
+	static CharPtr  class_label [] = { "Strong", "Moderate", "Weak", "Suspect" };
+	Char            idbuf [BUFFER_LENGTH];
+	SeqLocPtr       tmp;
+	ValNodePtr      var;
+
+	if (outfp == NULL)
+		return FALSE;
+
+	VSGetQueryId (query_bsp, idbuf);
+
+	for (var = vnp; var; var = var->next)
+	{
+		if (var->choice < 1 || var->choice > 4 || var->data.ptrvalue == NULL)
+			continue;
+		tmp = var->data.ptrvalue;
+		if (tmp->choice == SEQLOC_PACKED_INT)
+			tmp = tmp->data.ptrvalue;
+		while (tmp)
+		{
+			fprintf(outfp, "%s\t%ld\t%ld\t%s\n", idbuf,
+				(long) (SeqLocStart(tmp)+1), (long) (SeqLocStop(tmp)+1),
+				class_label[var->choice - 1]);
+			tmp = tmp->next;
+		}
+	}
+
+	return TRUE;
+}
+
+
+#define VS_FASTA_LINE 60
+
+/* 
+	Prints the query as FASTA with every matching segment in
+	lower case, the soft-masking format mgblast -U reads
+*/
+
+Boolean LIBCALL
+VSPrintMaskedFasta (ValNodePtr vnp, BioseqPtr query_bsp, FILE *outfp)
+
+{
+	CharPtr         title;
+	Int4            i, from, to, len;
+	SeqLocPtr       tmp;
+	Uint1Ptr        buf;
+	ValNodePtr      var;
+
+	if (outfp == NULL || query_bsp == NULL)
+		return FALSE;
+
+	len = query_bsp->length;
+	if ((buf = (Uint1Ptr) MemNew(len + 1)) == NULL)
+		return FALSE;
+	if (len > 0 && SeqPortBulkRead(query_bsp, 0, len - 1, Seq_strand_plus, Seq_code_iupacna, buf) != len)
+	{
+		MemFree(buf);
+		return FALSE;
+	}
+
+	for (var = vnp; var; var = var->next)
+	{
+		if (var->choice < 1 || var->choice > 4 || var->data.ptrvalue == NULL)
+			continue;
+		tmp = var->data.ptrvalue;
+		if (tmp->choice == SEQLOC_PACKED_INT)
+			tmp = tmp->data.ptrvalue;
+		for (; tmp; tmp = tmp->next)
+		{
+			from = MAX(SeqLocStart(tmp), 0);
+			to = MIN(SeqLocStop(tmp), len - 1);
+			for (i = from; i <= to; i++)
+				buf[i] = TO_LOWER(buf[i]);
+		}
+	}
+
+	title = BioseqGetTitle (query_bsp);
+	fprintf(outfp, ">%s\n", title ? title : "Id_unknown");
+	for (i = 0; i < len; i += VS_FASTA_LINE)
+		fprintf(outfp, "%.*s\n", (int) MIN(VS_FASTA_LINE, len - i), (CharPtr) buf + i);
+
+	MemFree(buf);
+
+	return TRUE;
+}
@@ -221,6 +221,28 @@ Boolean LIBCALL VSPrintListFromSeqLocs PROTO((ValNodePtr vnp, FILE *outfp));
 */
 Boolean LIBCALL VSPrintListIdLine PROTO((BioseqPtr bsp, CharPtr proginfo, CharPtr database, FILE *outfp));
 
+
+/*
+Performs VecScreen against an already opened database.  rdfp is attached
+to rather than reopened, so one readdb can serve many queries (and threads).
+blast_options must come from VSBlastOptionNew and may not be shared between
+concurrent calls; options may be shared.  Returns as VSScreenSequence; the
+alignments are freed after the SeqLocs are built.
+*/
+Int2 LIBCALL VSScreenSequenceWithReadDb PROTO((BioseqPtr bsp, VSOptionsPtr options, BLAST_OptionsBlkPtr blast_options, ReadDBFILEPtr rdfp, CharPtr database, ValNodePtr PNTR vnpp, ValNodePtr *error_returns));
+
+
+/* 
+	Prints matching segments as tab-delimited lines: id, start, stop, class
+*/
+Boolean LIBCALL VSPrintTabFromSeqLocs PROTO((ValNodePtr vnp, BioseqPtr query_bsp, FILE *outfp));
+
+
+/* 
+	Prints the query as FASTA with the matching segments in lower case
+*/
+Boolean LIBCALL VSPrintMaskedFasta PROTO((ValNodePtr vnp, BioseqPtr query_bsp, FILE *outfp));
+
 #ifdef __cplusplus
 }
 #endif